@@ -11,6 +11,16 @@
 #include "src/photo_manager.h"   // For photo capture logic and uploading
 #include "src/battery_handler.h" // For battery level monitoring
 #include "src/led_handler.h"     // For onboard LED control
+#include "src/ble_link.h"        // For connection modes and link statistics
+#include "src/command_dispatcher.h" // For command latency statistics
+#include "src/ble_session.h"     // For per-client throughput
+#include "src/ble_reconnect.h"   // For the advertising burst
+#include "src/param_store.h"     // For the runtime parameters kept in NVS
+#include "src/ota_update.h"      // For confirming a newly installed firmware
+#include "src/wake_state.h"      // For the wake cycle state kept in RTC memory
+#include "src/boot_profile.h"    // For boot phase timing
+#include "src/pm_lock.h"         // For the PM locks held during bursts
+#include "src/app_events.h"      // For the timers and events that drive the main loop
 #include "src/logger.h"
 
 // Forward declarations for FreeRTOS tasks are now handled in their respective modules
@@ -42,8 +52,71 @@ const char *bleState(bool connected)
     return connected ? "ACTIVE" : "IDLE";
 }
 
-unsigned long g_last_disconnect_time = 0;
-unsigned long g_last_debug_log_ms = 0;
+// DFS and light sleep are active: the idle LED shows the low-power heartbeat
+bool g_pm_enabled = false;
+
+// Re-arms the connection mode check with a new interval
+void on_link_check_changed(ParamId id, uint32_t value)
+{
+    if (g_is_ble_connected)
+    {
+        app_events_start_timer(APP_EVENT_LINK, value);
+    }
+}
+
+// Starts the timers of the new connected state and shows it on the LED
+void handle_connection_change()
+{
+    if (g_is_ble_connected)
+    {
+        // The connected state overrides any other LED state like LOW_POWER
+        set_led_status(LED_STATUS_CONNECTED);
+        app_events_stop_timer(APP_EVENT_SLEEP);
+        update_battery_level();
+        app_events_start_timer(APP_EVENT_BATTERY, BATTERY_UPDATE_INTERVAL_MS);
+        app_events_start_timer(APP_EVENT_STATS, DEBUG_LOG_INTERVAL_MS);
+        // Slow the connection down once the photo and audio workload has eased
+        app_events_start_timer(APP_EVENT_LINK, param_get(PARAM_LINK_CHECK_MS));
+        return;
+    }
+
+    app_events_stop_timer(APP_EVENT_BATTERY);
+    app_events_stop_timer(APP_EVENT_STATS);
+    app_events_stop_timer(APP_EVENT_LINK);
+    // Deep sleep after this delay without a client (soon after an idle wake nobody answered)
+    app_events_start_timer(APP_EVENT_SLEEP, wake_state_sleep_delay_ms());
+    set_led_status(g_pm_enabled ? LED_STATUS_LOW_POWER : LED_STATUS_DISCONNECTED);
+    logger_printf("[STATS] State changed. Uptime: %s | CPU Freq: %d MHz | BLE: %s | Free PSRAM: %u bytes\n",
+                  prettyUptime(millis()).c_str(),
+                  getCpuFrequencyMhz(),
+                  bleState(g_is_ble_connected),
+                  ESP.getFreePsram());
+}
+
+// Periodic debug log while connected
+void log_stats()
+{
+    logger_printf("[STATS] Uptime: %s | CPU Freq: %d MHz | BLE: %s | Free PSRAM: %u bytes\n",
+                  prettyUptime(millis()).c_str(),
+                  getCpuFrequencyMhz(),
+                  bleState(g_is_ble_connected),
+                  ESP.getFreePsram());
+    ble_link_log_stats();
+    command_dispatcher_log_stats();
+    ble_session_log_stats();
+    pm_lock_log_stats();
+    app_events_log_stats();
+}
+
+void enter_deep_sleep()
+{
+    uint32_t wake_ms = param_get(PARAM_DEEP_SLEEP_WAKE_MS);
+    logger_printf("[POWER] No connection for %u ms. Entering deep sleep for %u ms.\n", wake_state_sleep_delay_ms(), wake_ms);
+    app_events_log_stats();
+    wake_state_before_sleep();
+    esp_sleep_enable_timer_wakeup((uint64_t)wake_ms * 1000);
+    esp_deep_sleep_start();
+}
 
 /**
  * @brief Arduino setup function. Initializes hardware and software components.
@@ -53,6 +126,8 @@ void setup()
     Serial.begin(921600);
     initialize_logger(); // Must be called after Serial.begin()
     logger_printf(" \n");
+    boot_profile_mark("serial");
+    wake_state_begin();
     if (!psramFound())
     {
         logger_printf("[PSRAM] ERROR: PSRAM not found! Halting early.\n");
@@ -69,107 +144,90 @@ void setup()
 
     // Configure and enable power management by default for optimal battery life.
     // This includes Dynamic Frequency Scaling (DFS) and automatic light sleep.
+    // Latency-critical bursts hold PM locks while they run (see pm_lock.h).
     esp_pm_config_esp32s3_t pm_config = {
-        .max_freq_mhz = 240,       // Maximum CPU frequency
-        .min_freq_mhz = 80,        // Minimum CPU frequency for power saving
-        .light_sleep_enable = true // Enable automatic light sleep
+        .max_freq_mhz = PM_MAX_FREQ_MHZ, // Maximum CPU frequency
+        .min_freq_mhz = PM_MIN_FREQ_MHZ, // Minimum CPU frequency for power saving
+        .light_sleep_enable = true       // Enable automatic light sleep
     };
-    esp_pm_configure(&pm_config);
-    logger_printf("[POWER] Dynamic Frequency Scaling and Light Sleep enabled.\n");
+    g_pm_enabled = esp_pm_configure(&pm_config) == ESP_OK;
+    if (g_pm_enabled)
+    {
+        logger_printf("[POWER] Dynamic Frequency Scaling and Light Sleep enabled.\n");
+    }
+    else
+    {
+        logger_printf("[POWER] Power management not available. Running at full speed.\n");
+    }
+    pm_lock_init();
+    boot_profile_mark("power");
 
     // Initialize modules
+    param_store_load(); // Before any module reads its parameters
+    param_on_change(PARAM_LINK_CHECK_MS, on_link_check_changed);
+    boot_profile_mark("params");
+    app_events_init(); // Before BLE, which arms the advertising timer
     initialize_camera_mutex(); // Initialize the camera mutex
     initialize_led();
+    boot_profile_mark("mutex+led");
     configure_ble();
+    uint32_t advertising_ms = (uint32_t)(boot_profile_mark("ble") / 1000);
     initialize_photo_manager();                                 // Initializes photo buffer and default interval
-    initialize_battery_handler(g_battery_level_characteristic); // Pass the BLE characteristic
-    // The audio and photo streaming tasks are now started on-demand when a client subscribes to their respective characteristics
-    // start_photo_streaming_task();
-    start_camera_task();                                       // Start the new dedicated camera task
+    initialize_battery_handler();
+    // The audio and photo streaming tasks, and the camera task, are started on demand when a
+    // client subscribes, so a wake that no client joins never creates them
     // Set initial battery level after BLE characteristic is available
     update_battery_level();
-
+    boot_profile_mark("battery");
+    // BLE is up, so a new image can still be replaced over the air: keep it
+    ota_update_confirm_boot();
+    boot_profile_mark("ota");
+
+    boot_profile_log();
+    wake_state_set_boot_to_adv(advertising_ms);
+    // Starts the timers of the current state (the deep-sleep countdown, unless a client was quick)
+    app_events_post(APP_EVENT_CONNECTION);
     logger_printf("[SETUP] Complete. Entering main loop.\n");
 }
 
 /**
- * @brief Arduino main loop function. Handles audio, photo, and battery updates.
+ * @brief Arduino main loop function. Handles connection changes, battery updates, statistics and deep sleep.
  */
 void loop()
 {
-    static led_status_t last_led_status = LED_STATUS_OFF;
-
-    // Must be called on every loop to drive the LED blink patterns
-    handle_led();
+    // Blocks until a timer or the BLE handler sets an event. Meanwhile the idle task can
+    // enter light sleep; nothing wakes the CPU just to poll.
+    uint32_t events = app_events_wait();
 
-    if (g_is_ble_connected)
+    if (events & APP_EVENT_CONNECTION)
     {
-        // When connected, ensure LED shows connected status.
-        // This overrides any other state like LOW_POWER.
-        if (last_led_status != LED_STATUS_CONNECTED)
-        {
-            set_led_status(LED_STATUS_CONNECTED);
-            last_led_status = LED_STATUS_CONNECTED;
-            g_last_disconnect_time = 0; // Reset disconnect timer
-        }
-
-        // Handle battery updates
-        if (millis() - g_last_battery_update_ms >= BATTERY_UPDATE_INTERVAL_MS)
-        {
-            update_battery_level();
-        }
+        handle_connection_change();
+    }
 
-        // Periodic debug log while connected
-        if (millis() - g_last_debug_log_ms >= DEBUG_LOG_INTERVAL_MS)
-        {
-            g_last_debug_log_ms = millis();
-            logger_printf("[STATS] Uptime: %s | CPU Freq: %d MHz | BLE: %s | Free PSRAM: %u bytes\n",
-                          prettyUptime(millis()).c_str(),
-                          getCpuFrequencyMhz(),
-                          bleState(g_is_ble_connected),
-                          ESP.getFreePsram());
-        }
+    if (events & APP_EVENT_ADV)
+    {
+        // Ends the fast advertising burst (also while connected, when advertising for another client)
+        ble_reconnect_update();
     }
-    else // When disconnected
+
+    if (g_is_ble_connected)
     {
-        if (g_last_disconnect_time == 0)
+        if (events & APP_EVENT_LINK)
         {
-            g_last_disconnect_time = millis();
+            ble_link_update_conn_mode();
         }
-
-        // Check if it's time to go to deep sleep
-        if (millis() - g_last_disconnect_time >= DEEP_SLEEP_DISCONNECT_DELAY_MS)
+        if (events & APP_EVENT_BATTERY)
         {
-            logger_printf("[POWER] No connection for %lu ms. Entering deep sleep for %lu ms.\n", DEEP_SLEEP_DISCONNECT_DELAY_MS, DEEP_SLEEP_WAKE_INTERVAL_MS);
-            esp_sleep_enable_timer_wakeup(DEEP_SLEEP_WAKE_INTERVAL_MS * 1000);
-            esp_deep_sleep_start();
+            update_battery_level();
         }
-
-        // Check CPU frequency and update LED. Log any change in power state.
-        led_status_t new_status = (getCpuFrequencyMhz() <= 80) ? LED_STATUS_LOW_POWER : LED_STATUS_DISCONNECTED;
-        if (last_led_status != new_status)
+        if (events & APP_EVENT_STATS)
         {
-            set_led_status(new_status);
-            last_led_status = new_status;
-            // Log the change in state
-            logger_printf("[STATS] State changed. Uptime: %s | CPU Freq: %d MHz | BLE: %s | Free PSRAM: %u bytes\n",
-                          prettyUptime(millis()).c_str(),
-                          getCpuFrequencyMhz(),
-                          bleState(g_is_ble_connected),
-                          ESP.getFreePsram());
+            log_stats();
         }
     }
-
-    // This non-blocking delay allows the idle task to run, which will trigger
-    // light sleep if enabled and conditions are met. The delay is longer when
-    // disconnected to further encourage power saving.
-    if (g_is_ble_connected)
-    {
-        vTaskDelay(pdMS_TO_TICKS(LOOP_DELAY_MS)); // Active delay
-    }
-    else
+    else if (events & APP_EVENT_SLEEP)
     {
-        vTaskDelay(pdMS_TO_TICKS(500)); // Idle delay
+        enter_deep_sleep();
     }
 }
 
@@ -58,6 +58,22 @@ def ulaw2lin(data, width):
 # --- Configuration ---
 DEVICE_NAME = "OpenGlass"
 AUDIO_ULAW_UUID = "19b10001-e8f2-537e-4f6c-d104768a1214"
+AUDIO_OPUS_UUID = "19b10002-e8f2-537e-4f6c-d104768a1214"
+AUDIO_LOSSLESS_UUID = "19b10003-e8f2-537e-4f6c-d104768a1214"
+AUDIO_FORMAT_UUID = "19b10004-e8f2-537e-4f6c-d104768a1214"
+AUDIO_LOGMEL_UUID = "19b10008-e8f2-537e-4f6c-d104768a1214"
+REQUESTED_SAMPLE_RATE = 16000  # 16000, or 8000 to have the device decimate before encoding
+AUDIO_REPLAY_UUID = "19b10007-e8f2-537e-4f6c-d104768a1214"
+REPLAY_FROM_SEQUENCE = None  # Framed codecs: first missed sequence number to fetch from the device's backlog
+AUDIO_CODEC = "ulaw"  # "ulaw", "opus" (requires the 'opuslib' package), "lossless" or "logmel"
+PHOTO_CONTROL_UUID = "19b10006-e8f2-537e-4f6c-d104768a1214"
+CLOCK_SYNC_OPCODE = 0x01
+CLOCK_SYNC_ROUNDS = 8  # Exchanges before streaming; the fastest round gives the offset
+PACKET_TIMESTAMP_LEN = 4  # Framed codecs: first-sample time (device us, low 32 bits) leads fragment 0
+
+# Log-mel feature frames: one byte per mel bin every 10 ms, value = 4 * log2(energy)
+LOGMEL_NUM_BINS = 40
+LOGMEL_HOP_MS = 10
 
 # Audio parameters for the output WAV file
 SAMPLE_RATE = 16000
@@ -69,11 +85,68 @@ CAPTURE_DURATION_S = 10  # seconds
 stats = {}
 audio_data = []
 total_bytes_received = 0
+opus_decoder = None
+framed_packet = bytearray()
+framed_sequence = None
+lost_packets = 0
+logmel_frames = []
+clock_offset = None  # (host us - device us, device us at the sync) once synchronised
+first_packet_device_us = None
+
+async def clock_sync(client):
+    """NTP-style exchange on the photo control characteristic.
+
+    Returns (offset_us, rtt_us, device_us) from the round with the shortest round trip,
+    where host time = device time + offset_us."""
+    best = None
+    t4_prev = None
+    for _ in range(CLOCK_SYNC_ROUNDS):
+        t1 = time.time_ns() // 1000
+        if t4_prev is None:
+            request = struct.pack('<Bq', CLOCK_SYNC_OPCODE, t1)
+        else:
+            request = struct.pack('<Bqq', CLOCK_SYNC_OPCODE, t1, t4_prev)  # Lets the device estimate drift too
+        await client.write_gatt_char(PHOTO_CONTROL_UUID, request, response=True)
+        reply = await client.read_gatt_char(PHOTO_CONTROL_UUID)
+        t4 = time.time_ns() // 1000
+        t2, device_elapsed, _drift_ppb, _device_rtt = struct.unpack('<qIiI', reply[:20])
+        t3 = t2 + device_elapsed
+        rtt = (t4 - t1) - device_elapsed
+        offset = ((t1 - t2) + (t4 - t3)) // 2
+        if best is None or rtt < best[1]:
+            best = (offset, rtt, t2)
+        t4_prev = t4
+    return best
+
+def unwrap_device_us(timestamp, reference_us):
+    """Extends a 32-bit device timestamp to the full timebase using a nearby reference time."""
+    return reference_us + ((timestamp - reference_us + (1 << 31)) & 0xFFFFFFFF) - (1 << 31)
+
+def is_silence_marker(data):
+    """Silence markers are 0xFF 0xFF 0xFF followed by the duration in ms (LE).
+
+    Audio data never takes this form: u-law chunks are never 5 bytes long, and a framed
+    fragment's third byte is its index, which stays below 0xFF."""
+    return len(data) == 5 and data[0] == 0xFF and data[1] == 0xFF and data[2] == 0xFF
+
+def append_silence(data):
+    """Expands a silence marker into the equivalent run of zero PCM samples."""
+    global total_bytes_received
+    duration_ms = data[3] | (data[4] << 8)
+    if AUDIO_CODEC == "logmel":
+        logmel_frames.extend([bytes(LOGMEL_NUM_BINS)] * (duration_ms // LOGMEL_HOP_MS))
+    else:
+        audio_data.append(bytes(SAMPLE_WIDTH * SAMPLE_RATE * duration_ms // 1000))
+    total_bytes_received += len(data)
 
 def notification_handler(sender, data):
     """Handles incoming BLE notifications, decodes u-law data, and appends it."""
     global total_bytes_received
 
+    if is_silence_marker(data):
+        append_silence(data)
+        return
+
     # Decode the u-law data to 16-bit PCM and append it
     pcm_data = ulaw2lin(data, SAMPLE_WIDTH)
     audio_data.append(pcm_data)
@@ -82,9 +155,91 @@ def notification_handler(sender, data):
     total_bytes_received += len(data)
     print(f"\r[CLIENT] Receiving audio... ({total_bytes_received} bytes received)", end="")
 
+def decode_lossless_block(block):
+    """
+    Decodes one lossless block (fixed linear prediction + Rice-coded residuals)
+    back to bit-exact 16-bit PCM. See src/audio_lossless.h for the layout.
+    """
+    order, k, count = block[0], block[1], block[2] | (block[3] << 8)
+    if order == 0xFF:
+        return bytes(block[4:4 + 2 * count])
+
+    samples = list(struct.unpack_from(f'<{order}h', block, 4))
+    bits = int.from_bytes(block[4 + 2 * order:], 'big')
+    bit_pos = (len(block) - 4 - 2 * order) * 8
+    for _ in range(count - order):
+        q = 0
+        bit_pos -= 1
+        while (bits >> bit_pos) & 1:
+            q += 1
+            bit_pos -= 1
+        low = 0
+        if k:
+            bit_pos -= k
+            low = (bits >> bit_pos) & ((1 << k) - 1)
+        u = (q << k) | low
+        r = (u >> 1) ^ -(u & 1)
+        x = samples
+        if order == 0:
+            p = 0
+        elif order == 1:
+            p = x[-1]
+        elif order == 2:
+            p = 2 * x[-1] - x[-2]
+        elif order == 3:
+            p = 3 * x[-1] - 3 * x[-2] + x[-3]
+        else:
+            p = 4 * x[-1] - 6 * x[-2] + 4 * x[-3] - x[-4]
+        samples.append(p + r)
+    return struct.pack(f'<{count}h', *samples)
+
+def decode_framed_packet():
+    """Decodes the reassembled packet (one Opus frame, lossless block or log-mel frame)."""
+    if framed_packet:
+        if AUDIO_CODEC == "logmel":
+            logmel_frames.append(bytes(framed_packet))
+        elif AUDIO_CODEC == "lossless":
+            audio_data.append(decode_lossless_block(framed_packet))
+        else:
+            audio_data.append(opus_decoder.decode(bytes(framed_packet), SAMPLE_RATE // 50))
+
+def framed_notification_handler(sender, data):
+    """Reassembles framed Opus/lossless/log-mel packets: 2-byte sequence (LE), 1-byte fragment index, payload.
+
+    Fragment 0 starts with the packet's first-sample time (device us, low 32 bits)."""
+    global total_bytes_received, framed_sequence, lost_packets, first_packet_device_us
+
+    if is_silence_marker(data):
+        # The current packet is complete; the silence follows it.
+        decode_framed_packet()
+        framed_packet.clear()
+        append_silence(data)
+        return
+    if len(data) < 3:
+        return
+    sequence = data[0] | (data[1] << 8)
+    fragment_index = data[2]
+
+    if sequence != framed_sequence:
+        # A new sequence number means the previous packet is complete.
+        decode_framed_packet()
+        framed_packet.clear()
+        if framed_sequence is not None:
+            lost_packets += (sequence - framed_sequence - 1) & 0xFFFF
+        framed_sequence = sequence
+    if fragment_index == 0:
+        if first_packet_device_us is None and len(data) >= 3 + PACKET_TIMESTAMP_LEN:
+            first_packet_device_us = struct.unpack('<I', data[3:3 + PACKET_TIMESTAMP_LEN])[0]
+        framed_packet.extend(data[3 + PACKET_TIMESTAMP_LEN:])
+    elif framed_packet:
+        framed_packet.extend(data[3:])
+
+    total_bytes_received += len(data)
+    print(f"\r[CLIENT] Receiving audio... ({total_bytes_received} bytes received)", end="")
+
 async def main():
     """Main function to scan, connect, and record audio for a fixed duration."""
-    global stats
+    global stats, opus_decoder, SAMPLE_RATE, clock_offset
 
     print(f"Scanning for '{DEVICE_NAME}'...")
     scan_start_time = time.monotonic()
@@ -109,19 +264,52 @@ async def main():
 
         print(f"Connected. Capturing audio for {CAPTURE_DURATION_S} seconds...")
         
+        # Select the output sample rate and read back what the device will send
+        await client.write_gatt_char(AUDIO_FORMAT_UUID, struct.pack('<H', REQUESTED_SAMPLE_RATE), response=True)
+        audio_format = await client.read_gatt_char(AUDIO_FORMAT_UUID)
+        SAMPLE_RATE = audio_format[2] | (audio_format[3] << 8)
+        print(f"Device audio sample rate: {SAMPLE_RATE} Hz")
+
+        # Map the device timebase to host time so packet timestamps line up with photos
+        try:
+            offset_us, rtt_us, device_us = await clock_sync(client)
+            clock_offset = (offset_us, device_us)
+            print(f"Clock sync: offset {offset_us} us, best round trip {rtt_us / 1000:.1f} ms")
+        except Exception as e:
+            print(f"Clock sync failed: {e}. Packet timestamps stay in device time.")
+
+        if REPLAY_FROM_SEQUENCE is not None and AUDIO_CODEC != "ulaw":
+            # Ask for the backlog before subscribing; it arrives ahead of live audio
+            await client.write_gatt_char(AUDIO_REPLAY_UUID, struct.pack('<H', REPLAY_FROM_SEQUENCE & 0xFFFF), response=True)
+
+        if AUDIO_CODEC == "opus":
+            import opuslib
+            opus_decoder = opuslib.Decoder(SAMPLE_RATE, CHANNELS)
+            audio_uuid, handler = AUDIO_OPUS_UUID, framed_notification_handler
+        elif AUDIO_CODEC == "lossless":
+            # Uses the same sequence/fragment framing as Opus
+            audio_uuid, handler = AUDIO_LOSSLESS_UUID, framed_notification_handler
+        elif AUDIO_CODEC == "logmel":
+            audio_uuid, handler = AUDIO_LOGMEL_UUID, framed_notification_handler
+        else:
+            audio_uuid, handler = AUDIO_ULAW_UUID, notification_handler
+
         download_start_time = time.monotonic()
-        await client.start_notify(AUDIO_ULAW_UUID, notification_handler)
+        await client.start_notify(audio_uuid, handler)
         await asyncio.sleep(CAPTURE_DURATION_S)
-        await client.stop_notify(AUDIO_ULAW_UUID)
+        await client.stop_notify(audio_uuid)
         download_end_time = time.monotonic()
+        if AUDIO_CODEC != "ulaw":
+            decode_framed_packet()
 
         # --- Calculate download stats ---
         duration = download_end_time - download_start_time
         # The final size is the decoded PCM data
         final_pcm_data = b''.join(audio_data)
-        size_bytes = len(final_pcm_data)
+        size_bytes = len(final_pcm_data) + len(logmel_frames) * LOGMEL_NUM_BINS
 
         stats['download_duration_s'] = duration
+        stats['bytes_over_air'] = total_bytes_received
         stats['file_size_kb'] = size_bytes / 1024
         if duration > 0:
             stats['transfer_speed_kbps'] = (size_bytes / 1024) / duration
@@ -148,6 +336,18 @@ def save_wav_file():
     except Exception as e:
         print(f"\n[ERROR] Failed to save WAV file: {e}")
 
+def save_logmel_file():
+    """Saves the log-mel frames as CSV, one frame per row, values in log2 energy units."""
+    timestamp = datetime.now().strftime("%Y%m%d_%H%M%S")
+    filename = f"logmel_capture_{timestamp}.csv"
+    try:
+        with open(filename, 'w') as f:
+            for frame in logmel_frames:
+                f.write(",".join(f"{value / 4:.2f}" for value in frame) + "\n")
+        print(f"\n[SUCCESS] {len(logmel_frames)} log-mel frames saved as {filename}")
+    except Exception as e:
+        print(f"\n[ERROR] Failed to save log-mel file: {e}")
+
 def print_summary():
     """Prints a formatted summary of the connection and transfer stats."""
     print("\n\n--- Connection and Download Summary ---")
@@ -156,6 +356,13 @@ def print_summary():
     print(f"Download duration:      {stats.get('download_duration_s', 0):.2f} s")
     print(f"Total file size:        {stats.get('file_size_kb', 0):.2f} KB")
     print(f"Transfer speed:         {stats.get('transfer_speed_kbps', 0):.2f} KB/s")
+    print(f"Bytes over the air:     {stats.get('bytes_over_air', 0)}")
+    if AUDIO_CODEC != "ulaw":
+        print(f"Lost packets:           {lost_packets}")
+    if first_packet_device_us is not None and clock_offset is not None:
+        offset_us, device_us = clock_offset
+        first_host_us = unwrap_device_us(first_packet_device_us, device_us) + offset_us
+        print(f"First sample (host):    {datetime.fromtimestamp(first_host_us / 1e6).isoformat(timespec='milliseconds')}")
     print("-------------------------------------")
 
 if __name__ == "__main__":
@@ -167,7 +374,10 @@ if __name__ == "__main__":
     except Exception as e:
         print(f"\n[ERROR] An error occurred during the process: {e}")
     finally:
-        if audio_data:
+        if logmel_frames:
+            save_logmel_file()
+            print_summary()
+        elif audio_data:
             save_wav_file()
             print_summary()
         else:
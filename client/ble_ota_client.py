@@ -0,0 +1,114 @@
+import argparse
+import asyncio
+import hashlib
+import struct
+import time
+
+# --- Configuration ---
+# UUIDs and sizes should match the ones in your firmware's config.h and ota_update.h
+DEVICE_NAME = "OpenGlass"
+OTA_CONTROL_UUID = "19b10101-e8f2-537e-4f6c-d104768a1214"
+OTA_DATA_UUID = "19b10102-e8f2-537e-4f6c-d104768a1214"
+OTA_BLOCK_SIZE = 4096
+OTA_BUFFERS = 2
+CHUNK_HEADER_LEN = 4  # image offset LE32
+
+COMMAND_BEGIN = 0x01
+COMMAND_APPLY = 0x03
+STATES = ["idle", "preparing", "receiving", "verifying", "ready", "failed"]
+ERRORS = ["none", "no OTA partition", "image too large", "no memory", "flash error", "SHA-256 mismatch", "invalid image"]
+STATUS_FORMAT = "<BBIIII"  # state, error, next offset, written, image size, bytes/s
+
+
+class OtaStatus:
+    def __init__(self):
+        self.changed = asyncio.Event()
+        self.state = 0
+        self.error = 0
+        self.next_offset = 0
+        self.written = 0
+        self.rate = 0
+
+    def update(self, data):
+        self.state, self.error, self.next_offset, self.written, _, self.rate = struct.unpack(STATUS_FORMAT, bytes(data))
+        self.changed.set()
+
+
+async def send_image(client, image, status):
+    """Streams the image from the device's next expected offset, at most two blocks ahead of flash."""
+    chunk_len = client.mta_size - 3 - CHUNK_HEADER_LEN
+    window = OTA_BUFFERS * OTA_BLOCK_SIZE - chunk_len
+    offset = status.next_offset
+    while status.state == 2 and status.written < len(image):
+        if offset >= len(image) or offset - status.written >= window:
+            written = status.written
+            status.changed.clear()
+            try:
+                await asyncio.wait_for(status.changed.wait(), timeout=2.0)
+            except asyncio.TimeoutError:
+                pass
+            if status.written == written:
+                offset = status.next_offset  # Nothing reached flash: chunks were lost or refused
+            continue
+        chunk = image[offset:offset + chunk_len]
+        await client.write_gatt_char(OTA_DATA_UUID, struct.pack("<I", offset) + chunk, response=False)
+        offset += len(chunk)
+
+
+async def update(path, retries):
+    from bleak import BleakClient, BleakScanner
+
+    with open(path, "rb") as f:
+        image = f.read()
+    digest = hashlib.sha256(image).digest()
+    print(f"[CLIENT] {path}: {len(image)} bytes, SHA-256 {digest.hex()[:16]}...")
+
+    for attempt in range(retries + 1):
+        print(f"Scanning for '{DEVICE_NAME}'...")
+        device = await BleakScanner.find_device_by_name(DEVICE_NAME, timeout=10.0)
+        if not device:
+            print(f"Could not find '{DEVICE_NAME}'.")
+            continue
+        try:
+            async with BleakClient(device) as client:
+                status = OtaStatus()
+                await client.start_notify(OTA_CONTROL_UUID, lambda _, data: status.update(data))
+                # Starts the update, or resumes it if the device already holds part of this image
+                await client.write_gatt_char(OTA_CONTROL_UUID, struct.pack("<BI", COMMAND_BEGIN, len(image)) + digest, response=True)
+                while status.state in (0, 1) or not status.changed.is_set():
+                    status.changed.clear()
+                    await asyncio.wait_for(status.changed.wait(), timeout=60.0)
+                if status.state == 2:
+                    start, start_written = time.monotonic(), status.written
+                    print(f"[CLIENT] Sending from byte {status.next_offset}.")
+                    await send_image(client, image, status)
+                    elapsed = time.monotonic() - start
+                    sent = status.written - start_written
+                    print(f"[CLIENT] {sent} bytes in {elapsed:.1f} s ({sent / 1024 / elapsed:.1f} KB/s, device reports {status.rate / 1024:.1f} KB/s)")
+                while status.state in (2, 3):
+                    status.changed.clear()
+                    await asyncio.wait_for(status.changed.wait(), timeout=30.0)
+                if status.state == 5:
+                    print(f"[CLIENT] Update failed: {ERRORS[status.error]}")
+                    return
+                print("[CLIENT] Image verified. Restarting the device into it.")
+                await client.write_gatt_char(OTA_CONTROL_UUID, bytes([COMMAND_APPLY]), response=True)
+                return
+        except Exception as e:
+            print(f"[CLIENT] Connection lost ({e}). Resuming ({attempt + 1}/{retries}).")
+    print("[CLIENT] Giving up.")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Update the OpenGlass firmware over BLE.")
+    parser.add_argument("image", help="Application binary (e.g. OpenGlassesFirmware.ino.bin)")
+    parser.add_argument("--retries", type=int, default=5, help="Reconnect and resume this many times")
+    args = parser.parse_args()
+    try:
+        asyncio.run(update(args.image, args.retries))
+    except KeyboardInterrupt:
+        print("Script stopped by user.")
+
+
+if __name__ == "__main__":
+    main()
@@ -1,5 +1,6 @@
 import asyncio
 import datetime
+import struct
 import time
 from bleak import BleakClient, BleakScanner
 from bleak.backends.characteristic import BleakGATTCharacteristic
@@ -10,6 +11,8 @@ DEVICE_NAME = "OpenGlass"
 SERVICE_UUID = "19b10000-e8f2-537e-4f6c-d104768a1214"
 PHOTO_DATA_UUID = "19b10005-e8f2-537e-4f6c-d104768a1214"
 PHOTO_CONTROL_UUID = "19b10006-e8f2-537e-4f6c-d104768a1214"
+CLOCK_SYNC_OPCODE = 0x01
+CLOCK_SYNC_ROUNDS = 8  # Exchanges before the photo request; the fastest round gives the offset
 
 # Global state
 photo_buffer = bytearray()
@@ -18,10 +21,35 @@ received_frames = set()
 last_frame_number = -1
 download_start_time = 0
 stats = {}
+capture_device_us = None  # Capture time from the end-of-photo marker (device timebase)
+
+async def clock_sync(client):
+    """NTP-style exchange on the photo control characteristic.
+
+    Returns (offset_us, rtt_us) from the round with the shortest round trip,
+    where host time = device time + offset_us."""
+    best = None
+    t4_prev = None
+    for _ in range(CLOCK_SYNC_ROUNDS):
+        t1 = time.time_ns() // 1000
+        if t4_prev is None:
+            request = struct.pack('<Bq', CLOCK_SYNC_OPCODE, t1)
+        else:
+            request = struct.pack('<Bqq', CLOCK_SYNC_OPCODE, t1, t4_prev)  # Lets the device estimate drift too
+        await client.write_gatt_char(PHOTO_CONTROL_UUID, request, response=True)
+        reply = await client.read_gatt_char(PHOTO_CONTROL_UUID)
+        t4 = time.time_ns() // 1000
+        t2, device_elapsed, _drift_ppb, _device_rtt = struct.unpack('<qIiI', reply[:20])
+        rtt = (t4 - t1) - device_elapsed
+        offset = ((t1 - t2) + (t4 - (t2 + device_elapsed))) // 2
+        if best is None or rtt < best[1]:
+            best = (offset, rtt)
+        t4_prev = t4
+    return best
 
 def notification_handler(characteristic: BleakGATTCharacteristic, data: bytearray):
     """Handles incoming data from the photo data characteristic."""
-    global photo_buffer, is_receiving, received_frames, last_frame_number, download_start_time, stats
+    global photo_buffer, is_receiving, received_frames, last_frame_number, download_start_time, stats, capture_device_us
 
     if not is_receiving:
         return
@@ -30,10 +58,12 @@ def notification_handler(characteristic: BleakGATTCharacteristic, data: bytearra
     payload = data[2:]
     frame_number = int.from_bytes(header, 'little')
 
-    # End-of-Photo marker (0xFFFF)
+    # End-of-Photo marker (0xFFFF), followed by the capture time (device us, int64 LE)
     if frame_number == 0xFFFF:
         print("\n[CLIENT] End-of-photo marker received.")
         is_receiving = False  # Stop processing further packets
+        if len(payload) >= 8:
+            capture_device_us = struct.unpack('<q', payload[:8])[0]
 
         # --- Calculate download stats ---
         download_end_time = time.monotonic()
@@ -115,6 +145,14 @@ async def main():
         # Add a delay for service discovery to complete
         await asyncio.sleep(1.0)
 
+        # Map the device timebase to host time so the capture time can be reported
+        clock_offset_us = None
+        try:
+            clock_offset_us, rtt_us = await clock_sync(client)
+            print(f"[CLIENT] Clock sync: offset {clock_offset_us} us, best round trip {rtt_us / 1000:.1f} ms")
+        except Exception as e:
+            print(f"[CLIENT] Clock sync failed: {e}. Capture time will be in device time.")
+
         # Reset state for this run
         photo_buffer.clear()
         received_frames.clear()
@@ -157,6 +195,12 @@ async def main():
             print(f"  Download time:  {stats.get('download_duration_s', 0):.2f} s")
             print(f"  File size:      {stats.get('file_size_bytes', 0) / 1024:.2f} KB")
             print(f"  Transfer speed: {stats.get('transfer_speed_kbps', 0):.2f} KB/s")
+            if capture_device_us is not None:
+                if clock_offset_us is not None:
+                    captured_at = datetime.datetime.fromtimestamp((capture_device_us + clock_offset_us) / 1e6)
+                    print(f"  Captured at:    {captured_at.isoformat(timespec='milliseconds')}")
+                else:
+                    print(f"  Captured at:    {capture_device_us} us (device time)")
             print("---------------------------\n")
 
 
@@ -0,0 +1,147 @@
+import argparse
+import asyncio
+import socket
+import struct
+import threading
+import time
+from datetime import datetime
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+# --- Configuration ---
+# UUIDs and defaults should match the ones in your firmware's config.h
+DEVICE_NAME = "OpenGlass"
+WIFI_OFFLOAD_UUID = "19b10009-e8f2-537e-4f6c-d104768a1214"
+DEFAULT_PORT = 8080
+AP_SSID = "OpenGlass-Offload"
+AP_PASSWORD = "openglass"
+
+MODES = {"softap": 1, "station": 2}
+STATES = ["idle", "starting", "waiting for receiver", "uploading", "done", "failed"]
+ITEM_PHOTO = 0x01
+ITEM_AUDIO = 0x02
+AUDIO_ENTRY_HEADER_LEN = 8  # sequence LE16, length LE16, first-sample time LE32
+
+received = {}
+
+
+def read_chunked(rfile):
+    """Reads a chunked request body."""
+    body = bytearray()
+    while True:
+        size = int(rfile.readline().split(b";")[0].strip(), 16)
+        if size == 0:
+            rfile.readline()  # CRLF after the last chunk
+            return bytes(body)
+        body += rfile.read(size)
+        rfile.readline()
+
+
+def parse_audio_entries(body):
+    """Splits the replay ring dump into (sequence, timestamp_us, packet) tuples."""
+    entries = []
+    offset = 0
+    while offset + AUDIO_ENTRY_HEADER_LEN <= len(body):
+        sequence, length, timestamp = struct.unpack_from("<HHI", body, offset)
+        offset += AUDIO_ENTRY_HEADER_LEN
+        entries.append((sequence, timestamp, body[offset:offset + length]))
+        offset += length
+    return entries
+
+
+class OffloadHandler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def do_POST(self):
+        start = time.monotonic()
+        if self.headers.get("Transfer-Encoding", "").lower() == "chunked":
+            body = read_chunked(self.rfile)
+        else:
+            body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+        elapsed = time.monotonic() - start
+        stamp = datetime.now().strftime("%Y%m%d_%H%M%S")
+
+        if self.path == "/photo":
+            filename = f"photo_{stamp}.jpg"
+            valid = body[:2] == b"\xff\xd8" and body[-2:] == b"\xff\xd9"
+            print(f"[RECEIVER] Photo: {len(body)} bytes, capture time {self.headers.get('X-Capture-Time-Us')} us "
+                  f"(device), {'valid' if valid else 'INVALID'} JPEG")
+        elif self.path == "/audio":
+            filename = f"audio_{stamp}.bin"
+            entries = parse_audio_entries(body)
+            first = entries[0][0] if entries else None
+            print(f"[RECEIVER] Audio: {len(body)} bytes, {len(entries)} packets from sequence {first} "
+                  f"(codec {self.headers.get('X-Audio-Codec')}, {self.headers.get('X-Sample-Rate')} Hz)")
+        else:
+            self.send_response(404)
+            self.send_header("Content-Length", "0")
+            self.end_headers()
+            return
+
+        with open(filename, "wb") as f:
+            f.write(body)
+        received[self.path] = (len(body), elapsed)
+        print(f"[RECEIVER] Saved {filename} ({len(body) / 1024 / max(elapsed, 1e-6):.1f} KB/s)")
+        self.send_response(200)
+        self.send_header("Content-Length", "0")
+        self.end_headers()
+
+    def log_message(self, format, *args):
+        pass
+
+
+async def request_offload(mode, receiver_ip, port, items):
+    from bleak import BleakClient, BleakScanner
+
+    print(f"Scanning for '{DEVICE_NAME}'...")
+    device = await BleakScanner.find_device_by_name(DEVICE_NAME, timeout=10.0)
+    if not device:
+        print(f"Could not find '{DEVICE_NAME}'.")
+        return
+    async with BleakClient(device) as client:
+        ip_bytes = socket.inet_aton(receiver_ip) if receiver_ip else b"\x00\x00\x00\x00"
+        command = struct.pack("<B4sHB", MODES[mode], ip_bytes, port, items)
+        await client.write_gatt_char(WIFI_OFFLOAD_UUID, command, response=True)
+        if mode == "softap":
+            print(f"[CLIENT] Join the Wi-Fi network '{AP_SSID}' (password '{AP_PASSWORD}') to receive the upload.")
+        last_state = None
+        while True:
+            await asyncio.sleep(1.0)
+            state, ip, sent, elapsed_ms, http_status = struct.unpack("<B4sIIH", await client.read_gatt_char(WIFI_OFFLOAD_UUID))
+            if state != last_state:
+                print(f"[CLIENT] Offload {STATES[state]} (device {socket.inet_ntoa(ip)})")
+                last_state = state
+            if state in (4, 5):
+                rate = sent / 1024 / (elapsed_ms / 1000) if elapsed_ms else 0
+                print(f"[CLIENT] {sent} bytes in {elapsed_ms} ms ({rate:.1f} KB/s), last HTTP status {http_status}")
+                return
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Receive a Wi-Fi offload from the OpenGlass device.")
+    parser.add_argument("--mode", choices=MODES.keys(), default="softap")
+    parser.add_argument("--receiver-ip", help="This machine's address as seen by the device (station mode)")
+    parser.add_argument("--port", type=int, default=DEFAULT_PORT)
+    parser.add_argument("--photo-only", action="store_true")
+    parser.add_argument("--audio-only", action="store_true")
+    parser.add_argument("--no-ble", action="store_true", help="Only run the receiver")
+    args = parser.parse_args()
+
+    server = ThreadingHTTPServer(("0.0.0.0", args.port), OffloadHandler)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    print(f"[RECEIVER] Listening on port {args.port}.")
+
+    items = ITEM_PHOTO if args.photo_only else ITEM_AUDIO if args.audio_only else ITEM_PHOTO | ITEM_AUDIO
+    try:
+        if args.no_ble:
+            while True:
+                time.sleep(1.0)
+        else:
+            asyncio.run(request_offload(args.mode, args.receiver_ip, args.port, items))
+    except KeyboardInterrupt:
+        print("Script stopped by user.")
+    finally:
+        server.shutdown()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,123 @@
+#include "app_events.h"
+#include "logger.h"
+#include <Arduino.h>
+#include <esp_pm.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/timers.h>
+
+struct AppTimerSpec {
+    AppEvent event;
+    const char *name;
+    bool periodic;
+};
+
+static const AppTimerSpec TIMER_SPECS[] = {
+    {APP_EVENT_BATTERY, "battery", true},
+    {APP_EVENT_STATS, "stats", true},
+    {APP_EVENT_LINK, "link", true},
+    {APP_EVENT_ADV, "adv", false},
+    {APP_EVENT_SLEEP, "sleep", false},
+};
+static const size_t TIMER_COUNT = sizeof(TIMER_SPECS) / sizeof(TIMER_SPECS[0]);
+
+static const EventBits_t ALL_EVENTS = APP_EVENT_CONNECTION | APP_EVENT_BATTERY | APP_EVENT_STATS | APP_EVENT_LINK |
+                                      APP_EVENT_ADV | APP_EVENT_SLEEP;
+
+static EventGroupHandle_t s_events = nullptr;
+static TimerHandle_t s_timers[TIMER_COUNT] = {};
+
+// Loop statistics, only touched by the loop task
+static uint32_t s_wakeups = 0;
+static int64_t s_waited_us = 0;
+static uint32_t s_last_wakeups = 0;
+static int64_t s_last_waited_us = 0;
+static int64_t s_last_log_us = 0;
+
+// Runs on the timer service task: only hands the event to the loop
+static void on_timer(TimerHandle_t timer) {
+    xEventGroupSetBits(s_events, (EventBits_t)(uintptr_t)pvTimerGetTimerID(timer));
+}
+
+static TimerHandle_t find_timer(AppEvent event) {
+    for (size_t i = 0; i < TIMER_COUNT; i++) {
+        if (TIMER_SPECS[i].event == event) {
+            return s_timers[i];
+        }
+    }
+    return nullptr;
+}
+
+void app_events_init() {
+    s_events = xEventGroupCreate();
+    if (!s_events) {
+        logger_printf("[LOOP] ERROR: Failed to create the event group!\n");
+        return;
+    }
+    for (size_t i = 0; i < TIMER_COUNT; i++) {
+        const AppTimerSpec &spec = TIMER_SPECS[i];
+        // The period is set when the timer is started
+        s_timers[i] = xTimerCreate(spec.name, 1, spec.periodic ? pdTRUE : pdFALSE, (void *)(uintptr_t)spec.event,
+                                   on_timer);
+        if (!s_timers[i]) {
+            logger_printf("[LOOP] ERROR: Failed to create the %s timer!\n", spec.name);
+        }
+    }
+    s_last_log_us = esp_timer_get_time();
+}
+
+void app_events_post(uint32_t events) {
+    if (s_events) {
+        xEventGroupSetBits(s_events, (EventBits_t)events);
+    }
+}
+
+uint32_t app_events_wait() {
+    if (!s_events) {
+        vTaskDelay(pdMS_TO_TICKS(500)); // No event group: nothing can wake the loop but time
+        return 0;
+    }
+    int64_t start_us = esp_timer_get_time();
+    EventBits_t events = xEventGroupWaitBits(s_events, ALL_EVENTS, pdTRUE, pdFALSE, portMAX_DELAY);
+    s_waited_us += esp_timer_get_time() - start_us;
+    s_wakeups++;
+    return (uint32_t)(events & ALL_EVENTS);
+}
+
+void app_events_start_timer(AppEvent event, uint32_t period_ms) {
+    TimerHandle_t timer = find_timer(event);
+    if (!timer) {
+        return;
+    }
+    TickType_t ticks = pdMS_TO_TICKS(period_ms);
+    // Changing the period also starts a dormant timer, from now
+    if (xTimerChangePeriod(timer, ticks > 0 ? ticks : 1, 0) != pdPASS) {
+        logger_printf("[LOOP] Timer queue full. Event 0x%02X not scheduled.\n", (unsigned)event);
+    }
+}
+
+void app_events_stop_timer(AppEvent event) {
+    TimerHandle_t timer = find_timer(event);
+    if (timer) {
+        xTimerStop(timer, 0);
+    }
+}
+
+void app_events_log_stats() {
+    int64_t now_us = esp_timer_get_time();
+    uint32_t elapsed_ms = (uint32_t)((now_us - s_last_log_us) / 1000);
+    uint32_t wakeups = s_wakeups - s_last_wakeups;
+    uint32_t waited_ms = (uint32_t)((s_waited_us - s_last_waited_us) / 1000);
+    uint32_t per_100s = elapsed_ms ? (uint32_t)((uint64_t)wakeups * 100000 / elapsed_ms) : 0;
+    uint32_t waited_per_mille = elapsed_ms ? (uint32_t)((uint64_t)waited_ms * 1000 / elapsed_ms) : 0;
+    logger_printf("[LOOP] %u wakeups in %u s (%u.%02u/s), waiting %u.%u%% of the time.\n", wakeups,
+                  elapsed_ms / 1000, per_100s / 100, per_100s % 100, waited_per_mille / 10, waited_per_mille % 10);
+#if CONFIG_PM_PROFILING
+    // Time per power mode, including light sleep, and the locks that held the chip awake
+    esp_pm_dump_locks(stdout);
+#endif
+    s_last_log_us = now_us;
+    s_last_wakeups = s_wakeups;
+    s_last_waited_us = s_waited_us;
+}
@@ -0,0 +1,37 @@
+#ifndef APP_EVENTS_H
+#define APP_EVENTS_H
+
+#include <stdint.h>
+
+// Events of the main loop. loop() blocks in app_events_wait() until an event is set, so between
+// events the loop task takes no CPU time and the idle task can enter automatic light sleep.
+// Periodic and delayed work is driven by FreeRTOS software timers whose callbacks only set the
+// event bit; the BLE handler posts APP_EVENT_CONNECTION when the first client connects or the
+// last one leaves. Wakeups and the time spent waiting are logged with the [LOOP] tag.
+
+enum AppEvent : uint32_t {
+    APP_EVENT_CONNECTION = 1u << 0, // Connected state changed; g_is_ble_connected has the new state
+    APP_EVENT_BATTERY    = 1u << 1, // Battery level due (periodic, while connected)
+    APP_EVENT_STATS      = 1u << 2, // Debug statistics due (periodic, while connected)
+    APP_EVENT_LINK       = 1u << 3, // Connection mode re-evaluation (periodic, while connected)
+    APP_EVENT_ADV        = 1u << 4, // Fast advertising burst over (one-shot)
+    APP_EVENT_SLEEP      = 1u << 5, // Deep-sleep delay over without a client (one-shot)
+};
+
+// Creates the event group and the timers. Call in setup() before configure_ble().
+void app_events_init();
+
+// Sets events from any task
+void app_events_post(uint32_t events);
+
+// Blocks until at least one event is set, then returns and clears all that are set
+uint32_t app_events_wait();
+
+// (Re)starts the timer of a timer event: periodic ones repeat every period_ms until stopped
+void app_events_start_timer(AppEvent event, uint32_t period_ms);
+void app_events_stop_timer(AppEvent event);
+
+// Logs the loop wakeups per second and the share of time spent waiting since the last call
+void app_events_log_stats();
+
+#endif // APP_EVENTS_H
@@ -0,0 +1,41 @@
+#include "audio_decimator.h"
+#include <string.h>
+
+// Non-zero taps at odd offsets 1, 3, ..., 29 from the centre (the filter is symmetric).
+// Kaiser-windowed (beta 6.76) half-band sinc, quantised to Q15 with unity DC gain.
+static const int16_t HALFBAND_ODD_TAPS[(DECIMATOR_TAPS + 1) / 4] = {
+    10392, -3362, 1900, -1239, 852, -596, 415, -285, 190, -122, 74, -42, 21, -9, 3
+};
+static const int32_t HALFBAND_CENTRE_TAP = 16384;
+static const int HALFBAND_CENTRE = (DECIMATOR_TAPS - 1) / 2;
+
+void decimator_reset(DecimatorState &state) {
+    memset(state.buffer, 0, sizeof(state.buffer));
+}
+
+size_t decimate_by_2(DecimatorState &state, const int16_t *in, size_t in_samples, int16_t *out) {
+    if (!in || !out || in_samples == 0 || (in_samples & 1) || in_samples > AUDIO_MAX_INPUT_FRAME_SAMPLES) {
+        return 0;
+    }
+
+    // Append the new block after the history so the filter reads one contiguous window.
+    int16_t *window = state.buffer;
+    memcpy(&window[DECIMATOR_HISTORY], in, in_samples * sizeof(int16_t));
+
+    size_t out_samples = in_samples / 2;
+    for (size_t m = 0; m < out_samples; m++) {
+        // Window for output m spans window[2m + 1 .. 2m + DECIMATOR_TAPS]
+        const int16_t *centre = &window[2 * m + 1 + HALFBAND_CENTRE];
+        int32_t acc = HALFBAND_CENTRE_TAP * centre[0] + (1 << 14);
+        for (int k = 0; k < (DECIMATOR_TAPS + 1) / 4; k++) {
+            int offset = 2 * k + 1;
+            acc += HALFBAND_ODD_TAPS[k] * (centre[-offset] + centre[offset]);
+        }
+        acc >>= 15;
+        out[m] = (int16_t)(acc > INT16_MAX ? INT16_MAX : (acc < INT16_MIN ? INT16_MIN : acc));
+    }
+
+    // Keep the most recent samples as history for the next block.
+    memmove(window, &window[in_samples], DECIMATOR_HISTORY * sizeof(int16_t));
+    return out_samples;
+}
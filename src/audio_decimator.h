@@ -0,0 +1,28 @@
+#ifndef AUDIO_DECIMATOR_H
+#define AUDIO_DECIMATOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "config.h"
+
+// 2:1 polyphase decimator (16kHz -> 8kHz) built on a 59-tap half-band FIR in Q15.
+// Passband 0-3.4kHz (< 0.03dB ripple), stopband from 4.6kHz (> 69dB attenuation).
+// Because every other tap of a half-band filter is zero, each output costs 15
+// symmetric multiply-accumulates plus the centre tap. The kernel never allocates:
+// the filter history and the working block live in DecimatorState.
+constexpr int DECIMATOR_TAPS = 59;
+constexpr size_t DECIMATOR_HISTORY = DECIMATOR_TAPS - 1;
+
+struct DecimatorState {
+    int16_t buffer[DECIMATOR_HISTORY + AUDIO_MAX_INPUT_FRAME_SAMPLES];
+};
+
+// Clears the filter history.
+void decimator_reset(DecimatorState &state);
+
+// Decimates 'in_samples' (even, at most AUDIO_MAX_INPUT_FRAME_SAMPLES) input samples into
+// in_samples / 2 output samples. 'out' must not overlap 'in'. Returns the number of output
+// samples, or 0 if the arguments are invalid.
+size_t decimate_by_2(DecimatorState &state, const int16_t *in, size_t in_samples, int16_t *out);
+
+#endif // AUDIO_DECIMATOR_H
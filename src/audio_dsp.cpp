@@ -0,0 +1,105 @@
+#include "audio_dsp.h"
+#include "config.h"
+
+// Extra fractional bits kept in the DC blocker's feedback path so truncation
+// does not leave a residual offset or limit cycle.
+static const int DSP_DC_FRACTION_BITS = 8;
+
+static inline int16_t saturate16(int32_t v) {
+    return (int16_t)(v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : v));
+}
+
+static uint32_t isqrt32(uint32_t v) {
+    uint32_t root = 0;
+    uint32_t bit = 1u << 30;
+    while (bit > v) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (v >= root + bit) {
+            v -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+void audio_dsp_reset(AudioDspState &state) {
+    state.dc_prev_input = 0;
+    state.dc_prev_output = 0;
+    state.agc_gain_q8 = 256;
+    state.last_rms = 0;
+}
+
+// One-pole DC blocker: y[n] = x[n] - x[n-1] + a * y[n-1]. The recursion is inherently
+// sequential; the energy sum is folded into the same pass to avoid touching the frame twice.
+static uint64_t dc_block(AudioDspState &state, int16_t *pcm, size_t num_samples) {
+    int32_t x1 = state.dc_prev_input;
+    int32_t y1 = state.dc_prev_output;
+    uint64_t sum_squares = 0;
+
+    for (size_t i = 0; i < num_samples; i++) {
+        int32_t x = pcm[i];
+        int32_t y = ((x - x1) << DSP_DC_FRACTION_BITS) + (int32_t)(((int64_t)DSP_DC_BLOCK_COEFF_Q15 * y1) >> 15);
+        x1 = x;
+        y1 = y;
+        int16_t out = saturate16(y >> DSP_DC_FRACTION_BITS);
+        pcm[i] = out;
+        sum_squares += (uint32_t)((int32_t)out * out);
+    }
+
+    state.dc_prev_input = x1;
+    state.dc_prev_output = y1;
+    return sum_squares;
+}
+
+// Multiplies by a Q8 gain with saturation. Branch-free per sample so the compiler can
+// map it onto the S3's saturating min/max instructions or vectorise it on the host.
+static void apply_gain(int16_t *pcm, size_t num_samples, uint32_t gain_q8) {
+    const int32_t gain = (int32_t)gain_q8;
+    for (size_t i = 0; i < num_samples; i++) {
+        pcm[i] = saturate16((pcm[i] * gain) >> 8);
+    }
+}
+
+static void update_agc(AudioDspState &state, uint32_t rms) {
+    // Leave the gain alone in near-silence so background noise is not pumped up.
+    if (rms < AGC_NOISE_GATE_RMS) {
+        return;
+    }
+
+    // Gain (on top of VOLUME_GAIN) that would bring this frame to the target level
+    uint32_t boosted_rms = rms << VOLUME_GAIN;
+    uint32_t desired_q8 = (uint32_t)(((uint64_t)AGC_TARGET_RMS << 8) / boosted_rms);
+    if (desired_q8 > AGC_MAX_GAIN_Q8) desired_q8 = AGC_MAX_GAIN_Q8;
+    if (desired_q8 < AGC_MIN_GAIN_Q8) desired_q8 = AGC_MIN_GAIN_Q8;
+
+    if (desired_q8 < state.agc_gain_q8) {
+        state.agc_gain_q8 = desired_q8; // Fast attack to avoid clipping
+    } else {
+        // Slow release. The step rounds up so the gain reaches the target instead of stalling
+        // up to AGC_RELEASE_DIVISOR - 1 steps short of it.
+        state.agc_gain_q8 += (desired_q8 - state.agc_gain_q8 + AGC_RELEASE_DIVISOR - 1) / AGC_RELEASE_DIVISOR;
+    }
+}
+
+void audio_dsp_process(AudioDspState &state, int16_t *pcm, size_t num_samples) {
+    if (!pcm || num_samples == 0) {
+        return;
+    }
+
+    uint64_t sum_squares = dc_block(state, pcm, num_samples);
+    state.last_rms = isqrt32((uint32_t)(sum_squares / num_samples));
+
+    uint32_t gain_q8 = 256u << VOLUME_GAIN;
+    if (AUDIO_AGC_ENABLED) {
+        update_agc(state, state.last_rms);
+        gain_q8 = (uint32_t)(((uint64_t)gain_q8 * state.agc_gain_q8) >> 8);
+    }
+    if (gain_q8 != 256) {
+        apply_gain(pcm, num_samples, gain_q8);
+    }
+}
@@ -0,0 +1,25 @@
+#ifndef AUDIO_DSP_H
+#define AUDIO_DSP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Fixed-point pre-processing applied to microphone PCM before encoding:
+//  1. DC-blocking high-pass (removes the PDM microphone's offset)
+//  2. Saturating gain (VOLUME_GAIN as a shift, times the AGC gain)
+//  3. Optional AGC that steers the frame RMS towards AGC_TARGET_RMS
+// It has no hardware dependencies and all state is held in AudioDspState.
+struct AudioDspState {
+    int32_t dc_prev_input;    // x[n-1]
+    int32_t dc_prev_output;   // y[n-1] with DSP_DC_FRACTION_BITS fractional bits
+    uint32_t agc_gain_q8;     // Current AGC gain (Q8, 256 = 1.0)
+    uint32_t last_rms;        // RMS of the last frame after DC removal, before gain
+};
+
+// Resets the filter history and sets the AGC gain back to unity.
+void audio_dsp_reset(AudioDspState &state);
+
+// Processes one frame in place.
+void audio_dsp_process(AudioDspState &state, int16_t *pcm, size_t num_samples);
+
+#endif // AUDIO_DSP_H
@@ -2,28 +2,107 @@
 #include "config.h"
 #include "logger.h"
 #include <Arduino.h>
-#include <I2S.h> // Use the Arduino I2S library
+#include <esp_timer.h>
 
-// Buffer for raw microphone data
-size_t i2s_recording_buffer_size = FRAME_SIZE * (SAMPLE_BITS / 8);
-uint8_t *s_i2s_recording_buffer = nullptr;
+// Capture goes through the ESP-IDF i2s_channel PDM RX driver when the core provides it
+// (Arduino-ESP32 3.x). Older cores fall back to the Arduino I2S wrapper.
+#if __has_include(<driver/i2s_pdm.h>)
+#define MIC_USE_I2S_CHANNEL 1
+#include <driver/i2s_pdm.h>
+#else
+#define MIC_USE_I2S_CHANNEL 0
+#include <I2S.h> // Use the Arduino I2S library
+#endif
 
 // Flag to track if the driver is active
 static bool i2s_driver_installed = false;
 
+// Capture counters. The DMA counters are updated from the I2S interrupt.
+static volatile uint32_t s_dma_blocks = 0;
+static volatile uint32_t s_dma_overflows = 0;
+static uint32_t s_task_wakes = 0;
+static uint32_t s_read_timeouts = 0;
+
+// Capture timing: device time of the newest DMA block and the samples captured but not yet
+// read, so the time of the last sample handed to the reader can be worked out.
+static int64_t s_last_block_us = 0;
+static int32_t s_unread_samples = 0;
+static portMUX_TYPE s_capture_mux = portMUX_INITIALIZER_UNLOCKED;
+
+#if MIC_USE_I2S_CHANNEL
+static i2s_chan_handle_t s_rx_channel = nullptr;
+
+// Task waiting in wait_for_microphone_block(); notified once per filled DMA buffer
+static volatile TaskHandle_t s_reader_task = nullptr;
+
+static bool IRAM_ATTR on_dma_block_received(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx)
+{
+    s_dma_blocks++;
+    portENTER_CRITICAL_ISR(&s_capture_mux);
+    s_last_block_us = esp_timer_get_time();
+    s_unread_samples += I2S_DMA_FRAME_SAMPLES;
+    portEXIT_CRITICAL_ISR(&s_capture_mux);
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    TaskHandle_t reader = s_reader_task;
+    if (reader) {
+        vTaskNotifyGiveFromISR(reader, &higher_priority_task_woken);
+    }
+    return higher_priority_task_woken == pdTRUE;
+}
+
+// The reader fell behind and the DMA ring wrapped over a block nobody read
+static bool IRAM_ATTR on_dma_overflow(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx)
+{
+    s_dma_overflows++;
+    portENTER_CRITICAL_ISR(&s_capture_mux);
+    s_unread_samples -= I2S_DMA_FRAME_SAMPLES; // The oldest block was dropped
+    portEXIT_CRITICAL_ISR(&s_capture_mux);
+    return false;
+}
+#endif
+
 void configure_microphone()
 {
-    logger_printf("\n[MIC] Configuring microphone using Arduino I2S library...\n");
+    if (i2s_driver_installed) {
+        return; // Already running, e.g. when switching audio codec mode
+    }
+
+#if MIC_USE_I2S_CHANNEL
+    logger_printf("\n[MIC] Configuring PDM microphone on the I2S channel driver (%u DMA buffers x %u samples)...\n",
+                  I2S_DMA_DESC_NUM, I2S_DMA_FRAME_SAMPLES);
+
+    i2s_chan_config_t chan_config = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_0, I2S_ROLE_MASTER);
+    chan_config.dma_desc_num = I2S_DMA_DESC_NUM;
+    chan_config.dma_frame_num = I2S_DMA_FRAME_SAMPLES;
+    if (i2s_new_channel(&chan_config, NULL, &s_rx_channel) != ESP_OK) {
+        logger_printf("[MIC] ERROR: Failed to allocate I2S RX channel!\n");
+        s_rx_channel = nullptr;
+        return;
+    }
+
+    // Same pin mapping as the Arduino I2S path: clock on SCK, data on SD
+    i2s_pdm_rx_config_t pdm_config = {};
+    pdm_config.clk_cfg = I2S_PDM_RX_CLK_DEFAULT_CONFIG(SAMPLE_RATE);
+    pdm_config.slot_cfg = I2S_PDM_RX_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_MONO);
+    pdm_config.gpio_cfg.clk = (gpio_num_t)I2S_SCK_PIN;
+    pdm_config.gpio_cfg.din = (gpio_num_t)I2S_SD_PIN;
+
+    s_unread_samples = 0;
+    i2s_event_callbacks_t callbacks = {};
+    callbacks.on_recv = on_dma_block_received;
+    callbacks.on_recv_q_ovf = on_dma_overflow;
 
-    // Allocate the recording buffer if it hasn't been already
-    if (s_i2s_recording_buffer == nullptr) {
-        s_i2s_recording_buffer = (uint8_t *)ps_calloc(i2s_recording_buffer_size, sizeof(uint8_t));
-        if (!s_i2s_recording_buffer) {
-            logger_printf("[MIC] ERROR: Failed to allocate recording buffer!\n");
-            return;
-        }
-        logger_printf("[MIC] Recording buffer allocated (%zu bytes).\n", i2s_recording_buffer_size);
+    if (i2s_channel_init_pdm_rx_mode(s_rx_channel, &pdm_config) != ESP_OK ||
+        i2s_channel_register_event_callback(s_rx_channel, &callbacks, NULL) != ESP_OK ||
+        i2s_channel_enable(s_rx_channel) != ESP_OK)
+    {
+        logger_printf("[MIC] ERROR: Failed to initialize PDM RX channel!\n");
+        i2s_del_channel(s_rx_channel);
+        s_rx_channel = nullptr;
+        return;
     }
+#else
+    logger_printf("\n[MIC] Configuring microphone using Arduino I2S library...\n");
 
     // Use the simpler Arduino I2S configuration from the old code
     // Note: For PDM, the pin mapping can be tricky.
@@ -36,35 +115,98 @@ void configure_microphone()
         logger_printf("[MIC] ERROR: Failed to initialize I2S!\n");
         return;
     }
+#endif
 
     i2s_driver_installed = true;
-    logger_printf("[MIC] Arduino I2S library configured successfully.\n");
+    logger_printf("[MIC] Microphone configured successfully.\n");
 }
 
 size_t read_microphone_data(uint8_t *buffer, size_t buffer_size)
 {
-    if (buffer && i2s_driver_installed)
+    if (!buffer || !i2s_driver_installed)
     {
-        // Use I2S.read() to get data
-        return I2S.read(buffer, buffer_size);
+        return 0;
     }
-    return 0;
+
+#if MIC_USE_I2S_CHANNEL
+    // Non-blocking: copy whatever the DMA ring already holds, up to buffer_size.
+    // A timeout here only means less than buffer_size was available.
+    size_t bytes_read = 0;
+    i2s_channel_read(s_rx_channel, buffer, buffer_size, &bytes_read, 0);
+    portENTER_CRITICAL(&s_capture_mux);
+    s_unread_samples -= bytes_read / sizeof(int16_t);
+    portEXIT_CRITICAL(&s_capture_mux);
+    return bytes_read;
+#else
+    // Use I2S.read() to get data. Without a receive event the read time stands in for the
+    // capture time of the last sample.
+    int bytes_read = I2S.read(buffer, buffer_size);
+    if (bytes_read > 0) {
+        s_last_block_us = esp_timer_get_time();
+    }
+    return bytes_read;
+#endif
+}
+
+int64_t microphone_last_sample_time_us()
+{
+    portENTER_CRITICAL(&s_capture_mux);
+    int64_t block_us = s_last_block_us;
+    int32_t unread = s_unread_samples;
+    portEXIT_CRITICAL(&s_capture_mux);
+    if (unread < 0) {
+        unread = 0;
+    }
+    return block_us - (int64_t)unread * 1000000 / SAMPLE_RATE;
+}
+
+bool wait_for_microphone_block(uint32_t timeout_ms)
+{
+    if (!i2s_driver_installed)
+    {
+        vTaskDelay(pdMS_TO_TICKS(timeout_ms)); // Don't spin while the microphone is down
+        return false;
+    }
+
+    s_task_wakes++;
+#if MIC_USE_I2S_CHANNEL
+    s_reader_task = xTaskGetCurrentTaskHandle();
+    if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout_ms)) == 0) {
+        s_read_timeouts++;
+        return false;
+    }
+    return true;
+#else
+    // The Arduino wrapper has no receive event; poll at the old streaming rate instead
+    vTaskDelay(pdMS_TO_TICKS(ULAW_TASK_DELAY_MS < timeout_ms ? ULAW_TASK_DELAY_MS : timeout_ms));
+    return true;
+#endif
+}
+
+MicCaptureStats get_microphone_stats()
+{
+    MicCaptureStats stats;
+    stats.dma_blocks = s_dma_blocks;
+    stats.dma_overflows = s_dma_overflows;
+    stats.task_wakes = s_task_wakes;
+    stats.read_timeouts = s_read_timeouts;
+    return stats;
 }
 
 void deinit_microphone()
 {
     if (i2s_driver_installed)
     {
+#if MIC_USE_I2S_CHANNEL
+        i2s_channel_disable(s_rx_channel);
+        i2s_del_channel(s_rx_channel);
+        s_rx_channel = nullptr;
+        s_reader_task = nullptr;
+#else
         I2S.end();
+#endif
         logger_printf("[MIC] I2S driver uninstalled successfully.\n");
         i2s_driver_installed = false;
-
-        // Free the recording buffer
-        if (s_i2s_recording_buffer != nullptr) {
-            free(s_i2s_recording_buffer);
-            s_i2s_recording_buffer = nullptr;
-            logger_printf("[MIC] Recording buffer freed.\n");
-        }
     }
     else
     {
@@ -75,4 +217,4 @@ void deinit_microphone()
 bool is_microphone_initialized()
 {
     return i2s_driver_installed;
-}
\ No newline at end of file
+}
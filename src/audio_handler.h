@@ -4,8 +4,6 @@
 #include <stddef.h> // For size_t
 #include <stdint.h> // For uint8_t, uint16_t
 
-extern uint8_t *s_i2s_recording_buffer;
-
 // Buffers used by audio processing - can be extern if needed by other modules,
 // or kept static within audio_handler.cpp if not. For now, keep them internal.
 extern uint8_t *s_audio_packet_buffer;
@@ -13,8 +11,19 @@ extern uint8_t *s_audio_packet_buffer;
 // External declaration for global audio frame count
 extern uint16_t g_audio_frame_count;
 
+// Microphone capture counters, cumulative since boot
+struct MicCaptureStats {
+    uint32_t dma_blocks;    // DMA buffers filled by the I2S peripheral
+    uint32_t dma_overflows; // DMA buffers overwritten before they were read
+    uint32_t task_wakes;    // Times the reader slept waiting for a block
+    uint32_t read_timeouts; // Waits that ended without a new block
+};
+
 void configure_microphone();
-size_t read_microphone_data(uint8_t *buffer, size_t buffer_size); // More generic read
+size_t read_microphone_data(uint8_t *buffer, size_t buffer_size); // Non-blocking; returns bytes copied
+bool wait_for_microphone_block(uint32_t timeout_ms); // Sleeps until the next DMA block is ready
+MicCaptureStats get_microphone_stats();
+int64_t microphone_last_sample_time_us(); // Device time (esp_timer) of the last sample read
 void deinit_microphone(); // Add deinit function
 bool is_microphone_initialized();
 
@@ -0,0 +1,278 @@
+#include "config.h"
+#include "audio_logmel.h"
+#include "audio_replay.h"
+#include "ble_handler.h" // For notify_framed_audio_packet
+#include "logger.h"
+#include <Arduino.h>
+#include <math.h>
+#include <string.h>
+
+#if __has_include(<esp_dsp.h>)
+#include <esp_dsp.h>
+#define LOGMEL_USE_ESP_DSP 1
+#else
+#define LOGMEL_USE_ESP_DSP 0
+#endif
+
+// Number of frames between statistics log lines (500 x 10ms = 5s)
+static const uint32_t LOGMEL_STATS_LOG_FRAMES = 500;
+
+// Keep the FFT input below 2^14 so the butterflies cannot overflow int16
+static const int32_t LOGMEL_FFT_INPUT_LIMIT = 1 << 14;
+
+// Tables for the configured sample rate. Built once per rate at init; no allocation afterwards.
+static uint32_t s_logmel_sample_rate = 0;
+static size_t s_window_samples = 0;
+static size_t s_fft_size = 0;
+static int s_fft_log2 = 0;
+static int16_t s_hann_window[LOGMEL_WINDOW_MAX_SAMPLES];           // Q15
+#if !LOGMEL_USE_ESP_DSP
+static int16_t s_twiddle[LOGMEL_FFT_MAX_SIZE];                      // cos, sin pairs for k < N/2 (Q15)
+#endif
+static uint8_t s_bin_filter[LOGMEL_FFT_MAX_SIZE / 2 + 1];          // Mel band a bin starts in, 0xFF if unused
+static uint16_t s_bin_rising_weight[LOGMEL_FFT_MAX_SIZE / 2 + 1];  // Q15 weight towards the upper filter
+
+// Working buffers
+alignas(16) static int16_t s_fft_buffer[2 * LOGMEL_FFT_MAX_SIZE];   // Interleaved re, im
+static int32_t s_windowed[LOGMEL_WINDOW_MAX_SAMPLES];
+static uint64_t s_mel_energy[LOGMEL_NUM_BINS];
+static int16_t s_analysis_window[LOGMEL_WINDOW_MAX_SAMPLES];       // Sliding window of recent samples
+static uint8_t s_logmel_packet[LOGMEL_NUM_BINS];
+static uint16_t s_logmel_sequence = 0;
+
+// Statistics
+static uint32_t s_logmel_frames = 0;
+static uint64_t s_logmel_cycles = 0;
+static uint32_t s_logmel_cycles_max = 0;
+
+static float hz_to_mel(float hz) {
+    return 2595.0f * log10f(1.0f + hz / 700.0f);
+}
+
+static float mel_to_hz(float mel) {
+    return 700.0f * (powf(10.0f, mel / 2595.0f) - 1.0f);
+}
+
+bool initialize_logmel(uint32_t sample_rate) {
+    if (sample_rate != (uint32_t)SAMPLE_RATE && sample_rate != (uint32_t)SAMPLE_RATE / 2) {
+        return false;
+    }
+    if (s_logmel_sample_rate == sample_rate) {
+        return true;
+    }
+
+    s_window_samples = sample_rate * LOGMEL_WINDOW_MS / 1000;
+    s_fft_size = 1;
+    s_fft_log2 = 0;
+    while (s_fft_size < s_window_samples) {
+        s_fft_size <<= 1;
+        s_fft_log2++;
+    }
+
+    for (size_t i = 0; i < s_window_samples; i++) {
+        float w = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / (s_window_samples - 1));
+        s_hann_window[i] = (int16_t)lroundf(w * 32767.0f);
+    }
+
+#if LOGMEL_USE_ESP_DSP
+    if (dsps_fft2r_init_sc16(NULL, LOGMEL_FFT_MAX_SIZE) != ESP_OK) {
+        logger_printf("[LOGMEL] ERROR: esp-dsp FFT init failed!\n");
+        return false;
+    }
+#else
+    for (size_t k = 0; k < s_fft_size / 2; k++) {
+        float angle = 2.0f * (float)M_PI * k / s_fft_size;
+        s_twiddle[2 * k] = (int16_t)lroundf(cosf(angle) * 32767.0f);
+        s_twiddle[2 * k + 1] = (int16_t)lroundf(sinf(angle) * 32767.0f);
+    }
+#endif
+
+    // Mel filter edges: LOGMEL_NUM_BINS + 2 points equally spaced on the mel scale. Each FFT bin
+    // lies between two edges, on the rising slope of one filter and the falling slope of the one below.
+    float edges[LOGMEL_NUM_BINS + 2];
+    float mel_low = hz_to_mel((float)LOGMEL_MIN_HZ);
+    float mel_high = hz_to_mel(sample_rate / 2.0f);
+    for (int m = 0; m < LOGMEL_NUM_BINS + 2; m++) {
+        edges[m] = mel_to_hz(mel_low + (mel_high - mel_low) * m / (LOGMEL_NUM_BINS + 1));
+    }
+    size_t band = 0;
+    for (size_t k = 0; k <= s_fft_size / 2; k++) {
+        float hz = (float)k * sample_rate / s_fft_size;
+        while (band < LOGMEL_NUM_BINS + 1 && hz >= edges[band + 1]) {
+            band++;
+        }
+        if (hz < edges[0] || band >= LOGMEL_NUM_BINS + 1) {
+            s_bin_filter[k] = 0xFF;
+            s_bin_rising_weight[k] = 0;
+            continue;
+        }
+        s_bin_filter[k] = (uint8_t)band;
+        s_bin_rising_weight[k] = (uint16_t)lroundf((hz - edges[band]) / (edges[band + 1] - edges[band]) * 32768.0f);
+    }
+
+    s_logmel_sample_rate = sample_rate;
+    logger_printf("[LOGMEL] %u mel bins, %u-sample window, %u-point FFT (%s) at %u Hz.\n",
+                  LOGMEL_NUM_BINS, (uint32_t)s_window_samples, (uint32_t)s_fft_size,
+                  LOGMEL_USE_ESP_DSP ? "esp-dsp" : "scalar", sample_rate);
+    return true;
+}
+
+#if !LOGMEL_USE_ESP_DSP
+// In-place radix-2 decimation-in-time FFT on interleaved Q15 data. Each stage halves the
+// result (as esp-dsp's sc16 FFT does), so the output is the transform scaled by 1/N.
+static void fft_radix2_sc16(int16_t *data, size_t n, int log2n) {
+    for (size_t i = 0; i < n; i++) {
+        size_t j = 0;
+        for (int b = 0; b < log2n; b++) {
+            j |= ((i >> b) & 1) << (log2n - 1 - b);
+        }
+        if (j > i) {
+            int16_t re = data[2 * i], im = data[2 * i + 1];
+            data[2 * i] = data[2 * j];
+            data[2 * i + 1] = data[2 * j + 1];
+            data[2 * j] = re;
+            data[2 * j + 1] = im;
+        }
+    }
+
+    for (size_t half = 1, step = n / 2; half < n; half <<= 1, step >>= 1) {
+        for (size_t start = 0; start < n; start += 2 * half) {
+            for (size_t k = 0; k < half; k++) {
+                int32_t wr = s_twiddle[2 * k * step];
+                int32_t wi = -s_twiddle[2 * k * step + 1];
+                int16_t *a = &data[2 * (start + k)];
+                int16_t *b = &data[2 * (start + k + half)];
+                int32_t tr = (b[0] * wr - b[1] * wi + (1 << 14)) >> 15;
+                int32_t ti = (b[0] * wi + b[1] * wr + (1 << 14)) >> 15;
+                int32_t ar = a[0], ai = a[1];
+                a[0] = (int16_t)((ar + tr) >> 1);
+                a[1] = (int16_t)((ai + ti) >> 1);
+                b[0] = (int16_t)((ar - tr) >> 1);
+                b[1] = (int16_t)((ai - ti) >> 1);
+            }
+        }
+    }
+}
+#endif
+
+// log2(x) in Q8. log2(1 + f) for the fraction is approximated by f + 0.347 f (1 - f),
+// which is within 0.01 of the exact value.
+static int32_t log2_q8(uint64_t x) {
+    int exponent = 63 - __builtin_clzll(x);
+    uint32_t fraction = (exponent >= 8) ? (uint32_t)(x >> (exponent - 8)) & 0xFF : (uint32_t)(x << (8 - exponent)) & 0xFF;
+    return exponent * 256 + fraction + ((fraction * (256 - fraction) * 89) >> 16);
+}
+
+bool logmel_compute_frame(const int16_t *window, size_t window_samples, uint8_t *out) {
+    if (s_logmel_sample_rate == 0 || !window || !out || window_samples != s_window_samples) {
+        return false;
+    }
+
+    // Window, then pick a block exponent so the FFT input uses its full headroom
+    int32_t peak = 0;
+    for (size_t i = 0; i < window_samples; i++) {
+        int32_t v = window[i] * s_hann_window[i]; // Q15
+        s_windowed[i] = v;
+        int32_t mag = v < 0 ? -v : v;
+        if (mag > peak) {
+            peak = mag;
+        }
+    }
+    if (peak == 0) {
+        memset(out, 0, LOGMEL_NUM_BINS);
+        return true;
+    }
+    int shift = 0;
+    while ((peak >> shift) >= LOGMEL_FFT_INPUT_LIMIT) {
+        shift++;
+    }
+
+    memset(s_fft_buffer, 0, 2 * s_fft_size * sizeof(int16_t));
+    for (size_t i = 0; i < window_samples; i++) {
+        s_fft_buffer[2 * i] = (int16_t)(s_windowed[i] >> shift);
+    }
+
+#if LOGMEL_USE_ESP_DSP
+    dsps_fft2r_sc16(s_fft_buffer, s_fft_size);
+    dsps_bit_rev_sc16_ansi(s_fft_buffer, s_fft_size);
+#else
+    fft_radix2_sc16(s_fft_buffer, s_fft_size, s_fft_log2);
+#endif
+
+    // Power spectrum into the mel filters (Q15 weights)
+    memset(s_mel_energy, 0, sizeof(s_mel_energy));
+    for (size_t k = 0; k <= s_fft_size / 2; k++) {
+        uint8_t band = s_bin_filter[k];
+        if (band == 0xFF) {
+            continue;
+        }
+        int32_t re = s_fft_buffer[2 * k];
+        int32_t im = s_fft_buffer[2 * k + 1];
+        uint64_t power = (uint32_t)(re * re) + (uint32_t)(im * im);
+        uint32_t rising = s_bin_rising_weight[k];
+        if (band < LOGMEL_NUM_BINS) {
+            s_mel_energy[band] += power * rising;
+        }
+        if (band > 0) {
+            s_mel_energy[band - 1] += power * (32768 - rising);
+        }
+    }
+
+    // Undo the fixed-point scaling: the FFT input was the windowed signal times 2^(15 - shift),
+    // the FFT divided by N, and the filter weights carry 15 fractional bits.
+    int32_t offset_q8 = 256 * (2 * s_fft_log2 - 15 - 2 * (15 - shift));
+    for (int m = 0; m < LOGMEL_NUM_BINS; m++) {
+        if (s_mel_energy[m] == 0) {
+            out[m] = 0;
+            continue;
+        }
+        int32_t value = (log2_q8(s_mel_energy[m]) + offset_q8 + 32) >> 6; // 4 * log2, rounded
+        out[m] = (uint8_t)(value < 0 ? 0 : (value > 255 ? 255 : value));
+    }
+    return true;
+}
+
+void reset_logmel_stream() {
+    clear_logmel_window();
+    s_logmel_sequence = 0;
+}
+
+void clear_logmel_window() {
+    memset(s_analysis_window, 0, sizeof(s_analysis_window));
+}
+
+size_t process_and_send_logmel_features(BleChannel channel, const int16_t *pcm, size_t num_samples, int64_t first_sample_us) {
+    if (!pcm || num_samples == 0 || num_samples > s_window_samples) {
+        return 0;
+    }
+
+    // Slide the analysis window by one hop
+    memmove(s_analysis_window, &s_analysis_window[num_samples], (s_window_samples - num_samples) * sizeof(int16_t));
+    memcpy(&s_analysis_window[s_window_samples - num_samples], pcm, num_samples * sizeof(int16_t));
+
+    uint32_t start_cycles = ESP.getCycleCount();
+    if (!logmel_compute_frame(s_analysis_window, s_window_samples, s_logmel_packet)) {
+        return 0;
+    }
+    uint32_t cycles = ESP.getCycleCount() - start_cycles;
+
+    s_logmel_frames++;
+    s_logmel_cycles += cycles;
+    if (cycles > s_logmel_cycles_max) {
+        s_logmel_cycles_max = cycles;
+    }
+    if (s_logmel_frames % LOGMEL_STATS_LOG_FRAMES == 0) {
+        logger_printf("[LOGMEL] Frames: %u | Compute avg: %u cycles, max: %u cycles per %u ms frame (%s FFT)\n",
+                      s_logmel_frames,
+                      (uint32_t)(s_logmel_cycles / s_logmel_frames),
+                      s_logmel_cycles_max,
+                      LOGMEL_HOP_MS,
+                      LOGMEL_USE_ESP_DSP ? "esp-dsp" : "scalar");
+    }
+
+    uint32_t window_start_us = (uint32_t)(first_sample_us - (int64_t)(s_window_samples - num_samples) * 1000000 / s_logmel_sample_rate);
+    BleSessionMask live = audio_replay_capture(channel, s_logmel_sequence, window_start_us, s_logmel_packet, sizeof(s_logmel_packet));
+    notify_framed_audio_packet(channel, live, s_logmel_sequence, window_start_us, s_logmel_packet, sizeof(s_logmel_packet));
+    s_logmel_sequence++;
+    return sizeof(s_logmel_packet);
+}
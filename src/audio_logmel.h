@@ -0,0 +1,41 @@
+#ifndef AUDIO_LOGMEL_H
+#define AUDIO_LOGMEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "ble_transport.h" // For BleChannel
+
+// Log-mel spectrogram features for ASR/keyword backends. Every LOGMEL_HOP_MS the last
+// LOGMEL_WINDOW_MS of audio is Hann-windowed, transformed with a fixed-point radix-2 FFT
+// (esp-dsp on the ESP32-S3 when available, portable scalar code otherwise) and summed into
+// LOGMEL_NUM_BINS triangular mel filters (HTK mel scale, LOGMEL_MIN_HZ to Nyquist).
+//
+// Each feature frame is LOGMEL_NUM_BINS bytes, one per filter from low to high frequency:
+//   value = round(4 * log2(E)), clamped to 0-255
+// where E is the filter's power, the weighted sum of |X[k]|^2 over the unnormalised FFT
+// of the windowed 16-bit samples. One step is 0.75dB. Frames are sent with the same
+// sequence number and fragment index framing as Opus.
+
+// Builds the window, twiddle and filterbank tables for the sample rate (8000 or 16000).
+// Returns false for unsupported rates.
+bool initialize_logmel(uint32_t sample_rate);
+
+// Computes one feature frame from the most recent window of samples (window_samples long,
+// oldest first). Writes LOGMEL_NUM_BINS bytes to 'out'. Returns false if not initialized.
+// No hardware dependencies apart from the optional esp-dsp FFT.
+bool logmel_compute_frame(const int16_t *window, size_t window_samples, uint8_t *out);
+
+// Adds one hop of PCM to the analysis window, computes a feature frame and sends it over
+// BLE. first_sample_us is the device time of the hop's first sample; the frame is stamped
+// with the time of the first sample in its analysis window. Returns the number of feature bytes sent.
+size_t process_and_send_logmel_features(BleChannel channel, const int16_t *pcm, size_t num_samples, int64_t first_sample_us);
+
+// Clears the analysis window and resets the sequence number (e.g. on codec change)
+void reset_logmel_stream();
+
+// Clears the analysis window only, after a gap in the audio (e.g. frames the VAD dropped), so
+// the next frame does not mix samples from both sides of it. The sequence continues.
+void clear_logmel_window();
+
+#endif // AUDIO_LOGMEL_H
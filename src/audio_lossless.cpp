@@ -0,0 +1,194 @@
+#include "config.h"
+#include "audio_lossless.h"
+#include "audio_replay.h"
+#include "ble_handler.h" // For notify_framed_audio_packet
+#include "logger.h"
+#include <Arduino.h>
+#include <string.h>
+#include <esp_timer.h>
+
+// Number of blocks between statistics log lines (156 x 32ms ~= 5s)
+static const uint32_t LOSSLESS_STATS_LOG_BLOCKS = 156;
+
+// Largest Rice parameter tried; residuals of 16-bit audio never need more.
+static const uint8_t LOSSLESS_MAX_RICE_PARAM = 20;
+
+// All working buffers are static so the streaming path never allocates.
+static uint8_t s_lossless_packet[LOSSLESS_MAX_PACKET_BYTES];
+static uint16_t s_lossless_sequence = 0;
+
+// Encoder statistics
+static uint32_t s_lossless_blocks_encoded = 0;
+static uint64_t s_lossless_encode_time_us = 0;
+static uint64_t s_lossless_input_bytes = 0;
+static uint64_t s_lossless_output_bytes = 0;
+
+// --- Fixed predictors (FLAC orders 0-4) ---
+static inline int32_t fixed_residual(const int16_t *x, size_t n, int order) {
+    switch (order) {
+        case 0: return x[n];
+        case 1: return (int32_t)x[n] - x[n - 1];
+        case 2: return (int32_t)x[n] - 2 * x[n - 1] + x[n - 2];
+        case 3: return (int32_t)x[n] - 3 * x[n - 1] + 3 * x[n - 2] - x[n - 3];
+        default: return (int32_t)x[n] - 4 * x[n - 1] + 6 * x[n - 2] - 4 * x[n - 3] + x[n - 4];
+    }
+}
+
+static inline uint32_t zigzag(int32_t r) {
+    return ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+}
+
+// --- MSB-first bit writer over a fixed buffer ---
+struct BitWriter {
+    uint8_t *buf;
+    size_t capacity;
+    size_t pos;      // Byte position
+    uint32_t acc;    // Pending bits
+    int acc_bits;
+    bool overflow;
+};
+
+static inline void bit_writer_put(BitWriter &w, uint32_t value, int bits) {
+    // 'bits' is at most 24 so the accumulator never overflows
+    w.acc = (w.acc << bits) | (value & ((1u << bits) - 1));
+    w.acc_bits += bits;
+    while (w.acc_bits >= 8) {
+        w.acc_bits -= 8;
+        if (w.pos >= w.capacity) {
+            w.overflow = true;
+            return;
+        }
+        w.buf[w.pos++] = (uint8_t)(w.acc >> w.acc_bits);
+    }
+}
+
+static inline void bit_writer_put_unary(BitWriter &w, uint32_t q) {
+    while (q >= 16 && !w.overflow) {
+        bit_writer_put(w, 0xFFFF, 16);
+        q -= 16;
+    }
+    // q one-bits followed by the terminating zero-bit
+    bit_writer_put(w, ((1u << q) - 1) << 1, q + 1);
+}
+
+static size_t bit_writer_flush(BitWriter &w) {
+    if (w.acc_bits > 0 && !w.overflow) {
+        bit_writer_put(w, 0, 8 - w.acc_bits);
+    }
+    return w.overflow ? 0 : w.pos;
+}
+
+static size_t write_verbatim_block(const int16_t *pcm, size_t num_samples, uint8_t *out) {
+    out[0] = LOSSLESS_ORDER_VERBATIM;
+    out[1] = 0;
+    out[2] = (uint8_t)(num_samples & 0xFF);
+    out[3] = (uint8_t)((num_samples >> 8) & 0xFF);
+    for (size_t i = 0; i < num_samples; i++) {
+        out[LOSSLESS_BLOCK_HEADER_LEN + 2 * i] = (uint8_t)(pcm[i] & 0xFF);
+        out[LOSSLESS_BLOCK_HEADER_LEN + 2 * i + 1] = (uint8_t)(((uint16_t)pcm[i] >> 8) & 0xFF);
+    }
+    return LOSSLESS_BLOCK_HEADER_LEN + num_samples * sizeof(int16_t);
+}
+
+size_t lossless_encode_block(const int16_t *pcm, size_t num_samples, uint8_t *out, size_t out_capacity) {
+    size_t verbatim_len = LOSSLESS_BLOCK_HEADER_LEN + num_samples * sizeof(int16_t);
+    if (!pcm || !out || num_samples == 0 || num_samples > 0xFFFF || out_capacity < verbatim_len) {
+        return 0;
+    }
+    if (num_samples <= (size_t)LOSSLESS_MAX_ORDER) {
+        return write_verbatim_block(pcm, num_samples, out);
+    }
+
+    // Pick the predictor order with the smallest total residual magnitude.
+    uint64_t order_cost[LOSSLESS_MAX_ORDER + 1] = {0};
+    for (size_t n = LOSSLESS_MAX_ORDER; n < num_samples; n++) {
+        for (int order = 0; order <= LOSSLESS_MAX_ORDER; order++) {
+            int32_t r = fixed_residual(pcm, n, order);
+            order_cost[order] += (uint32_t)(r < 0 ? -r : r);
+        }
+    }
+    int best_order = 0;
+    for (int order = 1; order <= LOSSLESS_MAX_ORDER; order++) {
+        if (order_cost[order] < order_cost[best_order]) {
+            best_order = order;
+        }
+    }
+
+    // Rice parameter: the k for which 2^k is closest to the mean zigzagged residual.
+    size_t residual_count = num_samples - best_order;
+    uint64_t zigzag_sum = 0;
+    for (size_t n = best_order; n < num_samples; n++) {
+        zigzag_sum += zigzag(fixed_residual(pcm, n, best_order));
+    }
+    uint8_t k = 0;
+    while (k < LOSSLESS_MAX_RICE_PARAM && ((uint64_t)residual_count << (k + 1)) < zigzag_sum) {
+        k++;
+    }
+
+    out[0] = (uint8_t)best_order;
+    out[1] = k;
+    out[2] = (uint8_t)(num_samples & 0xFF);
+    out[3] = (uint8_t)((num_samples >> 8) & 0xFF);
+    size_t pos = LOSSLESS_BLOCK_HEADER_LEN;
+    for (int i = 0; i < best_order; i++) {
+        out[pos++] = (uint8_t)(pcm[i] & 0xFF);
+        out[pos++] = (uint8_t)(((uint16_t)pcm[i] >> 8) & 0xFF);
+    }
+
+    // Encode into the output buffer, but never let it grow past the verbatim size.
+    BitWriter w = { out, verbatim_len - 1, pos, 0, 0, false };
+    for (size_t n = best_order; n < num_samples && !w.overflow; n++) {
+        uint32_t u = zigzag(fixed_residual(pcm, n, best_order));
+        uint32_t q = u >> k;
+        if (q >= verbatim_len * 8) {
+            w.overflow = true; // Pathological residual; verbatim will be smaller
+            break;
+        }
+        bit_writer_put_unary(w, q);
+        if (k > 0) {
+            bit_writer_put(w, u, k);
+        }
+    }
+
+    size_t encoded_len = bit_writer_flush(w);
+    if (encoded_len == 0) {
+        return write_verbatim_block(pcm, num_samples, out);
+    }
+    return encoded_len;
+}
+
+void reset_lossless_stream() {
+    s_lossless_sequence = 0;
+}
+
+size_t process_and_send_lossless_audio(BleChannel channel, const int16_t *pcm, size_t num_samples, int64_t first_sample_us) {
+    if (!pcm || num_samples > (size_t)LOSSLESS_BLOCK_SAMPLES) {
+        return 0;
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    size_t encoded = lossless_encode_block(pcm, num_samples, s_lossless_packet, sizeof(s_lossless_packet));
+    s_lossless_encode_time_us += (uint64_t)(esp_timer_get_time() - start_us);
+
+    if (encoded == 0) {
+        logger_printf("[LOSSLESS] ERROR: Failed to encode block.\n");
+        return 0;
+    }
+
+    s_lossless_blocks_encoded++;
+    s_lossless_input_bytes += num_samples * sizeof(int16_t);
+    s_lossless_output_bytes += encoded;
+    if (s_lossless_blocks_encoded % LOSSLESS_STATS_LOG_BLOCKS == 0) {
+        logger_printf("[LOSSLESS] Blocks: %u | Ratio: %u.%02u | Encode avg: %u us per %d-sample block\n",
+                      s_lossless_blocks_encoded,
+                      (uint32_t)(s_lossless_input_bytes / s_lossless_output_bytes),
+                      (uint32_t)((s_lossless_input_bytes * 100 / s_lossless_output_bytes) % 100),
+                      (uint32_t)(s_lossless_encode_time_us / s_lossless_blocks_encoded),
+                      LOSSLESS_BLOCK_SAMPLES);
+    }
+
+    BleSessionMask live = audio_replay_capture(channel, s_lossless_sequence, (uint32_t)first_sample_us, s_lossless_packet, encoded);
+    notify_framed_audio_packet(channel, live, s_lossless_sequence, (uint32_t)first_sample_us, s_lossless_packet, encoded);
+    s_lossless_sequence++;
+    return encoded;
+}
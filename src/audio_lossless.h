@@ -0,0 +1,35 @@
+#ifndef AUDIO_LOSSLESS_H
+#define AUDIO_LOSSLESS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "ble_transport.h" // For BleChannel
+
+// Lossless 16-bit PCM compression in the style of FLAC: each block picks the fixed
+// linear predictor (order 0-4) with the smallest residual and Rice-codes the residual.
+// Blocks are self-contained so a client can decode each one as soon as it arrives.
+//
+// Block layout:
+//   byte 0     predictor order (0-4), or LOSSLESS_ORDER_VERBATIM for raw PCM
+//   byte 1     Rice parameter k
+//   bytes 2-3  number of samples (little-endian)
+//   then       'order' warm-up samples as int16 LE, followed by the Rice bitstream (MSB first).
+//              Each residual is zigzag-mapped, then coded as (u >> k) one-bits, a zero-bit,
+//              and the low k bits of u.
+constexpr uint8_t LOSSLESS_ORDER_VERBATIM = 0xFF;
+
+// Encodes one block of PCM samples. Returns the number of bytes written to 'out', or 0 if
+// the arguments are invalid. Never writes more than LOSSLESS_BLOCK_HEADER_LEN + 2 * num_samples
+// bytes, falling back to verbatim PCM when compression would not help.
+// This is a pure function with no hardware dependencies.
+size_t lossless_encode_block(const int16_t *pcm, size_t num_samples, uint8_t *out, size_t out_capacity);
+
+// Compresses one block of PCM and sends it over BLE, stamped with the device time of its
+// first sample. Returns the number of encoded bytes sent.
+size_t process_and_send_lossless_audio(BleChannel channel, const int16_t *pcm, size_t num_samples, int64_t first_sample_us);
+
+// Resets the sequence number (e.g. on new subscription)
+void reset_lossless_stream();
+
+#endif // AUDIO_LOSSLESS_H
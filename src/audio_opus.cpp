@@ -0,0 +1,137 @@
+#include "config.h"
+#include "audio_opus.h"
+#include "audio_replay.h"
+#include "ble_handler.h" // For notify_framed_audio_packet
+#include "logger.h"
+#include <Arduino.h>
+#include <string.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+
+#if __has_include(<opus.h>)
+#include <opus.h>
+#define OPUS_CODEC_AVAILABLE 1
+#else
+#define OPUS_CODEC_AVAILABLE 0
+#endif
+
+// Number of frames between encoder statistics log lines (250 x 20ms = 5s)
+static const uint32_t OPUS_STATS_LOG_FRAMES = 250;
+
+static uint16_t s_opus_sequence = 0;
+
+#if OPUS_CODEC_AVAILABLE
+// Encoder state is allocated once from internal RAM and never freed.
+static OpusEncoder *s_opus_encoder = nullptr;
+static uint32_t s_opus_sample_rate = 0;
+
+// All working buffers are static so the streaming path never allocates.
+static uint8_t s_opus_packet[OPUS_MAX_PACKET_BYTES];
+
+// Encoder statistics
+static uint32_t s_opus_frames_encoded = 0;
+static uint64_t s_opus_encode_time_us = 0;
+static uint32_t s_opus_encode_time_max_us = 0;
+static uint32_t s_opus_encoded_bytes = 0;
+#endif
+
+bool initialize_opus_encoder(uint32_t sample_rate) {
+#if OPUS_CODEC_AVAILABLE
+    if (s_opus_encoder != nullptr && s_opus_sample_rate == sample_rate) {
+        return true;
+    }
+
+    int state_size = opus_encoder_get_size(1);
+    if (state_size <= 0 || (size_t)state_size > OPUS_ENCODER_STATE_BUDGET) {
+        logger_printf("[OPUS] ERROR: Encoder state (%d bytes) exceeds budget (%zu bytes).\n", state_size, OPUS_ENCODER_STATE_BUDGET);
+        return false;
+    }
+
+    // Keep the state in internal RAM; the encoder touches it on every frame.
+    if (s_opus_encoder == nullptr) {
+        s_opus_encoder = (OpusEncoder *)heap_caps_malloc(state_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (!s_opus_encoder) {
+            logger_printf("[OPUS] ERROR: Failed to allocate encoder state!\n");
+            return false;
+        }
+    }
+
+    int err = opus_encoder_init(s_opus_encoder, sample_rate, 1, OPUS_APPLICATION_VOIP);
+    if (err != OPUS_OK) {
+        logger_printf("[OPUS] ERROR: opus_encoder_init failed: %d\n", err);
+        heap_caps_free(s_opus_encoder);
+        s_opus_encoder = nullptr;
+        s_opus_sample_rate = 0;
+        return false;
+    }
+    s_opus_sample_rate = sample_rate;
+
+    // Speech-only configuration keeps the encoder in SILK mode.
+    opus_encoder_ctl(s_opus_encoder, OPUS_SET_BITRATE(OPUS_BITRATE_BPS));
+    opus_encoder_ctl(s_opus_encoder, OPUS_SET_COMPLEXITY(OPUS_COMPLEXITY));
+    opus_encoder_ctl(s_opus_encoder, OPUS_SET_SIGNAL(OPUS_SIGNAL_VOICE));
+    opus_encoder_ctl(s_opus_encoder, OPUS_SET_BANDWIDTH(sample_rate >= 16000 ? OPUS_BANDWIDTH_WIDEBAND : OPUS_BANDWIDTH_NARROWBAND));
+    opus_encoder_ctl(s_opus_encoder, OPUS_SET_VBR(1));
+    opus_encoder_ctl(s_opus_encoder, OPUS_SET_DTX(0));
+
+    logger_printf("[OPUS] Encoder initialized (%d bytes state, %u Hz, %d bps, complexity %d).\n", state_size, sample_rate, OPUS_BITRATE_BPS, OPUS_COMPLEXITY);
+    return true;
+#else
+    logger_printf("[OPUS] ERROR: Opus library not available in this build.\n");
+    return false;
+#endif
+}
+
+void reset_opus_stream() {
+    s_opus_sequence = 0;
+#if OPUS_CODEC_AVAILABLE
+    if (s_opus_encoder) {
+        opus_encoder_ctl(s_opus_encoder, OPUS_RESET_STATE);
+    }
+#endif
+}
+
+size_t process_and_send_opus_audio(BleChannel channel, const int16_t *pcm, size_t num_samples, int64_t first_sample_us) {
+#if OPUS_CODEC_AVAILABLE
+    if (!s_opus_encoder || !pcm || num_samples != s_opus_sample_rate * OPUS_FRAME_MS / 1000) {
+        return 0;
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    opus_int32 encoded = opus_encode(s_opus_encoder, pcm, (int)num_samples, s_opus_packet, sizeof(s_opus_packet));
+    uint32_t elapsed_us = (uint32_t)(esp_timer_get_time() - start_us);
+
+    if (encoded < 0) {
+        logger_printf("[OPUS] ERROR: opus_encode failed: %d\n", (int)encoded);
+        return 0;
+    }
+
+    s_opus_frames_encoded++;
+    s_opus_encode_time_us += elapsed_us;
+    s_opus_encoded_bytes += (uint32_t)encoded;
+    if (elapsed_us > s_opus_encode_time_max_us) {
+        s_opus_encode_time_max_us = elapsed_us;
+    }
+    if (s_opus_frames_encoded % OPUS_STATS_LOG_FRAMES == 0) {
+        logger_printf("[OPUS] Frames: %u | Encode avg: %u us, max: %u us per %d ms frame | Avg packet: %u bytes\n",
+                      s_opus_frames_encoded,
+                      (uint32_t)(s_opus_encode_time_us / s_opus_frames_encoded),
+                      s_opus_encode_time_max_us,
+                      OPUS_FRAME_MS,
+                      s_opus_encoded_bytes / s_opus_frames_encoded);
+    }
+
+    // A 1-byte packet is a DTX/silence frame; still send it so sequence numbers stay contiguous.
+    // Every packet also goes into the replay ring; sessions catching up on a backlog get it from there.
+    BleSessionMask live = audio_replay_capture(channel, s_opus_sequence, (uint32_t)first_sample_us, s_opus_packet, (size_t)encoded);
+    notify_framed_audio_packet(channel, live, s_opus_sequence, (uint32_t)first_sample_us, s_opus_packet, (size_t)encoded);
+    s_opus_sequence++;
+    return (size_t)encoded;
+#else
+    (void)channel;
+    (void)pcm;
+    (void)num_samples;
+    (void)first_sample_us;
+    return 0;
+#endif
+}
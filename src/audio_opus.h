@@ -0,0 +1,23 @@
+#ifndef AUDIO_OPUS_H
+#define AUDIO_OPUS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "ble_handler.h"
+
+// Opus (SILK) low-bitrate speech encoding. Each 20ms frame is sent as one or more
+// notifications prefixed with a 2-byte sequence number and a 1-byte fragment index.
+
+// Allocates the encoder state (once) and configures it for speech at the given sample rate
+// (8000 or 16000). Returns false if the Opus library is not available or the state does
+// not fit the memory budget.
+bool initialize_opus_encoder(uint32_t sample_rate);
+
+// Encodes one OPUS_FRAME_MS frame of PCM and sends it over BLE, stamped with the device
+// time of its first sample. Returns the number of encoded bytes sent.
+size_t process_and_send_opus_audio(BleChannel channel, const int16_t *pcm, size_t num_samples, int64_t first_sample_us);
+
+// Resets the sequence number and encoder state (e.g. on new subscription)
+void reset_opus_stream();
+
+#endif // AUDIO_OPUS_H
@@ -0,0 +1,378 @@
+#include "audio_replay.h"
+#include "config.h"
+#include "ble_handler.h" // For notify_framed_audio_packet, g_is_ble_connected
+#include "ble_tx_scheduler.h" // For ble_tx_queue_space
+#include "ble_session.h" // For the session of each replay cursor
+#include "logger.h"
+#include <Arduino.h>
+#include <string.h>
+
+// Each ring entry is [sequence LE16][length LE16][timestamp LE32][encoded packet], stored with wrap-around.
+static const size_t REPLAY_ENTRY_HEADER_LEN = 8;
+
+static uint8_t *s_ring = nullptr;
+static size_t s_tail = 0;        // Offset of the oldest entry
+static size_t s_used = 0;        // Bytes in use
+static uint32_t s_packets = 0;
+static uint16_t s_oldest_sequence = 0;
+static uint16_t s_next_sequence = 0;
+static uint32_t s_frame_ms = 0;
+
+// Replay cursor of one session: next entry to send and how many entries remain up to the
+// live edge. Indexed by session slot; the session id tells a reused slot from its predecessor.
+struct ReplayCursor {
+    uint32_t session_id;
+    bool replaying;
+    size_t cursor;
+    uint32_t cursor_remaining;
+    unsigned long start_ms;
+    uint32_t bytes_sent;
+    uint32_t catchup_bytes_per_sec;
+    // Request handed over from the command dispatcher
+    volatile bool request_pending;
+    uint32_t request_session_id;
+    uint16_t request_sequence;
+    uint32_t request_rate;
+};
+static ReplayCursor s_replays[BLE_MAX_CONNECTIONS] = {};
+static size_t s_next_drain = 0; // Session served first on the next drain, for round-robin
+static uint32_t s_catchup_bytes_per_sec = AUDIO_REPLAY_CATCHUP_BYTES_PER_SEC; // Of the last request
+
+// Pinned for a reader outside the audio task (see audio_replay_pin)
+static volatile bool s_pinned = false;
+static volatile bool s_restart_pending = false;
+static uint32_t s_pinned_drops = 0;
+
+// Statistics
+static uint32_t s_packets_replayed = 0;
+static uint32_t s_overruns = 0;
+
+// Guards the indices read by audio_replay_get_status() from other tasks
+static portMUX_TYPE s_replay_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Scratch buffer for one packet taken out of the ring
+static uint8_t s_replay_packet[AUDIO_REPLAY_MAX_PACKET_BYTES];
+
+static void ring_write(size_t offset, const uint8_t *data, size_t len) {
+    size_t first = AUDIO_REPLAY_BUFFER_BYTES - offset;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(&s_ring[offset], data, first);
+    memcpy(s_ring, data + first, len - first);
+}
+
+static void ring_read(size_t offset, uint8_t *data, size_t len) {
+    size_t first = AUDIO_REPLAY_BUFFER_BYTES - offset;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(data, &s_ring[offset], first);
+    memcpy(data + first, s_ring, len - first);
+}
+
+static size_t entry_length(size_t offset) {
+    uint8_t header[REPLAY_ENTRY_HEADER_LEN];
+    ring_read(offset, header, sizeof(header));
+    return REPLAY_ENTRY_HEADER_LEN + (header[2] | (header[3] << 8));
+}
+
+static size_t ring_advance(size_t offset, size_t len) {
+    return (offset + len) % AUDIO_REPLAY_BUFFER_BYTES;
+}
+
+bool audio_replay_init() {
+    if (AUDIO_REPLAY_BUFFER_BYTES == 0) {
+        return false;
+    }
+    if (s_ring == nullptr) {
+        s_ring = (uint8_t *)ps_malloc(AUDIO_REPLAY_BUFFER_BYTES);
+        if (!s_ring) {
+            logger_printf("[REPLAY] ERROR: Failed to allocate %u-byte replay ring in PSRAM!\n", (uint32_t)AUDIO_REPLAY_BUFFER_BYTES);
+            return false;
+        }
+        logger_printf("[REPLAY] Replay ring allocated (%u bytes).\n", (uint32_t)AUDIO_REPLAY_BUFFER_BYTES);
+    }
+    return true;
+}
+
+void audio_replay_reset(uint32_t frame_ms) {
+    portENTER_CRITICAL(&s_replay_mux);
+    s_tail = 0;
+    s_used = 0;
+    s_packets = 0;
+    s_oldest_sequence = 0;
+    s_next_sequence = 0;
+    s_frame_ms = frame_ms;
+    for (size_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        s_replays[i].replaying = false;
+        s_replays[i].cursor_remaining = 0;
+    }
+    portEXIT_CRITICAL(&s_replay_mux);
+}
+
+// Sessions with a backlog pending or in progress
+static BleSessionMask replaying_sessions() {
+    BleSessionMask mask = 0;
+    for (size_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        if (s_replays[i].replaying || s_replays[i].request_pending) {
+            mask |= (BleSessionMask)(1u << i);
+        }
+    }
+    return mask;
+}
+
+// Evicts the oldest entry. If a replay cursor is still on it, that packet is lost to its client.
+static void evict_oldest() {
+    size_t len = entry_length(s_tail);
+    portENTER_CRITICAL(&s_replay_mux);
+    for (size_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        ReplayCursor &replay = s_replays[i];
+        if (replay.replaying && replay.cursor == s_tail) {
+            replay.cursor = ring_advance(replay.cursor, len);
+            replay.cursor_remaining--;
+            s_overruns++;
+        }
+    }
+    s_tail = ring_advance(s_tail, len);
+    s_used -= len;
+    s_packets--;
+    s_oldest_sequence++;
+    portEXIT_CRITICAL(&s_replay_mux);
+}
+
+BleSessionMask audio_replay_live_sessions(BleChannel channel) {
+    if (!g_is_ble_connected) {
+        return 0;
+    }
+    return ble_session_subscribers(channel) & (BleSessionMask)~replaying_sessions();
+}
+
+BleSessionMask audio_replay_capture(BleChannel channel, uint16_t sequence, uint32_t timestamp_us, const uint8_t *packet,
+                                    size_t packet_len) {
+    if (s_restart_pending) {
+        // Packets were skipped while pinned; sequences in the ring must stay contiguous
+        s_restart_pending = false;
+        logger_printf("[REPLAY] %u packets not held while pinned. Restarting the ring.\n", s_pinned_drops);
+        audio_replay_reset(s_frame_ms);
+    }
+    BleSessionMask send_live = audio_replay_live_sessions(channel);
+    if (!s_ring || packet_len > AUDIO_REPLAY_MAX_PACKET_BYTES) {
+        return send_live;
+    }
+    if (s_pinned) {
+        s_pinned_drops++;
+        return send_live;
+    }
+
+    size_t entry_len = REPLAY_ENTRY_HEADER_LEN + packet_len;
+    while (s_packets > 0 && AUDIO_REPLAY_BUFFER_BYTES - s_used < entry_len) {
+        evict_oldest();
+    }
+
+    uint8_t header[REPLAY_ENTRY_HEADER_LEN] = {
+        (uint8_t)(sequence & 0xFF),
+        (uint8_t)((sequence >> 8) & 0xFF),
+        (uint8_t)(packet_len & 0xFF),
+        (uint8_t)((packet_len >> 8) & 0xFF),
+        (uint8_t)(timestamp_us & 0xFF),
+        (uint8_t)((timestamp_us >> 8) & 0xFF),
+        (uint8_t)((timestamp_us >> 16) & 0xFF),
+        (uint8_t)((timestamp_us >> 24) & 0xFF)
+    };
+    size_t head = ring_advance(s_tail, s_used);
+    ring_write(head, header, sizeof(header));
+    ring_write(ring_advance(head, sizeof(header)), packet, packet_len);
+
+    portENTER_CRITICAL(&s_replay_mux);
+    if (s_packets == 0) {
+        s_oldest_sequence = sequence;
+    }
+    s_used += entry_len;
+    s_packets++;
+    s_next_sequence = sequence + 1;
+    for (size_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        if (s_replays[i].replaying) {
+            s_replays[i].cursor_remaining++;
+        }
+    }
+    portEXIT_CRITICAL(&s_replay_mux);
+    return send_live;
+}
+
+bool audio_replay_request(uint16_t conn, uint16_t from_sequence, uint32_t catchup_bytes_per_sec) {
+    int index = ble_session_index(conn);
+    BleSession session;
+    if (!ble_session_get(index, &session)) {
+        return false;
+    }
+    ReplayCursor &replay = s_replays[index];
+    portENTER_CRITICAL(&s_replay_mux);
+    replay.request_session_id = session.id;
+    replay.request_sequence = from_sequence;
+    replay.request_rate = catchup_bytes_per_sec;
+    replay.request_pending = true;
+    s_catchup_bytes_per_sec = catchup_bytes_per_sec;
+    portEXIT_CRITICAL(&s_replay_mux);
+    return true;
+}
+
+// Positions the session's cursor on from_sequence. Sequences are contiguous in the ring, so the
+// number of packets the client missed is the distance to the live edge.
+static void start_replay(size_t index, uint16_t from_sequence, uint32_t catchup_bytes_per_sec) {
+    ReplayCursor &replay = s_replays[index];
+    uint32_t missed = (uint16_t)(s_next_sequence - from_sequence);
+    if (missed == 0 || s_packets == 0) {
+        logger_printf("[REPLAY] Session #%u is up to date (next sequence %u).\n", (unsigned)index, s_next_sequence);
+        return;
+    }
+    if (missed > s_packets) {
+        logger_printf("[REPLAY] %u of %u requested packets already evicted. Replaying from %u.\n",
+                      missed - s_packets, missed, s_oldest_sequence);
+        s_overruns += missed - s_packets;
+        missed = s_packets;
+    }
+
+    size_t cursor = s_tail;
+    for (uint32_t skip = s_packets - missed; skip > 0; skip--) {
+        cursor = ring_advance(cursor, entry_length(cursor));
+    }
+
+    portENTER_CRITICAL(&s_replay_mux);
+    replay.cursor = cursor;
+    replay.cursor_remaining = missed;
+    replay.catchup_bytes_per_sec = catchup_bytes_per_sec;
+    replay.replaying = true;
+    portEXIT_CRITICAL(&s_replay_mux);
+    replay.start_ms = millis();
+    replay.bytes_sent = 0;
+    logger_printf("[REPLAY] Replaying %u packets (%u ms) from sequence %u to session #%u at %u bytes/s (0 = link speed).\n",
+                  missed, missed * s_frame_ms, (uint16_t)(s_next_sequence - missed), (unsigned)index, catchup_bytes_per_sec);
+}
+
+// Sends up to max_packets of one session's backlog, to that session only
+static size_t drain_session(size_t index, BleChannel channel, size_t max_packets) {
+    ReplayCursor &replay = s_replays[index];
+    if (replay.request_pending) {
+        portENTER_CRITICAL(&s_replay_mux);
+        replay.request_pending = false;
+        replay.session_id = replay.request_session_id;
+        uint16_t from_sequence = replay.request_sequence;
+        uint32_t rate = replay.request_rate;
+        portEXIT_CRITICAL(&s_replay_mux);
+        replay.replaying = false;
+        if (s_ring) {
+            start_replay(index, from_sequence, rate);
+        }
+    }
+    if (!replay.replaying) {
+        return 0;
+    }
+    BleSession session;
+    if (!ble_session_get((int)index, &session) || session.id != replay.session_id ||
+        !(session.subscriptions & (1u << channel))) {
+        replay.replaying = false; // The client asks again after reconnecting
+        return 0;
+    }
+
+    BleSessionMask target = (BleSessionMask)(1u << index);
+    size_t sent = 0;
+    while (sent < max_packets && replay.cursor_remaining > 0) {
+        if (replay.catchup_bytes_per_sec > 0) {
+            uint32_t budget = (uint32_t)((uint64_t)replay.catchup_bytes_per_sec * (millis() - replay.start_ms) / 1000);
+            if (replay.bytes_sent > budget) {
+                break;
+            }
+        }
+
+        uint8_t header[REPLAY_ENTRY_HEADER_LEN];
+        ring_read(replay.cursor, header, sizeof(header));
+        uint16_t sequence = header[0] | (header[1] << 8);
+        size_t packet_len = header[2] | (header[3] << 8);
+        if (ble_tx_queue_space(BLE_TX_STREAM_AUDIO) < framed_audio_fragment_count(target, packet_len)) {
+            break; // Leave room for live audio; the rest goes on a later pass
+        }
+        uint32_t timestamp_us = header[4] | (header[5] << 8) | (header[6] << 16) | ((uint32_t)header[7] << 24);
+        ring_read(ring_advance(replay.cursor, sizeof(header)), s_replay_packet, packet_len);
+
+        portENTER_CRITICAL(&s_replay_mux);
+        replay.cursor = ring_advance(replay.cursor, sizeof(header) + packet_len);
+        replay.cursor_remaining--;
+        portEXIT_CRITICAL(&s_replay_mux);
+
+        notify_framed_audio_packet(channel, target, sequence, timestamp_us, s_replay_packet, packet_len);
+        replay.bytes_sent += packet_len;
+        s_packets_replayed++;
+        sent++;
+    }
+
+    if (replay.cursor_remaining == 0) {
+        replay.replaying = false;
+        logger_printf("[REPLAY] Session #%u caught up in %lu ms (%u bytes). Resuming live audio.\n",
+                      (unsigned)index, millis() - replay.start_ms, replay.bytes_sent);
+    }
+    return sent;
+}
+
+size_t audio_replay_drain(BleChannel channel, size_t max_packets) {
+    size_t sent = 0;
+    for (size_t n = 0; n < BLE_MAX_CONNECTIONS && sent < max_packets; n++) {
+        sent += drain_session((s_next_drain + n) % BLE_MAX_CONNECTIONS, channel, max_packets - sent);
+    }
+    s_next_drain = (s_next_drain + 1) % BLE_MAX_CONNECTIONS;
+    return sent;
+}
+
+size_t audio_replay_pin(const uint8_t *spans[2], size_t lens[2]) {
+    if (!s_ring) {
+        return 0;
+    }
+    s_pinned_drops = 0;
+    portENTER_CRITICAL(&s_replay_mux);
+    s_pinned = true;
+    size_t tail = s_tail;
+    size_t used = s_used;
+    portEXIT_CRITICAL(&s_replay_mux);
+    if (used == 0) {
+        return 0;
+    }
+    size_t first = AUDIO_REPLAY_BUFFER_BYTES - tail;
+    if (first > used) {
+        first = used;
+    }
+    spans[0] = &s_ring[tail];
+    lens[0] = first;
+    if (first == used) {
+        return 1;
+    }
+    spans[1] = s_ring;
+    lens[1] = used - first;
+    return 2;
+}
+
+void audio_replay_unpin() {
+    if (!s_pinned) {
+        return;
+    }
+    s_pinned = false;
+    if (s_pinned_drops > 0) {
+        s_restart_pending = true; // Done by the audio task on its next capture
+    }
+}
+
+AudioReplayStatus audio_replay_get_status() {
+    AudioReplayStatus status;
+    portENTER_CRITICAL(&s_replay_mux);
+    status.oldest_sequence = s_oldest_sequence;
+    status.next_sequence = s_next_sequence;
+    status.packets = s_packets;
+    status.held_bytes = s_used;
+    status.held_ms = s_packets * s_frame_ms;
+    status.catchup_bytes_per_sec = s_catchup_bytes_per_sec;
+    status.replaying = replaying_sessions() != 0;
+    status.packets_replayed = s_packets_replayed;
+    status.overruns = s_overruns;
+    portEXIT_CRITICAL(&s_replay_mux);
+    status.capacity_bytes = s_ring ? AUDIO_REPLAY_BUFFER_BYTES : 0;
+    return status;
+}
@@ -0,0 +1,64 @@
+#ifndef AUDIO_REPLAY_H
+#define AUDIO_REPLAY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "ble_transport.h" // For BleChannel
+#include "ble_session.h"   // For BleSessionMask
+
+// Rolling PSRAM ring of recently encoded audio packets (all framed modes), keyed by
+// their frame sequence number. Packets keep being captured while the client is away, and
+// after a reconnect the client can ask for the backlog from a given sequence number. Each
+// session has its own replay cursor: the backlog is streamed to the session that asked for
+// it until it catches up, while the other sessions keep receiving live audio.
+
+struct AudioReplayStatus {
+    uint16_t oldest_sequence;      // Oldest packet still held
+    uint16_t next_sequence;        // Sequence of the next captured packet
+    uint32_t packets;              // Packets held
+    uint32_t held_bytes;           // Ring bytes in use, including per-packet headers
+    uint32_t capacity_bytes;       // Memory ceiling (AUDIO_REPLAY_BUFFER_BYTES)
+    uint32_t held_ms;              // Audio time held
+    uint32_t catchup_bytes_per_sec; // Backlog streaming rate of the last request, 0 = link speed
+    bool replaying;                // A backlog is being streamed to some session
+    uint32_t packets_replayed;
+    uint32_t overruns;             // Backlog packets evicted before they could be replayed
+};
+
+// Allocates the ring in PSRAM on first use. Returns false if replay is disabled or out of memory.
+bool audio_replay_init();
+
+// Drops everything held, e.g. when the codec or frame duration changes.
+void audio_replay_reset(uint32_t frame_ms);
+
+// Stores one encoded packet with its first-sample time (low 32 bits of the device timebase),
+// so replayed packets keep their original timestamps. Returns the sessions the packet should
+// also be sent to live now (see audio_replay_live_sessions).
+BleSessionMask audio_replay_capture(BleChannel channel, uint16_t sequence, uint32_t timestamp_us, const uint8_t *packet,
+                                    size_t packet_len);
+
+// Subscribers of the channel that follow live audio: all of them except sessions with a
+// backlog pending or in progress, which get packets from the ring in order instead.
+BleSessionMask audio_replay_live_sessions(BleChannel channel);
+
+// Requests the backlog starting at from_sequence for the connection's session. Safe to call
+// from another task; the audio task picks it up on its next pass. catchup_bytes_per_sec of 0
+// streams at link speed. Returns false if the connection has no session.
+bool audio_replay_request(uint16_t conn, uint16_t from_sequence, uint32_t catchup_bytes_per_sec);
+
+// Sends up to max_packets backlog packets on the channel, shared round-robin between the
+// sessions catching up, each honouring its catch-up rate. Returns the number of packets
+// sent. Called from the audio task.
+size_t audio_replay_drain(BleChannel channel, size_t max_packets);
+
+// Holds the ring still for a reader outside the audio task (the Wi-Fi offload): until
+// audio_replay_unpin(), new packets are not stored, and if any were skipped the ring starts
+// over afterwards. Fills up to two spans with the held entries, oldest first, each
+// [sequence LE16][length LE16][timestamp LE32][packet]. Returns the number of spans.
+size_t audio_replay_pin(const uint8_t *spans[2], size_t lens[2]);
+void audio_replay_unpin();
+
+AudioReplayStatus audio_replay_get_status();
+
+#endif // AUDIO_REPLAY_H
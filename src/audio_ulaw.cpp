@@ -1,18 +1,290 @@
 #include "config.h"
 #include "audio_ulaw.h"
 #include "audio_handler.h"
-#include "ble_handler.h" // For g_audio_data_characteristic
+#include "audio_opus.h"
+#include "audio_lossless.h"
+#include "audio_logmel.h"
+#include "audio_vad.h"
+#include "audio_dsp.h"
+#include "audio_decimator.h"
+#include "audio_replay.h"
+#include "ble_tx_scheduler.h"
+#include "ble_link.h" // For the audio connection mode
+#include "ble_handler.h" // For framed notifications
+#include "param_registry.h" // For the u-law packet size
+#include "pm_lock.h" // For full CPU speed while encoding
 #include "logger.h"
 #include <Arduino.h>
 #include <stdint.h>
 #include <string.h>
-#include <BLE2902.h> // For BLE2902 descriptor
 
 // Task handle for the audio streaming task
 static TaskHandle_t ulaw_streaming_task_handle = nullptr;
 
+// Set by stop_ulaw_streaming_task. The task releases the microphone between reads and then
+// blocks until start_ulaw_streaming_task clears it and notifies the task.
+static volatile bool s_audio_stop_requested = false;
+
+volatile AudioCodecMode g_audio_codec_mode = AUDIO_CODEC_ULAW;
+volatile uint32_t g_audio_output_sample_rate = AUDIO_DEFAULT_OUTPUT_SAMPLE_RATE;
+
+// Set when the codec or output rate changes so the task rebuilds its pipeline state.
+static volatile bool s_audio_pipeline_dirty = true;
+
+// Largest frame of any codec mode, before decimation. PCM is collected here until a full
+// frame is ready; decimated output goes to a separate buffer.
+static_assert(AUDIO_MAX_INPUT_FRAME_SAMPLES >= 2 * (size_t)LOSSLESS_BLOCK_SAMPLES &&
+              AUDIO_MAX_INPUT_FRAME_SAMPLES >= (size_t)OPUS_FRAME_SAMPLES && AUDIO_MAX_INPUT_FRAME_SAMPLES >= 2 * (size_t)FRAME_SIZE &&
+              AUDIO_MAX_INPUT_FRAME_SAMPLES >= (size_t)(SAMPLE_RATE * LOGMEL_HOP_MS / 1000),
+              "Audio frame buffer must hold a frame of every codec mode");
+static int16_t s_audio_frame[AUDIO_MAX_INPUT_FRAME_SAMPLES];
+static size_t s_audio_frame_fill = 0;
+
+// 16kHz -> 8kHz decimation, used when the client selects an 8kHz output rate
+static DecimatorState s_decimator_state;
+static int16_t s_decimated_frame[AUDIO_MAX_INPUT_FRAME_SAMPLES / 2];
+static uint64_t s_decimator_cycles = 0;
+static uint32_t s_decimator_frames = 0;
+
+// DSP front-end state and its per-frame cost
+static AudioDspState s_dsp_state;
+static uint64_t s_dsp_cycles = 0;
+static uint32_t s_dsp_frames = 0;
+
+// Voice activity gating. Silent frames wait in the pre-roll ring; frames that fall out of
+// it are reported to the client as silence markers instead of being sent.
+static VadState s_vad_state;
+static int16_t s_preroll_ring[VAD_PREROLL_SAMPLES];
+static int64_t s_preroll_timestamps[VAD_PREROLL_SAMPLES / FRAME_SIZE]; // FRAME_SIZE is the smallest frame of any mode
+static size_t s_preroll_capacity = 0; // Frames the ring holds for the current frame size
+static size_t s_preroll_head = 0;     // Slot of the oldest frame
+static size_t s_preroll_count = 0;
+static uint32_t s_pending_silence_ms = 0;
+static AudioVadStats s_vad_stats = {};
+
+// Replay ring for framed packets; capture continues through short disconnects
+static bool s_replay_enabled = false;
+
+static unsigned long s_last_stats_log_ms = 0;
+static MicCaptureStats s_last_mic_stats = {};
+static unsigned long s_last_mic_stats_ms = 0;
+
 // Forward declaration
-void process_and_send_ulaw_audio(BLECharacteristic *audio_characteristic);
+void process_and_send_ulaw_audio(BleChannel channel, const int16_t *pcm, size_t num_samples);
+
+// Samples per encoded frame at the output sample rate
+static size_t codec_frame_samples(AudioCodecMode codec, uint32_t sample_rate) {
+    switch (codec) {
+        case AUDIO_CODEC_OPUS: return sample_rate * OPUS_FRAME_MS / 1000;
+        case AUDIO_CODEC_LOSSLESS: return LOSSLESS_BLOCK_SAMPLES;
+        case AUDIO_CODEC_LOGMEL: return sample_rate * LOGMEL_HOP_MS / 1000;
+        default: return FRAME_SIZE;
+    }
+}
+
+// Opus, lossless and log-mel packets carry sequence numbers and can be replayed after a reconnect
+static bool codec_is_framed(AudioCodecMode codec) {
+    return codec == AUDIO_CODEC_OPUS || codec == AUDIO_CODEC_LOSSLESS || codec == AUDIO_CODEC_LOGMEL;
+}
+
+// Lossless promises every sample, so it is only gated when explicitly configured
+static bool codec_uses_vad(AudioCodecMode codec) {
+    return AUDIO_VAD_ENABLED && (codec != AUDIO_CODEC_LOSSLESS || AUDIO_VAD_LOSSLESS);
+}
+
+static BleChannel codec_channel(AudioCodecMode codec) {
+    switch (codec) {
+        case AUDIO_CODEC_OPUS: return BLE_CHANNEL_AUDIO_OPUS;
+        case AUDIO_CODEC_LOSSLESS: return BLE_CHANNEL_AUDIO_LOSSLESS;
+        case AUDIO_CODEC_LOGMEL: return BLE_CHANNEL_AUDIO_LOGMEL;
+        default: return BLE_CHANNEL_AUDIO_ULAW;
+    }
+}
+
+// Encodes and sends one frame stamped with the device time of its first sample.
+// Returns the number of payload bytes sent.
+static size_t send_audio_frame(AudioCodecMode codec, const int16_t *pcm, size_t num_samples, int64_t first_sample_us) {
+    BleChannel channel = codec_channel(codec);
+    size_t bytes_sent = 0;
+    switch (codec) {
+        case AUDIO_CODEC_OPUS:
+            bytes_sent = process_and_send_opus_audio(channel, pcm, num_samples, first_sample_us);
+            break;
+        case AUDIO_CODEC_LOSSLESS:
+            bytes_sent = process_and_send_lossless_audio(channel, pcm, num_samples, first_sample_us);
+            break;
+        case AUDIO_CODEC_LOGMEL:
+            bytes_sent = process_and_send_logmel_features(channel, pcm, num_samples, first_sample_us);
+            break;
+        default:
+            process_and_send_ulaw_audio(channel, pcm, num_samples);
+            bytes_sent = num_samples; // One byte per sample
+            break;
+    }
+    s_vad_stats.frames_sent++;
+    s_vad_stats.bytes_sent += bytes_sent;
+    return bytes_sent;
+}
+
+static void reset_audio_pipeline(AudioCodecMode codec, uint32_t sample_rate) {
+    if (codec == AUDIO_CODEC_OPUS) {
+        initialize_opus_encoder(sample_rate);
+        reset_opus_stream();
+    } else if (codec == AUDIO_CODEC_LOSSLESS) {
+        reset_lossless_stream();
+    } else if (codec == AUDIO_CODEC_LOGMEL) {
+        initialize_logmel(sample_rate);
+        reset_logmel_stream();
+    }
+
+    size_t frame_samples = codec_frame_samples(codec, sample_rate);
+    s_audio_frame_fill = 0;
+    audio_dsp_reset(s_dsp_state);
+    decimator_reset(s_decimator_state);
+    vad_reset(s_vad_state);
+    s_preroll_capacity = VAD_PREROLL_SAMPLES / frame_samples;
+    size_t frame_ms = frame_samples * 1000 / sample_rate;
+    size_t wanted = (VAD_PREROLL_MS + frame_ms - 1) / frame_ms;
+    if (wanted < s_preroll_capacity) {
+        s_preroll_capacity = wanted;
+    }
+    s_preroll_head = 0;
+    s_preroll_count = 0;
+    s_pending_silence_ms = 0;
+    audio_replay_reset(frame_ms);
+}
+
+static void flush_silence_marker(AudioCodecMode codec) {
+    // Dropped frames left a gap; the next feature window starts after it
+    if (s_pending_silence_ms > 0 && codec == AUDIO_CODEC_LOGMEL) {
+        clear_logmel_window();
+    }
+    // The replay ring only holds packets; a marker to a session catching up would arrive out of order
+    BleSessionMask sessions = audio_replay_live_sessions(codec_channel(codec));
+    if (sessions == 0) {
+        s_pending_silence_ms = 0;
+        return;
+    }
+    while (s_pending_silence_ms > 0) {
+        uint16_t marker_ms = (s_pending_silence_ms > VAD_SILENCE_MARKER_MAX_MS) ? VAD_SILENCE_MARKER_MAX_MS : (uint16_t)s_pending_silence_ms;
+        notify_audio_silence_marker(codec_channel(codec), sessions, marker_ms);
+        s_pending_silence_ms -= marker_ms;
+        s_vad_stats.markers_sent++;
+    }
+}
+
+// Runs one complete frame through the voice activity gate and sends what is needed.
+static void stream_audio_frame(AudioCodecMode codec, const int16_t *pcm, size_t num_samples, uint32_t sample_rate, int64_t first_sample_us) {
+    if (!codec_uses_vad(codec)) {
+        send_audio_frame(codec, pcm, num_samples, first_sample_us);
+        return;
+    }
+
+    uint32_t frame_ms = num_samples * 1000 / sample_rate;
+    bool speech = vad_process_frame(s_vad_state, pcm, num_samples, sample_rate);
+
+    if (!speech) {
+        // Hold the frame as pre-roll. The oldest held frame is dropped as silence.
+        if (s_preroll_count == s_preroll_capacity) {
+            s_preroll_head = (s_preroll_head + 1) % s_preroll_capacity;
+            s_preroll_count--;
+            s_pending_silence_ms += frame_ms;
+            s_vad_stats.silence_ms += frame_ms;
+            if (s_vad_stats.frames_sent > 0) {
+                s_vad_stats.bytes_suppressed += s_vad_stats.bytes_sent / s_vad_stats.frames_sent;
+            }
+            if (s_pending_silence_ms >= VAD_SILENCE_MARKER_MAX_MS) {
+                flush_silence_marker(codec);
+            }
+        }
+        if (s_preroll_capacity > 0) {
+            size_t slot = (s_preroll_head + s_preroll_count) % s_preroll_capacity;
+            memcpy(&s_preroll_ring[slot * num_samples], pcm, num_samples * sizeof(int16_t));
+            s_preroll_timestamps[slot] = first_sample_us;
+            s_preroll_count++;
+        } else {
+            s_pending_silence_ms += frame_ms;
+            s_vad_stats.silence_ms += frame_ms;
+        }
+        return;
+    }
+
+    // Speech: report the silence so far, then send the pre-roll ahead of this frame.
+    flush_silence_marker(codec);
+    while (s_preroll_count > 0) {
+        send_audio_frame(codec, &s_preroll_ring[s_preroll_head * num_samples], num_samples, s_preroll_timestamps[s_preroll_head]);
+        s_vad_stats.speech_ms += frame_ms;
+        s_preroll_head = (s_preroll_head + 1) % s_preroll_capacity;
+        s_preroll_count--;
+    }
+    send_audio_frame(codec, pcm, num_samples, first_sample_us);
+    s_vad_stats.speech_ms += frame_ms;
+}
+
+AudioVadStats get_audio_vad_stats() {
+    return s_vad_stats;
+}
+
+bool set_audio_output_sample_rate(uint32_t sample_rate) {
+    if (sample_rate != (uint32_t)SAMPLE_RATE && sample_rate != (uint32_t)SAMPLE_RATE / 2) {
+        logger_printf("[AUDIO] Unsupported output sample rate: %u Hz\n", sample_rate);
+        return false;
+    }
+    if (sample_rate != g_audio_output_sample_rate) {
+        g_audio_output_sample_rate = sample_rate;
+        s_audio_pipeline_dirty = true;
+        update_audio_format_characteristic();
+        logger_printf("[AUDIO] Output sample rate set to %u Hz.\n", sample_rate);
+    }
+    return true;
+}
+
+static void log_audio_stats(size_t frame_samples) {
+    logger_printf("[DSP] Avg: %u cycles per %u-sample frame | Input RMS: %u | AGC gain: %u/256\n",
+                  s_dsp_frames ? (uint32_t)(s_dsp_cycles / s_dsp_frames) : 0,
+                  (unsigned)frame_samples,
+                  s_dsp_state.last_rms,
+                  s_dsp_state.agc_gain_q8);
+    if (s_decimator_frames > 0) {
+        logger_printf("[DSP] Decimator avg: %u cycles per %u-sample input frame\n",
+                      (uint32_t)(s_decimator_cycles / s_decimator_frames),
+                      (unsigned)frame_samples);
+    }
+
+    // Capture rates over the last interval. Each wake is one sleep on a DMA block, so with
+    // frames smaller than a block several frames are handled per wake.
+    MicCaptureStats mic = get_microphone_stats();
+    uint32_t elapsed_ms = millis() - s_last_mic_stats_ms;
+    if (elapsed_ms > 0) {
+        logger_printf("[MIC] DMA: %u x %u samples | Blocks: %u/s | Task wakes: %u/s | Overflows: %u (+%u) | Timeouts: %u\n",
+                      I2S_DMA_DESC_NUM, I2S_DMA_FRAME_SAMPLES,
+                      (uint32_t)((uint64_t)(mic.dma_blocks - s_last_mic_stats.dma_blocks) * 1000 / elapsed_ms),
+                      (uint32_t)((uint64_t)(mic.task_wakes - s_last_mic_stats.task_wakes) * 1000 / elapsed_ms),
+                      mic.dma_overflows,
+                      mic.dma_overflows - s_last_mic_stats.dma_overflows,
+                      mic.read_timeouts);
+    }
+    s_last_mic_stats = mic;
+    s_last_mic_stats_ms = millis();
+
+    if (s_replay_enabled) {
+        AudioReplayStatus replay = audio_replay_get_status();
+        logger_printf("[REPLAY] Held: %u packets, %u ms, %u/%u bytes | Replayed: %u | Overruns: %u%s\n",
+                      replay.packets, replay.held_ms, replay.held_bytes, replay.capacity_bytes,
+                      replay.packets_replayed, replay.overruns, replay.replaying ? " | Catching up" : "");
+    }
+
+    if (AUDIO_VAD_ENABLED) {
+        uint32_t total_ms = s_vad_stats.speech_ms + s_vad_stats.silence_ms;
+        logger_printf("[VAD] Speech: %u ms | Silence: %u ms (%u%%) | Sent: %u bytes | Saved: ~%u bytes | Markers: %u\n",
+                      s_vad_stats.speech_ms,
+                      s_vad_stats.silence_ms,
+                      total_ms ? (uint32_t)((uint64_t)s_vad_stats.silence_ms * 100 / total_ms) : 0,
+                      s_vad_stats.bytes_sent,
+                      s_vad_stats.bytes_suppressed,
+                      s_vad_stats.markers_sent);
+    }
+}
 
 // The actual FreeRTOS task for streaming audio
 void ulaw_streaming_task(void *pvParameters) {
@@ -21,18 +293,80 @@ void ulaw_streaming_task(void *pvParameters) {
     // Initialize the microphone when the task starts running
     configure_microphone();
 
+    AudioCodecMode active_codec = g_audio_codec_mode;
+    uint32_t active_rate = g_audio_output_sample_rate;
+
     while (true) {
-        // This task will be suspended when no client is subscribed, so we just
-        // need to read and send data when it's running.
-        if (g_is_ble_connected && g_audio_data_characteristic) {
-            process_and_send_ulaw_audio(g_audio_data_characteristic);
+        if (s_audio_stop_requested) {
+            // Stopped while no client is subscribed. The I2S channel is only torn down here,
+            // never in the middle of a read or a wait on its receive event.
+            deinit_microphone();
+            while (s_audio_stop_requested) {
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            }
+            configure_microphone();
+            continue;
+        }
+
+        // Framed codecs keep capturing into the replay ring while the client is briefly away
+        if (g_is_ble_connected || (s_replay_enabled && codec_is_framed(g_audio_codec_mode))) {
+            if (s_audio_pipeline_dirty || g_audio_codec_mode != active_codec || g_audio_output_sample_rate != active_rate) {
+                s_audio_pipeline_dirty = false;
+                active_codec = g_audio_codec_mode;
+                active_rate = g_audio_output_sample_rate;
+                reset_audio_pipeline(active_codec, active_rate);
+            }
+
+            // A backlog requested after a reconnect goes out ahead of live audio
+            size_t replayed = audio_replay_drain(codec_channel(active_codec), AUDIO_REPLAY_BURST_PACKETS);
+
+            // Collect a full frame for the active codec from the I2S path. At 8kHz output,
+            // twice as many microphone samples are needed per encoded frame.
+            size_t frame_samples = codec_frame_samples(active_codec, active_rate);
+            size_t input_samples = frame_samples * (SAMPLE_RATE / active_rate);
+            size_t bytes_wanted = (input_samples - s_audio_frame_fill) * sizeof(int16_t);
+            size_t bytes_recorded = read_microphone_data((uint8_t *)&s_audio_frame[s_audio_frame_fill], bytes_wanted);
+            s_audio_frame_fill += bytes_recorded / sizeof(int16_t);
+            if (s_audio_frame_fill < input_samples) {
+                // Not enough buffered yet: sleep until the DMA engine completes the next block,
+                // unless there is still backlog to send
+                if (replayed == 0) {
+                    wait_for_microphone_block(I2S_READ_TIMEOUT_MS);
+                }
+            } else {
+                s_audio_frame_fill = 0;
+
+                // The read that completed the frame ended on its last sample
+                int64_t first_sample_us = microphone_last_sample_time_us() - (int64_t)(input_samples - 1) * 1000000 / SAMPLE_RATE;
+
+                uint32_t start_cycles = ESP.getCycleCount();
+                audio_dsp_process(s_dsp_state, s_audio_frame, input_samples);
+                s_dsp_cycles += ESP.getCycleCount() - start_cycles;
+                s_dsp_frames++;
+
+                const int16_t *output = s_audio_frame;
+                if (active_rate != (uint32_t)SAMPLE_RATE) {
+                    start_cycles = ESP.getCycleCount();
+                    decimate_by_2(s_decimator_state, s_audio_frame, input_samples, s_decimated_frame);
+                    s_decimator_cycles += ESP.getCycleCount() - start_cycles;
+                    s_decimator_frames++;
+                    output = s_decimated_frame;
+                    // Each output sample is centred on the filter's taps
+                    first_sample_us -= (int64_t)(DECIMATOR_TAPS - 1) / 2 * 1000000 / SAMPLE_RATE;
+                }
+
+                stream_audio_frame(active_codec, output, frame_samples, active_rate, first_sample_us);
+            }
+
+            if (millis() - s_last_stats_log_ms >= DEBUG_LOG_INTERVAL_MS) {
+                s_last_stats_log_ms = millis();
+                log_audio_stats(input_samples);
+            }
         } else {
-            // If not connected, delay to prevent busy-waiting. The task will be
-            // suspended on disconnect anyway, but this is a safeguard.
+            // If not connected, delay to prevent busy-waiting. The task is stopped on
+            // disconnect anyway, but this is a safeguard.
             vTaskDelay(pdMS_TO_TICKS(100));
         }
-        // Delay to control the streaming rate
-        vTaskDelay(pdMS_TO_TICKS(ULAW_TASK_DELAY_MS));
     }
 }
 
@@ -79,84 +413,84 @@ static uint8_t linear_to_ulaw(int16_t pcm_val) {
     return ~ulaw_byte;
 }
 
-// This function reads raw PCM data, encodes it to u-law, and sends it over BLE.
-void process_and_send_ulaw_audio(BLECharacteristic *audio_characteristic) {
-    extern uint8_t *s_i2s_recording_buffer; // Buffer for PCM data
-    const size_t pcm_samples_to_read = FRAME_SIZE;
-    const size_t pcm_buffer_size = pcm_samples_to_read * sizeof(int16_t);
-
-    // Read a chunk of PCM data from the I2S microphone
-    size_t bytes_recorded = read_microphone_data(s_i2s_recording_buffer, pcm_buffer_size);
-
-    if (bytes_recorded > 0 && audio_characteristic) {
-        // The u-law data will be half the size of the PCM data (8-bit vs 16-bit).
-        size_t ulaw_buffer_size = bytes_recorded / 2;
-        uint8_t* ulaw_buffer = (uint8_t*)malloc(ulaw_buffer_size);
-        if (!ulaw_buffer) {
-            logger_printf("[ERROR] Failed to allocate u-law buffer!\n");
-            return;
-        }
-
-        // Cast the PCM buffer to int16_t* for easier access
-        int16_t* pcm_samples = (int16_t*)s_i2s_recording_buffer;
-        size_t num_samples = bytes_recorded / sizeof(int16_t);
-
-        // Encode each PCM sample to u-law
-        for (size_t i = 0; i < num_samples; i++) {
-            ulaw_buffer[i] = linear_to_ulaw(pcm_samples[i]);
-        }
+// This function encodes one frame of PCM data to u-law and sends it over BLE.
+void process_and_send_ulaw_audio(BleChannel channel, const int16_t *pcm, size_t num_samples) {
+    // The u-law data is half the size of the PCM data (8-bit vs 16-bit).
+    static uint8_t ulaw_buffer[FRAME_SIZE];
 
-        // --- Chunk the data before sending to respect MTU size ---
-        size_t bytes_sent = 0;
-        while (bytes_sent < ulaw_buffer_size) {
-            size_t chunk_size = ulaw_buffer_size - bytes_sent;
-            if (chunk_size > AUDIO_BLE_PACKET_SIZE) {
-                chunk_size = AUDIO_BLE_PACKET_SIZE;
-            }
+    if (!pcm || num_samples > FRAME_SIZE) {
+        return;
+    }
 
-            audio_characteristic->setValue(ulaw_buffer + bytes_sent, chunk_size);
-            audio_characteristic->notify();
+    // Encode each PCM sample to u-law
+    for (size_t i = 0; i < num_samples; i++) {
+        ulaw_buffer[i] = linear_to_ulaw(pcm[i]);
+    }
 
-            bytes_sent += chunk_size;
-            
-            // A small delay between chunks can improve reliability for some clients
-            vTaskDelay(pdMS_TO_TICKS(1));
-        }
+    // --- Chunk the data before sending to respect MTU size ---
+    BleSessionMask sessions = ble_session_subscribers(channel); // One copy for all listeners
+    size_t packet_size = param_get(PARAM_AUDIO_PACKET_SIZE);
+    size_t mtu_payload = ble_session_min_mtu(sessions) - 3;
+    if (packet_size > mtu_payload) {
+        packet_size = mtu_payload;
+    }
+    size_t bytes_sent = 0;
+    while (bytes_sent < num_samples) {
+        // Never the length of a silence marker, so the client can tell them apart
+        size_t chunk_size = vad_ulaw_chunk_len(num_samples - bytes_sent, packet_size);
 
-        // Free the temporary u-law buffer
-        free(ulaw_buffer);
+        // Pacing is left to the transmit scheduler
+        ble_tx_enqueue(BLE_TX_STREAM_AUDIO, channel, sessions, ulaw_buffer + bytes_sent, chunk_size, 0);
 
-    } else if (bytes_recorded == 0) {
-        // This can be noisy, so it's commented out.
-        // logger_printf("[AUDIO] WARN: read_microphone_data() returned 0 bytes.\n");
+        bytes_sent += chunk_size;
     }
 }
 
-void start_ulaw_streaming_task() {
+void start_ulaw_streaming_task(AudioCodecMode codec) {
+    if (codec == AUDIO_CODEC_OPUS && !initialize_opus_encoder(g_audio_output_sample_rate)) {
+        logger_printf("[AUDIO] Opus unavailable. Falling back to u-law.\n");
+        codec = AUDIO_CODEC_ULAW;
+    }
+    // The task resets its pipeline when the codec changes. Resubscribing in the same mode
+    // keeps the sequence numbers and the replay ring, so a returning client can catch up.
+    g_audio_codec_mode = codec;
+    s_replay_enabled = audio_replay_init();
+    update_audio_format_characteristic();
+    ble_link_set_audio_active(true);
+    pm_lock_hold(PM_LOCK_AUDIO);
+
     if (ulaw_streaming_task_handle == nullptr) {
         logger_printf("[TASK] Creating audio streaming task.\n");
         xTaskCreatePinnedToCore(
             ulaw_streaming_task,          // Task function
             "uLawStreamer",               // Name of the task
-            4096,                         // Stack size in words
+            AUDIO_TASK_STACK_SIZE,        // Stack size in bytes
             NULL,                         // Task input parameter
             2,                            // Priority of the task
             &ulaw_streaming_task_handle,  // Task handle
             1                             // Core where the task should run
         );
-    } else {
+    } else if (s_audio_stop_requested) {
         logger_printf("[TASK] Resuming audio streaming task.\n");
-        // Re-initialize the microphone in case it was de-initialized
-        configure_microphone();
-        vTaskResume(ulaw_streaming_task_handle);
+        // The task re-initializes the microphone itself. A stop it has not acted on yet
+        // is simply cancelled.
+        s_audio_stop_requested = false;
+        xTaskNotifyGive(ulaw_streaming_task_handle);
     }
 }
 
+bool audio_stream_outlives_disconnect(AudioCodecMode codec) {
+    return s_replay_enabled && codec_is_framed(codec) && g_audio_codec_mode == codec;
+}
+
 void stop_ulaw_streaming_task() {
     if (ulaw_streaming_task_handle != nullptr) {
-        logger_printf("[TASK] Suspending audio streaming task.\n");
-        vTaskSuspend(ulaw_streaming_task_handle);
-        // De-initialize the microphone to save power immediately
-        deinit_microphone();
+        logger_printf("[TASK] Stopping audio streaming task.\n");
+        // The task de-initializes the microphone to save power once its current read or
+        // wait returns; the notification cuts a wait for the next DMA block short.
+        s_audio_stop_requested = true;
+        xTaskNotifyGive(ulaw_streaming_task_handle);
+        ble_link_set_audio_active(false);
+        pm_lock_release(PM_LOCK_AUDIO);
     }
 }
@@ -3,17 +3,50 @@
 
 #include <stdint.h>
 #include <stddef.h>
-#include "ble_handler.h"
 
-// Only μ-law streaming is supported now
+#include "ble_transport.h" // For BleChannel
 
-// Function to process a buffer of u-law audio data and send it as μ-law encoded packets
-void process_and_send_ulaw_audio(BLECharacteristic *audio_characteristic);
+// Codec used by the audio streaming task. The mode is selected by whichever audio
+// characteristic the client subscribes to; only one mode streams at a time.
+enum AudioCodecMode {
+    AUDIO_CODEC_ULAW,
+    AUDIO_CODEC_OPUS,
+    AUDIO_CODEC_LOSSLESS,
+    AUDIO_CODEC_LOGMEL
+};
 
-// Function to start the dedicated μ-law audio streaming task
-void start_ulaw_streaming_task();
+extern volatile AudioCodecMode g_audio_codec_mode;
 
-// Function to stop the dedicated μ-law audio streaming task
+// Sample rate of the encoded stream: SAMPLE_RATE, or SAMPLE_RATE / 2 with decimation
+extern volatile uint32_t g_audio_output_sample_rate;
+
+// Selects the output sample rate (16000 or 8000). Returns false for unsupported rates.
+bool set_audio_output_sample_rate(uint32_t sample_rate);
+
+// Voice activity gating statistics for the audio stream
+struct AudioVadStats {
+    uint32_t speech_ms;        // Audio time sent (speech, hangover and pre-roll)
+    uint32_t silence_ms;       // Audio time replaced by silence markers
+    uint32_t frames_sent;
+    uint32_t bytes_sent;       // Encoded payload bytes sent
+    uint32_t bytes_suppressed; // Estimated encoded bytes not sent during silence
+    uint32_t markers_sent;
+};
+
+AudioVadStats get_audio_vad_stats();
+
+// Function to encode one frame of PCM audio and send it as μ-law encoded packets
+void process_and_send_ulaw_audio(BleChannel channel, const int16_t *pcm, size_t num_samples);
+
+// Function to start the dedicated audio streaming task in the given codec mode
+void start_ulaw_streaming_task(AudioCodecMode codec = AUDIO_CODEC_ULAW);
+
+// Function to stop the dedicated μ-law audio streaming task. The task releases the microphone
+// itself once its current read returns, then blocks until the next start.
 void stop_ulaw_streaming_task();
 
+// True if the stream in this codec keeps capturing into the replay ring while its clients are
+// away, so a disconnect must not stop it (only an explicit unsubscribe does)
+bool audio_stream_outlives_disconnect(AudioCodecMode codec);
+
 #endif // AUDIO_ULAW_H
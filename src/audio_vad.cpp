@@ -0,0 +1,79 @@
+#include "audio_vad.h"
+#include "config.h"
+
+void vad_reset(VadState &state) {
+    state.noise_floor = VAD_MIN_NOISE_FLOOR;
+    state.hangover_left_ms = 0;
+    state.initialized = false;
+    state.speech = false;
+    state.last_energy = 0;
+    state.last_zcr_per_mille = 0;
+}
+
+size_t vad_ulaw_chunk_len(size_t remaining, size_t max_len) {
+    size_t len = remaining < max_len ? remaining : max_len;
+    // One byte less; the rest goes out in the next chunk, which this rule applies to as well
+    return len == AUDIO_SILENCE_MARKER_LEN ? len - 1 : len;
+}
+
+bool vad_process_frame(VadState &state, const int16_t *pcm, size_t num_samples, uint32_t sample_rate) {
+    if (!pcm || num_samples == 0 || sample_rate == 0) {
+        return state.speech;
+    }
+
+    // Frame features: mean-square energy and zero-crossing rate
+    uint64_t sum_squares = 0;
+    uint32_t crossings = 0;
+    for (size_t i = 0; i < num_samples; i++) {
+        int32_t x = pcm[i];
+        sum_squares += (uint64_t)(x * x);
+        if (i > 0 && ((pcm[i - 1] < 0) != (x < 0))) {
+            crossings++;
+        }
+    }
+    uint32_t energy = (uint32_t)(sum_squares / num_samples);
+    uint32_t zcr_per_mille = (uint32_t)((uint64_t)crossings * 1000 / num_samples);
+    uint32_t frame_ms = (uint32_t)((uint64_t)num_samples * 1000 / sample_rate);
+
+    if (!state.initialized) {
+        state.noise_floor = (energy > VAD_MIN_NOISE_FLOOR) ? energy : VAD_MIN_NOISE_FLOOR;
+        state.initialized = true;
+    }
+
+    // Energy well above the noise floor is speech unless it looks like broadband noise
+    // (very high zero-crossing rate); loud frames count regardless, to keep fricatives.
+    uint64_t threshold = (uint64_t)state.noise_floor * VAD_ENERGY_RATIO;
+    bool active = false;
+    if (energy >= VAD_MIN_SPEECH_ENERGY && energy > threshold) {
+        active = (zcr_per_mille <= VAD_MAX_ZCR_PER_MILLE) || (energy > threshold * VAD_ENERGY_RATIO);
+    }
+
+    // Track the noise floor: follow quickly downwards, creep upwards in non-speech frames,
+    // and adapt faster to noise-like frames so steady broadband noise is not sent forever.
+    bool noise_like = zcr_per_mille > VAD_MAX_ZCR_PER_MILLE;
+    if (energy < state.noise_floor) {
+        state.noise_floor -= (state.noise_floor - energy) / 8;
+    } else if (noise_like) {
+        state.noise_floor += (energy - state.noise_floor) / 16;
+    } else if (!active) {
+        state.noise_floor += (energy - state.noise_floor) / 64;
+    }
+    if (state.noise_floor < VAD_MIN_NOISE_FLOOR) {
+        state.noise_floor = VAD_MIN_NOISE_FLOOR;
+    }
+
+    if (active) {
+        state.hangover_left_ms = VAD_HANGOVER_MS;
+        state.speech = true;
+    } else if (state.hangover_left_ms > frame_ms) {
+        state.hangover_left_ms -= frame_ms;
+        state.speech = true;
+    } else {
+        state.hangover_left_ms = 0;
+        state.speech = false;
+    }
+
+    state.last_energy = energy;
+    state.last_zcr_per_mille = zcr_per_mille;
+    return state.speech;
+}
@@ -0,0 +1,31 @@
+#ifndef AUDIO_VAD_H
+#define AUDIO_VAD_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Lightweight voice activity detector: frame energy against an adaptive noise floor,
+// with a zero-crossing-rate check to reject broadband noise, plus a hangover so short
+// pauses inside speech are not cut. It has no hardware dependencies and all state is
+// held in VadState, so it can be run over any PCM buffer (e.g. on a host).
+struct VadState {
+    uint32_t noise_floor;        // Mean-square energy of the background noise
+    uint32_t hangover_left_ms;   // Time left before falling back to silence
+    bool initialized;            // Noise floor seeded from the first frame
+    bool speech;                 // Decision for the last frame (including hangover)
+    uint32_t last_energy;        // Mean-square energy of the last frame
+    uint32_t last_zcr_per_mille; // Zero crossings per 1000 samples in the last frame
+};
+
+// Resets the detector to its initial (silence) state.
+void vad_reset(VadState &state);
+
+// Classifies one frame of PCM. Returns true if the frame should be transmitted as speech.
+bool vad_process_frame(VadState &state, const int16_t *pcm, size_t num_samples, uint32_t sample_rate);
+
+// Length of the next u-law notification when 'remaining' bytes of a frame are left to send in
+// notifications of at most max_len bytes. No chunk is ever AUDIO_SILENCE_MARKER_LEN bytes long,
+// so a notification of that length on the u-law channel is always a silence marker.
+size_t vad_ulaw_chunk_len(size_t remaining, size_t max_len);
+
+#endif // AUDIO_VAD_H
@@ -1,17 +1,15 @@
 #include "battery_handler.h"
 #include "config.h"
 #include "logger.h"
+#include "ble_transport.h" // For the battery level characteristic
+#include "ble_session.h"   // For the subscribed clients
 #include <Arduino.h> // For millis()
-#include <BLECharacteristic.h>
 
 // Define global battery state variables here
 uint8_t g_battery_level_percent = 100; // Default to 100%
 unsigned long g_last_battery_update_ms = 0;
 
-BLECharacteristic *g_battery_level_characteristic_ptr = nullptr; // Pointer to be set during BLE init
-
-void initialize_battery_handler(BLECharacteristic *ble_char) {
-    g_battery_level_characteristic_ptr = ble_char;
+void initialize_battery_handler() {
     // Initialize g_last_battery_update_ms to ensure first update happens correctly
     g_last_battery_update_ms = millis(); 
     logger_printf("[BATT] Battery handler initialized.");
@@ -20,10 +18,9 @@ void initialize_battery_handler(BLECharacteristic *ble_char) {
 void update_battery_level() {
     // TODO: Implement actual battery level reading logic here.
     // https://wiki.seeedstudio.com/check_battery_voltage/
-    if (g_battery_level_characteristic_ptr) {
-        g_battery_level_characteristic_ptr->setValue(&g_battery_level_percent, 1);
-        g_battery_level_characteristic_ptr->notify();
-    }
+    ble_transport()->set_value(BLE_CHANNEL_BATTERY_LEVEL, &g_battery_level_percent, 1);
+    ble_session_notify(ble_session_subscribers(BLE_CHANNEL_BATTERY_LEVEL), BLE_CHANNEL_BATTERY_LEVEL,
+                       &g_battery_level_percent, 1);
     logger_printf("[BATT] Level updated (static value).");
     g_last_battery_update_ms = millis();
 }
\ No newline at end of file
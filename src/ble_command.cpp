@@ -0,0 +1,158 @@
+#include "ble_command.h"
+#include "config.h" // For the default catch-up rate
+#include "param_registry.h"
+#include <string.h>
+
+static BleCommand make_command(BleCommandType type, uint16_t conn, BleChannel channel, int64_t received_us) {
+    BleCommand command;
+    memset(&command, 0, sizeof(command));
+    command.type = type;
+    command.channel = channel;
+    command.conn = conn;
+    command.received_us = received_us;
+    return command;
+}
+
+bool ble_command_decode_write(uint16_t conn, BleChannel channel, const uint8_t *data, size_t len, int64_t received_us,
+                              BleCommand *command, const char **error) {
+    const char *reason = nullptr;
+    switch (channel) {
+        case BLE_CHANNEL_PHOTO_CONTROL:
+            if (len == 1) {
+                *command = make_command(BLE_CMD_PHOTO_CONTROL, conn, channel, received_us);
+                command->photo_control = (int8_t)data[0];
+                return true;
+            }
+            reason = (len == 0) ? "received empty data" : "expected a single byte";
+            break;
+        case BLE_CHANNEL_AUDIO_FORMAT:
+            if (len == 2) {
+                *command = make_command(BLE_CMD_AUDIO_SAMPLE_RATE, conn, channel, received_us);
+                command->sample_rate = data[0] | (data[1] << 8);
+                return true;
+            }
+            reason = "expected a 2-byte sample rate";
+            break;
+        case BLE_CHANNEL_AUDIO_REPLAY:
+            if (len == 2 || len == 6) {
+                *command = make_command(BLE_CMD_AUDIO_REPLAY, conn, channel, received_us);
+                command->replay_from = data[0] | (data[1] << 8);
+                command->replay_rate = AUDIO_REPLAY_CATCHUP_BYTES_PER_SEC;
+                if (len == 6) {
+                    command->replay_rate = data[2] | (data[3] << 8) | (data[4] << 16) | ((uint32_t)data[5] << 24);
+                }
+                return true;
+            }
+            reason = "expected a 2-byte sequence (+ optional 4-byte rate)";
+            break;
+        case BLE_CHANNEL_WIFI_OFFLOAD:
+            // Validated by the offload itself, which knows whether it is running
+            if (len > 0 && len <= BLE_COMMAND_MAX_PAYLOAD) {
+                *command = make_command(BLE_CMD_WIFI_OFFLOAD, conn, channel, received_us);
+                command->payload_len = (uint8_t)len;
+                memcpy(command->payload, data, len);
+                return true;
+            }
+            reason = (len == 0) ? "expected a mode byte" : "too long";
+            break;
+        case BLE_CHANNEL_OTA_CONTROL:
+            // Validated by the OTA module, which knows whether an update is running
+            if (len > 0 && len <= BLE_COMMAND_MAX_PAYLOAD) {
+                *command = make_command(BLE_CMD_OTA_CONTROL, conn, channel, received_us);
+                command->payload_len = (uint8_t)len;
+                memcpy(command->payload, data, len);
+                return true;
+            }
+            reason = (len == 0) ? "expected a command byte" : "too long";
+            break;
+        case BLE_CHANNEL_PARAM_CONFIG:
+            // [id] selects the parameter returned by reads (PARAM_RESET_ALL restores the
+            // defaults); [id][value LE32] sets and stores it. Ranges are checked by the registry.
+            if ((len == 1 && (data[0] < PARAM_COUNT || data[0] == PARAM_RESET_ALL)) || (len == 5 && data[0] < PARAM_COUNT)) {
+                *command = make_command(BLE_CMD_PARAM_CONFIG, conn, channel, received_us);
+                command->param_id = data[0];
+                command->param_set = len == 5;
+                if (command->param_set) {
+                    command->param_value = data[1] | (data[2] << 8) | (data[3] << 16) | ((uint32_t)data[4] << 24);
+                }
+                return true;
+            }
+            reason = (len == 1 || len == 5) ? "unknown parameter id" : "expected an id (+ 4-byte value)";
+            break;
+        default:
+            reason = "not writable";
+            break;
+    }
+    if (error) {
+        *error = reason;
+    }
+    return false;
+}
+
+BleCommand ble_command_subscribe(uint16_t conn, BleChannel channel, bool enabled, int64_t received_us) {
+    BleCommand command = make_command(BLE_CMD_SUBSCRIBE, conn, channel, received_us);
+    command.enabled = enabled;
+    return command;
+}
+
+bool ble_command_dispatch(const BleCommand &command, const BleCommandHandlers &handlers) {
+    switch (command.type) {
+        case BLE_CMD_PHOTO_CONTROL:
+            if (!handlers.photo_control) {
+                return false;
+            }
+            handlers.photo_control(command.photo_control);
+            return true;
+        case BLE_CMD_SUBSCRIBE:
+            if (!handlers.subscribe) {
+                return false;
+            }
+            handlers.subscribe(command.conn, command.channel, command.enabled);
+            return true;
+        case BLE_CMD_AUDIO_SAMPLE_RATE:
+            if (!handlers.audio_sample_rate) {
+                return false;
+            }
+            handlers.audio_sample_rate(command.sample_rate);
+            return true;
+        case BLE_CMD_AUDIO_REPLAY:
+            if (!handlers.audio_replay) {
+                return false;
+            }
+            handlers.audio_replay(command.conn, command.replay_from, command.replay_rate);
+            return true;
+        case BLE_CMD_WIFI_OFFLOAD:
+            if (!handlers.wifi_offload) {
+                return false;
+            }
+            handlers.wifi_offload(command.payload, command.payload_len);
+            return true;
+        case BLE_CMD_PARAM_CONFIG:
+            if (!handlers.param_config) {
+                return false;
+            }
+            handlers.param_config(command.param_id, command.param_set, command.param_value);
+            return true;
+        case BLE_CMD_OTA_CONTROL:
+            if (!handlers.ota_control) {
+                return false;
+            }
+            handlers.ota_control(command.payload, command.payload_len);
+            return true;
+        default:
+            return false;
+    }
+}
+
+const char *ble_command_name(BleCommandType type) {
+    switch (type) {
+        case BLE_CMD_PHOTO_CONTROL:     return "PhotoControl";
+        case BLE_CMD_SUBSCRIBE:         return "Subscribe";
+        case BLE_CMD_AUDIO_SAMPLE_RATE: return "AudioFormat";
+        case BLE_CMD_AUDIO_REPLAY:      return "AudioReplay";
+        case BLE_CMD_WIFI_OFFLOAD:      return "WifiOffload";
+        case BLE_CMD_PARAM_CONFIG:      return "ParamConfig";
+        case BLE_CMD_OTA_CONTROL:       return "OtaControl";
+        default:                        return "None";
+    }
+}
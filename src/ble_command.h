@@ -0,0 +1,66 @@
+#ifndef BLE_COMMAND_H
+#define BLE_COMMAND_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "ble_transport.h" // For BleChannel
+
+// Commands written by the client, decoded in the BLE callback and carried out later by the
+// command dispatcher task (command_dispatcher.h). Decoding and dispatch are a pure module
+// with no hardware dependencies, so they can be tested on the host.
+
+enum BleCommandType : uint8_t {
+    BLE_CMD_NONE = 0,
+    BLE_CMD_PHOTO_CONTROL,     // Single byte on the photo control characteristic
+    BLE_CMD_SUBSCRIBE,         // Notifications enabled or disabled on a channel
+    BLE_CMD_AUDIO_SAMPLE_RATE, // Write to the audio format characteristic
+    BLE_CMD_AUDIO_REPLAY,      // Write to the audio replay characteristic
+    BLE_CMD_WIFI_OFFLOAD,      // Write to the Wi-Fi offload characteristic
+    BLE_CMD_PARAM_CONFIG,      // Write to the config characteristic (param_registry.h)
+    BLE_CMD_OTA_CONTROL        // Write to the OTA control characteristic (ota_update.h)
+};
+
+constexpr size_t BLE_COMMAND_MAX_PAYLOAD = 40; // Longest raw command (OTA begin: size and SHA-256)
+
+struct BleCommand {
+    BleCommandType type;
+    BleChannel channel;
+    uint16_t conn;               // Connection that wrote it (or whose subscription changed)
+    int64_t received_us;         // When the callback ran, for command-to-effect latency
+    int8_t photo_control;        // BLE_CMD_PHOTO_CONTROL
+    bool enabled;                // BLE_CMD_SUBSCRIBE
+    uint16_t sample_rate;        // BLE_CMD_AUDIO_SAMPLE_RATE
+    uint16_t replay_from;        // BLE_CMD_AUDIO_REPLAY
+    uint32_t replay_rate;        // BLE_CMD_AUDIO_REPLAY, bytes per second
+    uint8_t payload_len;         // BLE_CMD_WIFI_OFFLOAD, BLE_CMD_OTA_CONTROL: the write as received
+    uint8_t payload[BLE_COMMAND_MAX_PAYLOAD];
+    uint8_t param_id;            // BLE_CMD_PARAM_CONFIG: ParamId or PARAM_RESET_ALL
+    bool param_set;              // BLE_CMD_PARAM_CONFIG: a value follows the id (otherwise a selection)
+    uint32_t param_value;
+};
+
+// Decodes a write on a channel. Returns false and points error at the reason (e.g.
+// "expected a single byte") if the write is not a valid command. Clock-sync writes and OTA
+// image chunks are not commands; they are handled inside the callback.
+bool ble_command_decode_write(uint16_t conn, BleChannel channel, const uint8_t *data, size_t len, int64_t received_us,
+                              BleCommand *command, const char **error);
+
+BleCommand ble_command_subscribe(uint16_t conn, BleChannel channel, bool enabled, int64_t received_us);
+
+// Effects of the commands. A null handler ignores its command.
+struct BleCommandHandlers {
+    void (*photo_control)(int8_t value);
+    void (*subscribe)(uint16_t conn, BleChannel channel, bool enabled);
+    void (*audio_sample_rate)(uint16_t sample_rate);
+    void (*audio_replay)(uint16_t conn, uint16_t from_sequence, uint32_t catchup_bytes_per_sec);
+    void (*wifi_offload)(const uint8_t *data, size_t len);
+    void (*param_config)(uint8_t id, bool set, uint32_t value);
+    void (*ota_control)(const uint8_t *data, size_t len);
+};
+
+// Runs the handler of a command. Returns false if it has none.
+bool ble_command_dispatch(const BleCommand &command, const BleCommandHandlers &handlers);
+
+const char *ble_command_name(BleCommandType type);
+
+#endif // BLE_COMMAND_H
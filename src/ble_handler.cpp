@@ -4,218 +4,533 @@
 #include "audio_handler.h" // For configure_microphone, deinit_microphone
 #include "camera_handler.h" // For configure_camera, deinit_camera
 #include "audio_ulaw.h" // For μ-law streaming support
+#include "audio_replay.h" // For the audio backlog ring
+#include "timebase.h"     // For the clock-sync exchange
+#include "ble_tx_scheduler.h" // For queued notifications
+#include "ble_link.h"         // For DLE/PHY negotiation and link statistics
+#include "ble_session.h"      // For per-client MTU and subscriptions
+#include "ble_reconnect.h"    // For the advertising policy and bonding
+#include "wake_state.h"       // For the deep-sleep wake cycle
+#include "app_events.h"       // For the connection event of the main loop
+#include "wifi_offload.h"     // For the Wi-Fi offload command and status
+#include "param_registry.h"   // For the runtime parameters
+#include "param_store.h"      // For keeping parameter changes in NVS
+#include "ota_update.h"       // For firmware updates
+#include "command_dispatcher.h" // For running commands off the callback context
 #include "led_handler.h"    // For LED status indicators
 #include "logger.h"         // For thread-safe logging
 #include <Arduino.h>
-#include <BLEDevice.h>
-#include <BLE2902.h> // For BLE2902 descriptor
-#include <esp_gatts_api.h> // For esp_ble_gatts_cb_param_t
+#include <esp_heap_caps.h> // For the idle heap report
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 
-// Define global BLE variables here
-BLECharacteristic *g_photo_data_characteristic = nullptr;
-BLECharacteristic *g_photo_control_characteristic = nullptr;
-BLECharacteristic *g_audio_data_characteristic = nullptr;
-BLECharacteristic *g_battery_level_characteristic = nullptr; // This will be passed to battery_handler
-
 volatile bool g_is_ble_connected = false;
 
 // The photo streaming task handle and implementation are now moved to photo_manager.cpp
-int g_photo_chunk_payload_size = 20; // Default to a safe size for 23-byte MTU
 
-// --- ServerHandler Class Implementation ---
-void ServerHandler::onConnect(BLEServer *server)
+// Header of the framed audio notification being queued (sequence, fragment index and, in
+// fragment 0, the timestamp); the payload is copied from the packet by the scheduler
+static uint8_t s_audio_notify_header[AUDIO_FRAME_HEADER_LEN + AUDIO_PACKET_TIMESTAMP_LEN];
+
+// A framed notification of AUDIO_SILENCE_MARKER_LEN bytes cannot look like a marker as long as
+// its fragment index stays below 0xFF, even at the default MTU
+static_assert((AUDIO_REPLAY_MAX_PACKET_BYTES + AUDIO_PACKET_TIMESTAMP_LEN) / (23 - 3 - AUDIO_FRAME_HEADER_LEN) < 0xFF,
+              "Fragment indices must never reach 0xFF");
+
+// Largest framed audio payload per notification that fits every subscriber's MTU
+static size_t framed_audio_max_fragment(BleSessionMask sessions)
 {
-    g_is_ble_connected = true;
-    logger_printf("[BLE] Client connected.\n");
-    set_led_status(LED_STATUS_CONNECTED); // Set LED to green
+    // The MTU minus 3 bytes for the ATT header and the frame header
+    size_t max_fragment = ble_session_min_mtu(sessions) - 3 - AUDIO_FRAME_HEADER_LEN;
+    if (max_fragment > BLE_TX_MAX_NOTIFY_LEN - AUDIO_FRAME_HEADER_LEN) {
+        max_fragment = BLE_TX_MAX_NOTIFY_LEN - AUDIO_FRAME_HEADER_LEN;
+    }
+    if (max_fragment <= AUDIO_PACKET_TIMESTAMP_LEN) {
+        max_fragment = AUDIO_PACKET_TIMESTAMP_LEN + 1;
+    }
+    return max_fragment;
+}
 
-    // On connection, the chunk size is the default until MTU is negotiated.
-    logger_printf("[BLE] Using default chunk size: %d\n", g_photo_chunk_payload_size);
+size_t framed_audio_fragment_count(BleSessionMask sessions, size_t packet_len)
+{
+    size_t max_fragment = framed_audio_max_fragment(sessions);
+    return (AUDIO_PACKET_TIMESTAMP_LEN + packet_len + max_fragment - 1) / max_fragment;
+}
 
-    // Tasks are now managed by their own logic (e.g., subscription status or commands)
-    // and should not be blindly resumed on connection.
-    /*
-    if (photo_streaming_task_handle != nullptr) {
-        vTaskResume(photo_streaming_task_handle);
-        logger_printf("[TASK] Resumed photo streaming task.\n");
+void notify_framed_audio_packet(BleChannel channel, BleSessionMask sessions, uint16_t sequence, uint32_t timestamp_us,
+                                const uint8_t *packet, size_t packet_len)
+{
+    // One copy of each fragment serves every session
+    if (sessions == 0) {
+        return;
     }
-    */
+    size_t max_fragment = framed_audio_max_fragment(sessions);
+    size_t offset = 0;
+    uint8_t fragment_index = 0;
+
+    s_audio_notify_header[0] = (uint8_t)(sequence & 0xFF);
+    s_audio_notify_header[1] = (uint8_t)((sequence >> 8) & 0xFF);
+
+    do {
+        uint8_t *payload = &s_audio_notify_header[AUDIO_FRAME_HEADER_LEN];
+        size_t payload_len = 0;
+        if (fragment_index == 0) {
+            // The first fragment leads with the packet's first-sample time
+            for (size_t i = 0; i < AUDIO_PACKET_TIMESTAMP_LEN; i++) {
+                payload[i] = (uint8_t)((timestamp_us >> (8 * i)) & 0xFF);
+            }
+            payload_len = AUDIO_PACKET_TIMESTAMP_LEN;
+        }
+
+        size_t fragment_len = packet_len - offset;
+        if (fragment_len > max_fragment - payload_len) {
+            fragment_len = max_fragment - payload_len;
+        }
+
+        s_audio_notify_header[2] = fragment_index++;
+        // The fragment is copied from the packet straight into the scheduler's slot
+        ble_tx_enqueue_parts(BLE_TX_STREAM_AUDIO, channel, sessions, s_audio_notify_header, AUDIO_FRAME_HEADER_LEN + payload_len,
+                             packet + offset, fragment_len, 0);
+
+        offset += fragment_len;
+    } while (offset < packet_len);
 }
 
-void ServerHandler::onDisconnect(BLEServer *server)
+void update_audio_format_characteristic()
 {
-    g_is_ble_connected = false;
-    logger_printf("[BLE] Client disconnected. Restarting advertising.\n");
-    set_led_status(LED_STATUS_DISCONNECTED); // Set LED to orange
+    uint16_t sample_rate = (uint16_t)g_audio_output_sample_rate;
+    uint8_t format[4] = {
+        (uint8_t)g_audio_codec_mode,
+        (uint8_t)((g_audio_codec_mode == AUDIO_CODEC_ULAW || g_audio_codec_mode == AUDIO_CODEC_LOGMEL) ? 8 : 16),
+        (uint8_t)(sample_rate & 0xFF),
+        (uint8_t)((sample_rate >> 8) & 0xFF)
+    };
+    ble_transport()->set_value(BLE_CHANNEL_AUDIO_FORMAT, format, sizeof(format));
+}
 
-    // The photo manager state is now reset by its own subscription callback (stop_photo_streaming_task)
-    // when the client unsubscribes or disconnects. Removing it from here prevents confusing logs.
-    // reset_photo_manager_state();
+void notify_audio_silence_marker(BleChannel channel, BleSessionMask sessions, uint16_t duration_ms)
+{
+    uint8_t marker[AUDIO_SILENCE_MARKER_LEN] = {
+        0xFF, 0xFF, 0xFF,
+        (uint8_t)(duration_ms & 0xFF),
+        (uint8_t)((duration_ms >> 8) & 0xFF)
+    };
+    ble_tx_enqueue(BLE_TX_STREAM_AUDIO, channel, sessions, marker, sizeof(marker), 0);
+}
+
+// The handlers below run on the command dispatcher task, not in the BLE callback
 
-    BLEDevice::startAdvertising(); // Restart advertising
+static void handle_photo_control_command(int8_t value)
+{
+    logger_printf("[BLE] PhotoControl single byte value: %d\n", value);
+    handle_photo_control(value); // Call function from photo_manager
 }
 
-void ServerHandler::onMtuChanged(BLEServer *pServer, void *param) {
-    esp_ble_gatts_cb_param_t* p = (esp_ble_gatts_cb_param_t*)param;
-    logger_printf("[BLE] MTU changed to: %d\n", p->mtu.mtu);
-    // The payload size is the MTU minus 3 bytes for the ATT header and 2 bytes for our chunk header.
-    g_photo_chunk_payload_size = p->mtu.mtu - 3 - PHOTO_CHUNK_HEADER_LEN;
-    logger_printf("[BLE] Payload chunk size updated to: %d bytes\n", g_photo_chunk_payload_size);
+static void handle_audio_sample_rate_command(uint16_t sample_rate)
+{
+    logger_printf("[BLE] AudioFormat sample rate requested: %u Hz\n", sample_rate);
+    set_audio_output_sample_rate(sample_rate);
+    // Always reflect the effective format back, even if the request was rejected.
+    update_audio_format_characteristic();
 }
 
-// --- PhotoControlCallback Class Implementation ---
-void PhotoControlCallback::onWrite(BLECharacteristic *characteristic)
+static void handle_audio_replay_command(uint16_t conn, uint16_t from_sequence, uint32_t catchup_rate)
 {
-    size_t len = characteristic->getLength();
-    logger_printf("[BLE] PhotoControl received %zu bytes of data.\n", len);
-    if (len == 1)
-    {
-        int8_t received_value = characteristic->getData()[0];
-        logger_printf("[BLE] PhotoControl single byte value: %d\n", received_value);
-        handle_photo_control(received_value); // Call function from photo_manager
-    } else if (len > 0) {
-        logger_printf("[BLE] PhotoControl received data (HEX): ");
-        uint8_t* data = characteristic->getData();
-        for (size_t i = 0; i < len; i++) {
-            logger_printf("%02X ", data[i]);
-        }
-        logger_printf("\n");
-        logger_printf("[BLE] PhotoControl expected a single byte. Command ignored.\n");
-    } else {
-        logger_printf("[BLE] PhotoControl received empty data. Command ignored.\n");
+    logger_printf("[BLE] AudioReplay requested by conn %u from sequence %u (catch-up %u bytes/s).\n", conn, from_sequence, catchup_rate);
+    if (!audio_replay_request(conn, from_sequence, catchup_rate)) {
+        logger_printf("[BLE] Conn %u has no session. AudioReplay ignored.\n", conn);
     }
 }
 
-void configure_ble()
+// Status: oldest seq, next seq (LE16), held bytes, capacity, held ms, catch-up rate (LE32), replaying flag
+static void update_audio_replay_status()
 {
-    logger_printf("\n");
-    logger_printf("[BLE] Initializing...\n");
-    BLEDevice::init(DEVICE_MODEL_NUMBER); // Device name
-    // BLEDevice::setMTU(247); // Let's use the default MTU for now to test compatibility
-    BLEServer *server = BLEDevice::createServer();
-    server->setCallbacks(new ServerHandler());
-
-    // Create the main custom service
-    BLEService *service = server->createService(SERVICE_UUID);
-
-    // Photo Data Characteristic
-    g_photo_data_characteristic = service->createCharacteristic(
-        PHOTO_DATA_UUID,
-        BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY);
-    
-    BLE2902* pPhoto2902 = new BLE2902();
-    pPhoto2902->setCallbacks(new PhotoDescriptorCallback());
-    g_photo_data_characteristic->addDescriptor(pPhoto2902);
-
-    BLEDescriptor *pPhotoDataDesc = new BLEDescriptor(BLEUUID((uint16_t)0x2901));
-    pPhotoDataDesc->setValue(PHOTO_DATA_USER_DESCRIPTION);
-    g_photo_data_characteristic->addDescriptor(pPhotoDataDesc);
-
-    // Photo Control Characteristic
-    g_photo_control_characteristic = service->createCharacteristic(
-        PHOTO_CONTROL_UUID,
-        BLECharacteristic::PROPERTY_WRITE);
-    g_photo_control_characteristic->setCallbacks(new PhotoControlCallback());
-    BLEDescriptor *pPhotoControlDesc = new BLEDescriptor(BLEUUID((uint16_t)0x2901));
-    pPhotoControlDesc->setValue(PHOTO_CONTROL_USER_DESCRIPTION);
-    g_photo_control_characteristic->addDescriptor(pPhotoControlDesc);
-    uint8_t initial_control_value = 0; // Default to stop
-    g_photo_control_characteristic->setValue(&initial_control_value, 1);
-
-    // μ-law Audio Characteristic
-    g_audio_data_characteristic = service->createCharacteristic(
-        AUDIO_CODEC_ULAW_UUID,
-        BLECharacteristic::PROPERTY_NOTIFY
-    );
-
-    BLE2902* pAudio2902 = new BLE2902();
-    pAudio2902->setCallbacks(new AudioDescriptorCallback());
-    g_audio_data_characteristic->addDescriptor(pAudio2902);
-
-    BLEDescriptor *pAudioUlawDesc = new BLEDescriptor(BLEUUID((uint16_t)0x2901));
-    pAudioUlawDesc->setValue(AUDIO_ULAW_USER_DESCRIPTION);
-    g_audio_data_characteristic->addDescriptor(pAudioUlawDesc);
-
-    // Device Information Service
-    BLEService *device_info_service = server->createService(DEVICE_INFORMATION_SERVICE_UUID);
-    BLECharacteristic *manufacturer = device_info_service->createCharacteristic(MANUFACTURER_NAME_STRING_CHAR_UUID, BLECharacteristic::PROPERTY_READ);
-    manufacturer->setValue(DEVICE_MANUFACTURER_NAME);
-    BLECharacteristic *model = device_info_service->createCharacteristic(MODEL_NUMBER_STRING_CHAR_UUID, BLECharacteristic::PROPERTY_READ);
-    model->setValue(DEVICE_MODEL_NUMBER);
-    BLECharacteristic *firmware = device_info_service->createCharacteristic(FIRMWARE_REVISION_STRING_CHAR_UUID, BLECharacteristic::PROPERTY_READ);
-    firmware->setValue(DEVICE_FIRMWARE_REVISION);
-    BLECharacteristic *hardware = device_info_service->createCharacteristic(HARDWARE_REVISION_STRING_CHAR_UUID, BLECharacteristic::PROPERTY_READ);
-    hardware->setValue(DEVICE_HARDWARE_REVISION);
-
-    // Battery Service
-    BLEService *battery_service = server->createService(BATTERY_SERVICE_UUID);
-    g_battery_level_characteristic = battery_service->createCharacteristic(
-        BATTERY_LEVEL_CHAR_UUID,
-        BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY);
-    g_battery_level_characteristic->addDescriptor(new BLE2902()); // For notifications
-    BLEDescriptor *pBatteryLevelDesc = new BLEDescriptor(BLEUUID((uint16_t)0x2901));
-    pBatteryLevelDesc->setValue(BATTERY_LEVEL_USER_DESCRIPTION);
-    g_battery_level_characteristic->addDescriptor(pBatteryLevelDesc);
-    // Initial battery value is set by battery_handler via initialize_battery_handler
+    AudioReplayStatus status = audio_replay_get_status();
+    uint8_t value[AUDIO_REPLAY_STATUS_LEN];
+    uint32_t fields[] = {status.held_bytes, status.capacity_bytes, status.held_ms, status.catchup_bytes_per_sec};
+    value[0] = (uint8_t)(status.oldest_sequence & 0xFF);
+    value[1] = (uint8_t)((status.oldest_sequence >> 8) & 0xFF);
+    value[2] = (uint8_t)(status.next_sequence & 0xFF);
+    value[3] = (uint8_t)((status.next_sequence >> 8) & 0xFF);
+    for (size_t i = 0; i < 4; i++) {
+        for (size_t b = 0; b < 4; b++) {
+            value[4 + i * 4 + b] = (uint8_t)((fields[i] >> (8 * b)) & 0xFF);
+        }
+    }
+    value[20] = status.replaying ? 1 : 0;
+    ble_transport()->set_value(BLE_CHANNEL_AUDIO_REPLAY, value, sizeof(value));
+}
+
+// Status: state, device IPv4 (network order), bytes sent, elapsed ms (LE32), HTTP status (LE16)
+static void update_wifi_offload_status()
+{
+    WifiOffloadStatus status = wifi_offload_get_status();
+    uint8_t value[WIFI_OFFLOAD_STATUS_LEN];
+    value[0] = status.state;
+    memcpy(&value[1], &status.device_ipv4, 4);
+    for (size_t b = 0; b < 4; b++) {
+        value[5 + b] = (uint8_t)((status.bytes >> (8 * b)) & 0xFF);
+        value[9 + b] = (uint8_t)((status.elapsed_ms >> (8 * b)) & 0xFF);
+    }
+    value[13] = (uint8_t)(status.http_status & 0xFF);
+    value[14] = (uint8_t)((status.http_status >> 8) & 0xFF);
+    ble_transport()->set_value(BLE_CHANNEL_WIFI_OFFLOAD, value, sizeof(value));
+}
+
+// Status: state, error, next expected offset, bytes written, image size, bytes/s (LE32)
+static void update_ota_status(uint8_t *value)
+{
+    OtaStatus status = ota_update_get_status();
+    uint32_t fields[] = {status.next_offset, status.written, status.image_size, status.bytes_per_sec};
+    value[0] = status.state;
+    value[1] = status.error;
+    for (size_t i = 0; i < 4; i++) {
+        for (size_t b = 0; b < 4; b++) {
+            value[2 + i * 4 + b] = (uint8_t)((fields[i] >> (8 * b)) & 0xFF);
+        }
+    }
+    ble_transport()->set_value(BLE_CHANNEL_OTA_CONTROL, value, OTA_STATUS_LEN);
+}
+
+void notify_ota_status()
+{
+    uint8_t value[OTA_STATUS_LEN];
+    update_ota_status(value);
+    ble_session_notify(ble_session_subscribers(BLE_CHANNEL_OTA_CONTROL), BLE_CHANNEL_OTA_CONTROL, value, sizeof(value));
+}
+
+// Parameter returned by reads of the config characteristic; set by the callback, so a read
+// straight after a write returns the parameter it named
+static volatile uint8_t s_selected_param = PARAM_PHOTO_RATE;
+
+static void update_param_config_value()
+{
+    uint8_t record[PARAM_RECORD_LEN];
+    if (param_encode(s_selected_param, record)) {
+        ble_transport()->set_value(BLE_CHANNEL_PARAM_CONFIG, record, sizeof(record));
+    }
+}
+
+static void handle_param_config_command(uint8_t id, bool set, uint32_t value)
+{
+    if (id == PARAM_RESET_ALL) {
+        logger_printf("[PARAM] Restoring defaults.\n");
+        param_reset_defaults();
+        param_store_clear();
+    } else if (set) {
+        ParamSetResult result = param_set(id, value);
+        logger_printf("[PARAM] %s = %u requested: %s.\n", PARAM_SPECS[id].key, value, param_set_result_name(result));
+        if (result == PARAM_SET_OK) {
+            param_store_save((ParamId)id);
+        }
+    }
+    update_param_config_value();
+}
+
+// Codec streamed on an audio channel
+static bool channel_codec(BleChannel channel, AudioCodecMode *codec)
+{
+    switch (channel) {
+        case BLE_CHANNEL_AUDIO_ULAW:     *codec = AUDIO_CODEC_ULAW; return true;
+        case BLE_CHANNEL_AUDIO_OPUS:     *codec = AUDIO_CODEC_OPUS; return true;
+        case BLE_CHANNEL_AUDIO_LOSSLESS: *codec = AUDIO_CODEC_LOSSLESS; return true;
+        case BLE_CHANNEL_AUDIO_LOGMEL:   *codec = AUDIO_CODEC_LOGMEL; return true;
+        default: return false;
+    }
+}
+
+// Sessions subscribed to the channel of a codec, except the connection's own
+static BleSessionMask codec_listeners(AudioCodecMode codec, uint16_t except_conn)
+{
+    BleSessionMask sessions = 0;
+    for (int c = 0; c < BLE_CHANNEL_COUNT; c++) {
+        AudioCodecMode channel_mode;
+        if (channel_codec((BleChannel)c, &channel_mode) && channel_mode == codec) {
+            sessions |= ble_session_subscribers((BleChannel)c);
+        }
+    }
+    int index = ble_session_index(except_conn);
+    if (index >= 0) {
+        sessions &= (BleSessionMask)~(1u << index);
+    }
+    return sessions;
+}
+
+// A codec some session is still subscribed to, for handing the stream over
+static bool find_subscribed_codec(AudioCodecMode *codec)
+{
+    for (int c = 0; c < BLE_CHANNEL_COUNT; c++) {
+        if (channel_codec((BleChannel)c, codec) && ble_session_subscribers((BleChannel)c) != 0) {
+            return true;
+        }
+    }
+    return false;
+}
 
-    // Start services
-    service->start();
-    device_info_service->start();
-    battery_service->start();
-
-    // Start advertising
-    BLEAdvertising *advertising = BLEDevice::getAdvertising();
-    advertising->addServiceUUID(SERVICE_UUID);
-    advertising->addServiceUUID(DEVICE_INFORMATION_SERVICE_UUID);
-    advertising->addServiceUUID(BATTERY_SERVICE_UUID);
-    advertising->setScanResponse(true);
-    // Set advertising interval for power efficiency. A slower interval saves significant
-    // power when the device is idle and waiting for a connection.
-    // The value is in units of 0.625ms. 0x0A0 = 160 -> 160 * 0.625ms = 100ms.
-    advertising->setMinInterval(0x0A0); // 100ms
-    advertising->setMaxInterval(0x0A0); // 100ms
-    // Set preferred connection parameters for lower latency
-    advertising->setMinPreferred(0x06);  // 7.5ms
-    advertising->setMaxPreferred(0x10);  // 20ms
-    BLEDevice::startAdvertising();
-
-    logger_printf("[BLE] Initialized and advertising started (100ms interval).\n");
-}
-
-// --- PhotoDescriptorCallback Class Implementation ---
-void PhotoDescriptorCallback::onWrite(BLEDescriptor* pDescriptor) {
-    uint8_t* pValue = pDescriptor->getValue();
-    if (pDescriptor->getLength() == 2) {
-        uint16_t ccc_value = (pValue[1] << 8) | pValue[0];
-        if (ccc_value == 0x0001) {
-            // Notifications enabled
+static void handle_subscribe_command(uint16_t conn, BleChannel channel, bool notifications)
+{
+    AudioCodecMode codec;
+    if (channel == BLE_CHANNEL_PHOTO_DATA) {
+        if (notifications) {
             logger_printf("[BLE] Photo notifications ENABLED. Starting photo stream.\n");
+            start_camera_task(); // Not created at boot, so a wake without photo clients skips it
             start_photo_streaming_task();
-        } else if (ccc_value == 0x0000) {
-            // Notifications disabled
+        } else if (ble_session_subscribers(channel) == 0) {
+            // Only stop once the last client unsubscribed
             logger_printf("[BLE] Photo notifications DISABLED. Stopping photo stream.\n");
             stop_photo_streaming_task();
         }
+    } else if (channel_codec(channel, &codec)) {
+        AudioCodecMode active = g_audio_codec_mode;
+        if (notifications) {
+            // One codec streams at a time: switching would silence the other clients
+            BleSessionMask others = codec_listeners(active, conn);
+            if (codec != active && others != 0) {
+                logger_printf("[BLE] Conn %u subscribed to codec %d, but codec %d streams to other clients (0x%02X). Keeping codec %d.\n",
+                              conn, codec, active, others, active);
+                return;
+            }
+            logger_printf("[BLE] Audio notifications ENABLED (codec %d, conn %u). Starting audio stream.\n", codec, conn);
+            start_ulaw_streaming_task(codec);
+        } else if (active == codec && ble_session_subscribers(channel) == 0) {
+            // This channel owned the stream and nobody listens to it any more
+            AudioCodecMode next;
+            if (find_subscribed_codec(&next)) {
+                logger_printf("[BLE] Codec %d has no subscribers left. Switching the audio stream to codec %d.\n", codec, next);
+                start_ulaw_streaming_task(next);
+            } else {
+                logger_printf("[BLE] Audio notifications DISABLED (codec %d). Stopping audio stream.\n", codec);
+                stop_ulaw_streaming_task();
+            }
+        }
     }
 }
 
-// --- AudioDescriptorCallback Class Implementation ---
-void AudioDescriptorCallback::onWrite(BLEDescriptor* pDescriptor) {
-    uint8_t* pValue = pDescriptor->getValue();
-    if (pDescriptor->getLength() == 2) {
-        uint16_t ccc_value = (pValue[1] << 8) | pValue[0];
-        if (ccc_value == 0x0001) {
-            // Notifications enabled
-            logger_printf("[BLE] Audio notifications ENABLED. Starting audio stream.\n");
-            start_ulaw_streaming_task();
-        } else if (ccc_value == 0x0000) {
-            // Notifications disabled
-            logger_printf("[BLE] Audio notifications DISABLED. Stopping audio stream.\n");
-            stop_ulaw_streaming_task();
+static const BleCommandHandlers s_command_handlers = {
+    handle_photo_control_command,
+    handle_subscribe_command,
+    handle_audio_sample_rate_command,
+    handle_audio_replay_command,
+    wifi_offload_handle_command,
+    handle_param_config_command,
+    ota_update_handle_command
+};
+
+// Connect time, for the connect-to-first-subscription setup time in the log
+static volatile uint32_t s_connect_ms = 0;
+static volatile bool s_setup_time_logged = false;
+
+class BleEventHandler : public BleTransportListener {
+public:
+    void on_connect(uint16_t conn) override
+    {
+        int index = ble_session_open(conn);
+        if (index < 0) {
+            // More links than BLE_MAX_CONNECTIONS: the stack allows it, but nothing is sent to it
+            logger_printf("[BLE] Client connected (conn %u), but all %u sessions are taken.\n", conn, (unsigned)BLE_MAX_CONNECTIONS);
+            return;
+        }
+        if (!g_is_ble_connected) {
+            g_is_ble_connected = true;
+            app_events_post(APP_EVENT_CONNECTION);
+        }
+        s_connect_ms = millis();
+        s_setup_time_logged = false;
+        timebase_reset_session(index);
+        logger_printf("[BLE] Client connected (conn %u, session #%d, %u of %u).\n", conn, index,
+                      (unsigned)ble_session_count(), (unsigned)BLE_MAX_CONNECTIONS);
+        set_led_status(LED_STATUS_CONNECTED); // Set LED to green
+        wake_state_on_connect();
+        ble_reconnect_on_connect(conn);
+        ble_link_on_connect(conn);
+
+        // Connecting stops advertising; keep it up while there is room for another client
+        if (ble_session_count() < BLE_MAX_CONNECTIONS) {
+            ble_reconnect_start_advertising(false);
+        }
+    }
+
+    void on_disconnect(uint16_t conn) override
+    {
+        int index = ble_session_index(conn);
+        BleSession session;
+        if (!ble_session_get(index, &session)) {
+            ble_reconnect_start_advertising(true);
+            return;
+        }
+        ble_session_close(conn);
+        wake_state_on_disconnect(session.subscriptions, millis() - session.connected_ms, session.bonded);
+        g_is_ble_connected = ble_session_count() > 0;
+        logger_printf("[BLE] Client disconnected (conn %u, session #%d). Restarting advertising.\n", conn, index);
+
+        // Its subscriptions end with it, so streams nobody else follows are stopped. A framed
+        // audio stream keeps capturing into the replay ring instead, for the client to catch up.
+        for (int c = 0; c < BLE_CHANNEL_COUNT; c++) {
+            AudioCodecMode codec;
+            if (!(session.subscriptions & (1u << c))) {
+                continue;
+            }
+            if (channel_codec((BleChannel)c, &codec) && audio_stream_outlives_disconnect(codec)) {
+                continue;
+            }
+            command_dispatcher_post(ble_command_subscribe(conn, (BleChannel)c, false, timebase_now_us()));
+        }
+
+        // The managed link goes to a client that is still connected
+        if (ble_link_on_disconnect(conn)) {
+            for (size_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+                BleSession other;
+                if (ble_session_get((int)i, &other)) {
+                    ble_link_on_connect(other.conn);
+                    ble_link_on_mtu_changed(other.conn, other.mtu);
+                    break;
+                }
+            }
+        }
+        if (!g_is_ble_connected) {
+            set_led_status(LED_STATUS_DISCONNECTED); // Set LED to orange
+            app_events_post(APP_EVENT_CONNECTION);
+        }
+        ble_reconnect_start_advertising(true); // The client may be coming back
+    }
+
+    void on_mtu_changed(uint16_t conn, uint16_t mtu) override
+    {
+        logger_printf("[BLE] MTU of conn %u changed to: %d\n", conn, mtu);
+        ble_session_set_mtu(conn, mtu);
+        ble_link_on_mtu_changed(conn, mtu);
+    }
+
+    void on_subscribe(uint16_t conn, BleChannel channel, bool notifications) override
+    {
+        if (notifications && !s_setup_time_logged) {
+            // Connection setup time: from connect to the client's first subscription
+            s_setup_time_logged = true;
+            logger_printf("[BLE] %s connection set up in %u ms.\n", ble_transport()->name(), (unsigned)(millis() - s_connect_ms));
+        }
+
+        if (ble_session_index(conn) < 0) {
+            return; // A client beyond BLE_MAX_CONNECTIONS
+        }
+        // The session is updated here, so the dispatcher sees who is still subscribed
+        ble_session_set_subscribed(conn, channel, notifications);
+        if (!command_dispatcher_post(ble_command_subscribe(conn, channel, notifications, timebase_now_us()))) {
+            logger_printf("[BLE] Command queue full. Subscription change dropped.\n");
+        }
+    }
+
+    void on_write(uint16_t conn, BleChannel channel, const uint8_t *data, size_t len) override
+    {
+        int64_t received_us = timebase_now_us(); // Clock-sync t2, taken before anything else
+        if (channel == BLE_CHANNEL_OTA_DATA) {
+            // Image chunks arrive back to back; queueing each one would copy it twice
+            ota_update_on_data(data, len);
+            return;
+        }
+        if (channel == BLE_CHANNEL_PHOTO_CONTROL && len > 1 && data[0] == CONTROL_OPCODE_CLOCK_SYNC) {
+            // Answered here: the reply must be ready for the client's next read
+            timebase_handle_sync_request(ble_session_index(conn), data + 1, len - 1, received_us);
+            return;
+        }
+        BleCommand command;
+        const char *error = nullptr;
+        if (!ble_command_decode_write(conn, channel, data, len, received_us, &command, &error)) {
+            logger_printf("[BLE] %s %s. Command ignored.\n", BLE_CHANNEL_SPECS[channel].description, error);
+            return;
+        }
+        if (command.type == BLE_CMD_PARAM_CONFIG && command.param_id != PARAM_RESET_ALL) {
+            s_selected_param = command.param_id;
+        }
+        if (!command_dispatcher_post(command)) {
+            logger_printf("[BLE] Command queue full. %s dropped.\n", ble_command_name(command.type));
+        }
+    }
+
+    void on_read(uint16_t conn, BleChannel channel) override
+    {
+        if (channel == BLE_CHANNEL_PHOTO_CONTROL) {
+            // The value is shared, but it is set for this read just before it is answered
+            uint8_t reply[CLOCK_SYNC_REPLY_LEN];
+            timebase_fill_sync_reply(ble_session_index(conn), reply);
+            ble_transport()->set_value(BLE_CHANNEL_PHOTO_CONTROL, reply, sizeof(reply));
+        } else if (channel == BLE_CHANNEL_AUDIO_REPLAY) {
+            update_audio_replay_status();
+        } else if (channel == BLE_CHANNEL_WIFI_OFFLOAD) {
+            update_wifi_offload_status();
+        } else if (channel == BLE_CHANNEL_PARAM_CONFIG) {
+            update_param_config_value();
+        } else if (channel == BLE_CHANNEL_OTA_CONTROL) {
+            uint8_t value[OTA_STATUS_LEN];
+            update_ota_status(value);
+        }
+    }
+
+    void on_data_length(uint16_t conn, int status, uint16_t tx_octets, uint16_t rx_octets) override
+    {
+        ble_link_on_data_length(conn, status, tx_octets, rx_octets);
+    }
+
+    void on_phy_update(uint16_t conn, int status, uint8_t tx_phy, uint8_t rx_phy) override
+    {
+        ble_link_on_phy_update(conn, status, tx_phy, rx_phy);
+    }
+
+    void on_conn_params(uint16_t conn, int status, uint16_t interval, uint16_t latency, uint16_t timeout) override
+    {
+        ble_link_on_conn_params(conn, status, interval, latency, timeout);
+    }
+
+    void on_l2cap_channel(uint16_t conn, bool open, uint16_t sdu_mtu) override
+    {
+        // Photos to this client take the channel it opened, from its next upload
+        ble_session_set_l2cap(conn, open ? sdu_mtu : 0);
+        if (open) {
+            logger_printf("[BLE] L2CAP photo channel open on conn %u (SDU up to %u bytes). Its photos use it from the next upload.\n",
+                          conn, sdu_mtu);
+        } else {
+            logger_printf("[BLE] L2CAP photo channel of conn %u closed. Its photos use GATT.\n", conn);
         }
     }
+
+    void on_encryption(uint16_t conn, int status, bool bonded) override
+    {
+        ble_reconnect_on_encryption(conn, status, bonded);
+    }
+};
+
+static BleEventHandler s_event_handler;
+
+void configure_ble()
+{
+    logger_printf("\n");
+    logger_printf("[BLE] Initializing...\n");
+    BleTransport *transport = ble_transport();
+    transport->begin(&s_event_handler); // Offers BLE_LOCAL_MTU; DLE and 2M PHY are requested per connection
+    ble_reconnect_init();
+    if (transport->l2cap_listen(BLE_L2CAP_PHOTO_PSM, BLE_L2CAP_PHOTO_MTU)) {
+        logger_printf("[BLE] L2CAP photo channel accepted on PSM 0x%04X (SDU up to %u bytes).\n", BLE_L2CAP_PHOTO_PSM, BLE_L2CAP_PHOTO_MTU);
+    } else {
+        logger_printf("[BLE] No L2CAP channel on the %s transport. Photos use GATT.\n", transport->name());
+    }
+
+    uint8_t initial_control_value = 0; // Default to stop
+    transport->set_value(BLE_CHANNEL_PHOTO_CONTROL, &initial_control_value, 1);
+    update_audio_format_characteristic();
+    update_param_config_value();
+    ble_link_init();
+    // Initial battery value is set by battery_handler via initialize_battery_handler
+
+    start_ble_tx_scheduler();
+    start_command_dispatcher(&s_command_handlers);
+    ble_reconnect_start_advertising(true);
+
+    logger_printf("[BLE] Initialized and advertising started (%u-%u ms for %u s, then %u-%u ms).\n",
+                  (unsigned)BLE_ADV_FAST_MIN_INTERVAL * 5 / 8, (unsigned)BLE_ADV_FAST_MAX_INTERVAL * 5 / 8,
+                  (unsigned)(BLE_ADV_FAST_DURATION_MS / 1000),
+                  (unsigned)BLE_ADV_SLOW_MIN_INTERVAL * 5 / 8, (unsigned)BLE_ADV_SLOW_MAX_INTERVAL * 5 / 8);
+    // Idle footprint of the stack, for comparing backends
+    logger_printf("[BLE] %s transport ready. Free internal heap: %u bytes\n", transport->name(),
+                  (unsigned)heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
 }
 
 // The photo_streaming_task and its start function have been moved to photo_manager.cpp
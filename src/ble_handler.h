@@ -1,48 +1,44 @@
 #ifndef BLE_HANDLER_H
 #define BLE_HANDLER_H
 
-#include <BLEDevice.h>
-#include <BLEUtils.h>
-#include <BLEServer.h>
-#include <BLE2902.h>
-#include <BLEDescriptor.h>
-
-// Extern declarations for global BLE variables
-extern BLECharacteristic *g_photo_data_characteristic;
-extern BLECharacteristic *g_photo_control_characteristic;
-extern BLECharacteristic *g_audio_data_characteristic;
-extern BLECharacteristic *g_battery_level_characteristic;
-
-extern volatile bool g_is_ble_connected;
-extern int g_photo_chunk_payload_size;
-
-// BLE Server Event Callbacks
-class ServerHandler : public BLEServerCallbacks
-{
-    void onConnect(BLEServer *pServer) override;
-    void onDisconnect(BLEServer *pServer) override;
-    void onMtuChanged(BLEServer *pServer, void *param); // Use void* to avoid header dependency
-};
-
-// BLE Characteristic Event Callbacks for Photo Control
-class PhotoControlCallback : public BLECharacteristicCallbacks
-{
-    void onWrite(BLECharacteristic *pCharacteristic) override;
-};
-
-// Callback for photo data descriptor (for subscription management)
-class PhotoDescriptorCallback : public BLEDescriptorCallbacks {
-    void onWrite(BLEDescriptor* pDescriptor) override;
-};
-
-// Callback for audio data descriptor (for subscription management)
-class AudioDescriptorCallback : public BLEDescriptorCallbacks {
-    void onWrite(BLEDescriptor* pDescriptor) override;
-};
-
+#include <stdint.h>
+#include <stddef.h>
+#include "ble_transport.h" // For BleChannel
+#include "ble_session.h"   // For BleSessionMask
+
+extern volatile bool g_is_ble_connected; // At least one client has a session
+
+// Starts the BLE transport (see ble_transport.h) with the firmware's GATT behaviour: photo
+// and audio subscriptions start and stop their tasks, the photo control characteristic takes
+// photo commands and the clock-sync exchange (see timebase.h), the audio format and replay
+// characteristics select the sample rate and request the backlog. Up to BLE_MAX_CONNECTIONS
+// clients are served at once, each with its own session (see ble_session.h); advertising
+// continues while there is room. Then starts advertising.
 void configure_ble();
 
-// Forward declaration from photo_manager.h, used by PhotoControlCallback
+// Sends one encoded audio packet as notifications prefixed with the 2-byte sequence number
+// and 1-byte fragment index, splitting it to fit the smallest MTU among the sessions, which
+// all get the same notifications. Fragment 0 carries the first-sample time (low 32 bits of
+// the device timebase, LE) ahead of the packet data.
+void notify_framed_audio_packet(BleChannel channel, BleSessionMask sessions, uint16_t sequence, uint32_t timestamp_us,
+                                const uint8_t *packet, size_t packet_len);
+
+// Number of notifications notify_framed_audio_packet() uses for a packet to the sessions
+size_t framed_audio_fragment_count(BleSessionMask sessions, size_t packet_len);
+
+// Refreshes the audio format characteristic: codec id, bits per sample, sample rate (LE)
+void update_audio_format_characteristic();
+
+// Sends a compact "silence for duration_ms" marker to the sessions on an audio channel
+// (0xFF 0xFF 0xFF followed by the duration in ms, little-endian). A notification of that
+// length is always a marker: u-law chunks are never AUDIO_SILENCE_MARKER_LEN bytes long, and
+// framed fragments start with a fragment index below 0xFF in their third byte.
+void notify_audio_silence_marker(BleChannel channel, BleSessionMask sessions, uint16_t duration_ms);
+
+// Refreshes the OTA control characteristic with the update status and notifies its subscribers
+void notify_ota_status();
+
+// Forward declaration from photo_manager.h, used by the photo control characteristic
 void handle_photo_control(int8_t control_value);
 
 void start_photo_streaming_task();
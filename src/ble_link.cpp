@@ -0,0 +1,332 @@
+#include "ble_link.h"
+#include "config.h"
+#include "ble_tx_scheduler.h" // For the photo pacing rate
+#include "ble_transport.h"    // For the link-layer requests
+#include "param_registry.h"   // For the photo pacing rates
+#include "logger.h"
+#include <Arduino.h>
+#include <string.h>
+
+// Link-layer defaults before any negotiation
+static const uint16_t DEFAULT_ATT_MTU = 23;
+static const uint16_t DEFAULT_DATA_LEN = 27;
+
+static BleLinkStats s_link = {};
+static portMUX_TYPE s_link_mux = portMUX_INITIALIZER_UNLOCKED;
+
+struct ConnModeParams {
+    uint16_t min_interval;
+    uint16_t max_interval;
+    uint16_t latency;
+};
+
+// Indexed by BleConnMode (DEFAULT is never requested)
+static const ConnModeParams CONN_MODE_PARAMS[BLE_CONN_MODE_COUNT] = {
+    {0, 0, 0},
+    {BLE_CONN_IDLE_MIN_INTERVAL, BLE_CONN_IDLE_MAX_INTERVAL, BLE_CONN_IDLE_LATENCY},
+    {BLE_CONN_AUDIO_MIN_INTERVAL, BLE_CONN_AUDIO_MAX_INTERVAL, BLE_CONN_AUDIO_LATENCY},
+    {BLE_CONN_BULK_MIN_INTERVAL, BLE_CONN_BULK_MAX_INTERVAL, BLE_CONN_BULK_LATENCY},
+};
+static const char *const CONN_MODE_NAMES[BLE_CONN_MODE_COUNT] = {"Default", "Idle", "Audio", "Bulk"};
+
+// Workload reported by the tasks; these outlive a connection like the tasks themselves
+static volatile bool s_photo_active = false;
+static volatile bool s_audio_active = false;
+
+// Connection mode bookkeeping, guarded by s_link_mux
+static BleConnMode s_workload_mode = BLE_CONN_MODE_DEFAULT; // Mode the workload asked for last
+static unsigned long s_workload_changed_ms = 0;
+static unsigned long s_conn_mode_since_ms = 0;
+static bool s_conn_update_pending = false;
+static unsigned long s_conn_update_requested_ms = 0;
+
+static const char *request_state_name(BleLinkRequestState state) {
+    switch (state) {
+        case BLE_LINK_REQUEST_PENDING: return "pending";
+        case BLE_LINK_REQUEST_ACCEPTED: return "accepted";
+        case BLE_LINK_REQUEST_REJECTED: return "rejected";
+        default: return "not requested";
+    }
+}
+
+static const char *phy_name(uint8_t phy) {
+    switch (phy) {
+        case BLE_PHY_2M: return "2M";
+        case BLE_PHY_CODED: return "Coded";
+        default: return "1M";
+    }
+}
+
+// Adds the time since the last call to the current mode. Call inside s_link_mux.
+static void account_conn_mode_time(unsigned long now_ms) {
+    s_link.conn_mode_ms[s_link.conn_mode] += now_ms - s_conn_mode_since_ms;
+    s_conn_mode_since_ms = now_ms;
+}
+
+static void set_phy_state(BleLinkRequestState state) {
+    portENTER_CRITICAL(&s_link_mux);
+    s_link.phy_state = state;
+    portEXIT_CRITICAL(&s_link_mux);
+}
+
+// Photo chunks are paced for a 1M link without DLE unless both upgrades were accepted
+static void update_photo_rate() {
+    bool fast = s_link.dle_state == BLE_LINK_REQUEST_ACCEPTED && s_link.phy_state == BLE_LINK_REQUEST_ACCEPTED;
+    ble_tx_set_stream_rate(BLE_TX_STREAM_PHOTO, param_get(fast ? PARAM_PHOTO_FAST_RATE : PARAM_PHOTO_RATE));
+}
+
+static void on_photo_rate_changed(ParamId id, uint32_t value) {
+    update_photo_rate();
+}
+
+// Second step, after the data length request has completed either way
+static void request_2m_phy() {
+    if (!BLE_LINK_PREFER_2M_PHY) {
+        return;
+    }
+    set_phy_state(BLE_LINK_REQUEST_PENDING);
+    if (!ble_transport()->request_2m_phy(s_link.conn)) {
+        logger_printf("[LINK] 2M PHY request failed to start. Staying on 1M.\n");
+        set_phy_state(BLE_LINK_REQUEST_REJECTED);
+    }
+}
+
+// Events of other clients' links are not tracked
+static bool is_link(uint16_t conn) {
+    return s_link.connected && s_link.conn == conn;
+}
+
+void ble_link_on_data_length(uint16_t conn, int status, uint16_t tx_octets, uint16_t rx_octets) {
+    if (!is_link(conn)) {
+        return;
+    }
+    bool ok = status == 0;
+    portENTER_CRITICAL(&s_link_mux);
+    if (ok) {
+        s_link.tx_data_len = tx_octets;
+        s_link.rx_data_len = rx_octets;
+    }
+    s_link.dle_state = ok ? BLE_LINK_REQUEST_ACCEPTED : BLE_LINK_REQUEST_REJECTED;
+    portEXIT_CRITICAL(&s_link_mux);
+    if (ok) {
+        logger_printf("[LINK] Data length: TX %u, RX %u bytes per PDU.\n", tx_octets, rx_octets);
+    } else {
+        logger_printf("[LINK] Data length extension rejected (status %d). Keeping %u-byte PDUs.\n", status, DEFAULT_DATA_LEN);
+    }
+    if (s_link.connected) {
+        request_2m_phy();
+    }
+}
+
+void ble_link_on_phy_update(uint16_t conn, int status, uint8_t tx_phy, uint8_t rx_phy) {
+    if (!is_link(conn)) {
+        return;
+    }
+    bool ok = status == 0;
+    portENTER_CRITICAL(&s_link_mux);
+    if (ok) {
+        s_link.tx_phy = tx_phy;
+        s_link.rx_phy = rx_phy;
+    }
+    // Success with both directions left on 1M means the peer declined 2M
+    bool on_2m = s_link.tx_phy == BLE_PHY_2M || s_link.rx_phy == BLE_PHY_2M;
+    s_link.phy_state = (ok && on_2m) ? BLE_LINK_REQUEST_ACCEPTED : BLE_LINK_REQUEST_REJECTED;
+    portEXIT_CRITICAL(&s_link_mux);
+    logger_printf("[LINK] PHY update %s: TX %s, RX %s.\n", ok ? "complete" : "failed",
+                  phy_name(s_link.tx_phy), phy_name(s_link.rx_phy));
+    update_photo_rate();
+}
+
+// Also reported when the central changes the parameters on its own
+void ble_link_on_conn_params(uint16_t conn, int status, uint16_t interval, uint16_t latency, uint16_t timeout) {
+    if (!is_link(conn)) {
+        return;
+    }
+    bool ok = status == 0;
+    portENTER_CRITICAL(&s_link_mux);
+    s_conn_update_pending = false;
+    if (ok) {
+        s_link.conn_interval_1250us = interval;
+        s_link.conn_latency = latency;
+        s_link.supervision_timeout_10ms = timeout;
+        s_link.conn_updates++;
+    } else {
+        s_link.conn_update_failures++;
+    }
+    BleConnMode mode = s_link.conn_mode;
+    portEXIT_CRITICAL(&s_link_mux);
+    if (ok) {
+        logger_printf("[LINK] Connection interval: %u.%02u ms, latency %u, timeout %u ms (%s mode).\n",
+                      interval * 125 / 100, (interval * 125) % 100, latency, timeout * 10, CONN_MODE_NAMES[mode]);
+    } else {
+        logger_printf("[LINK] Connection parameter update for %s mode rejected (status %d).\n", CONN_MODE_NAMES[mode], status);
+    }
+}
+
+void ble_link_init() {
+    param_on_change(PARAM_PHOTO_RATE, on_photo_rate_changed);
+    param_on_change(PARAM_PHOTO_FAST_RATE, on_photo_rate_changed);
+}
+
+void ble_link_on_connect(uint16_t conn) {
+    if (s_link.connected) {
+        return; // Another client's link is already managed
+    }
+    unsigned long now = millis();
+    portENTER_CRITICAL(&s_link_mux);
+    memset(&s_link, 0, sizeof(s_link));
+    s_link.connected = true;
+    s_link.conn = conn;
+    s_link.mtu = DEFAULT_ATT_MTU;
+    s_link.tx_data_len = DEFAULT_DATA_LEN;
+    s_link.rx_data_len = DEFAULT_DATA_LEN;
+    s_link.tx_phy = BLE_PHY_1M;
+    s_link.rx_phy = BLE_PHY_1M;
+    s_link.dle_state = BLE_LINK_REQUEST_PENDING;
+    s_link.conn_mode = BLE_CONN_MODE_DEFAULT;
+    // Connecting counts as activity, so discovery runs on the central's parameters
+    s_workload_mode = BLE_CONN_MODE_DEFAULT;
+    s_workload_changed_ms = now;
+    s_conn_mode_since_ms = now;
+    s_conn_update_pending = false;
+    portEXIT_CRITICAL(&s_link_mux);
+    update_photo_rate();
+
+    // First step: larger link-layer PDUs. The PHY request follows its completion event,
+    // since controllers handle one link-layer procedure at a time.
+    if (!ble_transport()->request_data_length(conn, BLE_LINK_DATA_LEN)) {
+        logger_printf("[LINK] Data length request failed to start. Keeping %u-byte PDUs.\n", DEFAULT_DATA_LEN);
+        portENTER_CRITICAL(&s_link_mux);
+        s_link.dle_state = BLE_LINK_REQUEST_REJECTED;
+        portEXIT_CRITICAL(&s_link_mux);
+        request_2m_phy();
+    }
+}
+
+bool ble_link_on_disconnect(uint16_t conn) {
+    portENTER_CRITICAL(&s_link_mux);
+    bool managed = is_link(conn);
+    if (managed) {
+        account_conn_mode_time(millis());
+        s_link.connected = false;
+    }
+    portEXIT_CRITICAL(&s_link_mux);
+    return managed;
+}
+
+void ble_link_on_mtu_changed(uint16_t conn, uint16_t mtu) {
+    if (!is_link(conn)) {
+        return;
+    }
+    portENTER_CRITICAL(&s_link_mux);
+    s_link.mtu = mtu;
+    portEXIT_CRITICAL(&s_link_mux);
+}
+
+static BleConnMode workload_mode() {
+    if (s_photo_active) {
+        return BLE_CONN_MODE_BULK;
+    }
+    return s_audio_active ? BLE_CONN_MODE_AUDIO : BLE_CONN_MODE_IDLE;
+}
+
+void ble_link_update_conn_mode() {
+    unsigned long now = millis();
+    BleConnMode target = workload_mode();
+
+    portENTER_CRITICAL(&s_link_mux);
+    if (target != s_workload_mode) {
+        s_workload_mode = target;
+        s_workload_changed_ms = now;
+    }
+    if (s_conn_update_pending && now - s_conn_update_requested_ms >= BLE_CONN_UPDATE_TIMEOUT_MS) {
+        s_conn_update_pending = false; // No answer; stop waiting for one
+    }
+    // Busier modes apply at once; slowing down waits out the hold time so short gaps
+    // between photos or audio bursts do not cause a parameter update each
+    bool faster = target != BLE_CONN_MODE_IDLE && target > s_link.conn_mode;
+    bool held = now - s_workload_changed_ms >= BLE_CONN_MODE_HOLD_MS;
+    // The controller runs one parameter update at a time
+    bool request = s_link.connected && !s_conn_update_pending && target != s_link.conn_mode && (faster || held);
+    if (request) {
+        account_conn_mode_time(now);
+        s_link.conn_mode = target;
+        s_conn_update_pending = true;
+        s_conn_update_requested_ms = now;
+    }
+    portEXIT_CRITICAL(&s_link_mux);
+    if (!request) {
+        return;
+    }
+
+    const ConnModeParams &mode = CONN_MODE_PARAMS[target];
+    logger_printf("[LINK] Requesting %s mode: interval %u-%u x 1.25ms, latency %u.\n",
+                  CONN_MODE_NAMES[target], mode.min_interval, mode.max_interval, mode.latency);
+    if (!ble_transport()->update_conn_params(s_link.conn, mode.min_interval, mode.max_interval, mode.latency, BLE_CONN_SUPERVISION_TIMEOUT)) {
+        logger_printf("[LINK] Connection parameter request failed to start.\n");
+        portENTER_CRITICAL(&s_link_mux);
+        s_conn_update_pending = false;
+        s_link.conn_update_failures++;
+        portEXIT_CRITICAL(&s_link_mux);
+    }
+}
+
+void ble_link_set_photo_active(bool active) {
+    s_photo_active = active;
+    ble_link_update_conn_mode();
+}
+
+void ble_link_set_audio_active(bool active) {
+    s_audio_active = active;
+    ble_link_update_conn_mode();
+}
+
+void ble_link_record_photo_transfer(size_t bytes, uint32_t elapsed_ms, BlePhotoPath path) {
+    uint32_t rate = elapsed_ms ? (uint32_t)((uint64_t)bytes * 1000 / elapsed_ms) : 0;
+    portENTER_CRITICAL(&s_link_mux);
+    s_link.photo_path = path;
+    s_link.photo_path_uploads[path]++;
+    s_link.photo_path_bytes[path] += (uint32_t)bytes;
+    s_link.photo_path_ms[path] += elapsed_ms;
+    s_link.photo_bytes = (uint32_t)bytes;
+    s_link.photo_ms = elapsed_ms;
+    s_link.photo_bytes_per_sec = rate;
+    if (rate > s_link.photo_best_bytes_per_sec) {
+        s_link.photo_best_bytes_per_sec = rate;
+    }
+    portEXIT_CRITICAL(&s_link_mux);
+}
+
+BleLinkStats ble_link_get_stats() {
+    portENTER_CRITICAL(&s_link_mux);
+    if (s_link.connected) {
+        account_conn_mode_time(millis());
+    }
+    BleLinkStats stats = s_link;
+    portEXIT_CRITICAL(&s_link_mux);
+    return stats;
+}
+
+void ble_link_log_stats() {
+    BleLinkStats link = ble_link_get_stats();
+    if (!link.connected) {
+        return;
+    }
+    logger_printf("[LINK] MTU: %u | PDU: TX %u / RX %u (DLE %s) | PHY: TX %s / RX %s (2M %s) | Interval: %u x 1.25ms | Photo: %u B/s (best %u B/s)\n",
+                  link.mtu, link.tx_data_len, link.rx_data_len, request_state_name(link.dle_state),
+                  phy_name(link.tx_phy), phy_name(link.rx_phy), request_state_name(link.phy_state),
+                  link.conn_interval_1250us,
+                  link.photo_bytes_per_sec, link.photo_best_bytes_per_sec);
+    logger_printf("[LINK] Mode: %s | Time in Idle: %u s, Audio: %u s, Bulk: %u s, Default: %u s | Updates: %u, failed: %u\n",
+                  CONN_MODE_NAMES[link.conn_mode],
+                  link.conn_mode_ms[BLE_CONN_MODE_IDLE] / 1000, link.conn_mode_ms[BLE_CONN_MODE_AUDIO] / 1000,
+                  link.conn_mode_ms[BLE_CONN_MODE_BULK] / 1000, link.conn_mode_ms[BLE_CONN_MODE_DEFAULT] / 1000,
+                  link.conn_updates, link.conn_update_failures);
+    uint32_t path_rate[BLE_PHOTO_PATH_COUNT];
+    for (int p = 0; p < BLE_PHOTO_PATH_COUNT; p++) {
+        path_rate[p] = link.photo_path_ms[p] ? (uint32_t)((uint64_t)link.photo_path_bytes[p] * 1000 / link.photo_path_ms[p]) : 0;
+    }
+    logger_printf("[LINK] Photo paths: GATT %u uploads, %u B/s | L2CAP %u uploads, %u B/s\n",
+                  link.photo_path_uploads[BLE_PHOTO_PATH_GATT], path_rate[BLE_PHOTO_PATH_GATT],
+                  link.photo_path_uploads[BLE_PHOTO_PATH_L2CAP], path_rate[BLE_PHOTO_PATH_L2CAP]);
+}
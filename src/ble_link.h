@@ -0,0 +1,101 @@
+#ifndef BLE_LINK_H
+#define BLE_LINK_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Post-connect link optimisation. After a client connects, the firmware asks the controller
+// for LE Data Length Extension (BLE_LINK_DATA_LEN-byte PDUs) and then for the 2M PHY. It
+// records what the peer accepted. A rejected or unanswered request leaves the link at the
+// default it had (27-byte PDUs, 1M PHY), so nothing else depends on the outcome. The ATT
+// MTU can only be raised by the client; the firmware offers BLE_LOCAL_MTU and tracks what
+// the client exchanges.
+//
+// The connection interval follows the workload: short intervals while a photo uploads,
+// medium ones for steady audio, and long intervals with slave latency when idle. The photo
+// and audio tasks report their state; moving to a busier mode is requested at once, while
+// slowing down waits until the lighter workload has lasted BLE_CONN_MODE_HOLD_MS.
+//
+// With several clients (see ble_session.h) one link is managed: the first client's. Events of
+// the other links are ignored, and they keep the parameters their central chose. When the
+// managed client leaves, the BLE handler hands the role to a remaining one. L2CAP photo
+// channels are tracked per client, in its session.
+
+enum BleLinkRequestState : uint8_t {
+    BLE_LINK_REQUEST_IDLE = 0,  // Not requested on this connection
+    BLE_LINK_REQUEST_PENDING,   // Waiting for the controller's completion event
+    BLE_LINK_REQUEST_ACCEPTED,
+    BLE_LINK_REQUEST_REJECTED   // Refused locally or by the peer; the default stays in use
+};
+
+enum BleConnMode : uint8_t {
+    BLE_CONN_MODE_DEFAULT = 0, // Parameters the central chose when connecting
+    BLE_CONN_MODE_IDLE,        // Nothing streaming
+    BLE_CONN_MODE_AUDIO,       // Steady audio stream
+    BLE_CONN_MODE_BULK,        // Photo upload in progress
+    BLE_CONN_MODE_COUNT
+};
+
+// How a photo upload reached the client
+enum BlePhotoPath : uint8_t {
+    BLE_PHOTO_PATH_GATT = 0,   // PHOTO_DATA_UUID notifications
+    BLE_PHOTO_PATH_L2CAP,      // SDUs on the client's L2CAP channel
+    BLE_PHOTO_PATH_COUNT
+};
+
+struct BleLinkStats {
+    bool connected;
+    uint16_t conn;                  // Transport connection id of the managed link
+    uint16_t mtu;                   // ATT MTU (23 until the client exchanges a larger one)
+    uint16_t tx_data_len;           // Link-layer PDU payload octets
+    uint16_t rx_data_len;
+    uint8_t tx_phy;                 // 1 = 1M, 2 = 2M, 3 = coded
+    uint8_t rx_phy;
+    BleLinkRequestState dle_state;
+    BleLinkRequestState phy_state;
+    uint16_t conn_interval_1250us;  // Connection interval in 1.25ms units (0 = not reported yet)
+    uint16_t conn_latency;
+    uint16_t supervision_timeout_10ms;
+    BleConnMode conn_mode;          // Last mode requested
+    uint32_t conn_mode_ms[BLE_CONN_MODE_COUNT]; // Time spent in each mode on this connection
+    uint32_t conn_updates;          // Parameter updates the central applied
+    uint32_t conn_update_failures;  // Requests refused locally or by the central
+    uint32_t photo_bytes;           // Last completed photo upload
+    uint32_t photo_ms;
+    uint32_t photo_bytes_per_sec;
+    uint32_t photo_best_bytes_per_sec; // Best upload on this connection
+    BlePhotoPath photo_path;        // Path of the last upload
+    uint32_t photo_path_uploads[BLE_PHOTO_PATH_COUNT]; // Uploads per path on this connection
+    uint32_t photo_path_bytes[BLE_PHOTO_PATH_COUNT];
+    uint32_t photo_path_ms[BLE_PHOTO_PATH_COUNT];
+};
+
+// Starts the DLE/PHY requests for a newly connected peer, unless a link is already managed
+// Subscribes to changes of the photo pacing parameters. Call once before the first connection.
+void ble_link_init();
+
+void ble_link_on_connect(uint16_t conn);
+// Returns true if conn was the managed link, which is then free for another client
+bool ble_link_on_disconnect(uint16_t conn);
+void ble_link_on_mtu_changed(uint16_t conn, uint16_t mtu);
+
+// Link-layer outcomes from the BLE transport (status 0 = success)
+void ble_link_on_data_length(uint16_t conn, int status, uint16_t tx_octets, uint16_t rx_octets);
+void ble_link_on_phy_update(uint16_t conn, int status, uint8_t tx_phy, uint8_t rx_phy);
+void ble_link_on_conn_params(uint16_t conn, int status, uint16_t interval, uint16_t latency, uint16_t timeout);
+
+// Workload reports from the photo and audio tasks. Each call re-evaluates the connection mode.
+void ble_link_set_photo_active(bool active);
+void ble_link_set_audio_active(bool active);
+
+// Applies pending slow-downs once their hold time has passed. Call periodically while connected.
+void ble_link_update_conn_mode();
+
+// Records a completed photo upload for the throughput statistics, per path so GATT and
+// L2CAP can be compared on the same link
+void ble_link_record_photo_transfer(size_t bytes, uint32_t elapsed_ms, BlePhotoPath path);
+
+BleLinkStats ble_link_get_stats();
+void ble_link_log_stats();
+
+#endif // BLE_LINK_H
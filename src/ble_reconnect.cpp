@@ -0,0 +1,100 @@
+#include "ble_reconnect.h"
+#include "ble_transport.h"
+#include "ble_session.h"
+#include "app_events.h"
+#include "config.h"
+#include "logger.h"
+#include <Arduino.h>
+#include <Preferences.h>
+
+static const char *LAYOUT_KEY = "layout";
+
+// Advertising state, written on the stack's task (connect) and the loop task (burst end)
+static volatile bool s_advertising = false;
+static volatile bool s_fast = false;
+static volatile uint32_t s_adv_start_ms = 0;
+
+// Interval in 0.625ms units, as whole ms for the log
+static unsigned adv_interval_ms(uint16_t interval) {
+    return (unsigned)interval * 5 / 8;
+}
+
+void ble_reconnect_init() {
+    uint32_t hash = ble_gatt_layout_hash();
+    Preferences prefs;
+    if (!prefs.begin(BLE_GATT_STORE_NAMESPACE, false)) {
+        logger_printf("[BLE] ERROR: Cannot open NVS to check the GATT layout!\n");
+        return;
+    }
+    bool stored = prefs.isKey(LAYOUT_KEY);
+    if (!stored || prefs.getUInt(LAYOUT_KEY, 0) != hash) {
+        if (stored) {
+            logger_printf("[BLE] GATT layout changed since the last boot. Bonded peers will rediscover it.\n");
+            ble_transport()->set_services_changed();
+        }
+        prefs.putUInt(LAYOUT_KEY, hash);
+    }
+    prefs.end();
+}
+
+void ble_reconnect_start_advertising(bool fast_burst) {
+    if (fast_burst || !s_advertising) {
+        s_adv_start_ms = millis();
+    }
+    s_fast = fast_burst;
+    s_advertising = true;
+    if (fast_burst) {
+        ble_transport()->start_advertising(BLE_ADV_FAST_MIN_INTERVAL, BLE_ADV_FAST_MAX_INTERVAL);
+        app_events_start_timer(APP_EVENT_ADV, BLE_ADV_FAST_DURATION_MS);
+    } else {
+        ble_transport()->start_advertising(BLE_ADV_SLOW_MIN_INTERVAL, BLE_ADV_SLOW_MAX_INTERVAL);
+    }
+}
+
+void ble_reconnect_update() {
+    if (!s_advertising || !s_fast) {
+        return;
+    }
+    uint32_t elapsed_ms = millis() - s_adv_start_ms;
+    if (elapsed_ms < BLE_ADV_FAST_DURATION_MS) {
+        // Timer ticks and millis() round differently: wait out the rest
+        app_events_start_timer(APP_EVENT_ADV, BLE_ADV_FAST_DURATION_MS - elapsed_ms);
+        return;
+    }
+    // A client may have taken the last session since; advertising stays off then
+    if (ble_session_count() >= BLE_MAX_CONNECTIONS) {
+        s_advertising = false;
+        return;
+    }
+    s_fast = false;
+    ble_transport()->start_advertising(BLE_ADV_SLOW_MIN_INTERVAL, BLE_ADV_SLOW_MAX_INTERVAL);
+    logger_printf("[ADV] No connection after %u s. Advertising every %u ms.\n",
+                  (unsigned)(BLE_ADV_FAST_DURATION_MS / 1000), adv_interval_ms(BLE_ADV_SLOW_MAX_INTERVAL));
+}
+
+void ble_reconnect_on_connect(uint16_t conn) {
+    // Connecting stops advertising; the BLE handler restarts it if there is room
+    bool fast = s_fast;
+    s_advertising = false;
+    s_fast = false;
+    bool bonded = ble_transport()->is_bonded(conn);
+    ble_session_set_bonded(conn, bonded);
+    logger_printf("[ADV] Conn %u connected %u ms after advertising started (%s interval, %s peer).\n", conn,
+                  (unsigned)(millis() - s_adv_start_ms), fast ? "fast" : "slow", bonded ? "bonded" : "new");
+    if (BLE_BONDING && !ble_transport()->request_encryption(conn)) {
+        logger_printf("[BLE] Could not request encryption on conn %u. The link stays unencrypted.\n", conn);
+    }
+}
+
+void ble_reconnect_on_encryption(uint16_t conn, int status, bool bonded) {
+    if (status != 0) {
+        logger_printf("[BLE] Encryption of conn %u failed (status %d).\n", conn, status);
+        return;
+    }
+    ble_session_set_encrypted(conn);
+    BleSession session;
+    if (ble_session_get(ble_session_index(conn), &session)) {
+        logger_printf("[BLE] Conn %u encrypted %u ms after connecting (%s).\n", conn, session.encrypted_ms,
+                      bonded ? (session.bonded ? "stored bond" : "new bond") : "not bonded");
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef BLE_RECONNECT_H
+#define BLE_RECONNECT_H
+
+#include <stdint.h>
+
+// Fast connection and reconnection. After boot, a wake from deep sleep or a disconnect, the
+// glasses advertise at BLE_ADV_FAST_* for BLE_ADV_FAST_DURATION_MS, while a phone that wants
+// them back is most likely scanning, then fall back to BLE_ADV_SLOW_* to save power.
+// Advertising for a further client while others are connected is slow from the start.
+//
+// With BLE_BONDING, each client is asked to encrypt the link after connecting: a new one pairs
+// (Just Works) and bonds, a known one re-encrypts with its stored keys. Phones keep the GATT
+// table of a bonded device cached and skip service discovery when they reconnect. The layout
+// hash of the table is kept in NVS; when a firmware update changes it, bonded peers are sent
+// Service Changed so they rediscover instead of using stale handles.
+//
+// Each connection logs its delay since advertising started, and its session records the
+// connect-to-encryption and connect-to-first-notification times (see ble_session.h).
+
+// Compares the GATT layout with the one bonded peers saw. Call after the transport's begin().
+void ble_reconnect_init();
+
+// Starts advertising, with the fast burst or directly at the slow interval
+void ble_reconnect_start_advertising(bool fast_burst);
+
+// Ends the fast burst once it has lasted BLE_ADV_FAST_DURATION_MS. Starting a burst arms
+// APP_EVENT_ADV for that time; call this from the main loop when the event fires.
+void ble_reconnect_update();
+
+// Called by the BLE handler on the stack's task, after the session is opened
+void ble_reconnect_on_connect(uint16_t conn);
+void ble_reconnect_on_encryption(uint16_t conn, int status, bool bonded);
+
+#endif // BLE_RECONNECT_H
@@ -0,0 +1,235 @@
+#include "ble_session.h"
+#include "config.h"
+#include "logger.h"
+#include <Arduino.h>
+#include <string.h>
+
+static_assert(BLE_MAX_CONNECTIONS <= 8 * sizeof(BleSessionMask), "Session masks hold one bit per session");
+static_assert(BLE_CHANNEL_COUNT <= 32, "Subscriptions hold one bit per channel");
+
+static const uint16_t DEFAULT_ATT_MTU = 23;
+
+static BleSession s_sessions[BLE_MAX_CONNECTIONS] = {};
+static uint32_t s_next_id = 1;
+static portMUX_TYPE s_session_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Statistics at the last log, per slot
+static uint32_t s_logged_id[BLE_MAX_CONNECTIONS] = {};
+static uint64_t s_logged_bytes[BLE_MAX_CONNECTIONS] = {};
+static unsigned long s_logged_ms[BLE_MAX_CONNECTIONS] = {};
+
+// Call inside s_session_mux
+static int find_session(uint16_t conn) {
+    for (size_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        if (s_sessions[i].open && s_sessions[i].conn == conn) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+int ble_session_open(uint16_t conn) {
+    int index = -1;
+    portENTER_CRITICAL(&s_session_mux);
+    for (size_t i = 0; i < BLE_MAX_CONNECTIONS && index < 0; i++) {
+        if (!s_sessions[i].open) {
+            index = (int)i;
+        }
+    }
+    if (index >= 0) {
+        BleSession &session = s_sessions[index];
+        memset(&session, 0, sizeof(session));
+        session.open = true;
+        session.conn = conn;
+        session.id = s_next_id++;
+        session.mtu = DEFAULT_ATT_MTU;
+        session.connected_ms = millis();
+    }
+    portEXIT_CRITICAL(&s_session_mux);
+    return index;
+}
+
+void ble_session_close(uint16_t conn) {
+    portENTER_CRITICAL(&s_session_mux);
+    int index = find_session(conn);
+    if (index >= 0) {
+        s_sessions[index].open = false;
+        s_sessions[index].subscriptions = 0;
+    }
+    portEXIT_CRITICAL(&s_session_mux);
+}
+
+void ble_session_set_mtu(uint16_t conn, uint16_t mtu) {
+    portENTER_CRITICAL(&s_session_mux);
+    int index = find_session(conn);
+    if (index >= 0) {
+        s_sessions[index].mtu = mtu;
+    }
+    portEXIT_CRITICAL(&s_session_mux);
+}
+
+void ble_session_set_subscribed(uint16_t conn, BleChannel channel, bool enabled) {
+    portENTER_CRITICAL(&s_session_mux);
+    int index = find_session(conn);
+    if (index >= 0) {
+        if (enabled) {
+            s_sessions[index].subscriptions |= (1u << channel);
+        } else {
+            s_sessions[index].subscriptions &= ~(1u << channel);
+        }
+    }
+    portEXIT_CRITICAL(&s_session_mux);
+}
+
+void ble_session_set_l2cap(uint16_t conn, uint16_t sdu_mtu) {
+    portENTER_CRITICAL(&s_session_mux);
+    int index = find_session(conn);
+    if (index >= 0) {
+        s_sessions[index].l2cap_sdu_mtu = sdu_mtu;
+    }
+    portEXIT_CRITICAL(&s_session_mux);
+}
+
+void ble_session_set_bonded(uint16_t conn, bool bonded) {
+    portENTER_CRITICAL(&s_session_mux);
+    int index = find_session(conn);
+    if (index >= 0) {
+        s_sessions[index].bonded = bonded;
+    }
+    portEXIT_CRITICAL(&s_session_mux);
+}
+
+// Delay since the session's connection, at least 1 so that 0 keeps meaning "not yet"
+static uint32_t ms_since_connect(const BleSession &session) {
+    uint32_t elapsed = (uint32_t)(millis() - session.connected_ms);
+    return elapsed ? elapsed : 1;
+}
+
+void ble_session_set_encrypted(uint16_t conn) {
+    portENTER_CRITICAL(&s_session_mux);
+    int index = find_session(conn);
+    if (index >= 0 && s_sessions[index].encrypted_ms == 0) {
+        s_sessions[index].encrypted_ms = ms_since_connect(s_sessions[index]);
+    }
+    portEXIT_CRITICAL(&s_session_mux);
+}
+
+int ble_session_index(uint16_t conn) {
+    portENTER_CRITICAL(&s_session_mux);
+    int index = find_session(conn);
+    portEXIT_CRITICAL(&s_session_mux);
+    return index;
+}
+
+bool ble_session_get(int index, BleSession *session) {
+    if (index < 0 || index >= (int)BLE_MAX_CONNECTIONS) {
+        return false;
+    }
+    portENTER_CRITICAL(&s_session_mux);
+    *session = s_sessions[index];
+    portEXIT_CRITICAL(&s_session_mux);
+    return session->open;
+}
+
+size_t ble_session_count() {
+    size_t count = 0;
+    portENTER_CRITICAL(&s_session_mux);
+    for (size_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        if (s_sessions[i].open) {
+            count++;
+        }
+    }
+    portEXIT_CRITICAL(&s_session_mux);
+    return count;
+}
+
+BleSessionMask ble_session_subscribers(BleChannel channel) {
+    BleSessionMask mask = 0;
+    portENTER_CRITICAL(&s_session_mux);
+    for (size_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        if (s_sessions[i].open && (s_sessions[i].subscriptions & (1u << channel))) {
+            mask |= (BleSessionMask)(1u << i);
+        }
+    }
+    portEXIT_CRITICAL(&s_session_mux);
+    return mask;
+}
+
+uint16_t ble_session_min_mtu(BleSessionMask mask) {
+    uint16_t mtu = 0;
+    portENTER_CRITICAL(&s_session_mux);
+    for (size_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        if ((mask & (1u << i)) && s_sessions[i].open && (mtu == 0 || s_sessions[i].mtu < mtu)) {
+            mtu = s_sessions[i].mtu;
+        }
+    }
+    portEXIT_CRITICAL(&s_session_mux);
+    return mtu ? mtu : DEFAULT_ATT_MTU;
+}
+
+void ble_session_record_notify(int index, size_t len, bool sent) {
+    if (index < 0 || index >= (int)BLE_MAX_CONNECTIONS) {
+        return;
+    }
+    BleSession first = {};
+    portENTER_CRITICAL(&s_session_mux);
+    BleSession &session = s_sessions[index];
+    if (sent) {
+        if (session.notifications == 0 && session.open) {
+            session.first_notify_ms = ms_since_connect(session);
+            first = session;
+        }
+        session.notifications++;
+        session.bytes += len;
+    } else {
+        session.failed++;
+    }
+    portEXIT_CRITICAL(&s_session_mux);
+    if (first.first_notify_ms) {
+        logger_printf("[BLE] First notification to conn %u %u ms after connecting (%s peer, encrypted after %u ms).\n",
+                      first.conn, first.first_notify_ms, first.bonded ? "bonded" : "new", first.encrypted_ms);
+    }
+}
+
+BleSessionMask ble_session_notify(BleSessionMask sessions, BleChannel channel, const uint8_t *data, size_t len) {
+    BleSessionMask refused = 0;
+    for (size_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        BleSession session;
+        if (!(sessions & (1u << i)) || !ble_session_get((int)i, &session) ||
+            !(session.subscriptions & (1u << channel))) {
+            continue;
+        }
+        bool ok = ble_transport()->notify(session.conn, channel, data, len);
+        ble_session_record_notify((int)i, len, ok);
+        if (!ok) {
+            refused |= (BleSessionMask)(1u << i);
+        }
+    }
+    return refused;
+}
+
+void ble_session_log_stats() {
+    unsigned long now = millis();
+    for (size_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        BleSession session;
+        if (!ble_session_get((int)i, &session)) {
+            continue;
+        }
+        if (s_logged_id[i] != session.id) {
+            // New client in this slot: its rate starts at its connection
+            s_logged_id[i] = session.id;
+            s_logged_bytes[i] = 0;
+            s_logged_ms[i] = session.connected_ms;
+        }
+        unsigned long elapsed_ms = now - s_logged_ms[i];
+        uint64_t bytes = session.bytes - s_logged_bytes[i];
+        logger_printf("[PEER] #%u (conn %u): %u B/s | MTU: %u | L2CAP SDU: %u | Subscriptions: 0x%03X | Sent: %u notifications, %u KB | Failed: %u | Connected: %u s | %s, encrypted +%u ms, first notification +%u ms\n",
+                      (unsigned)i, session.conn,
+                      elapsed_ms ? (uint32_t)(bytes * 1000 / elapsed_ms) : 0,
+                      session.mtu, session.l2cap_sdu_mtu, session.subscriptions, session.notifications, (uint32_t)(session.bytes / 1024),
+                      session.failed, (uint32_t)((now - session.connected_ms) / 1000),
+                      session.bonded ? "Bonded" : "New", session.encrypted_ms, session.first_notify_ms);
+        s_logged_bytes[i] = session.bytes;
+        s_logged_ms[i] = now;
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef BLE_SESSION_H
+#define BLE_SESSION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "ble_transport.h" // For BleChannel and BLE_CONN_NONE
+
+// Per-connection state for up to BLE_MAX_CONNECTIONS clients: the ATT MTU each negotiated,
+// the channels each subscribed to and what was sent to each. Sessions are addressed by slot
+// index; a set of sessions is a bit mask of indices, so one queued notification can be sent
+// to several clients (see ble_tx_scheduler.h). Upload cursors live with their producer
+// (photo_manager.cpp) and are tied to a session by its id.
+
+typedef uint8_t BleSessionMask;
+
+struct BleSession {
+    bool open;
+    uint16_t conn;             // Transport connection id
+    uint32_t id;               // Unique per connection, so a reused slot is never mistaken for its predecessor
+    uint16_t mtu;              // ATT MTU (23 until the client exchanges a larger one)
+    uint32_t subscriptions;    // Bit per BleChannel with notifications enabled
+    uint16_t l2cap_sdu_mtu;    // Largest SDU of the client's open L2CAP photo channel, 0 = none open
+    unsigned long connected_ms;
+    uint32_t notifications;    // Notifications the stack accepted for this client
+    uint64_t bytes;
+    uint32_t failed;           // Notifications the stack refused
+    // Reconnect timing (see ble_reconnect.h), in ms after connecting; 0 = not yet
+    bool bonded;               // The peer held a bond when it connected
+    uint32_t encrypted_ms;
+    uint32_t first_notify_ms;
+};
+
+// Called by the BLE handler on the stack's task. open returns the slot, or -1 if all are taken.
+int ble_session_open(uint16_t conn);
+void ble_session_close(uint16_t conn);
+void ble_session_set_mtu(uint16_t conn, uint16_t mtu);
+void ble_session_set_subscribed(uint16_t conn, BleChannel channel, bool enabled);
+void ble_session_set_l2cap(uint16_t conn, uint16_t sdu_mtu); // 0 when the channel closes
+void ble_session_set_bonded(uint16_t conn, bool bonded);
+void ble_session_set_encrypted(uint16_t conn);
+
+// Slot of a connection, or -1
+int ble_session_index(uint16_t conn);
+
+// Copies a session. Returns false if the slot is not open.
+bool ble_session_get(int index, BleSession *session);
+
+size_t ble_session_count();
+
+// Open sessions subscribed to a channel
+BleSessionMask ble_session_subscribers(BleChannel channel);
+
+// Smallest MTU among the sessions in mask (23 if it is empty), for payloads sent to all of them
+uint16_t ble_session_min_mtu(BleSessionMask mask);
+
+// Outcome of one notification to a session, for the per-client statistics. The first one
+// sent is logged with its delay after connecting.
+void ble_session_record_notify(int index, size_t len, bool sent);
+
+// Notifies every session in the mask that is still open and subscribed to the channel through
+// the transport, from the same buffer, and records each outcome. Returns the sessions whose
+// stack refused the notification.
+BleSessionMask ble_session_notify(BleSessionMask sessions, BleChannel channel, const uint8_t *data, size_t len);
+
+// Logs each client's throughput since the last call with the [PEER] tag
+void ble_session_log_stats();
+
+#endif // BLE_SESSION_H
@@ -0,0 +1,58 @@
+#include "ble_transport.h"
+#include "config.h" // For UUIDs and descriptions
+#include <string.h>
+
+const BleChannelSpec BLE_CHANNEL_SPECS[BLE_CHANNEL_COUNT] = {
+    {BLE_SERVICE_MAIN, PHOTO_DATA_UUID, 0, BLE_PROP_READ | BLE_PROP_NOTIFY, PHOTO_DATA_USER_DESCRIPTION},
+    {BLE_SERVICE_MAIN, PHOTO_CONTROL_UUID, 0, BLE_PROP_READ | BLE_PROP_WRITE, PHOTO_CONTROL_USER_DESCRIPTION},
+    {BLE_SERVICE_MAIN, AUDIO_CODEC_ULAW_UUID, 0, BLE_PROP_NOTIFY, AUDIO_ULAW_USER_DESCRIPTION},
+    {BLE_SERVICE_MAIN, AUDIO_CODEC_OPUS_UUID, 0, BLE_PROP_NOTIFY, AUDIO_OPUS_USER_DESCRIPTION},
+    {BLE_SERVICE_MAIN, AUDIO_CODEC_LOSSLESS_UUID, 0, BLE_PROP_NOTIFY, AUDIO_LOSSLESS_USER_DESCRIPTION},
+    {BLE_SERVICE_MAIN, AUDIO_LOGMEL_UUID, 0, BLE_PROP_NOTIFY, AUDIO_LOGMEL_USER_DESCRIPTION},
+    {BLE_SERVICE_MAIN, AUDIO_FORMAT_UUID, 0, BLE_PROP_READ | BLE_PROP_WRITE, AUDIO_FORMAT_USER_DESCRIPTION},
+    {BLE_SERVICE_MAIN, AUDIO_REPLAY_UUID, 0, BLE_PROP_READ | BLE_PROP_WRITE, AUDIO_REPLAY_USER_DESCRIPTION},
+    {BLE_SERVICE_MAIN, WIFI_OFFLOAD_UUID, 0, BLE_PROP_READ | BLE_PROP_WRITE, WIFI_OFFLOAD_USER_DESCRIPTION},
+    {BLE_SERVICE_MAIN, PARAM_CONFIG_UUID, 0, BLE_PROP_READ | BLE_PROP_WRITE, PARAM_CONFIG_USER_DESCRIPTION},
+    {BLE_SERVICE_OTA, OTA_CONTROL_UUID, 0, BLE_PROP_READ | BLE_PROP_WRITE | BLE_PROP_NOTIFY, OTA_CONTROL_USER_DESCRIPTION},
+    {BLE_SERVICE_OTA, OTA_DATA_UUID, 0, BLE_PROP_WRITE_NR, OTA_DATA_USER_DESCRIPTION},
+    {BLE_SERVICE_BATTERY, nullptr, BATTERY_LEVEL_CHAR_UUID, BLE_PROP_READ | BLE_PROP_NOTIFY, BATTERY_LEVEL_USER_DESCRIPTION},
+};
+
+// FNV-1a
+static uint32_t hash_bytes(uint32_t hash, const void *data, size_t len) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+uint32_t ble_gatt_layout_hash() {
+    uint32_t hash = 2166136261u;
+    const uint32_t handles[] = {MAIN_SERVICE_NUM_HANDLES, OTA_SERVICE_NUM_HANDLES};
+    hash = hash_bytes(hash, handles, sizeof(handles));
+    for (int c = 0; c < BLE_CHANNEL_COUNT; c++) {
+        const BleChannelSpec &spec = BLE_CHANNEL_SPECS[c];
+        hash = hash_bytes(hash, &spec.service, sizeof(spec.service));
+        if (spec.uuid) {
+            hash = hash_bytes(hash, spec.uuid, strlen(spec.uuid));
+        } else {
+            hash = hash_bytes(hash, &spec.uuid16, sizeof(spec.uuid16));
+        }
+        hash = hash_bytes(hash, &spec.properties, sizeof(spec.properties));
+    }
+    return hash;
+}
+
+static BleTransport *s_transport = nullptr;
+
+BleTransport *ble_transport() {
+    if (!s_transport) {
+        s_transport = ble_transport_default();
+    }
+    return s_transport;
+}
+
+void ble_transport_install(BleTransport *transport) {
+    s_transport = transport;
+}
@@ -0,0 +1,132 @@
+#ifndef BLE_TRANSPORT_H
+#define BLE_TRANSPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Interface between the firmware and the BLE stack. ble_handler.cpp implements the GATT
+// behaviour once, in terms of channels; a backend builds the GATT table from the UUIDs in
+// config.h and moves bytes and events between the stack and the firmware. Two backends
+// exist, selected at build time by BLE_USE_NIMBLE: the Arduino (Bluedroid) BLE library and
+// NimBLE-Arduino. Host tests can install a mock transport instead.
+
+// Characteristics of the GATT table the firmware reads, writes or notifies
+enum BleChannel : uint8_t {
+    BLE_CHANNEL_PHOTO_DATA = 0,
+    BLE_CHANNEL_PHOTO_CONTROL,
+    BLE_CHANNEL_AUDIO_ULAW,
+    BLE_CHANNEL_AUDIO_OPUS,
+    BLE_CHANNEL_AUDIO_LOSSLESS,
+    BLE_CHANNEL_AUDIO_LOGMEL,
+    BLE_CHANNEL_AUDIO_FORMAT,
+    BLE_CHANNEL_AUDIO_REPLAY,
+    BLE_CHANNEL_WIFI_OFFLOAD,
+    BLE_CHANNEL_PARAM_CONFIG,
+    BLE_CHANNEL_OTA_CONTROL,
+    BLE_CHANNEL_OTA_DATA,
+    BLE_CHANNEL_BATTERY_LEVEL,
+    BLE_CHANNEL_COUNT
+};
+
+// GATT layout shared by the backends: one entry per channel, in table order
+enum BleServiceId : uint8_t {
+    BLE_SERVICE_MAIN = 0,   // SERVICE_UUID
+    BLE_SERVICE_BATTERY,    // BATTERY_SERVICE_UUID
+    BLE_SERVICE_OTA,        // OTA_SERVICE_UUID
+    BLE_SERVICE_COUNT
+};
+
+constexpr uint8_t BLE_PROP_READ = 0x01;
+constexpr uint8_t BLE_PROP_WRITE = 0x02;
+constexpr uint8_t BLE_PROP_NOTIFY = 0x04;
+constexpr uint8_t BLE_PROP_WRITE_NR = 0x08; // Write without response
+
+struct BleChannelSpec {
+    BleServiceId service;
+    const char *uuid;        // 128-bit UUID string, or nullptr to use uuid16
+    uint16_t uuid16;
+    uint8_t properties;      // BLE_PROP_* flags
+    const char *description; // User description (0x2901)
+};
+
+extern const BleChannelSpec BLE_CHANNEL_SPECS[BLE_CHANNEL_COUNT];
+
+// Hash of the GATT layout (services, characteristics, properties and handle budgets). It
+// changes whenever the attribute handles a client may have cached can change.
+uint32_t ble_gatt_layout_hash();
+
+// Connections are identified by the stack's id (Bluedroid conn_id, NimBLE connection handle)
+constexpr uint16_t BLE_CONN_NONE = 0xFFFF;
+
+// PHY values as reported by the controller (the same in both stacks)
+constexpr uint8_t BLE_PHY_1M = 1;
+constexpr uint8_t BLE_PHY_2M = 2;
+constexpr uint8_t BLE_PHY_CODED = 3;
+
+// Events from the stack, delivered on the stack's task with the connection they concern.
+// A status of 0 means success.
+class BleTransportListener {
+public:
+    virtual ~BleTransportListener() {}
+    virtual void on_connect(uint16_t conn) = 0;
+    virtual void on_disconnect(uint16_t conn) = 0;
+    virtual void on_mtu_changed(uint16_t conn, uint16_t mtu) = 0;
+    virtual void on_subscribe(uint16_t conn, BleChannel channel, bool notifications) = 0;
+    virtual void on_write(uint16_t conn, BleChannel channel, const uint8_t *data, size_t len) = 0;
+    // Called before a read by conn is answered, so the value can be refreshed with set_value()
+    virtual void on_read(uint16_t conn, BleChannel channel) = 0;
+    virtual void on_data_length(uint16_t conn, int status, uint16_t tx_octets, uint16_t rx_octets) = 0;
+    virtual void on_phy_update(uint16_t conn, int status, uint8_t tx_phy, uint8_t rx_phy) = 0;
+    // Interval in 1.25ms units, supervision timeout in 10ms units
+    virtual void on_conn_params(uint16_t conn, int status, uint16_t interval, uint16_t latency, uint16_t timeout) = 0;
+    // The client on conn opened (sdu_mtu = largest SDU it accepts) or closed the L2CAP channel
+    virtual void on_l2cap_channel(uint16_t conn, bool open, uint16_t sdu_mtu) = 0;
+    // Pairing or re-encryption finished; bonded is true if the peer's keys are stored
+    virtual void on_encryption(uint16_t conn, int status, bool bonded) = 0;
+};
+
+class BleTransport {
+public:
+    virtual ~BleTransport() {}
+    virtual const char *name() const = 0;
+    // Starts the stack, offers BLE_LOCAL_MTU and builds the GATT table. Does not advertise.
+    virtual bool begin(BleTransportListener *listener) = 0;
+    // Advertises at an interval in 0.625ms units, restarting advertising if it is running
+    virtual void start_advertising(uint16_t min_interval, uint16_t max_interval) = 0;
+    // Notifies one client. The caller checks its subscription (see ble_session.h). Returns
+    // false if the stack refused it.
+    virtual bool notify(uint16_t conn, BleChannel channel, const uint8_t *data, size_t len) = 0;
+    // Value returned to reads, shared by all clients
+    virtual void set_value(BleChannel channel, const uint8_t *data, size_t len) = 0;
+    // Link-layer requests for a connection. A false return means the request was not
+    // started; otherwise the outcome arrives through the listener.
+    virtual bool request_data_length(uint16_t conn, uint16_t tx_octets) = 0;
+    virtual bool request_2m_phy(uint16_t conn) = 0;
+    virtual bool update_conn_params(uint16_t conn, uint16_t min_interval, uint16_t max_interval, uint16_t latency, uint16_t timeout) = 0;
+    // LE credit-based L2CAP channel for bulk data. A backend without one keeps the defaults,
+    // and the firmware stays on GATT.
+    // Accepts channels the client opens on psm. Returns false if not supported.
+    virtual bool l2cap_listen(uint16_t psm, uint16_t mtu) { return false; }
+    // Sends one SDU (at most the client's sdu_mtu) on the channel conn opened, waiting for
+    // credits. Returns false if conn has no open channel or the send failed.
+    virtual bool l2cap_send(uint16_t conn, const uint8_t *data, size_t len) { return false; }
+    // Bonding (see ble_reconnect.h). A backend without it never encrypts links.
+    // The peer of conn holds a bond from an earlier connection
+    virtual bool is_bonded(uint16_t conn) { return false; }
+    // Asks the peer to encrypt the link, pairing first if it has no keys. The outcome arrives
+    // through on_encryption.
+    virtual bool request_encryption(uint16_t conn) { return false; }
+    // The GATT table differs from the one bonded peers cached: they are sent Service Changed
+    virtual void set_services_changed() {}
+};
+
+// The transport in use: the installed one, or the backend selected by BLE_USE_NIMBLE
+BleTransport *ble_transport();
+
+// Replaces the build's backend (e.g. with a mock in host tests). Call before configure_ble().
+void ble_transport_install(BleTransport *transport);
+
+// Implemented by the backend compiled into this build
+BleTransport *ble_transport_default();
+
+#endif // BLE_TRANSPORT_H
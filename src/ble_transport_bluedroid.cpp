@@ -0,0 +1,331 @@
+#include "config.h"
+#if !BLE_USE_NIMBLE
+
+#include "ble_transport.h"
+#include <Arduino.h>
+#include <BLEDevice.h>
+#include <BLEServer.h>
+#include <BLE2902.h>
+#include <BLEDescriptor.h>
+#include <esp_gap_ble_api.h>
+#include <esp_gatts_api.h>
+#include <string.h>
+
+// Backend on the Arduino BLE library (Bluedroid host)
+
+static BleTransportListener *s_listener = nullptr;
+static BLECharacteristic *s_characteristics[BLE_CHANNEL_COUNT] = {};
+static BLE2902 *s_cccds[BLE_CHANNEL_COUNT] = {};
+static volatile uint16_t s_gatts_if = 0;
+
+// Address of each connection, since GAP events and requests identify the peer by address
+struct BluedroidPeer {
+    bool used;
+    uint16_t conn_id;
+    esp_bd_addr_t address;
+};
+static BluedroidPeer s_peers[BLE_MAX_CONNECTIONS] = {};
+
+// The data length event names no peer; it answers the last request
+static volatile uint16_t s_data_length_conn = BLE_CONN_NONE;
+
+// Bonded peers to tell about a changed GATT table. Bluedroid sends Service Changed to a peer
+// that is connected, so each one gets it when it encrypts during this boot.
+static volatile bool s_services_changed = false;
+
+#ifdef CONFIG_BT_SMP_MAX_BONDS
+static const int BLUEDROID_MAX_BONDS = CONFIG_BT_SMP_MAX_BONDS;
+#else
+static const int BLUEDROID_MAX_BONDS = 15;
+#endif
+static esp_ble_bond_dev_t s_bonds[BLUEDROID_MAX_BONDS]; // Used on the BTC task only
+
+static BluedroidPeer *find_peer(uint16_t conn_id) {
+    for (size_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        if (s_peers[i].used && s_peers[i].conn_id == conn_id) {
+            return &s_peers[i];
+        }
+    }
+    return nullptr;
+}
+
+static uint16_t conn_for_address(const esp_bd_addr_t address) {
+    for (size_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        if (s_peers[i].used && memcmp(s_peers[i].address, address, sizeof(esp_bd_addr_t)) == 0) {
+            return s_peers[i].conn_id;
+        }
+    }
+    return BLE_CONN_NONE;
+}
+
+class BluedroidServerCallbacks : public BLEServerCallbacks {
+    void onConnect(BLEServer *server, esp_ble_gatts_cb_param_t *param) override {
+        s_gatts_if = server->getGattsIf();
+        for (size_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+            if (!s_peers[i].used) {
+                s_peers[i].used = true;
+                s_peers[i].conn_id = param->connect.conn_id;
+                memcpy(s_peers[i].address, param->connect.remote_bda, sizeof(esp_bd_addr_t));
+                break;
+            }
+        }
+        s_listener->on_connect(param->connect.conn_id);
+    }
+
+    void onDisconnect(BLEServer *server, esp_ble_gatts_cb_param_t *param) override {
+        BluedroidPeer *peer = find_peer(param->disconnect.conn_id);
+        if (peer) {
+            peer->used = false;
+        }
+        s_listener->on_disconnect(param->disconnect.conn_id);
+    }
+
+    void onMtuChanged(BLEServer *server, esp_ble_gatts_cb_param_t *param) override {
+        s_listener->on_mtu_changed(param->mtu.conn_id, param->mtu.mtu);
+    }
+};
+
+class BluedroidChannelCallbacks : public BLECharacteristicCallbacks {
+public:
+    explicit BluedroidChannelCallbacks(BleChannel channel) : m_channel(channel) {}
+    void onWrite(BLECharacteristic *characteristic, esp_ble_gatts_cb_param_t *param) override {
+        s_listener->on_write(param->write.conn_id, m_channel, characteristic->getData(), characteristic->getLength());
+    }
+    void onRead(BLECharacteristic *characteristic, esp_ble_gatts_cb_param_t *param) override {
+        s_listener->on_read(param->read.conn_id, m_channel);
+    }
+private:
+    BleChannel m_channel;
+};
+
+// The library keeps one CCCD value for all clients, so subscriptions are taken from the raw
+// write event, which names the connection
+static void gatts_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param) {
+    if (event != ESP_GATTS_WRITE_EVT || param->write.is_prep || param->write.len != 2) {
+        return;
+    }
+    for (int c = 0; c < BLE_CHANNEL_COUNT; c++) {
+        if (s_cccds[c] && s_cccds[c]->getHandle() == param->write.handle) {
+            bool notifications = (((param->write.value[1] << 8) | param->write.value[0]) & 0x0001) != 0;
+            s_listener->on_subscribe(param->write.conn_id, (BleChannel)c, notifications);
+            return;
+        }
+    }
+}
+
+static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param) {
+    switch (event) {
+        case ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT:
+            s_listener->on_data_length(s_data_length_conn, param->pkt_data_length_cmpl.status,
+                                       param->pkt_data_length_cmpl.params.tx_len, param->pkt_data_length_cmpl.params.rx_len);
+            break;
+        case ESP_GAP_BLE_PHY_UPDATE_COMPLETE_EVT:
+            s_listener->on_phy_update(conn_for_address(param->phy_update.bda), param->phy_update.status, param->phy_update.tx_phy, param->phy_update.rx_phy);
+            break;
+        case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT:
+            // Also reported when the central changes the parameters on its own
+            s_listener->on_conn_params(conn_for_address(param->update_conn_params.bda), param->update_conn_params.status, param->update_conn_params.conn_int,
+                                       param->update_conn_params.latency, param->update_conn_params.timeout);
+            break;
+        case ESP_GAP_BLE_AUTH_CMPL_EVT: {
+            uint16_t conn = conn_for_address(param->ble_security.auth_cmpl.bd_addr);
+            bool success = param->ble_security.auth_cmpl.success;
+            if (success && s_services_changed) {
+                esp_ble_gatts_send_service_change_indication((esp_gatt_if_t)s_gatts_if, param->ble_security.auth_cmpl.bd_addr);
+            }
+            s_listener->on_encryption(conn, success ? 0 : param->ble_security.auth_cmpl.fail_reason,
+                                      success && (param->ble_security.auth_cmpl.auth_mode & ESP_LE_AUTH_BOND));
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static uint32_t characteristic_properties(uint8_t properties) {
+    uint32_t result = 0;
+    if (properties & BLE_PROP_READ) {
+        result |= BLECharacteristic::PROPERTY_READ;
+    }
+    if (properties & BLE_PROP_WRITE) {
+        result |= BLECharacteristic::PROPERTY_WRITE;
+    }
+    if (properties & BLE_PROP_NOTIFY) {
+        result |= BLECharacteristic::PROPERTY_NOTIFY;
+    }
+    if (properties & BLE_PROP_WRITE_NR) {
+        result |= BLECharacteristic::PROPERTY_WRITE_NR;
+    }
+    return result;
+}
+
+class BluedroidTransport : public BleTransport {
+public:
+    const char *name() const override { return "Bluedroid"; }
+
+    bool begin(BleTransportListener *listener) override {
+        s_listener = listener;
+        BLEDevice::init(DEVICE_MODEL_NUMBER); // Device name
+        BLEDevice::setMTU(BLE_LOCAL_MTU);     // Accepted when the client exchanges MTU
+        BLEDevice::setCustomGapHandler(gap_event_handler);
+        BLEDevice::setCustomGattsHandler(gatts_event_handler);
+        if (BLE_BONDING) {
+            // Just Works with LE Secure Connections. Identity keys are exchanged so a phone
+            // with a private address is recognised when it returns.
+            esp_ble_auth_req_t auth = ESP_LE_AUTH_REQ_SC_BOND;
+            esp_ble_io_cap_t io_cap = ESP_IO_CAP_NONE;
+            uint8_t keys = ESP_BLE_ENC_KEY_MASK | ESP_BLE_ID_KEY_MASK;
+            esp_ble_gap_set_security_param(ESP_BLE_SM_AUTHEN_REQ_MODE, &auth, sizeof(auth));
+            esp_ble_gap_set_security_param(ESP_BLE_SM_IOCAP_MODE, &io_cap, sizeof(io_cap));
+            esp_ble_gap_set_security_param(ESP_BLE_SM_SET_INIT_KEY, &keys, sizeof(keys));
+            esp_ble_gap_set_security_param(ESP_BLE_SM_SET_RSP_KEY, &keys, sizeof(keys));
+        }
+        BLEServer *server = BLEDevice::createServer();
+        server->setCallbacks(new BluedroidServerCallbacks());
+
+        // Services are created in the original order so attribute handles stay the same
+        BLEService *services[BLE_SERVICE_COUNT];
+        services[BLE_SERVICE_MAIN] = server->createService(BLEUUID(SERVICE_UUID), MAIN_SERVICE_NUM_HANDLES);
+        BLEService *device_info_service = server->createService(DEVICE_INFORMATION_SERVICE_UUID);
+        services[BLE_SERVICE_BATTERY] = server->createService(BATTERY_SERVICE_UUID);
+        services[BLE_SERVICE_OTA] = server->createService(BLEUUID(OTA_SERVICE_UUID), OTA_SERVICE_NUM_HANDLES);
+        for (int c = 0; c < BLE_CHANNEL_COUNT; c++) {
+            const BleChannelSpec &spec = BLE_CHANNEL_SPECS[c];
+            BLEUUID uuid = spec.uuid ? BLEUUID(spec.uuid) : BLEUUID(spec.uuid16);
+            BLECharacteristic *characteristic = services[spec.service]->createCharacteristic(uuid, characteristic_properties(spec.properties));
+            characteristic->setCallbacks(new BluedroidChannelCallbacks((BleChannel)c));
+            if (spec.properties & BLE_PROP_NOTIFY) {
+                s_cccds[c] = new BLE2902();
+                characteristic->addDescriptor(s_cccds[c]);
+            }
+            BLEDescriptor *description = new BLEDescriptor(BLEUUID((uint16_t)0x2901));
+            description->setValue(spec.description);
+            characteristic->addDescriptor(description);
+            s_characteristics[c] = characteristic;
+        }
+
+        // Device Information Service
+        BLECharacteristic *manufacturer = device_info_service->createCharacteristic(MANUFACTURER_NAME_STRING_CHAR_UUID, BLECharacteristic::PROPERTY_READ);
+        manufacturer->setValue(DEVICE_MANUFACTURER_NAME);
+        BLECharacteristic *model = device_info_service->createCharacteristic(MODEL_NUMBER_STRING_CHAR_UUID, BLECharacteristic::PROPERTY_READ);
+        model->setValue(DEVICE_MODEL_NUMBER);
+        BLECharacteristic *firmware = device_info_service->createCharacteristic(FIRMWARE_REVISION_STRING_CHAR_UUID, BLECharacteristic::PROPERTY_READ);
+        firmware->setValue(DEVICE_FIRMWARE_REVISION);
+        BLECharacteristic *hardware = device_info_service->createCharacteristic(HARDWARE_REVISION_STRING_CHAR_UUID, BLECharacteristic::PROPERTY_READ);
+        hardware->setValue(DEVICE_HARDWARE_REVISION);
+
+        // Start services
+        services[BLE_SERVICE_MAIN]->start();
+        device_info_service->start();
+        services[BLE_SERVICE_BATTERY]->start();
+        services[BLE_SERVICE_OTA]->start();
+
+        BLEAdvertising *advertising = BLEDevice::getAdvertising();
+        advertising->addServiceUUID(BLEUUID(SERVICE_UUID));
+        advertising->addServiceUUID(DEVICE_INFORMATION_SERVICE_UUID);
+        advertising->addServiceUUID(BATTERY_SERVICE_UUID);
+        advertising->setScanResponse(true);
+        // The interval is set by start_advertising (see ble_reconnect.h)
+        // Preferred connection parameters until the first workload-driven update (see ble_link.h)
+        advertising->setMinPreferred(0x06);  // 7.5ms
+        advertising->setMaxPreferred(0x10);  // 20ms
+        return true;
+    }
+
+    void start_advertising(uint16_t min_interval, uint16_t max_interval) override {
+        // The parameters only apply when advertising starts
+        BLEAdvertising *advertising = BLEDevice::getAdvertising();
+        advertising->stop();
+        advertising->setMinInterval(min_interval);
+        advertising->setMaxInterval(max_interval);
+        advertising->start();
+    }
+
+    bool notify(uint16_t conn, BleChannel channel, const uint8_t *data, size_t len) override {
+        BLECharacteristic *characteristic = s_characteristics[channel];
+        if (!BLE_TX_DIRECT_NOTIFY) {
+            // Library path: setValue() copies into the characteristic's value storage first,
+            // and notify() reaches every client, so it is only meant for single-client tests
+            characteristic->setValue((uint8_t *)data, len);
+            characteristic->notify();
+            return true;
+        }
+        esp_err_t err = esp_ble_gatts_send_indicate((esp_gatt_if_t)s_gatts_if, conn, characteristic->getHandle(),
+                                                    len, (uint8_t *)data, false);
+        return err == ESP_OK;
+    }
+
+    void set_value(BleChannel channel, const uint8_t *data, size_t len) override {
+        if (s_characteristics[channel]) {
+            s_characteristics[channel]->setValue((uint8_t *)data, len);
+        }
+    }
+
+    bool request_data_length(uint16_t conn, uint16_t tx_octets) override {
+        BluedroidPeer *peer = find_peer(conn);
+        if (!peer) {
+            return false;
+        }
+        s_data_length_conn = conn;
+        return esp_ble_gap_set_pkt_data_len(peer->address, tx_octets) == ESP_OK;
+    }
+
+    bool request_2m_phy(uint16_t conn) override {
+        BluedroidPeer *peer = find_peer(conn);
+        if (!peer) {
+            return false;
+        }
+        // Both PHYs stay allowed, so a peer without 2M support keeps 1M instead of failing
+        return esp_ble_gap_set_preferred_phy(peer->address, 0,
+                                             ESP_BLE_GAP_PHY_1M_PREF_MASK | ESP_BLE_GAP_PHY_2M_PREF_MASK,
+                                             ESP_BLE_GAP_PHY_1M_PREF_MASK | ESP_BLE_GAP_PHY_2M_PREF_MASK,
+                                             ESP_BLE_GAP_PHY_OPTIONS_NO_PREF) == ESP_OK;
+    }
+
+    bool update_conn_params(uint16_t conn, uint16_t min_interval, uint16_t max_interval, uint16_t latency, uint16_t timeout) override {
+        BluedroidPeer *peer = find_peer(conn);
+        if (!peer) {
+            return false;
+        }
+        esp_ble_conn_update_params_t params = {};
+        memcpy(params.bda, peer->address, sizeof(params.bda));
+        params.min_int = min_interval;
+        params.max_int = max_interval;
+        params.latency = latency;
+        params.timeout = timeout;
+        return esp_ble_gap_update_conn_params(&params) == ESP_OK;
+    }
+
+    bool is_bonded(uint16_t conn) override {
+        BluedroidPeer *peer = find_peer(conn);
+        int count = BLUEDROID_MAX_BONDS;
+        if (!peer || esp_ble_get_bond_device_list(&count, s_bonds) != ESP_OK) {
+            return false;
+        }
+        for (int i = 0; i < count; i++) {
+            if (memcmp(s_bonds[i].bd_addr, peer->address, sizeof(esp_bd_addr_t)) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool request_encryption(uint16_t conn) override {
+        BluedroidPeer *peer = find_peer(conn);
+        if (!peer) {
+            return false;
+        }
+        return esp_ble_set_encryption(peer->address, ESP_BLE_SEC_ENCRYPT_NO_MITM) == ESP_OK;
+    }
+
+    void set_services_changed() override {
+        s_services_changed = true;
+    }
+};
+
+BleTransport *ble_transport_default() {
+    static BluedroidTransport transport;
+    return &transport;
+}
+
+#endif // !BLE_USE_NIMBLE
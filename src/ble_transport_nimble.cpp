@@ -0,0 +1,256 @@
+#include "config.h"
+#if BLE_USE_NIMBLE
+
+#if !__has_include(<NimBLEDevice.h>)
+#error "BLE_USE_NIMBLE needs the NimBLE-Arduino library (2.x)"
+#endif
+
+#include "ble_transport.h"
+#include <Arduino.h>
+#include <NimBLEDevice.h>
+#include <string.h>
+#if __has_include(<services/gatt/ble_svc_gatt.h>)
+#include <services/gatt/ble_svc_gatt.h>
+#else
+#include "nimble/nimble/host/services/gatt/include/services/gatt/ble_svc_gatt.h"
+#endif
+
+// LE credit-based channels arrived in NimBLE-Arduino 2.2; older versions stay on GATT
+#if __has_include(<NimBLEL2CAPServer.h>)
+#define BLE_NIMBLE_HAS_L2CAP 1
+#include <NimBLEL2CAPServer.h>
+#include <NimBLEL2CAPChannel.h>
+#include <vector>
+#else
+#define BLE_NIMBLE_HAS_L2CAP 0
+#endif
+
+// Backend on NimBLE-Arduino 2.x. NimBLE keeps the CCCDs itself and notifies straight from
+// the caller's buffer, and its host needs far less internal RAM than Bluedroid.
+
+static BleTransportListener *s_listener = nullptr;
+static NimBLECharacteristic *s_characteristics[BLE_CHANNEL_COUNT] = {};
+
+class NimbleServerCallbacks : public NimBLEServerCallbacks {
+    void onConnect(NimBLEServer *server, NimBLEConnInfo &info) override {
+        s_listener->on_connect(info.getConnHandle());
+    }
+
+    void onDisconnect(NimBLEServer *server, NimBLEConnInfo &info, int reason) override {
+        s_listener->on_disconnect(info.getConnHandle());
+    }
+
+    void onMTUChange(uint16_t mtu, NimBLEConnInfo &info) override {
+        s_listener->on_mtu_changed(info.getConnHandle(), mtu);
+    }
+
+    // NimBLE only reports updates that took effect; refusals surface as ble_link's timeout
+    void onConnParamsUpdate(NimBLEConnInfo &info) override {
+        s_listener->on_conn_params(info.getConnHandle(), 0, info.getConnInterval(), info.getConnLatency(), info.getConnTimeout());
+    }
+
+    void onPhyUpdate(NimBLEConnInfo &info, uint8_t tx_phy, uint8_t rx_phy) override {
+        s_listener->on_phy_update(info.getConnHandle(), 0, tx_phy, rx_phy);
+    }
+
+    void onAuthenticationComplete(NimBLEConnInfo &info) override {
+        s_listener->on_encryption(info.getConnHandle(), info.isEncrypted() ? 0 : -1, info.isBonded());
+    }
+};
+
+class NimbleChannelCallbacks : public NimBLECharacteristicCallbacks {
+public:
+    explicit NimbleChannelCallbacks(BleChannel channel) : m_channel(channel) {}
+    void onWrite(NimBLECharacteristic *characteristic, NimBLEConnInfo &info) override {
+        NimBLEAttValue value = characteristic->getValue();
+        s_listener->on_write(info.getConnHandle(), m_channel, value.data(), value.size());
+    }
+    void onRead(NimBLECharacteristic *characteristic, NimBLEConnInfo &info) override {
+        s_listener->on_read(info.getConnHandle(), m_channel);
+    }
+    void onSubscribe(NimBLECharacteristic *characteristic, NimBLEConnInfo &info, uint16_t sub_value) override {
+        s_listener->on_subscribe(info.getConnHandle(), m_channel, (sub_value & 0x0001) != 0);
+    }
+private:
+    BleChannel m_channel;
+};
+
+#if BLE_NIMBLE_HAS_L2CAP
+static NimBLEL2CAPChannel *s_l2cap_channel = nullptr;
+static volatile bool s_l2cap_open = false;
+static volatile uint16_t s_l2cap_conn = BLE_CONN_NONE; // Connection that opened the channel
+
+class NimbleL2capCallbacks : public NimBLEL2CAPChannelCallbacks {
+    void onConnect(NimBLEL2CAPChannel *channel, uint16_t negotiated_mtu) override {
+        s_l2cap_conn = channel->getConnHandle();
+        s_l2cap_open = true;
+        s_listener->on_l2cap_channel(s_l2cap_conn, true, negotiated_mtu);
+    }
+    void onRead(NimBLEL2CAPChannel *channel, std::vector<uint8_t> &data) override {
+        // The channel only carries data to the client
+    }
+    void onDisconnect(NimBLEL2CAPChannel *channel) override {
+        s_l2cap_open = false;
+        s_listener->on_l2cap_channel(s_l2cap_conn, false, 0);
+        s_l2cap_conn = BLE_CONN_NONE;
+    }
+};
+#endif
+
+static uint32_t characteristic_properties(uint8_t properties) {
+    uint32_t result = 0;
+    if (properties & BLE_PROP_READ) {
+        result |= NIMBLE_PROPERTY::READ;
+    }
+    if (properties & BLE_PROP_WRITE) {
+        result |= NIMBLE_PROPERTY::WRITE;
+    }
+    if (properties & BLE_PROP_NOTIFY) {
+        result |= NIMBLE_PROPERTY::NOTIFY;
+    }
+    if (properties & BLE_PROP_WRITE_NR) {
+        result |= NIMBLE_PROPERTY::WRITE_NR;
+    }
+    return result;
+}
+
+static void set_string_value(NimBLECharacteristic *characteristic, const char *value) {
+    characteristic->setValue((const uint8_t *)value, strlen(value));
+}
+
+class NimbleTransport : public BleTransport {
+public:
+    const char *name() const override { return "NimBLE"; }
+
+    bool begin(BleTransportListener *listener) override {
+        s_listener = listener;
+        NimBLEDevice::init(DEVICE_MODEL_NUMBER);
+        NimBLEDevice::setMTU(BLE_LOCAL_MTU);
+        if (BLE_BONDING) {
+            // Just Works with LE Secure Connections. Bonds persist in NVS when the host is
+            // built with CONFIG_BT_NIMBLE_NVS_PERSIST.
+            NimBLEDevice::setSecurityAuth(true, false, true);
+            NimBLEDevice::setSecurityIOCap(BLE_HS_IO_NO_INPUT_OUTPUT);
+        }
+        NimBLEServer *server = NimBLEDevice::createServer();
+        server->setCallbacks(new NimbleServerCallbacks());
+        server->advertiseOnDisconnect(false); // ble_handler restarts advertising itself
+
+        // Same services, characteristics and order as the Bluedroid backend
+        NimBLEService *services[BLE_SERVICE_COUNT];
+        services[BLE_SERVICE_MAIN] = server->createService(NimBLEUUID(SERVICE_UUID));
+        NimBLEService *device_info_service = server->createService(NimBLEUUID(DEVICE_INFORMATION_SERVICE_UUID));
+        services[BLE_SERVICE_BATTERY] = server->createService(NimBLEUUID(BATTERY_SERVICE_UUID));
+        services[BLE_SERVICE_OTA] = server->createService(NimBLEUUID(OTA_SERVICE_UUID));
+        for (int c = 0; c < BLE_CHANNEL_COUNT; c++) {
+            const BleChannelSpec &spec = BLE_CHANNEL_SPECS[c];
+            NimBLEUUID uuid = spec.uuid ? NimBLEUUID(spec.uuid) : NimBLEUUID(spec.uuid16);
+            NimBLECharacteristic *characteristic = services[spec.service]->createCharacteristic(uuid, characteristic_properties(spec.properties));
+            characteristic->setCallbacks(new NimbleChannelCallbacks((BleChannel)c));
+            NimBLEDescriptor *description = characteristic->createDescriptor(NimBLEUUID((uint16_t)0x2901), NIMBLE_PROPERTY::READ,
+                                                                             strlen(spec.description));
+            description->setValue((const uint8_t *)spec.description, strlen(spec.description));
+            s_characteristics[c] = characteristic;
+        }
+
+        set_string_value(device_info_service->createCharacteristic(NimBLEUUID(MANUFACTURER_NAME_STRING_CHAR_UUID), NIMBLE_PROPERTY::READ), DEVICE_MANUFACTURER_NAME);
+        set_string_value(device_info_service->createCharacteristic(NimBLEUUID(MODEL_NUMBER_STRING_CHAR_UUID), NIMBLE_PROPERTY::READ), DEVICE_MODEL_NUMBER);
+        set_string_value(device_info_service->createCharacteristic(NimBLEUUID(FIRMWARE_REVISION_STRING_CHAR_UUID), NIMBLE_PROPERTY::READ), DEVICE_FIRMWARE_REVISION);
+        set_string_value(device_info_service->createCharacteristic(NimBLEUUID(HARDWARE_REVISION_STRING_CHAR_UUID), NIMBLE_PROPERTY::READ), DEVICE_HARDWARE_REVISION);
+        server->start();
+
+        NimBLEAdvertising *advertising = NimBLEDevice::getAdvertising();
+        advertising->setName(DEVICE_MODEL_NUMBER);
+        advertising->addServiceUUID(NimBLEUUID(SERVICE_UUID));
+        advertising->addServiceUUID(NimBLEUUID(DEVICE_INFORMATION_SERVICE_UUID));
+        advertising->addServiceUUID(NimBLEUUID(BATTERY_SERVICE_UUID));
+        advertising->enableScanResponse(true);
+        // The interval is set by start_advertising (see ble_reconnect.h)
+        advertising->setPreferredParams(0x06, 0x10); // 7.5-20ms until the first workload-driven update
+        return true;
+    }
+
+    void start_advertising(uint16_t min_interval, uint16_t max_interval) override {
+        // The parameters only apply when advertising starts
+        NimBLEAdvertising *advertising = NimBLEDevice::getAdvertising();
+        if (advertising->isAdvertising()) {
+            advertising->stop();
+        }
+        advertising->setMinInterval(min_interval);
+        advertising->setMaxInterval(max_interval);
+        advertising->start();
+    }
+
+    bool notify(uint16_t conn, BleChannel channel, const uint8_t *data, size_t len) override {
+        // Sent straight from data
+        return s_characteristics[channel]->notify(data, len, conn);
+    }
+
+    void set_value(BleChannel channel, const uint8_t *data, size_t len) override {
+        if (s_characteristics[channel]) {
+            s_characteristics[channel]->setValue(data, len);
+        }
+    }
+
+    bool request_data_length(uint16_t conn, uint16_t tx_octets) override {
+        // NimBLE-Arduino does not forward the data length change event, so the outcome of
+        // the request itself is reported
+        uint16_t tx_time_us = (tx_octets + 14) * 8; // 1M PHY air time of a full PDU
+        int rc = ble_gap_set_data_len(conn, tx_octets, tx_time_us);
+        s_listener->on_data_length(conn, rc, tx_octets, tx_octets);
+        return true;
+    }
+
+    bool request_2m_phy(uint16_t conn) override {
+        // Both PHYs stay allowed, so a peer without 2M support keeps 1M instead of failing
+        uint8_t phys = BLE_GAP_LE_PHY_1M_MASK | BLE_GAP_LE_PHY_2M_MASK;
+        return ble_gap_set_prefered_le_phy(conn, phys, phys, BLE_GAP_LE_PHY_CODED_ANY) == 0;
+    }
+
+    bool update_conn_params(uint16_t conn, uint16_t min_interval, uint16_t max_interval, uint16_t latency, uint16_t timeout) override {
+        ble_gap_upd_params params = {};
+        params.itvl_min = min_interval;
+        params.itvl_max = max_interval;
+        params.latency = latency;
+        params.supervision_timeout = timeout;
+        return ble_gap_update_params(conn, &params) == 0;
+    }
+
+    bool is_bonded(uint16_t conn) override {
+        return NimBLEDevice::isBonded(NimBLEDevice::getServer()->getPeerInfoByHandle(conn).getIdAddress());
+    }
+
+    bool request_encryption(uint16_t conn) override {
+        return NimBLEDevice::startSecurity(conn);
+    }
+
+    void set_services_changed() override {
+        // The host also keeps the indication for bonded peers that are not connected and
+        // sends it when they return
+        ble_svc_gatt_changed(0x0001, 0xFFFF);
+    }
+
+#if BLE_NIMBLE_HAS_L2CAP
+    bool l2cap_listen(uint16_t psm, uint16_t mtu) override {
+        // Fails when the host was built without CoC support (CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM = 0)
+        s_l2cap_channel = NimBLEDevice::createL2CAPServer()->createService(psm, mtu, new NimbleL2capCallbacks());
+        return s_l2cap_channel != nullptr;
+    }
+
+    bool l2cap_send(uint16_t conn, const uint8_t *data, size_t len) override {
+        if (!s_l2cap_open || s_l2cap_conn != conn) {
+            return false;
+        }
+        // The library takes the SDU as a vector and blocks while the client has no credits
+        std::vector<uint8_t> sdu(data, data + len);
+        return s_l2cap_channel->write(sdu);
+    }
+#endif
+};
+
+BleTransport *ble_transport_default() {
+    static NimbleTransport transport;
+    return &transport;
+}
+
+#endif // BLE_USE_NIMBLE
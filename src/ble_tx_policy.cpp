@@ -0,0 +1,95 @@
+#include "ble_tx_policy.h"
+#include <string.h>
+
+static const int64_t US_PER_SEC = 1000000;
+
+static void bucket_refill(BleTxTokenBucket &bucket, int64_t now_us) {
+    int64_t elapsed = now_us - bucket.last_refill_us;
+    bucket.last_refill_us = now_us;
+    if (elapsed <= 0) {
+        return;
+    }
+    int64_t cap = (int64_t)bucket.burst_bytes * US_PER_SEC;
+    bucket.tokens += elapsed * bucket.rate_bytes_per_sec;
+    if (bucket.tokens > cap) {
+        bucket.tokens = cap;
+    }
+}
+
+void ble_tx_policy_init(BleTxPolicy &policy, const uint32_t rate_bytes_per_sec[BLE_TX_STREAM_COUNT],
+                        const uint32_t burst_bytes[BLE_TX_STREAM_COUNT], int64_t now_us) {
+    memset(&policy, 0, sizeof(policy));
+    for (int s = 0; s < BLE_TX_STREAM_COUNT; s++) {
+        BleTxTokenBucket &bucket = policy.buckets[s];
+        bucket.rate_bytes_per_sec = rate_bytes_per_sec[s];
+        bucket.burst_bytes = burst_bytes[s];
+        bucket.tokens = (int64_t)bucket.burst_bytes * US_PER_SEC;
+        bucket.last_refill_us = now_us;
+    }
+}
+
+int ble_tx_policy_select(BleTxPolicy &policy, const size_t head_len[BLE_TX_STREAM_COUNT], int64_t now_us, uint32_t *wait_us) {
+    uint32_t wait = UINT32_MAX;
+    for (int s = 0; s < BLE_TX_STREAM_COUNT; s++) {
+        if (head_len[s] == 0) {
+            continue;
+        }
+        BleTxTokenBucket &bucket = policy.buckets[s];
+        if (bucket.rate_bytes_per_sec == 0) {
+            return s;
+        }
+
+        // A full bucket always admits the head, even one larger than the burst size,
+        // so an undersized burst slows the stream down instead of stalling it
+        bucket_refill(bucket, now_us);
+        int64_t needed = (int64_t)head_len[s] * US_PER_SEC;
+        int64_t cap = (int64_t)bucket.burst_bytes * US_PER_SEC;
+        if (bucket.tokens >= needed || bucket.tokens >= cap) {
+            bucket.tokens -= needed;
+            return s;
+        }
+
+        policy.stats[s].throttled++;
+        int64_t target = needed < cap ? needed : cap;
+        int64_t stream_wait = (target - bucket.tokens + bucket.rate_bytes_per_sec - 1) / bucket.rate_bytes_per_sec;
+        if (stream_wait < (int64_t)wait) {
+            wait = (uint32_t)stream_wait;
+        }
+    }
+    if (wait_us) {
+        *wait_us = wait;
+    }
+    return BLE_TX_STREAM_NONE;
+}
+
+void ble_tx_policy_set_rate(BleTxPolicy &policy, int stream, uint32_t rate_bytes_per_sec, int64_t now_us) {
+    BleTxTokenBucket &bucket = policy.buckets[stream];
+    bucket_refill(bucket, now_us); // Tokens earned so far count at the old rate
+    bucket.rate_bytes_per_sec = rate_bytes_per_sec;
+}
+
+void ble_tx_policy_on_enqueue(BleTxPolicy &policy, int stream, uint32_t queue_depth, uint32_t cpu_us) {
+    BleTxStreamStats &stats = policy.stats[stream];
+    stats.cpu_us += cpu_us;
+    stats.queue_depth = queue_depth;
+    if (queue_depth > stats.max_queue_depth) {
+        stats.max_queue_depth = queue_depth;
+    }
+}
+
+void ble_tx_policy_on_sent(BleTxPolicy &policy, int stream, size_t len, int64_t enqueued_us, int64_t now_us, uint32_t queue_depth, uint32_t cpu_us) {
+    BleTxStreamStats &stats = policy.stats[stream];
+    stats.cpu_us += cpu_us;
+    uint32_t latency = (now_us > enqueued_us) ? (uint32_t)(now_us - enqueued_us) : 0;
+    stats.packets++;
+    stats.bytes += len;
+    stats.latency_total_us += latency;
+    if (latency > stats.latency_max_us) {
+        stats.latency_max_us = latency;
+    }
+    stats.queue_depth = queue_depth;
+}
+
+void ble_tx_policy_on_drop(BleTxPolicy &policy, int stream) {
+    policy.stats[stream].drops++;
+}
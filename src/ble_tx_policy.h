@@ -0,0 +1,64 @@
+#ifndef BLE_TX_POLICY_H
+#define BLE_TX_POLICY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Scheduling policy for the BLE transmit scheduler (ble_tx_scheduler.h). Streams are served
+// in strict priority order: a queued notification of a higher-priority stream always goes
+// first. Each stream can also be limited by a token bucket so bulk data cannot fill the
+// controller's buffers ahead of real-time audio. A throttled stream does not block the
+// streams below it. This is a pure module with no hardware dependencies.
+
+enum BleTxStream {
+    BLE_TX_STREAM_AUDIO = 0, // Real-time audio, highest priority
+    BLE_TX_STREAM_PHOTO,     // Bulk photo chunks
+    BLE_TX_STREAM_COUNT
+};
+
+constexpr int BLE_TX_STREAM_NONE = -1;
+
+// Tokens are kept in byte-microseconds per second so refills need no division.
+// A rate of 0 means the stream is not limited.
+struct BleTxTokenBucket {
+    uint32_t rate_bytes_per_sec;
+    uint32_t burst_bytes;
+    int64_t tokens;
+    int64_t last_refill_us;
+};
+
+// Cumulative per-stream counters
+struct BleTxStreamStats {
+    uint32_t packets;
+    uint64_t bytes;
+    uint32_t drops;           // Notifications refused (queue full) or discarded (link down)
+    uint32_t queue_depth;     // Queued when last enqueued or sent
+    uint32_t max_queue_depth;
+    uint64_t latency_total_us; // Enqueue-to-send time
+    uint32_t latency_max_us;
+    uint32_t throttled;       // Times the stream had data but no tokens
+    uint64_t cpu_us;          // Time spent copying in and sending, for CPU cost per KB
+};
+
+struct BleTxPolicy {
+    BleTxTokenBucket buckets[BLE_TX_STREAM_COUNT];
+    BleTxStreamStats stats[BLE_TX_STREAM_COUNT];
+};
+
+// Sets up the buckets (full) and clears the statistics
+void ble_tx_policy_init(BleTxPolicy &policy, const uint32_t rate_bytes_per_sec[BLE_TX_STREAM_COUNT],
+                        const uint32_t burst_bytes[BLE_TX_STREAM_COUNT], int64_t now_us);
+
+// Picks the stream to send next given the length of each queue head (0 = empty) and takes
+// that many tokens. Returns BLE_TX_STREAM_NONE if nothing can be sent now; *wait_us is then
+// the time until a throttled stream has tokens again, or UINT32_MAX if all queues are empty.
+int ble_tx_policy_select(BleTxPolicy &policy, const size_t head_len[BLE_TX_STREAM_COUNT], int64_t now_us, uint32_t *wait_us);
+
+// Changes a stream's rate limit (0 = unlimited) without resetting its statistics
+void ble_tx_policy_set_rate(BleTxPolicy &policy, int stream, uint32_t rate_bytes_per_sec, int64_t now_us);
+
+void ble_tx_policy_on_enqueue(BleTxPolicy &policy, int stream, uint32_t queue_depth, uint32_t cpu_us);
+void ble_tx_policy_on_sent(BleTxPolicy &policy, int stream, size_t len, int64_t enqueued_us, int64_t now_us, uint32_t queue_depth, uint32_t cpu_us);
+void ble_tx_policy_on_drop(BleTxPolicy &policy, int stream);
+
+#endif // BLE_TX_POLICY_H
@@ -0,0 +1,273 @@
+#include "ble_tx_scheduler.h"
+#include "config.h"
+#include "ble_handler.h" // For g_is_ble_connected
+#include "ble_session.h" // For the clients each notification goes to
+#include "param_registry.h" // For the initial photo rate
+#include "logger.h"
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <string.h>
+
+struct BleTxItem {
+    BleChannel channel;
+    BleSessionMask sessions;
+    int64_t enqueued_us;
+    uint16_t len;
+    uint8_t data[BLE_TX_MAX_NOTIFY_LEN];
+};
+
+static const char *const STREAM_NAMES[BLE_TX_STREAM_COUNT] = {"Audio", "Photo"};
+static const size_t QUEUE_LENGTHS[BLE_TX_STREAM_COUNT] = {BLE_TX_AUDIO_QUEUE_LEN, BLE_TX_PHOTO_QUEUE_LEN};
+static const uint32_t STREAM_BURSTS[BLE_TX_STREAM_COUNT] = {0, BLE_TX_PHOTO_BURST_BYTES};
+
+// Notifications are written once, straight into a pre-allocated slot. Only slot indices
+// travel through the queues. Each pool has one extra slot for the head held by the task.
+static BleTxItem s_audio_slots[BLE_TX_AUDIO_QUEUE_LEN + 1];
+static BleTxItem s_photo_slots[BLE_TX_PHOTO_QUEUE_LEN + 1];
+static BleTxItem *const SLOTS[BLE_TX_STREAM_COUNT] = {s_audio_slots, s_photo_slots};
+static_assert(BLE_TX_AUDIO_QUEUE_LEN < 255 && BLE_TX_PHOTO_QUEUE_LEN < 255, "Slot indices are 8-bit");
+
+static TaskHandle_t s_tx_task = nullptr;
+static QueueHandle_t s_free_slots[BLE_TX_STREAM_COUNT] = {};
+static QueueHandle_t s_queues[BLE_TX_STREAM_COUNT] = {};
+
+// Slot at the head of each queue, taken out so its length can be offered to the policy
+static uint8_t s_heads[BLE_TX_STREAM_COUNT];
+static bool s_head_valid[BLE_TX_STREAM_COUNT] = {};
+
+// The policy's statistics are also updated by producers
+static BleTxPolicy s_policy;
+static portMUX_TYPE s_tx_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static BleTxStreamStats s_last_stats[BLE_TX_STREAM_COUNT] = {};
+static unsigned long s_last_stats_log_ms = 0;
+
+static void log_tx_stats() {
+    unsigned long elapsed_ms = millis() - s_last_stats_log_ms;
+    if (elapsed_ms == 0) {
+        return;
+    }
+    for (int s = 0; s < BLE_TX_STREAM_COUNT; s++) {
+        BleTxStreamStats stats = ble_tx_get_stats((BleTxStream)s);
+        uint32_t packets = stats.packets - s_last_stats[s].packets;
+        uint64_t bytes = stats.bytes - s_last_stats[s].bytes;
+        uint64_t latency_us = stats.latency_total_us - s_last_stats[s].latency_total_us;
+        uint64_t cpu_us = stats.cpu_us - s_last_stats[s].cpu_us;
+        if (packets > 0 || stats.drops != s_last_stats[s].drops) {
+            logger_printf("[TX] %s: %u pkt/s, %u B/s | Queue: %u (max %u) | Latency avg: %u us, max: %u us | CPU: %u us/KB | Drops: %u | Throttled: %u\n",
+                          STREAM_NAMES[s],
+                          (uint32_t)((uint64_t)packets * 1000 / elapsed_ms),
+                          (uint32_t)(bytes * 1000 / elapsed_ms),
+                          stats.queue_depth, stats.max_queue_depth,
+                          packets ? (uint32_t)(latency_us / packets) : 0,
+                          stats.latency_max_us,
+                          bytes ? (uint32_t)(cpu_us * 1024 / bytes) : 0,
+                          stats.drops,
+                          stats.throttled);
+        }
+        s_last_stats[s] = stats;
+    }
+    s_last_stats_log_ms = millis();
+}
+
+// Nobody is listening: throw away everything queued so producers never block on a dead link
+static void discard_queued() {
+    for (int s = 0; s < BLE_TX_STREAM_COUNT; s++) {
+        uint32_t discarded = 0;
+        if (s_head_valid[s]) {
+            xQueueSend(s_free_slots[s], &s_heads[s], 0);
+            s_head_valid[s] = false;
+            discarded++;
+        }
+        uint8_t slot;
+        while (xQueueReceive(s_queues[s], &slot, 0) == pdTRUE) {
+            xQueueSend(s_free_slots[s], &slot, 0);
+            discarded++;
+        }
+        portENTER_CRITICAL(&s_tx_mux);
+        for (uint32_t i = 0; i < discarded; i++) {
+            ble_tx_policy_on_drop(s_policy, s);
+        }
+        s_policy.stats[s].queue_depth = 0;
+        portEXIT_CRITICAL(&s_tx_mux);
+    }
+}
+
+static void ble_tx_task(void *pvParameters) {
+    logger_printf("[TASK] BLE TX scheduler task is running.\n");
+    while (true) {
+        if (!g_is_ble_connected) {
+            discard_queued();
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(DEBUG_LOG_INTERVAL_MS));
+            continue;
+        }
+
+        size_t head_len[BLE_TX_STREAM_COUNT];
+        for (int s = 0; s < BLE_TX_STREAM_COUNT; s++) {
+            if (!s_head_valid[s] && xQueueReceive(s_queues[s], &s_heads[s], 0) == pdTRUE) {
+                s_head_valid[s] = true;
+            }
+            head_len[s] = s_head_valid[s] ? SLOTS[s][s_heads[s]].len : 0;
+        }
+
+        uint32_t wait_us = UINT32_MAX;
+        portENTER_CRITICAL(&s_tx_mux);
+        int stream = ble_tx_policy_select(s_policy, head_len, esp_timer_get_time(), &wait_us);
+        portEXIT_CRITICAL(&s_tx_mux);
+
+        if (stream != BLE_TX_STREAM_NONE) {
+            BleTxItem &item = SLOTS[stream][s_heads[stream]];
+            int64_t start_us = esp_timer_get_time();
+            // Every client gets the notification from the same slot; the stack makes the only
+            // copy after it. Clients that left or unsubscribed since it was queued are skipped.
+            BleSessionMask refused = ble_session_notify(item.sessions, item.channel, item.data, item.len);
+            if (refused && stream == BLE_TX_STREAM_PHOTO) {
+                // A lost chunk would leave a hole in the JPEG: keep the head and send it again,
+                // only to the clients that refused it, once the bucket has tokens for it again
+                item.sessions = refused;
+                continue;
+            }
+            bool sent = refused == 0;
+            int64_t now_us = esp_timer_get_time();
+            size_t len = item.len;
+            int64_t enqueued_us = item.enqueued_us;
+            xQueueSend(s_free_slots[stream], &s_heads[stream], 0);
+            s_head_valid[stream] = false;
+
+            uint32_t depth = uxQueueMessagesWaiting(s_queues[stream]);
+            portENTER_CRITICAL(&s_tx_mux);
+            if (sent) {
+                ble_tx_policy_on_sent(s_policy, stream, len, enqueued_us, now_us, depth, (uint32_t)(now_us - start_us));
+            } else {
+                ble_tx_policy_on_drop(s_policy, stream); // The stack had no buffer for a client (audio is not resent)
+            }
+            portEXIT_CRITICAL(&s_tx_mux);
+        } else {
+            // Sleep until a producer queues something or a throttled stream earns its tokens
+            TickType_t ticks = pdMS_TO_TICKS(DEBUG_LOG_INTERVAL_MS);
+            if (wait_us != UINT32_MAX) {
+                ticks = pdMS_TO_TICKS((wait_us + 999) / 1000);
+                if (ticks == 0) {
+                    ticks = 1;
+                }
+            }
+            ulTaskNotifyTake(pdTRUE, ticks);
+        }
+
+        if (millis() - s_last_stats_log_ms >= DEBUG_LOG_INTERVAL_MS) {
+            log_tx_stats();
+        }
+    }
+}
+
+void start_ble_tx_scheduler() {
+    if (s_tx_task != nullptr) {
+        return;
+    }
+    for (int s = 0; s < BLE_TX_STREAM_COUNT; s++) {
+        // Room for every slot: the spare one can be queued while the task is between heads
+        s_queues[s] = xQueueCreate(QUEUE_LENGTHS[s] + 1, sizeof(uint8_t));
+        s_free_slots[s] = xQueueCreate(QUEUE_LENGTHS[s] + 1, sizeof(uint8_t));
+        if (!s_queues[s] || !s_free_slots[s]) {
+            logger_printf("[TX] ERROR: Failed to create the %s transmit queue!\n", STREAM_NAMES[s]);
+            return;
+        }
+        for (uint8_t slot = 0; slot <= QUEUE_LENGTHS[s]; slot++) {
+            xQueueSend(s_free_slots[s], &slot, 0);
+        }
+    }
+    // Photo pacing starts at the default-link rate; ble_link raises it once the link is upgraded
+    const uint32_t rates[BLE_TX_STREAM_COUNT] = {0, param_get(PARAM_PHOTO_RATE)};
+    ble_tx_policy_init(s_policy, rates, STREAM_BURSTS, esp_timer_get_time());
+    s_last_stats_log_ms = millis();
+
+    logger_printf("[TASK] Creating BLE TX scheduler task (photo limited to %u B/s, %s transport).\n", rates[BLE_TX_STREAM_PHOTO],
+                  ble_transport()->name());
+    xTaskCreatePinnedToCore(
+        ble_tx_task,             // Task function
+        "BleTxScheduler",        // Name of the task
+        BLE_TX_TASK_STACK_SIZE,  // Stack size in bytes
+        NULL,                    // Task input parameter
+        BLE_TX_TASK_PRIORITY,    // Priority of the task
+        &s_tx_task,              // Task handle
+        1                        // Core where the task should run
+    );
+}
+
+bool ble_tx_enqueue_parts(BleTxStream stream, BleChannel channel, BleSessionMask sessions, const uint8_t *header,
+                          size_t header_len, const uint8_t *payload, size_t payload_len, uint32_t wait_ms) {
+    if (sessions == 0) {
+        return true; // Nobody to send to
+    }
+    size_t len = header_len + payload_len;
+    if (!s_tx_task || len == 0 || len > BLE_TX_MAX_NOTIFY_LEN ||
+        (header_len && !header) || (payload_len && !payload)) {
+        return false;
+    }
+
+    // Waiting for a free slot is the producer's backpressure
+    uint8_t slot;
+    if (xQueueReceive(s_free_slots[stream], &slot, pdMS_TO_TICKS(wait_ms)) != pdTRUE) {
+        portENTER_CRITICAL(&s_tx_mux);
+        ble_tx_policy_on_drop(s_policy, stream);
+        portEXIT_CRITICAL(&s_tx_mux);
+        return false;
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    BleTxItem &item = SLOTS[stream][slot];
+    item.channel = channel;
+    item.sessions = sessions;
+    item.len = (uint16_t)len;
+    if (header_len) {
+        memcpy(item.data, header, header_len);
+    }
+    if (payload_len) {
+        memcpy(item.data + header_len, payload, payload_len);
+    }
+    item.enqueued_us = start_us;
+    if (xQueueSend(s_queues[stream], &slot, 0) != pdTRUE) {
+        // Not expected, as the queue has a place for every slot; never leak the slot
+        xQueueSend(s_free_slots[stream], &slot, 0);
+        portENTER_CRITICAL(&s_tx_mux);
+        ble_tx_policy_on_drop(s_policy, stream);
+        portEXIT_CRITICAL(&s_tx_mux);
+        return false;
+    }
+
+    uint32_t depth = uxQueueMessagesWaiting(s_queues[stream]);
+    uint32_t cpu_us = (uint32_t)(esp_timer_get_time() - start_us);
+    portENTER_CRITICAL(&s_tx_mux);
+    ble_tx_policy_on_enqueue(s_policy, stream, depth, cpu_us);
+    portEXIT_CRITICAL(&s_tx_mux);
+    xTaskNotifyGive(s_tx_task);
+    return true;
+}
+
+bool ble_tx_enqueue(BleTxStream stream, BleChannel channel, BleSessionMask sessions, const uint8_t *data, size_t len,
+                    uint32_t wait_ms) {
+    return ble_tx_enqueue_parts(stream, channel, sessions, data, len, nullptr, 0, wait_ms);
+}
+
+size_t ble_tx_queue_space(BleTxStream stream) {
+    return s_free_slots[stream] ? uxQueueMessagesWaiting(s_free_slots[stream]) : 0;
+}
+
+void ble_tx_set_stream_rate(BleTxStream stream, uint32_t rate_bytes_per_sec) {
+    portENTER_CRITICAL(&s_tx_mux);
+    ble_tx_policy_set_rate(s_policy, stream, rate_bytes_per_sec, esp_timer_get_time());
+    portEXIT_CRITICAL(&s_tx_mux);
+    if (s_tx_task) {
+        xTaskNotifyGive(s_tx_task); // Re-evaluate a throttled stream now
+    }
+}
+
+BleTxStreamStats ble_tx_get_stats(BleTxStream stream) {
+    portENTER_CRITICAL(&s_tx_mux);
+    BleTxStreamStats stats = s_policy.stats[stream];
+    portEXIT_CRITICAL(&s_tx_mux);
+    return stats;
+}
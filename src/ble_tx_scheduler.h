@@ -0,0 +1,38 @@
+#ifndef BLE_TX_SCHEDULER_H
+#define BLE_TX_SCHEDULER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "ble_tx_policy.h"
+#include "ble_transport.h" // For BleChannel
+#include "ble_session.h"   // For BleSessionMask
+
+// Single BLE transmit task shared by audio and photo. Producers copy each notification once,
+// into a pre-allocated slot of their stream's pool; the task sends them in the order chosen
+// by ble_tx_policy (audio first, photo paced by a token bucket) through the BLE transport,
+// which notifies straight from the slot. A notification for several clients is queued once
+// and sent to each of them from the same slot. It keeps per-stream throughput, queue depth,
+// latency and CPU statistics. Queued notifications are discarded while no client is
+// connected.
+
+// Creates the queues and the scheduler task. Safe to call more than once.
+void start_ble_tx_scheduler();
+
+// Queues one notification of up to BLE_TX_MAX_NOTIFY_LEN bytes for the sessions in the mask,
+// made of a header followed by a payload, copied from where they are (e.g. the camera frame
+// buffer). Waits up to wait_ms for a free slot; returns false (and counts a drop) if none
+// became free. An empty mask queues nothing.
+bool ble_tx_enqueue_parts(BleTxStream stream, BleChannel channel, BleSessionMask sessions, const uint8_t *header,
+                          size_t header_len, const uint8_t *payload, size_t payload_len, uint32_t wait_ms);
+bool ble_tx_enqueue(BleTxStream stream, BleChannel channel, BleSessionMask sessions, const uint8_t *data, size_t len,
+                    uint32_t wait_ms);
+
+// Free slots in a stream's queue, for producers that want to avoid drops (e.g. audio replay)
+size_t ble_tx_queue_space(BleTxStream stream);
+
+// Changes a stream's token bucket rate, e.g. when the link gets faster (0 = unlimited)
+void ble_tx_set_stream_rate(BleTxStream stream, uint32_t rate_bytes_per_sec);
+
+BleTxStreamStats ble_tx_get_stats(BleTxStream stream);
+
+#endif // BLE_TX_SCHEDULER_H
@@ -0,0 +1,30 @@
+#include "boot_profile.h"
+#include "logger.h"
+#include <esp_timer.h>
+
+struct BootPhase {
+    const char *name;
+    int64_t end_us;
+};
+
+static BootPhase s_phases[BOOT_PROFILE_MAX_PHASES];
+static size_t s_phase_count = 0;
+
+int64_t boot_profile_mark(const char *phase) {
+    int64_t now_us = esp_timer_get_time();
+    if (s_phase_count < BOOT_PROFILE_MAX_PHASES) {
+        s_phases[s_phase_count].name = phase;
+        s_phases[s_phase_count].end_us = now_us;
+        s_phase_count++;
+    }
+    return now_us;
+}
+
+void boot_profile_log() {
+    int64_t start_us = 0;
+    for (size_t i = 0; i < s_phase_count; i++) {
+        logger_printf("[BOOT] %-10s %6u us\n", s_phases[i].name, (uint32_t)(s_phases[i].end_us - start_us));
+        start_us = s_phases[i].end_us;
+    }
+    logger_printf("[BOOT] Total %u ms since reset.\n", (uint32_t)(start_us / 1000));
+}
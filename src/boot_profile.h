@@ -0,0 +1,20 @@
+#ifndef BOOT_PROFILE_H
+#define BOOT_PROFILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Boot phase timing. setup() marks the end of each phase, and the phases are logged once
+// with the [BOOT] tag. Times come from esp_timer, which starts during startup before
+// app_main, so the ROM and second-stage bootloader (a fixed few tens of ms) are not included.
+
+constexpr size_t BOOT_PROFILE_MAX_PHASES = 12;
+
+// Ends the phase that started at the previous mark (or at reset). phase must be a string
+// literal. Returns the time since reset in us.
+int64_t boot_profile_mark(const char *phase);
+
+// Logs each phase's duration and the total
+void boot_profile_log();
+
+#endif // BOOT_PROFILE_H
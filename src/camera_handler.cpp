@@ -2,14 +2,30 @@
 #include "camera_handler.h"
 #include "camera_pins.h"
 #include "logger.h"
+#include "param_registry.h" // For the JPEG quality, resolution and warm-up
+#include "pm_lock.h" // For full speed during capture
 #include <esp_camera.h>
+#include <esp_timer.h>
+#include <freertos/queue.h>
 
 // Definition of the global frame buffer pointer
 camera_fb_t *fb = nullptr;
 static bool camera_initialized = false;
 SemaphoreHandle_t g_camera_mutex = nullptr; // Mutex for camera access
-SemaphoreHandle_t g_camera_request_semaphore = nullptr; // Signals the camera task
-volatile bool g_is_photo_ready = false; // Flag indicates a photo is ready in the buffer
+static TaskHandle_t s_camera_task = nullptr;
+static TaskHandle_t s_requester = nullptr; // Notified when the requested frame is handed off
+static QueueHandle_t s_frame_queue = nullptr; // One slot: the result of the latest request
+static int64_t s_photo_capture_us = 0; // Capture time of the photo in fb
+static int s_photo_refs = 0; // Uploads sharing the photo in fb, guarded by g_camera_mutex
+static framesize_t s_init_frame_size = FRAMESIZE_QVGA; // Resolution the frame buffers were allocated for
+
+// Resolutions selectable with PARAM_FRAME_SIZE
+static const framesize_t FRAME_SIZES[] = {FRAMESIZE_QVGA, FRAMESIZE_VGA, FRAMESIZE_SVGA, FRAMESIZE_XGA, FRAMESIZE_SXGA, FRAMESIZE_UXGA};
+
+static framesize_t selected_frame_size() {
+    uint32_t index = param_get(PARAM_FRAME_SIZE);
+    return FRAME_SIZES[index < sizeof(FRAME_SIZES) / sizeof(FRAME_SIZES[0]) ? index : CAMERA_FRAME_SIZE];
+}
 
 // Forward declaration for the internal, non-locking version
 static void release_photo_buffer_internal();
@@ -17,29 +33,52 @@ static void release_photo_buffer_internal();
 // The new dedicated camera task function
 void camera_task(void *pvParameters) {
     while (true) {
-        // Wait for a signal to take a photo
-        if (xSemaphoreTake(g_camera_request_semaphore, portMAX_DELAY) == pdTRUE) {
-            logger_printf("[CAM_TASK] Received photo request.\n");
+        // Sleeps until camera_request_photo(); requests made during a capture are merged
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        CameraFrame result = {};
+        result.started_us = esp_timer_get_time();
+        logger_printf("[CAM_TASK] Received photo request.\n");
+        pm_lock_hold(PM_LOCK_CAMERA);
 
-            // Ensure camera is initialized
-            if (!is_camera_initialized()) {
-                configure_camera();
-            }
+        // Ensure camera is initialized
+        if (!is_camera_initialized()) {
+            configure_camera();
+        }
 
-            // Take the photo
-            if (take_photo()) {
-                logger_printf("[CAM_TASK] Photo captured successfully. Setting flag.\n");
-                g_is_photo_ready = true; // Signal that the photo is ready
-            } else {
-                logger_printf("[CAM_TASK] Failed to capture photo.\n");
-                g_is_photo_ready = false;
-                // Optional: de-init camera on failure to try and recover
-                deinit_camera();
-            }
+        // Take the photo
+        if (take_photo()) {
+            logger_printf("[CAM_TASK] Photo captured successfully. Handing it off.\n");
+            result.frame = fb;
+        } else {
+            logger_printf("[CAM_TASK] Failed to capture photo.\n");
+            // Optional: de-init camera on failure to try and recover
+            deinit_camera();
+        }
+        pm_lock_release(PM_LOCK_CAMERA);
+
+        result.ready_us = esp_timer_get_time();
+        xQueueOverwrite(s_frame_queue, &result);
+        TaskHandle_t requester = s_requester;
+        if (requester) {
+            xTaskNotify(requester, CAMERA_NOTIFY_FRAME, eSetBits);
         }
     }
 }
 
+bool camera_request_photo() {
+    if (!s_camera_task) {
+        logger_printf("[CAM] ERROR: Photo requested before the camera task was started.\n");
+        return false;
+    }
+    s_requester = xTaskGetCurrentTaskHandle();
+    xTaskNotifyGive(s_camera_task);
+    return true;
+}
+
+bool camera_take_frame(CameraFrame *out) {
+    return s_frame_queue && xQueueReceive(s_frame_queue, out, 0) == pdTRUE;
+}
+
 void initialize_camera_mutex() {
     g_camera_mutex = xSemaphoreCreateMutex();
     if (g_camera_mutex == nullptr) {
@@ -47,23 +86,59 @@ void initialize_camera_mutex() {
         while(1);
     }
 
-    // Create the semaphore for the camera task
-    g_camera_request_semaphore = xSemaphoreCreateBinary();
-    if (g_camera_request_semaphore == nullptr) {
-        logger_printf("[MUTEX] ERROR: Failed to create camera semaphore! Halting.\n");
+    // Create the handoff queue for the camera task's results
+    s_frame_queue = xQueueCreate(1, sizeof(CameraFrame));
+    if (s_frame_queue == nullptr) {
+        logger_printf("[MUTEX] ERROR: Failed to create camera frame queue! Halting.\n");
         while(1);
     }
-    logger_printf("[MUTEX] Camera mutex and semaphore created successfully.\n");
+    logger_printf("[MUTEX] Camera mutex and frame queue created successfully.\n");
+}
+
+// The sensor's JPEG quality can change between frames
+static void on_jpeg_quality_changed(ParamId id, uint32_t value) {
+    if (xSemaphoreTake(g_camera_mutex, portMAX_DELAY)) {
+        sensor_t *s = camera_initialized ? esp_camera_sensor_get() : nullptr;
+        if (s) {
+            s->set_quality(s, (int)value);
+            logger_printf("[CAM] JPEG quality set to %u.\n", value);
+        }
+        xSemaphoreGive(g_camera_mutex);
+    }
+}
+
+// The resolution can drop to or below the one the frame buffers were allocated for between
+// frames. Growing past it waits for the next init.
+static void on_frame_size_changed(ParamId id, uint32_t value) {
+    if (xSemaphoreTake(g_camera_mutex, portMAX_DELAY)) {
+        sensor_t *s = camera_initialized ? esp_camera_sensor_get() : nullptr;
+        if (s) {
+            framesize_t size = selected_frame_size();
+            if (size <= s_init_frame_size) {
+                s->set_framesize(s, size);
+                logger_printf("[CAM] Frame size set to %u.\n", value);
+            } else {
+                logger_printf("[CAM] Frame size %u exceeds the frame buffers; applies at the next camera init.\n", value);
+            }
+        }
+        xSemaphoreGive(g_camera_mutex);
+    }
 }
 
 void start_camera_task() {
+    if (s_camera_task) {
+        return;
+    }
+    param_on_change(PARAM_JPEG_QUALITY, on_jpeg_quality_changed);
+    param_on_change(PARAM_FRAME_SIZE, on_frame_size_changed);
+
     xTaskCreatePinnedToCore(
         camera_task,          // Task function
         "CameraTask",         // Name of the task
         8192,                 // Stack size (increased for camera)
         NULL,                 // Parameter of the task
         2,                    // Priority of the task
-        NULL,                 // Task handle
+        &s_camera_task,       // Task handle
         1);                   // Core where the task should run
     logger_printf("[TASK] Dedicated camera task started.\n");
 }
@@ -100,9 +175,9 @@ void configure_camera() {
         config.xclk_freq_hz = 20000000;
 
         // Camera settings
-        config.frame_size = FRAMESIZE_XGA;         // 1024x768 resolution
+        config.frame_size = selected_frame_size(); // 1024x768 (XGA) by default
         config.pixel_format = PIXFORMAT_JPEG;      // Output format JPEG
-        config.jpeg_quality = 20;                  // JPEG quality (0-63, lower means higher quality)
+        config.jpeg_quality = (int)param_get(PARAM_JPEG_QUALITY); // JPEG quality (0-63, lower means higher quality)
         config.fb_location = CAMERA_FB_IN_PSRAM;   // Store frame buffer in PSRAM
         config.fb_count = 2;                       // Use 2 frame buffers for stability
         config.grab_mode = CAMERA_GRAB_WHEN_EMPTY; // Use WHEN_EMPTY for more stability
@@ -116,14 +191,16 @@ void configure_camera() {
             return;
         }
         camera_initialized = true;
+        s_init_frame_size = config.frame_size;
         logger_printf("[CAM] Camera initialized successfully.\n");
 
         // Get a reference to the sensor and apply settings to fix potential init issues
         sensor_t * s = esp_camera_sensor_get();
         if (s) {
             s->reset(s); // Reset the sensor to ensure it's in a known state
-            s->set_framesize(s, FRAMESIZE_XGA);
+            s->set_framesize(s, config.frame_size);
             s->set_pixformat(s, PIXFORMAT_JPEG);
+            s->set_quality(s, config.jpeg_quality); // reset() may restore the sensor's own default
             logger_printf("[CAM] Sensor reset, framesize and pixformat set post-init.\n");
         } else {
             logger_printf("[CAM] WARNING: Could not get sensor handle post-init.\n");
@@ -137,18 +214,23 @@ void configure_camera() {
     }
 }
 
+int64_t photo_capture_time_us() {
+    return s_photo_capture_us;
+}
+
 bool take_photo() {
     bool success = false;
     if (xSemaphoreTake(g_camera_mutex, portMAX_DELAY)) {
         release_photo_buffer_internal(); // Ensure previous buffer is released without causing a deadlock
 
         // Camera warm-up: discard frames to allow AWB/gain to settle
-        for (int i = 0; i < CAMERA_WARMUP_FRAMES; ++i) {
+        uint32_t warmup_frames = param_get(PARAM_CAMERA_WARMUP_FRAMES);
+        for (uint32_t i = 0; i < warmup_frames; ++i) {
             camera_fb_t *tmp_fb = esp_camera_fb_get();
             if (tmp_fb) {
                 esp_camera_fb_return(tmp_fb);
             } else {
-                logger_printf("[CAM] WARNING: Warm-up frame %d failed.\n", i+1);
+                logger_printf("[CAM] WARNING: Warm-up frame %u failed.\n", i+1);
             }
         }
 
@@ -158,6 +240,8 @@ bool take_photo() {
             success = false;
         } else {
             logger_printf("[CAM] Photo captured: %zu bytes.\n", fb->len);
+            // The driver stamps each frame with esp_timer at the start of its readout
+            s_photo_capture_us = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
             success = true;
         }
         xSemaphoreGive(g_camera_mutex);
@@ -167,6 +251,7 @@ bool take_photo() {
 
 // New internal function that assumes the mutex is already held
 static void release_photo_buffer_internal() {
+    s_photo_refs = 0;
     if (fb) {
         logger_printf("[CAM] Releasing previous frame buffer (internal).\n");
         esp_camera_fb_return(fb);
@@ -174,6 +259,27 @@ static void release_photo_buffer_internal() {
     }
 }
 
+camera_fb_t *retain_photo_buffer() {
+    camera_fb_t *photo = nullptr;
+    if (xSemaphoreTake(g_camera_mutex, portMAX_DELAY)) {
+        if (fb) {
+            s_photo_refs++;
+            photo = fb;
+        }
+        xSemaphoreGive(g_camera_mutex);
+    }
+    return photo;
+}
+
+void drop_photo_buffer(bool release_if_last) {
+    if (xSemaphoreTake(g_camera_mutex, portMAX_DELAY)) {
+        if (s_photo_refs > 0 && --s_photo_refs == 0 && release_if_last) {
+            release_photo_buffer_internal();
+        }
+        xSemaphoreGive(g_camera_mutex);
+    }
+}
+
 // The public function still takes the mutex for safe external calls
 void release_photo_buffer() {
     if (xSemaphoreTake(g_camera_mutex, portMAX_DELAY)) {
@@ -8,14 +8,32 @@
 // Global camera frame buffer pointer - consider encapsulating this
 extern camera_fb_t *fb;
 extern SemaphoreHandle_t g_camera_mutex; // Mutex to protect camera access
-extern SemaphoreHandle_t g_camera_request_semaphore; // Signals the camera task to take a photo
-extern volatile bool g_is_photo_ready; // Flag to indicate a photo is ready in the buffer
+
+// Result of a capture, handed from the camera task to the task that requested it
+struct CameraFrame {
+    camera_fb_t *frame;   // The new fb, or nullptr if the capture failed
+    int64_t started_us;   // Camera task woke for the request (esp_timer)
+    int64_t ready_us;     // Capture done
+};
+
+// Set in the requester's notification value (eSetBits) once its CameraFrame is queued
+constexpr uint32_t CAMERA_NOTIFY_FRAME = 1u << 0;
 
 void initialize_camera_mutex(); // Function to create the mutex
-void start_camera_task(); // Function to create the dedicated camera task
+void start_camera_task(); // Creates the dedicated camera task on the first photo subscription; later calls do nothing
+// Wakes the camera task for one capture and makes the calling task the one notified of the result
+bool camera_request_photo();
+// Takes the result of the latest request without waiting; false if there is none (yet)
+bool camera_take_frame(CameraFrame *out);
 void configure_camera();
 bool take_photo();
-void release_photo_buffer(); // New helper function
+int64_t photo_capture_time_us(); // Device time (esp_timer) at which the current photo was exposed
+void release_photo_buffer(); // Releases fb at once, whoever still references it
+// Uploads that share the photo in fb each hold a reference; the last drop releases it
+// (retain returns fb, or nullptr if there is no photo to hold). Without release_if_last, the
+// last drop leaves the photo held for a later upload.
+camera_fb_t *retain_photo_buffer();
+void drop_photo_buffer(bool release_if_last = true);
 void deinit_camera(); // Add deinit function
 bool is_camera_initialized();
 
@@ -0,0 +1,89 @@
+#include "clock_sync.h"
+#include <string.h>
+#include <math.h>
+
+// Below this spread of device time the slope is mostly noise, so drift is left as it was
+static const int64_t CLOCK_SYNC_MIN_DRIFT_SPAN_US = 2000000;
+
+void clock_sync_reset(ClockSyncEstimator &est) {
+    memset(&est, 0, sizeof(est));
+}
+
+bool clock_sync_add_exchange(ClockSyncEstimator &est, int64_t t1_client_us, int64_t t2_device_us,
+                             int64_t t3_device_us, int64_t t4_client_us) {
+    int64_t device_elapsed = t3_device_us - t2_device_us;
+    int64_t client_elapsed = t4_client_us - t1_client_us;
+    if (device_elapsed < 0 || client_elapsed < device_elapsed || client_elapsed - device_elapsed > UINT32_MAX) {
+        return false;
+    }
+
+    ClockSyncSample &sample = est.samples[est.next];
+    sample.device_us = t2_device_us + device_elapsed / 2;
+    sample.offset_us = ((t1_client_us - t2_device_us) + (t4_client_us - t3_device_us)) / 2;
+    sample.rtt_us = (uint32_t)(client_elapsed - device_elapsed);
+    est.next = (est.next + 1) % CLOCK_SYNC_WINDOW;
+    if (est.count < CLOCK_SYNC_WINDOW) {
+        est.count++;
+    }
+    est.last_rtt_us = sample.rtt_us;
+
+    // Keep the faster half of the window (at least one sample): queueing only ever adds delay
+    uint32_t rtts[CLOCK_SYNC_WINDOW];
+    for (size_t i = 0; i < est.count; i++) {
+        uint32_t rtt = est.samples[i].rtt_us;
+        size_t j = i;
+        for (; j > 0 && rtts[j - 1] > rtt; j--) {
+            rtts[j] = rtts[j - 1];
+        }
+        rtts[j] = rtt;
+    }
+    uint32_t rtt_limit = rtts[(est.count - 1) / 2];
+
+    // Least-squares line through the selected samples, relative to the newest one for precision
+    const ClockSyncSample &newest = sample;
+    double sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+    int64_t min_x = INT64_MAX, max_x = INT64_MIN;
+    uint32_t used = 0;
+    for (size_t i = 0; i < est.count; i++) {
+        const ClockSyncSample &s = est.samples[i];
+        if (s.rtt_us > rtt_limit) {
+            continue;
+        }
+        int64_t dx = s.device_us - newest.device_us;
+        double x = (double)dx;
+        double y = (double)(s.offset_us - newest.offset_us);
+        sum_x += x;
+        sum_y += y;
+        sum_xx += x * x;
+        sum_xy += x * y;
+        if (dx < min_x) min_x = dx;
+        if (dx > max_x) max_x = dx;
+        used++;
+    }
+
+    double mean_x = sum_x / used;
+    double mean_y = sum_y / used;
+    if (used >= 2 && max_x - min_x >= CLOCK_SYNC_MIN_DRIFT_SPAN_US) {
+        est.drift = (sum_xy - used * mean_x * mean_y) / (sum_xx - used * mean_x * mean_x);
+    }
+    est.reference_device_us = newest.device_us;
+    est.offset_us = newest.offset_us + (int64_t)llround(mean_y - est.drift * mean_x);
+    est.samples_used = used;
+    est.valid = true;
+    return true;
+}
+
+int64_t clock_sync_device_to_client_us(const ClockSyncEstimator &est, int64_t device_us) {
+    if (!est.valid) {
+        return device_us;
+    }
+    int64_t dx = device_us - est.reference_device_us;
+    return device_us + est.offset_us + (int64_t)llround(est.drift * (double)dx);
+}
+
+int32_t clock_sync_drift_ppb(const ClockSyncEstimator &est) {
+    double ppb = est.drift * 1e9;
+    if (ppb > INT32_MAX) return INT32_MAX;
+    if (ppb < INT32_MIN) return INT32_MIN;
+    return (int32_t)llround(ppb);
+}
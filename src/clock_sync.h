@@ -0,0 +1,50 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Offset and drift estimator mapping the device timebase (esp_timer microseconds) to a
+// client's wall clock. Each NTP-style exchange gives four timestamps:
+//   t1  client sends the sync request      t2  device receives it
+//   t3  device sends its reply             t4  client receives the reply
+// offset = ((t1 - t2) + (t4 - t3)) / 2 and round-trip time = (t4 - t1) - (t3 - t2).
+// Samples with a long round trip are the least accurate, so only the faster half of the
+// recent window is used, and a least-squares line through them gives offset and drift.
+// This is a pure module with no hardware dependencies.
+
+constexpr size_t CLOCK_SYNC_WINDOW = 64; // Exchanges kept for the estimate (~5 min at one per 5s)
+
+struct ClockSyncSample {
+    int64_t device_us; // Device time of the exchange (midpoint of t2 and t3)
+    int64_t offset_us; // client time - device time
+    uint32_t rtt_us;
+};
+
+struct ClockSyncEstimator {
+    ClockSyncSample samples[CLOCK_SYNC_WINDOW];
+    size_t count;
+    size_t next;
+    // Current estimate: client = device + offset_us + drift * (device - reference_device_us)
+    bool valid;
+    int64_t reference_device_us;
+    int64_t offset_us;
+    double drift;            // Client seconds gained per device second
+    uint32_t last_rtt_us;
+    uint32_t samples_used;
+};
+
+void clock_sync_reset(ClockSyncEstimator &est);
+
+// Adds one exchange and refreshes the estimate. Returns false (and ignores the exchange)
+// if the timestamps are inconsistent.
+bool clock_sync_add_exchange(ClockSyncEstimator &est, int64_t t1_client_us, int64_t t2_device_us,
+                             int64_t t3_device_us, int64_t t4_client_us);
+
+// Maps a device timestamp to client time. Returns device_us unchanged before the first exchange.
+int64_t clock_sync_device_to_client_us(const ClockSyncEstimator &est, int64_t device_us);
+
+// Drift in parts per billion (positive when the client clock runs faster than the device)
+int32_t clock_sync_drift_ppb(const ClockSyncEstimator &est);
+
+#endif // CLOCK_SYNC_H
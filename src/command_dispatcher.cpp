@@ -0,0 +1,105 @@
+#include "command_dispatcher.h"
+#include "config.h"
+#include "logger.h"
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+static TaskHandle_t s_task = nullptr;
+static QueueHandle_t s_queue = nullptr;
+static const BleCommandHandlers *s_handlers = nullptr;
+
+static CommandDispatcherStats s_stats = {};
+static CommandDispatcherStats s_last_logged = {};
+static portMUX_TYPE s_stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void command_dispatcher_task(void *pvParameters) {
+    logger_printf("[TASK] Command dispatcher task is running.\n");
+    BleCommand command;
+    while (true) {
+        if (xQueueReceive(s_queue, &command, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        int64_t start_us = esp_timer_get_time();
+        if (!ble_command_dispatch(command, *s_handlers)) {
+            logger_printf("[CMD] No handler for %s. Command ignored.\n", ble_command_name(command.type));
+            continue;
+        }
+        int64_t done_us = esp_timer_get_time();
+
+        uint32_t wait_us = (uint32_t)(start_us - command.received_us);
+        uint32_t latency_us = (uint32_t)(done_us - command.received_us);
+        portENTER_CRITICAL(&s_stats_mux);
+        s_stats.commands++;
+        s_stats.wait_total_us += wait_us;
+        s_stats.latency_total_us += latency_us;
+        if (wait_us > s_stats.wait_max_us) {
+            s_stats.wait_max_us = wait_us;
+        }
+        if (latency_us > s_stats.latency_max_us) {
+            s_stats.latency_max_us = latency_us;
+        }
+        portEXIT_CRITICAL(&s_stats_mux);
+        logger_printf("[CMD] %s handled %u us after the callback (queued %u us).\n", ble_command_name(command.type),
+                      latency_us, wait_us);
+    }
+}
+
+void start_command_dispatcher(const BleCommandHandlers *handlers) {
+    if (s_task != nullptr) {
+        return;
+    }
+    s_handlers = handlers;
+    s_queue = xQueueCreate(COMMAND_QUEUE_LEN, sizeof(BleCommand));
+    if (!s_queue) {
+        logger_printf("[CMD] ERROR: Failed to create the command queue!\n");
+        return;
+    }
+    logger_printf("[TASK] Creating command dispatcher task.\n");
+    xTaskCreatePinnedToCore(
+        command_dispatcher_task,  // Task function
+        "CommandDispatcher",      // Name of the task
+        COMMAND_TASK_STACK_SIZE,  // Stack size in bytes
+        NULL,                     // Task input parameter
+        COMMAND_TASK_PRIORITY,    // Priority of the task
+        &s_task,                  // Task handle
+        1                         // Core where the task should run
+    );
+}
+
+bool command_dispatcher_post(const BleCommand &command) {
+    // Never blocks: the caller is the BLE stack's callback
+    if (s_queue && xQueueSend(s_queue, &command, 0) == pdTRUE) {
+        return true;
+    }
+    portENTER_CRITICAL(&s_stats_mux);
+    s_stats.drops++;
+    portEXIT_CRITICAL(&s_stats_mux);
+    return false;
+}
+
+CommandDispatcherStats command_dispatcher_get_stats() {
+    CommandDispatcherStats stats;
+    portENTER_CRITICAL(&s_stats_mux);
+    stats = s_stats;
+    portEXIT_CRITICAL(&s_stats_mux);
+    return stats;
+}
+
+void command_dispatcher_log_stats() {
+    CommandDispatcherStats stats = command_dispatcher_get_stats();
+    uint32_t commands = stats.commands - s_last_logged.commands;
+    if (commands == 0 && stats.drops == s_last_logged.drops) {
+        return;
+    }
+    uint64_t wait_us = stats.wait_total_us - s_last_logged.wait_total_us;
+    uint64_t latency_us = stats.latency_total_us - s_last_logged.latency_total_us;
+    logger_printf("[CMD] Commands: %u | Queue wait avg: %u us, max: %u us | Command-to-effect avg: %u us, max: %u us | Drops: %u\n",
+                  commands,
+                  commands ? (uint32_t)(wait_us / commands) : 0, stats.wait_max_us,
+                  commands ? (uint32_t)(latency_us / commands) : 0, stats.latency_max_us,
+                  stats.drops);
+    s_last_logged = stats;
+}
@@ -0,0 +1,32 @@
+#ifndef COMMAND_DISPATCHER_H
+#define COMMAND_DISPATCHER_H
+
+#include <stdint.h>
+#include "ble_command.h"
+
+// Task that carries out client commands off the BLE callback context. Callbacks decode a
+// write (ble_command.h), post it and return; the task runs the command's handler, which may
+// block (e.g. starting the camera) without stalling the stack. It keeps the queue wait and
+// the command-to-effect latency, from the callback to the end of the handler.
+
+struct CommandDispatcherStats {
+    uint32_t commands;
+    uint32_t drops;              // Commands refused because the queue was full
+    uint64_t wait_total_us;      // Callback to start of the handler
+    uint32_t wait_max_us;
+    uint64_t latency_total_us;   // Callback to end of the handler
+    uint32_t latency_max_us;
+};
+
+// Creates the queue and the task. The handlers must outlive it. Safe to call more than once.
+void start_command_dispatcher(const BleCommandHandlers *handlers);
+
+// Queues a command without blocking. Returns false (and counts a drop) if the queue is full.
+bool command_dispatcher_post(const BleCommand &command);
+
+CommandDispatcherStats command_dispatcher_get_stats();
+
+// Logs the commands handled since the last call with the [CMD] tag
+void command_dispatcher_log_stats();
+
+#endif // COMMAND_DISPATCHER_H
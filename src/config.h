@@ -1,7 +1,8 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
-#include <BLEUUID.h> // For BLEUUID
+#include <stdint.h>
+#include <stddef.h>
 
 // Select camera model (this should ideally be a build flag)
 #define CAMERA_MODEL_XIAO_ESP32S3
@@ -13,7 +14,73 @@ constexpr int FRAME_SIZE = 80;      // Number of audio samples per frame (for 8k
 constexpr int SAMPLE_RATE = 16000;  // Audio sample rate in Hz (16kHz for PDM mic)
 constexpr int SAMPLE_BITS = 16;     // Audio sample bit depth (16-bit)
 constexpr int VOLUME_GAIN = 2;      // Audio volume gain factor (applied as bit shift: e.g., 1 for 2x, 2 for 4x gain)
-constexpr size_t AUDIO_FRAME_HEADER_LEN = 3; // Bytes for audio frame header
+constexpr size_t AUDIO_FRAME_HEADER_LEN = 3; // Bytes for audio frame header (2-byte sequence + 1-byte fragment index)
+constexpr size_t AUDIO_PACKET_TIMESTAMP_LEN = 4; // First-sample time (device us, low 32 bits) leading fragment 0
+
+// Opus (SILK) low-bitrate speech mode. Only built when the Opus library is installed.
+constexpr int OPUS_FRAME_MS = 20;                                      // Opus frame duration
+constexpr int OPUS_FRAME_SAMPLES = SAMPLE_RATE * OPUS_FRAME_MS / 1000; // 320 samples at 16kHz
+constexpr int OPUS_BITRATE_BPS = 24000;                                // Target bitrate (16000-24000 is plenty for speech)
+constexpr int OPUS_COMPLEXITY = 3;                                     // 0-10, kept low for the ESP32-S3
+constexpr size_t OPUS_MAX_PACKET_BYTES = 160;                          // Hard cap on one encoded frame
+constexpr size_t OPUS_ENCODER_STATE_BUDGET = 32 * 1024;                // Static memory budget for the encoder state
+
+// Lossless mode: FLAC-style fixed linear prediction with Rice-coded residuals
+constexpr int LOSSLESS_BLOCK_SAMPLES = 512;                                  // 32ms blocks at 16kHz
+constexpr int LOSSLESS_MAX_ORDER = 4;                                        // Highest fixed predictor order
+constexpr size_t LOSSLESS_BLOCK_HEADER_LEN = 4;                              // order, rice parameter, sample count (LE)
+constexpr size_t LOSSLESS_MAX_PACKET_BYTES = LOSSLESS_BLOCK_HEADER_LEN + LOSSLESS_BLOCK_SAMPLES * sizeof(int16_t); // Verbatim worst case
+
+// Log-mel feature stream: LOGMEL_NUM_BINS log energies every LOGMEL_HOP_MS instead of waveform
+constexpr int LOGMEL_NUM_BINS = 40;                                          // Mel filters (one byte each per frame)
+constexpr int LOGMEL_HOP_MS = 10;                                            // Frame step
+constexpr int LOGMEL_WINDOW_MS = 25;                                         // Analysis window length
+constexpr int LOGMEL_MIN_HZ = 20;                                            // Lower edge of the lowest filter
+constexpr size_t LOGMEL_WINDOW_MAX_SAMPLES = SAMPLE_RATE * LOGMEL_WINDOW_MS / 1000; // 400 samples at 16kHz
+constexpr size_t LOGMEL_FFT_MAX_SIZE = 512;                                  // FFT length for the 16kHz window
+
+// Output sample rate. Clients select 16000 or 8000 through the audio format characteristic;
+// 8000 runs the anti-aliased 2:1 polyphase decimator before encoding.
+constexpr uint32_t AUDIO_DEFAULT_OUTPUT_SAMPLE_RATE = SAMPLE_RATE;
+constexpr size_t AUDIO_MAX_INPUT_FRAME_SAMPLES = 2 * LOSSLESS_BLOCK_SAMPLES; // Largest codec frame at 2:1 decimation
+
+// DSP front-end applied to every frame before encoding (DC removal, gain, optional AGC)
+constexpr int32_t DSP_DC_BLOCK_COEFF_Q15 = 32604;        // Pole at ~0.995: -3dB at ~13Hz for 16kHz audio
+constexpr bool AUDIO_AGC_ENABLED = false;                // Automatic gain control on top of VOLUME_GAIN
+constexpr uint32_t AGC_TARGET_RMS = 3000;                // Output level the AGC steers towards
+constexpr uint32_t AGC_MAX_GAIN_Q8 = 8 * 256;            // Up to 8x extra gain (Q8)
+constexpr uint32_t AGC_MIN_GAIN_Q8 = 256 / 8;            // Down to 1/8x (Q8)
+constexpr uint32_t AGC_NOISE_GATE_RMS = 100;             // Frames quieter than this do not raise the gain
+constexpr uint32_t AGC_RELEASE_DIVISOR = 32;             // Gain rises 1/32 of the way to target per frame
+
+// Voice activity detection: silent frames are replaced by compact silence markers
+constexpr bool AUDIO_VAD_ENABLED = true;                // Gate audio transmission on speech
+constexpr bool AUDIO_VAD_LOSSLESS = false;              // Also gate the lossless stream (no longer bit-exact PCM)
+constexpr uint32_t VAD_MIN_NOISE_FLOOR = 64;            // Mean-square floor (RMS 8) so digital silence still adapts
+constexpr uint32_t VAD_MIN_SPEECH_ENERGY = 2500;        // Mean-square (RMS 50) below which nothing counts as speech
+constexpr uint32_t VAD_ENERGY_RATIO = 4;                // Speech must be 6dB above the noise floor
+constexpr uint32_t VAD_MAX_ZCR_PER_MILLE = 450;         // Higher zero-crossing rates look like broadband noise
+constexpr uint32_t VAD_HANGOVER_MS = 300;               // Keep sending this long after speech stops
+constexpr uint32_t VAD_PREROLL_MS = 200;                // Audio sent ahead of detected speech onset
+constexpr size_t VAD_PREROLL_SAMPLES = SAMPLE_RATE * VAD_PREROLL_MS / 1000 + LOSSLESS_BLOCK_SAMPLES; // Pre-roll ring size
+constexpr uint16_t VAD_SILENCE_MARKER_MAX_MS = 1000;    // Longest silence reported by one marker
+constexpr size_t AUDIO_SILENCE_MARKER_LEN = 5;          // 0xFF 0xFF 0xFF + duration in ms (LE)
+
+// Replay ring: recent framed (Opus, lossless, log-mel) packets kept in PSRAM so a client that reconnects can
+// fetch what it missed by sequence number before live audio resumes.
+constexpr size_t AUDIO_REPLAY_BUFFER_BYTES = 256 * 1024;      // Memory ceiling (0 disables replay); ~80s of 24kbps Opus
+constexpr uint32_t AUDIO_REPLAY_CATCHUP_BYTES_PER_SEC = 0;    // Default backlog rate, 0 = as fast as the link allows
+constexpr size_t AUDIO_REPLAY_BURST_PACKETS = 4;              // Backlog packets sent per audio task pass
+constexpr size_t AUDIO_REPLAY_MAX_PACKET_BYTES = LOSSLESS_MAX_PACKET_BYTES > OPUS_MAX_PACKET_BYTES ? LOSSLESS_MAX_PACKET_BYTES : OPUS_MAX_PACKET_BYTES;
+constexpr size_t AUDIO_REPLAY_STATUS_LEN = 21;                // Bytes in the replay characteristic value
+
+// Microphone capture (ESP-IDF i2s_channel PDM RX). The audio task sleeps until the DMA engine
+// hands over a full buffer: larger buffers mean fewer wakes but more capture latency.
+constexpr uint32_t I2S_DMA_DESC_NUM = 6;                // DMA buffers in the ring (120ms of audio)
+constexpr uint32_t I2S_DMA_FRAME_SAMPLES = 320;         // Samples per DMA buffer (20ms at 16kHz, max 2046)
+constexpr uint32_t I2S_READ_TIMEOUT_MS = 100;           // Longest wait for a block before re-checking state
+
+constexpr uint32_t AUDIO_TASK_STACK_SIZE = 32768;                      // Bytes; the SILK encoder needs a deep stack
 
 // ----------------------------------------------------------------------------
 // I2S PINS (for XIAO ESP32S3 Sense)
@@ -36,11 +103,27 @@ const uint16_t HARDWARE_REVISION_STRING_CHAR_UUID = 0x2A27;
 const uint16_t BATTERY_SERVICE_UUID = 0x180F;
 const uint16_t BATTERY_LEVEL_CHAR_UUID = 0x2A19;
 
-// Main Custom Service (OpenGlass Service)
-static BLEUUID SERVICE_UUID("19b10000-e8f2-537e-4f6c-d104768a1214");
-static BLEUUID PHOTO_DATA_UUID("19b10005-e8f2-537e-4f6c-d104768a1214");
-static BLEUUID PHOTO_CONTROL_UUID("19b10006-e8f2-537e-4f6c-d104768a1214");
-static BLEUUID AUDIO_CODEC_ULAW_UUID("19b10001-e8f2-537e-4f6c-d104768a1214");
+// Main Custom Service (OpenGlass Service). Both BLE backends build the same table from these.
+constexpr const char *SERVICE_UUID = "19b10000-e8f2-537e-4f6c-d104768a1214";
+constexpr const char *PHOTO_DATA_UUID = "19b10005-e8f2-537e-4f6c-d104768a1214";
+constexpr const char *PHOTO_CONTROL_UUID = "19b10006-e8f2-537e-4f6c-d104768a1214";
+constexpr const char *AUDIO_CODEC_ULAW_UUID = "19b10001-e8f2-537e-4f6c-d104768a1214";
+constexpr const char *AUDIO_CODEC_OPUS_UUID = "19b10002-e8f2-537e-4f6c-d104768a1214";
+constexpr const char *AUDIO_CODEC_LOSSLESS_UUID = "19b10003-e8f2-537e-4f6c-d104768a1214";
+constexpr const char *AUDIO_FORMAT_UUID = "19b10004-e8f2-537e-4f6c-d104768a1214";
+constexpr const char *AUDIO_REPLAY_UUID = "19b10007-e8f2-537e-4f6c-d104768a1214";
+constexpr const char *AUDIO_LOGMEL_UUID = "19b10008-e8f2-537e-4f6c-d104768a1214";
+constexpr const char *WIFI_OFFLOAD_UUID = "19b10009-e8f2-537e-4f6c-d104768a1214";
+constexpr const char *PARAM_CONFIG_UUID = "19b1000a-e8f2-537e-4f6c-d104768a1214";
+
+// Firmware update service (see ota_update.h)
+constexpr const char *OTA_SERVICE_UUID = "19b10100-e8f2-537e-4f6c-d104768a1214";
+constexpr const char *OTA_CONTROL_UUID = "19b10101-e8f2-537e-4f6c-d104768a1214";
+constexpr const char *OTA_DATA_UUID = "19b10102-e8f2-537e-4f6c-d104768a1214";
+
+// Attribute handles reserved for the main service (each characteristic with CCCD and user description uses 4)
+constexpr uint32_t MAIN_SERVICE_NUM_HANDLES = 44;
+constexpr uint32_t OTA_SERVICE_NUM_HANDLES = 12;
 
 // ---------------------------------------------------------------------------------
 // BLE Characteristic User Descriptions (UUID 0x2901)
@@ -48,11 +131,66 @@ static BLEUUID AUDIO_CODEC_ULAW_UUID("19b10001-e8f2-537e-4f6c-d104768a1214");
 constexpr const char* PHOTO_DATA_USER_DESCRIPTION = "Photo JPEG Data Stream";
 constexpr const char* PHOTO_CONTROL_USER_DESCRIPTION = "Photo Capture Control";
 constexpr const char* AUDIO_ULAW_USER_DESCRIPTION = "u-law encoded audio stream";
+constexpr const char* AUDIO_OPUS_USER_DESCRIPTION = "Opus encoded audio stream";
+constexpr const char* AUDIO_LOSSLESS_USER_DESCRIPTION = "Lossless compressed audio stream";
+constexpr const char* AUDIO_FORMAT_USER_DESCRIPTION = "Audio format (codec, bits, sample rate)";
+constexpr const char* AUDIO_LOGMEL_USER_DESCRIPTION = "Log-mel audio features (40 bins / 10ms)";
+constexpr const char* AUDIO_REPLAY_USER_DESCRIPTION = "Audio replay (backlog request and status)";
+constexpr const char* WIFI_OFFLOAD_USER_DESCRIPTION = "Wi-Fi offload (command and status)";
+constexpr const char* PARAM_CONFIG_USER_DESCRIPTION = "Runtime parameters (id + value)";
+constexpr const char* OTA_CONTROL_USER_DESCRIPTION = "Firmware update (command and status)";
+constexpr const char* OTA_DATA_USER_DESCRIPTION = "Firmware image chunks (offset + data)";
+constexpr const char* BATTERY_LEVEL_USER_DESCRIPTION = "Battery Level";
 
 // ---------------------------------------------------------------------------------
 // BLE Streaming Configuration
 // ---------------------------------------------------------------------------------
-constexpr int AUDIO_BLE_PACKET_SIZE = 20; // Max bytes per BLE notification (must be <= MTU-3)
+// BLE stack (see ble_transport.h): 0 = Arduino BLE library (Bluedroid), 1 = NimBLE-Arduino 2.x.
+// Can be set as a build flag instead.
+#ifndef BLE_USE_NIMBLE
+#define BLE_USE_NIMBLE 0
+#endif
+constexpr int AUDIO_BLE_PACKET_SIZE = 20; // Max bytes per u-law notification (clamped to the smallest subscriber MTU - 3)
+constexpr uint16_t BLE_LOCAL_MTU = 247;   // ATT MTU offered to clients (matches MAX_PHOTO_CHUNK_PAYLOAD_SIZE + 3)
+constexpr uint16_t BLE_LINK_DATA_LEN = 251; // LE Data Length Extension PDU payload requested after connecting
+constexpr bool BLE_LINK_PREFER_2M_PHY = true; // Request the 2M PHY after connecting (1M stays allowed)
+// Clients served at once (see ble_session.h). Advertising continues until all are taken. The
+// stack must allow as many links (CONFIG_BT_ACL_CONNECTIONS / CONFIG_BT_NIMBLE_MAX_CONNECTIONS).
+constexpr size_t BLE_MAX_CONNECTIONS = 3;
+// L2CAP photo channel. Clients that open it after connecting get photos as SDUs; the others
+// keep GATT. Only on NimBLE, built with CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM >= 1.
+constexpr uint16_t BLE_L2CAP_PHOTO_PSM = 0x0080;  // First dynamic LE PSM
+constexpr uint16_t BLE_L2CAP_PHOTO_MTU = 4096;    // Largest SDU; bounded by the host's buffer pool, not the 64KB the spec allows
+
+// Connection parameters per workload (see ble_link.h). Intervals are in 1.25ms units,
+// supervision timeouts in 10ms units.
+constexpr uint16_t BLE_CONN_BULK_MIN_INTERVAL = 6;     // 7.5ms while a photo uploads
+constexpr uint16_t BLE_CONN_BULK_MAX_INTERVAL = 12;    // 15ms
+constexpr uint16_t BLE_CONN_BULK_LATENCY = 0;
+constexpr uint16_t BLE_CONN_AUDIO_MIN_INTERVAL = 12;   // 15ms for steady audio
+constexpr uint16_t BLE_CONN_AUDIO_MAX_INTERVAL = 24;   // 30ms
+constexpr uint16_t BLE_CONN_AUDIO_LATENCY = 0;
+constexpr uint16_t BLE_CONN_IDLE_MIN_INTERVAL = 80;    // 100ms when nothing streams
+constexpr uint16_t BLE_CONN_IDLE_MAX_INTERVAL = 120;   // 150ms
+constexpr uint16_t BLE_CONN_IDLE_LATENCY = 4;          // May skip 4 events: commands wait up to 750ms
+constexpr uint16_t BLE_CONN_SUPERVISION_TIMEOUT = 600; // 6 seconds, above 2 x (1 + latency) x max interval
+constexpr unsigned long BLE_CONN_MODE_HOLD_MS = 3000;           // Workload must stay lower this long before slowing down
+constexpr unsigned long BLE_CONN_UPDATE_TIMEOUT_MS = 5000;      // Give up waiting for a parameter update event
+
+// ---------------------------------------------------------------------------------
+// BLE Advertising and Reconnection
+// ---------------------------------------------------------------------------------
+// Advertising starts with a fast burst after boot, wake or disconnect, then slows down
+// (see ble_reconnect.h). Intervals are in 0.625ms units.
+constexpr uint16_t BLE_ADV_FAST_MIN_INTERVAL = 0x20;        // 20ms
+constexpr uint16_t BLE_ADV_FAST_MAX_INTERVAL = 0x30;        // 30ms
+constexpr unsigned long BLE_ADV_FAST_DURATION_MS = 30000;   // Burst length before slowing down
+constexpr uint16_t BLE_ADV_SLOW_MIN_INTERVAL = 0x29C;       // 417.5ms
+constexpr uint16_t BLE_ADV_SLOW_MAX_INTERVAL = 0x2B0;       // 430ms
+// Bond with clients (Just Works, no passkey), so phones keep their GATT cache between
+// connections and skip service discovery. Bonds are kept in NVS by the stack.
+constexpr bool BLE_BONDING = true;
+constexpr const char *BLE_GATT_STORE_NAMESPACE = "gatt";    // Hash of the GATT layout bonded peers last saw
 
 // ---------------------------------------------------------------------------------
 // Device Information Strings
@@ -70,17 +208,96 @@ constexpr const char* DEVICE_HARDWARE_REVISION = "Seeed Xiao ESP32S3 Sense";
 constexpr size_t MAX_PHOTO_CHUNK_PAYLOAD_SIZE = 244;
 constexpr size_t PHOTO_CHUNK_HEADER_LEN = 2;
 constexpr size_t PHOTO_CHUNK_BUFFER_SIZE = MAX_PHOTO_CHUNK_PAYLOAD_SIZE + PHOTO_CHUNK_HEADER_LEN;
+constexpr size_t PHOTO_END_MARKER_LEN = PHOTO_CHUNK_HEADER_LEN + 8; // 0xFFFF + capture time (device us, int64 LE)
+constexpr size_t PHOTO_L2CAP_HEADER_LEN = 12; // First SDU of an L2CAP photo: JPEG length (uint32 LE) + capture time (int64 LE)
+
+// Clock sync on the photo control characteristic (see timebase.h). Single-byte writes are
+// photo commands; longer writes start with an opcode.
+constexpr uint8_t CONTROL_OPCODE_CLOCK_SYNC = 0x01;
+constexpr size_t CLOCK_SYNC_REPLY_LEN = 20;
+
+// ---------------------------------------------------------------------------------
+// BLE Transmit Scheduler
+// ---------------------------------------------------------------------------------
+// All audio and photo notifications go through one task (ble_tx_scheduler.h). Audio has
+// strict priority; photo chunks are paced by a token bucket so they cannot delay audio.
+constexpr size_t BLE_TX_MAX_NOTIFY_LEN = AUDIO_FRAME_HEADER_LEN + MAX_PHOTO_CHUNK_PAYLOAD_SIZE + PHOTO_CHUNK_HEADER_LEN;
+constexpr size_t BLE_TX_AUDIO_QUEUE_LEN = 24;                              // Notifications; a few framed packets
+constexpr size_t BLE_TX_PHOTO_QUEUE_LEN = 4;                               // Photo chunks in flight
+constexpr uint32_t BLE_TX_PHOTO_RATE_BYTES_PER_SEC = 24400;                // One full chunk per 10ms
+constexpr uint32_t BLE_TX_PHOTO_FAST_RATE_BYTES_PER_SEC = 64000;           // Once the link runs on 2M PHY with DLE
+constexpr uint32_t BLE_TX_PHOTO_BURST_BYTES = 4 * PHOTO_CHUNK_BUFFER_SIZE;
+constexpr uint32_t BLE_TX_PHOTO_ENQUEUE_TIMEOUT_MS = 100;                  // Photo task backpressure wait per chunk
+constexpr uint32_t BLE_TX_TASK_STACK_SIZE = 4096;                          // Bytes
+constexpr int BLE_TX_TASK_PRIORITY = 3;                                    // Above the audio (2) and photo (1) producers
+constexpr bool BLE_TX_DIRECT_NOTIFY = true;  // Bluedroid: send with esp_ble_gatts_send_indicate; false uses setValue()/notify() for comparison
+
+// ---------------------------------------------------------------------------------
+// Command Dispatcher
+// ---------------------------------------------------------------------------------
+// Client writes and subscriptions are decoded in the BLE callback and carried out by a
+// task (command_dispatcher.h), so the stack's task never waits on the camera or the codec.
+constexpr size_t COMMAND_QUEUE_LEN = 8;                 // Commands waiting for the dispatcher
+constexpr uint32_t COMMAND_TASK_STACK_SIZE = 4096;      // Bytes
+constexpr int COMMAND_TASK_PRIORITY = 2;                // Below the TX scheduler (3), level with audio
+
+// ---------------------------------------------------------------------------------
+// Wi-Fi Offload
+// ---------------------------------------------------------------------------------
+// Bulk upload of the held photo and the audio replay ring over Wi-Fi (wifi_offload.h),
+// started by a write to the offload characteristic. The radio is off otherwise.
+constexpr const char *WIFI_OFFLOAD_AP_SSID = "OpenGlass-Offload";   // SoftAP mode: the phone joins this network
+constexpr const char *WIFI_OFFLOAD_AP_PASSWORD = "openglass";       // At least 8 characters (WPA2)
+constexpr uint8_t WIFI_OFFLOAD_AP_CHANNEL = 6;
+constexpr uint32_t WIFI_OFFLOAD_AP_CLIENT_IP = 0x0204A8C0;          // 192.168.4.2 (network order): the only SoftAP client's lease
+constexpr const char *WIFI_OFFLOAD_STA_SSID = "";                   // Station mode: network to join (empty disables it)
+constexpr const char *WIFI_OFFLOAD_STA_PASSWORD = "";
+constexpr uint16_t WIFI_OFFLOAD_DEFAULT_PORT = 8080;                // Port of the client's HTTP receiver
+constexpr size_t WIFI_OFFLOAD_CHUNK_BYTES = 16 * 1024;              // Largest HTTP chunk sent from PSRAM in one call
+constexpr uint32_t WIFI_OFFLOAD_JOIN_TIMEOUT_MS = 15000;            // Station mode: give up joining the network
+constexpr uint32_t WIFI_OFFLOAD_SERVER_WAIT_MS = 30000;             // Keep retrying until the receiver accepts
+constexpr uint32_t WIFI_OFFLOAD_RETRY_MS = 500;
+constexpr uint32_t WIFI_OFFLOAD_SOCKET_TIMEOUT_MS = 5000;           // Per send/receive call
+constexpr size_t WIFI_OFFLOAD_STATUS_LEN = 15;                      // Bytes in the offload characteristic value
+constexpr uint32_t WIFI_OFFLOAD_TASK_STACK_SIZE = 6144;             // Bytes
+constexpr int WIFI_OFFLOAD_TASK_PRIORITY = 1;
+
+// ---------------------------------------------------------------------------------
+// BLE OTA Update
+// ---------------------------------------------------------------------------------
+// Firmware images are written to the inactive OTA partition while they arrive (ota_update.h).
+// The new image must confirm itself once BLE is up; without that the bootloader rolls back,
+// if it was built with CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE.
+constexpr size_t OTA_BLOCK_SIZE = 4096;                  // One flash sector per buffer; two buffers in internal RAM
+constexpr uint32_t OTA_RESUME_SAVE_BYTES = 64 * 1024;    // Progress kept in NVS this often, for resuming after a reboot
+constexpr const char *OTA_STORE_NAMESPACE = "ota";
+constexpr size_t OTA_STATUS_LEN = 18;                    // Bytes in the OTA control characteristic value
+constexpr uint32_t OTA_REBOOT_DELAY_MS = 500;            // After the apply command, so its status notification goes out
+constexpr uint32_t OTA_TASK_STACK_SIZE = 4096;           // Bytes
+constexpr int OTA_TASK_PRIORITY = 2;                     // With the audio producer, below the TX scheduler
+
+// ---------------------------------------------------------------------------------
+// Power Management Locks
+// ---------------------------------------------------------------------------------
+// setup() enables DFS (80-240 MHz) and automatic light sleep. Capture, upload, audio and OTA
+// hold PM locks while active (see pm_lock.h); false runs them under DFS and light sleep, for
+// comparing energy against latency.
+constexpr bool PM_LOCKS_ENABLED = true;
+constexpr int PM_MAX_FREQ_MHZ = 240;
+constexpr int PM_MIN_FREQ_MHZ = 80;
 
 // ---------------------------------------------------------------------------------
 // Timings and Intervals (all in milliseconds)
 // ---------------------------------------------------------------------------------
 constexpr unsigned long BATTERY_UPDATE_INTERVAL_MS = 60000;      // 60 seconds
-constexpr unsigned long LOOP_DELAY_MS = 20;                      // Delay at the end of the main loop
+constexpr unsigned long LINK_CHECK_INTERVAL_MS = 500;            // Connection mode re-evaluated this often while connected
 constexpr unsigned long DEEP_SLEEP_DISCONNECT_DELAY_MS = 600000; // 10 minutes
 constexpr unsigned long DEEP_SLEEP_WAKE_INTERVAL_MS = 10000;     // 10 seconds
+constexpr unsigned long DEEP_SLEEP_WAKE_WINDOW_MS = 5000;        // Advertising after an idle wake before sleeping again
 constexpr unsigned long DEBUG_LOG_INTERVAL_MS = 10000;           // 10 seconds
 constexpr unsigned long PHOTO_INTERVAL_MS = 5000;                // 5 seconds
-constexpr unsigned long ULAW_TASK_DELAY_MS = 10;                 // Delay for the audio streaming task loop
+constexpr unsigned long PHOTO_SINGLE_SHOT_DELAY_MS = 200;        // Single shot held back so the client is ready for the first chunk
+constexpr unsigned long ULAW_TASK_DELAY_MS = 10;                 // Audio task poll interval without I2S receive events
 
 // ---------------------------------------------------------------------------------
 // Pin Definitions
@@ -89,5 +306,15 @@ constexpr unsigned long ULAW_TASK_DELAY_MS = 10;                 // Delay for th
 
 // Camera warm-up: number of frames to discard after init (for AWB/gain to settle)
 constexpr int CAMERA_WARMUP_FRAMES = 5;
+constexpr int CAMERA_JPEG_QUALITY = 20; // 0-63, lower means higher quality
+// Index into the camera's resolution table: 0 = QVGA, 1 = VGA, 2 = SVGA, 3 = XGA (1024x768), 4 = SXGA, 5 = UXGA
+constexpr int CAMERA_FRAME_SIZE = 3;
+
+// ---------------------------------------------------------------------------------
+// Runtime Parameters
+// ---------------------------------------------------------------------------------
+// Some of the constants above are only defaults (see PARAM_SPECS in param_registry.cpp).
+// Clients can change them over the config characteristic; changes are kept in NVS.
+constexpr const char *PARAM_STORE_NAMESPACE = "params";
 
 #endif // CONFIG_H
\ No newline at end of file
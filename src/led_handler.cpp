@@ -2,72 +2,99 @@
 #include "logger.h"
 #include "config.h"
 #include "ble_handler.h" // For g_is_ble_connected
-#include <Arduino.h>     // For pinMode, digitalWrite, millis
+#include <Arduino.h>     // For pinMode, digitalWrite
+#include <freertos/FreeRTOS.h>
+#include <freertos/timers.h>
 
-static led_status_t g_current_led_status = LED_STATUS_OFF;
+static const uint32_t LED_BLINK_SLOW_MS = 500;      // Disconnected: 1s period
+static const uint32_t LED_BLINK_FAST_MS = 250;      // Audio streaming: 0.5s period
+static const uint32_t LED_HEARTBEAT_ON_MS = 50;     // Low power: 50ms pulse every 2s
+static const uint32_t LED_HEARTBEAT_OFF_MS = 1950;
+
+static volatile led_status_t g_current_led_status = LED_STATUS_OFF;
+static volatile bool s_led_on = false;
+static TimerHandle_t s_blink_timer = nullptr; // Runs only for the blinking patterns
+
+static void write_led(bool on) {
+    s_led_on = on;
+    digitalWrite(PIN_LED, on ? HIGH : LOW);
+}
+
+// Runs on the timer service task at each edge of the blink pattern
+static void on_blink_timer(TimerHandle_t timer) {
+    switch (g_current_led_status) {
+        case LED_STATUS_DISCONNECTED:
+        case LED_STATUS_AUDIO_STREAMING:
+            write_led(!s_led_on);
+            break;
+
+        case LED_STATUS_LOW_POWER: // Uneven phases: the period changes at every edge
+            write_led(!s_led_on);
+            xTimerChangePeriod(timer, pdMS_TO_TICKS(s_led_on ? LED_HEARTBEAT_ON_MS : LED_HEARTBEAT_OFF_MS), 0);
+            break;
+
+        default:
+            break; // Steady states are written by set_led_status
+    }
+}
+
+static void start_blink(uint32_t period_ms) {
+    if (s_blink_timer) {
+        xTimerChangePeriod(s_blink_timer, pdMS_TO_TICKS(period_ms), 0);
+    }
+}
+
+static void stop_blink() {
+    if (s_blink_timer) {
+        xTimerStop(s_blink_timer, 0);
+    }
+}
 
 void initialize_led() {
     pinMode(PIN_LED, OUTPUT);
-    digitalWrite(PIN_LED, LOW); // Start with LED off
+    write_led(false); // Start with LED off
+    s_blink_timer = xTimerCreate("led", pdMS_TO_TICKS(LED_BLINK_SLOW_MS), pdTRUE, nullptr, on_blink_timer);
+    if (!s_blink_timer) {
+        logger_printf("[LED] ERROR: Failed to create the blink timer!\n");
+    }
     set_led_status(LED_STATUS_DISCONNECTED); // Set initial logical state
     logger_printf("[LED] Single-color LED handler initialized on pin %d.\n", PIN_LED);
 }
 
 void set_led_status(led_status_t status) {
-    // Photo capturing is a momentary flash, handled in handle_led directly
+    // Photo capturing is a momentary flash on top of the current pattern
     if (status == LED_STATUS_PHOTO_CAPTURING) {
-        // Immediately flash the LED
         digitalWrite(PIN_LED, HIGH);
         delay(50); // Brief blocking delay for a visible flash
-        digitalWrite(PIN_LED, LOW);
-        // The main handle_led loop will then resume the previous state's pattern
+        // Back to the pattern's current level; a blinking pattern carries on at its next edge
+        digitalWrite(PIN_LED, s_led_on ? HIGH : LOW);
         return;
     }
     g_current_led_status = status;
-}
-
-void handle_led() {
-    static unsigned long last_blink_time = 0;
-    static bool led_state = false;
-    unsigned long current_time = millis();
 
-    switch (g_current_led_status) {
+    switch (status) {
         case LED_STATUS_CONNECTED:
-            digitalWrite(PIN_LED, HIGH); // Solid ON
+            stop_blink();
+            write_led(true); // Solid ON
             break;
 
-        case LED_STATUS_DISCONNECTED: // Slow blink (1s period)
-            if (current_time - last_blink_time >= 500) {
-                last_blink_time = current_time;
-                led_state = !led_state;
-                digitalWrite(PIN_LED, led_state);
-            }
+        case LED_STATUS_DISCONNECTED: // Slow blink
+            start_blink(LED_BLINK_SLOW_MS);
             break;
 
-        case LED_STATUS_AUDIO_STREAMING: // Fast blink (0.5s period)
-            if (current_time - last_blink_time >= 250) {
-                last_blink_time = current_time;
-                led_state = !led_state;
-                digitalWrite(PIN_LED, led_state);
-            }
+        case LED_STATUS_AUDIO_STREAMING: // Fast blink
+            start_blink(LED_BLINK_FAST_MS);
             break;
 
-        case LED_STATUS_LOW_POWER: // Slow "heartbeat" pulse (50ms pulse every 2s)
-            if (!led_state && (current_time - last_blink_time >= 2000)) {
-                last_blink_time = current_time;
-                led_state = true;
-                digitalWrite(PIN_LED, HIGH);
-            } else if (led_state && (current_time - last_blink_time >= 50)) {
-                led_state = false;
-                digitalWrite(PIN_LED, LOW);
-            }
+        case LED_STATUS_LOW_POWER: // Slow "heartbeat" pulse
+            write_led(false);
+            start_blink(LED_HEARTBEAT_OFF_MS);
             break;
 
         case LED_STATUS_OFF:
-            digitalWrite(PIN_LED, LOW); // Solid OFF
-            break;
-
         default:
-            break; // Should not happen
+            stop_blink();
+            write_led(false); // Solid OFF
+            break;
     }
 }
@@ -8,12 +8,12 @@ enum led_status_t {
     LED_STATUS_CONNECTED,
     LED_STATUS_AUDIO_STREAMING,
     LED_STATUS_PHOTO_CAPTURING,
-    LED_STATUS_LOW_POWER, // For indicating CPU is in low-power mode (80 MHz)
+    LED_STATUS_LOW_POWER, // Idle with DFS (down to 80 MHz) and light sleep active
     LED_STATUS_OFF
 };
 
 void initialize_led();
+// Blinking patterns run from a FreeRTOS timer, so nothing needs to poll the LED
 void set_led_status(led_status_t status);
-void handle_led(); // Must be called in the main loop to handle blinking patterns
 
 #endif // LED_HANDLER_H
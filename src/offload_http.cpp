@@ -0,0 +1,147 @@
+#include "offload_http.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+// Sends every byte described by iov, continuing after partial sends
+static bool send_all(int fd, struct iovec *iov, int iov_count) {
+    while (iov_count > 0) {
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = iov;
+        message.msg_iovlen = iov_count;
+        ssize_t sent = sendmsg(fd, &message, 0);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        // Skip the fully sent entries, then trim the partly sent one
+        while (iov_count > 0 && (size_t)sent >= iov->iov_len) {
+            sent -= iov->iov_len;
+            iov++;
+            iov_count--;
+        }
+        if (iov_count > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + sent;
+            iov->iov_len -= sent;
+        }
+    }
+    return true;
+}
+
+static bool send_text(int fd, const char *text) {
+    struct iovec iov = {(void *)text, strlen(text)};
+    return send_all(fd, &iov, 1);
+}
+
+// Reads the status line of the reply ("HTTP/1.1 200 OK"). Returns 0 if there is none.
+static int read_status(int fd) {
+    char line[64];
+    size_t len = 0;
+    while (len < sizeof(line) - 1) {
+        ssize_t got = recv(fd, &line[len], sizeof(line) - 1 - len, 0);
+        if (got <= 0) {
+            break;
+        }
+        len += (size_t)got;
+        line[len] = '\0';
+        if (strchr(line, '\n')) {
+            break;
+        }
+    }
+    line[len] = '\0';
+    int status = 0;
+    if (sscanf(line, "HTTP/%*d.%*d %d", &status) != 1) {
+        return 0;
+    }
+    return status;
+}
+
+bool offload_http_post(uint32_t ipv4, uint16_t port, const char *path, const char *content_type,
+                       const char *extra_headers, const OffloadSpan *spans, size_t span_count,
+                       size_t chunk_bytes, uint32_t timeout_ms, OffloadUploadResult *result) {
+    OffloadUploadResult local = {};
+    if (!result) {
+        result = &local;
+    }
+    memset(result, 0, sizeof(*result));
+    if (chunk_bytes == 0) {
+        result->error = EINVAL;
+        return false;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        result->error = errno;
+        return false;
+    }
+    struct timeval timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_usec = (timeout_ms % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    struct sockaddr_in server;
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons(port);
+    server.sin_addr.s_addr = ipv4;
+    if (connect(fd, (struct sockaddr *)&server, sizeof(server)) != 0) {
+        result->error = errno;
+        close(fd);
+        return false;
+    }
+
+    char head[256];
+    int head_len = snprintf(head, sizeof(head),
+                            "POST %s HTTP/1.1\r\n"
+                            "Host: device\r\n"
+                            "Content-Type: %s\r\n"
+                            "Transfer-Encoding: chunked\r\n"
+                            "Connection: close\r\n",
+                            path, content_type);
+    bool ok = head_len > 0 && (size_t)head_len < sizeof(head) && send_text(fd, head)
+              && (!extra_headers || send_text(fd, extra_headers)) && send_text(fd, "\r\n");
+
+    // Each chunk goes out as size line, data and CRLF in one call; the data is not copied
+    static const char CRLF[] = "\r\n";
+    for (size_t s = 0; ok && s < span_count; s++) {
+        for (size_t offset = 0; ok && offset < spans[s].len; offset += chunk_bytes) {
+            size_t len = spans[s].len - offset;
+            if (len > chunk_bytes) {
+                len = chunk_bytes;
+            }
+            char size_line[2 * sizeof(size_t) + 3]; // Hex digits, CRLF and the terminator
+            snprintf(size_line, sizeof(size_line), "%zx\r\n", len);
+            struct iovec iov[3] = {
+                {size_line, strlen(size_line)},
+                {(void *)(spans[s].data + offset), len},
+                {(void *)CRLF, 2}
+            };
+            ok = send_all(fd, iov, 3);
+            if (ok) {
+                result->body_bytes += len;
+            }
+        }
+    }
+    ok = ok && send_text(fd, "0\r\n\r\n");
+    if (!ok) {
+        result->error = errno;
+        close(fd);
+        return false;
+    }
+
+    result->http_status = read_status(fd);
+    if (result->http_status == 0) {
+        result->error = errno;
+    }
+    close(fd);
+    return result->http_status >= 200 && result->http_status < 300;
+}
@@ -0,0 +1,31 @@
+#ifndef OFFLOAD_HTTP_H
+#define OFFLOAD_HTTP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// HTTP upload used by the Wi-Fi offload (see wifi_offload.h). Only BSD socket calls, so the
+// same code runs on lwIP and on a Linux host, where it can be pointed at a loopback server.
+
+// One contiguous piece of a request body, sent straight from where it lives (e.g. PSRAM)
+struct OffloadSpan {
+    const uint8_t *data;
+    size_t len;
+};
+
+struct OffloadUploadResult {
+    int http_status;   // Status code of the reply, 0 if none was received
+    int error;         // errno of the socket call that failed, 0 if none did
+    size_t body_bytes; // Body bytes accepted by the socket
+};
+
+// POSTs the spans, in order, as one body with chunked transfer encoding. Each chunk is at
+// most chunk_bytes and is handed to the socket together with its framing in one sendmsg(),
+// without copying it. ipv4 is in network byte order. extra_headers (may be nullptr) are
+// complete "Name: value\r\n" lines. Send and receive calls time out after timeout_ms.
+// Returns true if the server answered with a 2xx status.
+bool offload_http_post(uint32_t ipv4, uint16_t port, const char *path, const char *content_type,
+                       const char *extra_headers, const OffloadSpan *spans, size_t span_count,
+                       size_t chunk_bytes, uint32_t timeout_ms, OffloadUploadResult *result);
+
+#endif // OFFLOAD_HTTP_H
@@ -0,0 +1,112 @@
+#include "ota_receiver.h"
+#include <string.h>
+
+void ota_receiver_init(OtaReceiver &rx, uint8_t *const buffers[OTA_RECEIVER_BUFFERS], size_t block_size) {
+    memset(&rx, 0, sizeof(rx));
+    for (size_t i = 0; i < OTA_RECEIVER_BUFFERS; i++) {
+        rx.buffers[i] = buffers[i];
+    }
+    rx.block_size = block_size;
+}
+
+void ota_receiver_start(OtaReceiver &rx, uint32_t image_size, uint32_t resume_offset) {
+    if (resume_offset > image_size) {
+        resume_offset = 0;
+    }
+    resume_offset -= resume_offset % rx.block_size;
+    rx.image_size = image_size;
+    rx.next_offset = resume_offset;
+    rx.written = resume_offset;
+    rx.fill = 0;
+    rx.fill_len = 0;
+    rx.write = 0;
+    for (size_t i = 0; i < OTA_RECEIVER_BUFFERS; i++) {
+        rx.ready[i] = false;
+    }
+    rx.chunks = 0;
+    rx.duplicates = 0;
+    rx.gaps = 0;
+    rx.busy = 0;
+}
+
+// Hands the buffer being filled to the flash writer and moves on to the next one
+static void close_block(OtaReceiver &rx) {
+    rx.block_offset[rx.fill] = rx.next_offset - (uint32_t)rx.fill_len;
+    rx.block_len[rx.fill] = (uint32_t)rx.fill_len;
+    rx.ready[rx.fill] = true;
+    rx.fill = (rx.fill + 1) % OTA_RECEIVER_BUFFERS;
+    rx.fill_len = 0;
+}
+
+OtaChunkResult ota_receiver_push(OtaReceiver &rx, const uint8_t *chunk, size_t len, bool *block_ready) {
+    *block_ready = false;
+    if (rx.image_size == 0 || len <= OTA_CHUNK_HEADER_LEN) {
+        return OTA_CHUNK_INVALID;
+    }
+    uint32_t offset = chunk[0] | (chunk[1] << 8) | (chunk[2] << 16) | ((uint32_t)chunk[3] << 24);
+    const uint8_t *data = chunk + OTA_CHUNK_HEADER_LEN;
+    size_t data_len = len - OTA_CHUNK_HEADER_LEN;
+    if (data_len > rx.block_size || offset > rx.image_size || data_len > rx.image_size - offset) {
+        return OTA_CHUNK_INVALID;
+    }
+    if (offset + data_len <= rx.next_offset) {
+        rx.duplicates++;
+        return OTA_CHUNK_DUPLICATE;
+    }
+    if (offset != rx.next_offset) {
+        rx.gaps++;
+        return OTA_CHUNK_GAP;
+    }
+
+    // Room in the buffer being filled, plus the next one if it is free
+    size_t space = rx.ready[rx.fill] ? 0 : rx.block_size - rx.fill_len;
+    size_t next = (rx.fill + 1) % OTA_RECEIVER_BUFFERS;
+    if (data_len > space && (space == 0 || rx.ready[next])) {
+        rx.busy++;
+        return OTA_CHUNK_BUSY;
+    }
+
+    size_t first = data_len < space ? data_len : space;
+    memcpy(rx.buffers[rx.fill] + rx.fill_len, data, first);
+    rx.fill_len += first;
+    rx.next_offset += (uint32_t)first;
+    if (rx.fill_len == rx.block_size) {
+        close_block(rx);
+        *block_ready = true;
+    }
+    if (first < data_len) {
+        memcpy(rx.buffers[rx.fill], data + first, data_len - first);
+        rx.fill_len = data_len - first;
+        rx.next_offset += (uint32_t)(data_len - first);
+    }
+    // The image's tail does not fill a block
+    if (rx.next_offset == rx.image_size && rx.fill_len > 0) {
+        close_block(rx);
+        *block_ready = true;
+    }
+    rx.chunks++;
+    return OTA_CHUNK_ACCEPTED;
+}
+
+bool ota_receiver_next_block(const OtaReceiver &rx, const uint8_t **data, uint32_t *offset, uint32_t *len) {
+    if (!rx.ready[rx.write]) {
+        return false;
+    }
+    *data = rx.buffers[rx.write];
+    *offset = rx.block_offset[rx.write];
+    *len = rx.block_len[rx.write];
+    return true;
+}
+
+void ota_receiver_block_written(OtaReceiver &rx) {
+    if (!rx.ready[rx.write]) {
+        return;
+    }
+    rx.written = rx.block_offset[rx.write] + rx.block_len[rx.write];
+    rx.ready[rx.write] = false;
+    rx.write = (rx.write + 1) % OTA_RECEIVER_BUFFERS;
+}
+
+bool ota_receiver_complete(const OtaReceiver &rx) {
+    return rx.image_size > 0 && rx.written == rx.image_size;
+}
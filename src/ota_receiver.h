@@ -0,0 +1,65 @@
+#ifndef OTA_RECEIVER_H
+#define OTA_RECEIVER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Reassembly of a firmware image sent as write-without-response chunks, each
+// [offset uint32 LE][data]. Chunks are copied into OTA_RECEIVER_BUFFERS block buffers in
+// turn: while one full block is written to flash, the next one fills. Nothing is acked per
+// chunk, so a chunk that does not start at the next expected byte (a loss, or a resend after
+// a reconnect) or that finds both buffers waiting for flash is ignored and counted. The client
+// learns the next expected offset from the status and continues from there, which is also
+// how an upload resumes after a disconnect. Blocks are handed to the flash writer in order.
+// This is a pure module with no hardware dependencies.
+
+constexpr size_t OTA_RECEIVER_BUFFERS = 2;
+constexpr size_t OTA_CHUNK_HEADER_LEN = 4; // Image offset of the chunk's first byte
+
+enum OtaChunkResult : uint8_t {
+    OTA_CHUNK_ACCEPTED = 0,
+    OTA_CHUNK_DUPLICATE,   // Ends before the next expected byte: already held
+    OTA_CHUNK_GAP,         // Starts at another offset: earlier chunks were lost
+    OTA_CHUNK_BUSY,        // Both buffers are waiting for flash
+    OTA_CHUNK_INVALID      // No image started, no data, larger than a block or past the end
+};
+
+struct OtaReceiver {
+    uint8_t *buffers[OTA_RECEIVER_BUFFERS];
+    size_t block_size;
+    uint32_t image_size;
+    uint32_t next_offset;            // Next byte expected from the client
+    uint32_t written;                // Bytes the flash writer has finished
+    size_t fill;                     // Buffer being filled
+    size_t fill_len;
+    size_t write;                    // Next buffer for the flash writer
+    bool ready[OTA_RECEIVER_BUFFERS]; // Full (or the image's tail), waiting for flash
+    uint32_t block_offset[OTA_RECEIVER_BUFFERS];
+    uint32_t block_len[OTA_RECEIVER_BUFFERS];
+    // Statistics since the image started
+    uint32_t chunks;
+    uint32_t duplicates;
+    uint32_t gaps;
+    uint32_t busy;
+};
+
+// Buffers of block_size bytes each. Blocks start at multiples of block_size in the image.
+void ota_receiver_init(OtaReceiver &rx, uint8_t *const buffers[OTA_RECEIVER_BUFFERS], size_t block_size);
+
+// Starts an image, or resumes one whose first resume_offset bytes are already on flash
+// (rounded down to a block). Buffered data is dropped.
+void ota_receiver_start(OtaReceiver &rx, uint32_t image_size, uint32_t resume_offset);
+
+// Takes one chunk. Sets block_ready if a block is now waiting for the flash writer.
+OtaChunkResult ota_receiver_push(OtaReceiver &rx, const uint8_t *chunk, size_t len, bool *block_ready);
+
+// Oldest block waiting for flash. Returns false if there is none.
+bool ota_receiver_next_block(const OtaReceiver &rx, const uint8_t **data, uint32_t *offset, uint32_t *len);
+
+// Frees the block returned by ota_receiver_next_block once it is on flash
+void ota_receiver_block_written(OtaReceiver &rx);
+
+// Every byte of the image is on flash
+bool ota_receiver_complete(const OtaReceiver &rx);
+
+#endif // OTA_RECEIVER_H
@@ -0,0 +1,355 @@
+#include "ota_update.h"
+#include "ota_receiver.h"
+#include "config.h"
+#include "ble_handler.h" // For the status notification
+#include "pm_lock.h"
+#include "logger.h"
+#include <Arduino.h>
+#include <Preferences.h>
+#include <esp_heap_caps.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <esp_timer.h>
+#include <mbedtls/sha256.h>
+#include <string.h>
+
+static TaskHandle_t s_task = nullptr;
+static volatile bool s_cancel = false;
+
+// Reassembly state, shared by the BLE callback and the writer task
+static uint8_t *s_buffers[OTA_RECEIVER_BUFFERS] = {};
+static OtaReceiver s_rx = {};
+static bool s_receiving = false;            // Chunks are taken
+static volatile bool s_status_due = false;  // A chunk was refused; tell the client where to continue
+static OtaState s_state = OTA_STATE_IDLE;
+static OtaError s_error = OTA_ERROR_NONE;
+static int64_t s_rate_start_us = 0;
+static int64_t s_rate_end_us = 0;           // When receiving stopped, so the final rate holds
+static uint32_t s_rate_start_written = 0;
+static portMUX_TYPE s_rx_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Image being written, set by the begin command before the task starts
+static const esp_partition_t *s_partition = nullptr;
+static uint32_t s_image_size = 0;
+static uint8_t s_expected_sha[32];
+static uint32_t s_resume_from = 0;          // Bytes an earlier boot wrote
+static mbedtls_sha256_context s_sha;
+
+static Preferences s_prefs;
+
+static void set_state(OtaState state, OtaError error) {
+    portENTER_CRITICAL(&s_rx_mux);
+    s_state = state;
+    s_error = error;
+    portEXIT_CRITICAL(&s_rx_mux);
+}
+
+// Resume point in NVS, valid only for the same image on the same partition
+static uint32_t load_progress(const esp_partition_t *partition, uint32_t image_size, const uint8_t *sha) {
+    uint32_t written = 0;
+    uint8_t stored_sha[32];
+    if (!s_prefs.begin(OTA_STORE_NAMESPACE, true)) {
+        return 0;
+    }
+    if (s_prefs.getUInt("addr", 0) == partition->address && s_prefs.getUInt("size", 0) == image_size &&
+        s_prefs.getBytes("sha", stored_sha, sizeof(stored_sha)) == sizeof(stored_sha) &&
+        memcmp(stored_sha, sha, sizeof(stored_sha)) == 0) {
+        written = s_prefs.getUInt("written", 0);
+    }
+    s_prefs.end();
+    return written <= image_size ? written : 0;
+}
+
+static void save_progress(uint32_t written) {
+    if (!s_prefs.begin(OTA_STORE_NAMESPACE, false)) {
+        return;
+    }
+    s_prefs.putUInt("addr", s_partition->address);
+    s_prefs.putUInt("size", s_image_size);
+    s_prefs.putBytes("sha", s_expected_sha, sizeof(s_expected_sha));
+    s_prefs.putUInt("written", written);
+    s_prefs.end();
+}
+
+static void clear_progress() {
+    if (s_prefs.begin(OTA_STORE_NAMESPACE, false)) {
+        s_prefs.clear();
+        s_prefs.end();
+    }
+}
+
+static void free_buffers() {
+    for (size_t i = 0; i < OTA_RECEIVER_BUFFERS; i++) {
+        heap_caps_free(s_buffers[i]);
+        s_buffers[i] = nullptr;
+    }
+}
+
+// Continues the running hash over what an earlier boot already wrote
+static bool rehash_prefix(uint32_t len) {
+    for (uint32_t offset = 0; offset < len && !s_cancel; offset += OTA_BLOCK_SIZE) {
+        uint32_t n = (len - offset < OTA_BLOCK_SIZE) ? len - offset : OTA_BLOCK_SIZE;
+        if (esp_partition_read(s_partition, offset, s_buffers[0], n) != ESP_OK) {
+            return false;
+        }
+        mbedtls_sha256_update(&s_sha, s_buffers[0], n);
+    }
+    return !s_cancel;
+}
+
+static void log_throughput(const char *what, uint32_t bytes, int64_t elapsed_us) {
+    uint32_t rate = elapsed_us > 0 ? (uint32_t)((uint64_t)bytes * 1000000 / elapsed_us) : 0;
+    logger_printf("[OTA] %s: %u KB in %u ms (%u.%u KB/s).\n", what, bytes / 1024, (uint32_t)(elapsed_us / 1000),
+                  rate / 1024, (rate % 1024) * 10 / 1024);
+}
+
+static void ota_task(void *pvParameters) {
+    pm_lock_hold(PM_LOCK_OTA);
+    mbedtls_sha256_init(&s_sha);
+    mbedtls_sha256_starts(&s_sha, 0); // SHA-256, not SHA-224
+    bool ok = true;
+    if (s_resume_from > 0) {
+        logger_printf("[OTA] Resuming at %u of %u bytes. Re-hashing what was written.\n", s_resume_from, s_image_size);
+        ok = rehash_prefix(s_resume_from);
+        if (!ok && !s_cancel) {
+            set_state(OTA_STATE_FAILED, OTA_ERROR_FLASH);
+        }
+    }
+
+    uint32_t last_saved = s_resume_from;
+    uint32_t last_logged = s_resume_from;
+    if (ok) {
+        portENTER_CRITICAL(&s_rx_mux);
+        ota_receiver_start(s_rx, s_image_size, s_resume_from);
+        s_receiving = true;
+        s_state = OTA_STATE_RECEIVING;
+        s_rate_start_us = esp_timer_get_time();
+        s_rate_start_written = s_rx.written;
+        portEXIT_CRITICAL(&s_rx_mux);
+        notify_ota_status();
+    }
+
+    bool complete = false;
+    while (ok && !complete && !s_cancel) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        bool progressed = false;
+        while (!s_cancel) {
+            const uint8_t *data;
+            uint32_t offset, len;
+            portENTER_CRITICAL(&s_rx_mux);
+            bool has_block = ota_receiver_next_block(s_rx, &data, &offset, &len);
+            portEXIT_CRITICAL(&s_rx_mux);
+            if (!has_block) {
+                break;
+            }
+            // The callback does not touch a full buffer, so it is written outside the lock.
+            // Blocks are sector-aligned, and the partition is a whole number of sectors.
+            if (esp_partition_erase_range(s_partition, offset, OTA_BLOCK_SIZE) != ESP_OK ||
+                esp_partition_write(s_partition, offset, data, len) != ESP_OK) {
+                logger_printf("[OTA] ERROR: Flash write at 0x%06X failed!\n", offset);
+                set_state(OTA_STATE_FAILED, OTA_ERROR_FLASH);
+                ok = false;
+                break;
+            }
+            mbedtls_sha256_update(&s_sha, data, len);
+            portENTER_CRITICAL(&s_rx_mux);
+            ota_receiver_block_written(s_rx);
+            complete = ota_receiver_complete(s_rx);
+            portEXIT_CRITICAL(&s_rx_mux);
+            progressed = true;
+
+            uint32_t written = offset + len;
+            if (written - last_saved >= OTA_RESUME_SAVE_BYTES) {
+                save_progress(written);
+                last_saved = written;
+            }
+            if (written - last_logged >= OTA_RESUME_SAVE_BYTES) {
+                logger_printf("[OTA] %u of %u KB written (%u KB/s).\n", written / 1024, s_image_size / 1024,
+                              ota_update_get_status().bytes_per_sec / 1024);
+                last_logged = written;
+            }
+        }
+        if (progressed || s_status_due) {
+            s_status_due = false;
+            notify_ota_status();
+        }
+    }
+
+    portENTER_CRITICAL(&s_rx_mux);
+    s_receiving = false;
+    s_rate_end_us = esp_timer_get_time();
+    OtaReceiver rx = s_rx;
+    int64_t elapsed_us = s_rate_end_us - s_rate_start_us;
+    portEXIT_CRITICAL(&s_rx_mux);
+
+    if (complete) {
+        log_throughput("Image received", rx.written - s_rate_start_written, elapsed_us);
+        logger_printf("[OTA] Chunks: %u | Duplicates: %u | Gaps: %u | Buffers full: %u\n", rx.chunks, rx.duplicates, rx.gaps, rx.busy);
+        set_state(OTA_STATE_VERIFYING, OTA_ERROR_NONE);
+        notify_ota_status();
+        uint8_t sha[32];
+        mbedtls_sha256_finish(&s_sha, sha);
+        if (memcmp(sha, s_expected_sha, sizeof(sha)) != 0) {
+            logger_printf("[OTA] ERROR: SHA-256 mismatch. Image discarded.\n");
+            set_state(OTA_STATE_FAILED, OTA_ERROR_HASH_MISMATCH);
+        } else if (esp_ota_set_boot_partition(s_partition) != ESP_OK) {
+            // Also checks the image header, segments and the app's own checksum
+            logger_printf("[OTA] ERROR: Image rejected by the image check.\n");
+            set_state(OTA_STATE_FAILED, OTA_ERROR_INVALID_IMAGE);
+        } else {
+            logger_printf("[OTA] Image verified. %s boots next; waiting for the apply command.\n", s_partition->label);
+            set_state(OTA_STATE_READY, OTA_ERROR_NONE);
+        }
+        clear_progress(); // A finished or bad image is never resumed
+    } else if (s_cancel) {
+        logger_printf("[OTA] Update aborted at %u of %u bytes.\n", rx.written, s_image_size);
+        clear_progress();
+        set_state(OTA_STATE_IDLE, OTA_ERROR_NONE);
+    }
+
+    mbedtls_sha256_free(&s_sha);
+    free_buffers();
+    notify_ota_status();
+    pm_lock_release(PM_LOCK_OTA);
+    s_task = nullptr;
+    vTaskDelete(NULL);
+}
+
+static void begin_update(const uint8_t *data, size_t len) {
+    if (len != OTA_BEGIN_COMMAND_LEN) {
+        logger_printf("[OTA] Begin expected a 4-byte size and a 32-byte SHA-256. Command ignored.\n");
+        return;
+    }
+    uint32_t image_size = data[1] | (data[2] << 8) | (data[3] << 16) | ((uint32_t)data[4] << 24);
+    const uint8_t *sha = &data[5];
+    if (s_task) {
+        if (image_size == s_image_size && memcmp(sha, s_expected_sha, sizeof(s_expected_sha)) == 0) {
+            // Same image after a reconnect: the buffered data is still there
+            logger_printf("[OTA] Client resumed at byte %u.\n", ota_update_get_status().next_offset);
+            notify_ota_status();
+        } else {
+            logger_printf("[OTA] Another image is being written. Abort it first.\n");
+        }
+        return;
+    }
+
+    const esp_partition_t *partition = esp_ota_get_next_update_partition(NULL);
+    if (!partition) {
+        logger_printf("[OTA] ERROR: No OTA partition to write to!\n");
+        set_state(OTA_STATE_FAILED, OTA_ERROR_NO_PARTITION);
+        notify_ota_status();
+        return;
+    }
+    if (image_size == 0 || image_size > partition->size) {
+        logger_printf("[OTA] Image of %u bytes does not fit %s (%u bytes).\n", image_size, partition->label, partition->size);
+        set_state(OTA_STATE_FAILED, OTA_ERROR_TOO_LARGE);
+        notify_ota_status();
+        return;
+    }
+    for (size_t i = 0; i < OTA_RECEIVER_BUFFERS; i++) {
+        // Internal RAM: flash writes from PSRAM would go through a bounce buffer
+        s_buffers[i] = (uint8_t *)heap_caps_malloc(OTA_BLOCK_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    if (!s_buffers[0] || !s_buffers[1]) {
+        logger_printf("[OTA] ERROR: No memory for the block buffers!\n");
+        free_buffers();
+        set_state(OTA_STATE_FAILED, OTA_ERROR_NO_MEMORY);
+        notify_ota_status();
+        return;
+    }
+
+    s_partition = partition;
+    s_image_size = image_size;
+    memcpy(s_expected_sha, sha, sizeof(s_expected_sha));
+    s_resume_from = load_progress(partition, image_size, sha);
+    s_cancel = false;
+    s_status_due = false;
+    portENTER_CRITICAL(&s_rx_mux);
+    ota_receiver_init(s_rx, s_buffers, OTA_BLOCK_SIZE);
+    portEXIT_CRITICAL(&s_rx_mux);
+    set_state(OTA_STATE_PREPARING, OTA_ERROR_NONE);
+    logger_printf("[OTA] Writing a %u-byte image to %s.\n", image_size, partition->label);
+    if (xTaskCreatePinnedToCore(ota_task, "OtaTask", OTA_TASK_STACK_SIZE, NULL, OTA_TASK_PRIORITY, &s_task, 1) != pdPASS) {
+        logger_printf("[OTA] ERROR: Failed to create the OTA task!\n");
+        s_task = nullptr;
+        free_buffers();
+        set_state(OTA_STATE_FAILED, OTA_ERROR_NO_MEMORY);
+        notify_ota_status();
+    }
+}
+
+void ota_update_handle_command(const uint8_t *data, size_t len) {
+    if (len == 0) {
+        logger_printf("[OTA] Expected a command byte. Command ignored.\n");
+        return;
+    }
+    switch (data[0]) {
+        case OTA_COMMAND_BEGIN:
+            begin_update(data, len);
+            break;
+        case OTA_COMMAND_ABORT:
+            if (s_task) {
+                s_cancel = true;
+                xTaskNotifyGive(s_task);
+            }
+            break;
+        case OTA_COMMAND_APPLY:
+            if (ota_update_get_status().state != OTA_STATE_READY) {
+                logger_printf("[OTA] No verified image to apply. Command ignored.\n");
+                break;
+            }
+            logger_printf("[OTA] Restarting into the new firmware.\n");
+            vTaskDelay(pdMS_TO_TICKS(OTA_REBOOT_DELAY_MS));
+            esp_restart();
+            break;
+        default:
+            logger_printf("[OTA] Unknown command 0x%02X. Command ignored.\n", data[0]);
+            break;
+    }
+}
+
+void ota_update_on_data(const uint8_t *data, size_t len) {
+    bool block_ready = false;
+    portENTER_CRITICAL(&s_rx_mux);
+    OtaChunkResult result = s_receiving ? ota_receiver_push(s_rx, data, len, &block_ready) : OTA_CHUNK_INVALID;
+    portEXIT_CRITICAL(&s_rx_mux);
+    if (block_ready) {
+        xTaskNotifyGive(s_task);
+    } else if ((result == OTA_CHUNK_GAP || result == OTA_CHUNK_BUSY) && !s_status_due) {
+        // Once per refusal streak: the status tells the client where to continue
+        s_status_due = true;
+        xTaskNotifyGive(s_task);
+    }
+}
+
+OtaStatus ota_update_get_status() {
+    OtaStatus status;
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&s_rx_mux);
+    status.state = s_state;
+    status.error = s_error;
+    status.next_offset = s_rx.next_offset;
+    status.written = s_rx.written;
+    status.image_size = s_rx.image_size;
+    int64_t elapsed_us = (s_receiving ? now_us : s_rate_end_us) - s_rate_start_us;
+    uint32_t bytes = s_rx.written - s_rate_start_written;
+    portEXIT_CRITICAL(&s_rx_mux);
+    status.bytes_per_sec = (s_rate_start_us > 0 && elapsed_us > 0) ? (uint32_t)((uint64_t)bytes * 1000000 / elapsed_us) : 0;
+    return status;
+}
+
+void ota_update_confirm_boot() {
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    esp_ota_img_states_t state;
+    if (running && esp_ota_get_state_partition(running, &state) == ESP_OK && state == ESP_OTA_IMG_PENDING_VERIFY) {
+        if (esp_ota_mark_app_valid_cancel_rollback() == ESP_OK) {
+            logger_printf("[OTA] New firmware on %s confirmed. Rollback cancelled.\n", running->label);
+        }
+    }
+}
+
+// The Arduino core marks a new image valid as soon as it starts unless this returns true.
+// The firmware confirms it itself once BLE is up (ota_update_confirm_boot).
+extern "C" bool verifyRollbackLater() {
+    return true;
+}
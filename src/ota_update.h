@@ -0,0 +1,66 @@
+#ifndef OTA_UPDATE_H
+#define OTA_UPDATE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Firmware update over BLE. The client starts an update on the OTA control characteristic
+// with the image size and SHA-256, then streams the image as write-without-response chunks
+// on the OTA data characteristic (ota_receiver.h). A writer task erases and programs each
+// block of the inactive OTA partition and hashes it while the next block arrives. The status
+// is notified after every block; the client keeps at most two blocks ahead of the written
+// offset and continues from the next expected offset after a loss or a reconnect. Progress is
+// kept in NVS, so the same image also resumes after a reboot. A complete image is verified
+// (hash, then the bootloader's image check) and becomes the boot partition; the apply command
+// restarts into it.
+
+enum OtaCommand : uint8_t {
+    OTA_COMMAND_BEGIN = 0x01,   // [size uint32 LE][SHA-256 32 bytes]: start, or resume the same image
+    OTA_COMMAND_ABORT = 0x02,
+    OTA_COMMAND_APPLY = 0x03    // Restart into the verified image
+};
+
+constexpr size_t OTA_BEGIN_COMMAND_LEN = 1 + 4 + 32;
+
+enum OtaState : uint8_t {
+    OTA_STATE_IDLE = 0,
+    OTA_STATE_PREPARING,        // Re-hashing what an earlier boot wrote, before resuming
+    OTA_STATE_RECEIVING,
+    OTA_STATE_VERIFYING,
+    OTA_STATE_READY,            // Verified and set as the boot partition
+    OTA_STATE_FAILED
+};
+
+enum OtaError : uint8_t {
+    OTA_ERROR_NONE = 0,
+    OTA_ERROR_NO_PARTITION,     // No inactive OTA partition in the partition table
+    OTA_ERROR_TOO_LARGE,
+    OTA_ERROR_NO_MEMORY,
+    OTA_ERROR_FLASH,
+    OTA_ERROR_HASH_MISMATCH,
+    OTA_ERROR_INVALID_IMAGE     // Rejected by the bootloader's image check
+};
+
+struct OtaStatus {
+    OtaState state;
+    OtaError error;
+    uint32_t next_offset;       // Next byte expected from the client
+    uint32_t written;           // Bytes on flash
+    uint32_t image_size;
+    uint32_t bytes_per_sec;     // Flash-written throughput since the upload (re)started
+};
+
+// Handles a write to the OTA control characteristic; called by the command dispatcher
+void ota_update_handle_command(const uint8_t *data, size_t len);
+
+// Takes one chunk from the OTA data characteristic. Called in the BLE callback: it only
+// copies the chunk into a block buffer and wakes the writer task.
+void ota_update_on_data(const uint8_t *data, size_t len);
+
+OtaStatus ota_update_get_status();
+
+// Marks a newly installed image as good. Call once the firmware is up (BLE advertising);
+// until then the bootloader rolls back if the image crashes.
+void ota_update_confirm_boot();
+
+#endif // OTA_UPDATE_H
@@ -0,0 +1,92 @@
+#include "param_registry.h"
+#include "config.h" // For the defaults
+
+const ParamSpec PARAM_SPECS[PARAM_COUNT] = {
+    {"photo_rate", PARAM_TYPE_U32, BLE_TX_PHOTO_RATE_BYTES_PER_SEC, 2000, 200000, PARAM_APPLY_NOW},
+    {"photo_fast", PARAM_TYPE_U32, BLE_TX_PHOTO_FAST_RATE_BYTES_PER_SEC, 2000, 200000, PARAM_APPLY_NOW},
+    {"jpeg_quality", PARAM_TYPE_U8, CAMERA_JPEG_QUALITY, 8, 63, PARAM_APPLY_NOW},
+    {"frame_size", PARAM_TYPE_U8, CAMERA_FRAME_SIZE, 0, 5, PARAM_APPLY_NEXT_USE},
+    {"warmup_frames", PARAM_TYPE_U8, CAMERA_WARMUP_FRAMES, 0, 30, PARAM_APPLY_NOW},
+    {"audio_packet", PARAM_TYPE_U16, AUDIO_BLE_PACKET_SIZE, 20, MAX_PHOTO_CHUNK_PAYLOAD_SIZE, PARAM_APPLY_NOW},
+    {"sleep_delay_ms", PARAM_TYPE_U32, DEEP_SLEEP_DISCONNECT_DELAY_MS, 10000, 86400000, PARAM_APPLY_NOW},
+    {"sleep_wake_ms", PARAM_TYPE_U32, DEEP_SLEEP_WAKE_INTERVAL_MS, 1000, 3600000, PARAM_APPLY_NOW},
+    {"link_check_ms", PARAM_TYPE_U16, LINK_CHECK_INTERVAL_MS, 20, 5000, PARAM_APPLY_NOW},
+    {"wake_window_ms", PARAM_TYPE_U32, DEEP_SLEEP_WAKE_WINDOW_MS, 1000, 600000, PARAM_APPLY_NOW},
+};
+
+// The defaults of PARAM_SPECS, so values are valid before the store is loaded
+volatile uint32_t g_param_values[PARAM_COUNT] = {
+    BLE_TX_PHOTO_RATE_BYTES_PER_SEC,
+    BLE_TX_PHOTO_FAST_RATE_BYTES_PER_SEC,
+    CAMERA_JPEG_QUALITY,
+    CAMERA_FRAME_SIZE,
+    CAMERA_WARMUP_FRAMES,
+    AUDIO_BLE_PACKET_SIZE,
+    DEEP_SLEEP_DISCONNECT_DELAY_MS,
+    DEEP_SLEEP_WAKE_INTERVAL_MS,
+    LINK_CHECK_INTERVAL_MS,
+    DEEP_SLEEP_WAKE_WINDOW_MS,
+};
+
+static ParamChangeHandler s_handlers[PARAM_COUNT] = {};
+
+void param_on_change(ParamId id, ParamChangeHandler handler) {
+    if (id < PARAM_COUNT) {
+        s_handlers[id] = handler;
+    }
+}
+
+ParamSetResult param_set(uint8_t id, uint32_t value) {
+    if (id >= PARAM_COUNT) {
+        return PARAM_SET_UNKNOWN_ID;
+    }
+    const ParamSpec &spec = PARAM_SPECS[id];
+    if (value < spec.min || value > spec.max) {
+        return PARAM_SET_OUT_OF_RANGE;
+    }
+    if (g_param_values[id] == value) {
+        return PARAM_SET_UNCHANGED;
+    }
+    g_param_values[id] = value;
+    if (s_handlers[id]) {
+        s_handlers[id]((ParamId)id, value);
+    }
+    return PARAM_SET_OK;
+}
+
+void param_reset_defaults() {
+    for (uint8_t id = 0; id < PARAM_COUNT; id++) {
+        param_set(id, PARAM_SPECS[id].default_value);
+    }
+}
+
+const char *param_set_result_name(ParamSetResult result) {
+    switch (result) {
+        case PARAM_SET_OK:           return "ok";
+        case PARAM_SET_UNCHANGED:    return "unchanged";
+        case PARAM_SET_UNKNOWN_ID:   return "unknown id";
+        case PARAM_SET_OUT_OF_RANGE: return "out of range";
+        default:                     return "?";
+    }
+}
+
+static void put_le32(uint8_t *out, uint32_t value) {
+    for (size_t b = 0; b < 4; b++) {
+        out[b] = (uint8_t)((value >> (8 * b)) & 0xFF);
+    }
+}
+
+bool param_encode(uint8_t id, uint8_t *out) {
+    if (id >= PARAM_COUNT) {
+        return false;
+    }
+    const ParamSpec &spec = PARAM_SPECS[id];
+    out[0] = id;
+    out[1] = spec.type;
+    out[2] = spec.apply;
+    put_le32(&out[3], g_param_values[id]);
+    put_le32(&out[7], spec.default_value);
+    put_le32(&out[11], spec.min);
+    put_le32(&out[15], spec.max);
+    return true;
+}
@@ -0,0 +1,89 @@
+#ifndef PARAM_REGISTRY_H
+#define PARAM_REGISTRY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Performance parameters that can be tuned at runtime over the config characteristic and are
+// kept across reboots (param_store.h). Each parameter has a fixed id, a type and a valid range;
+// defaults come from config.h. Values live in a plain array indexed by id, so param_get() on a
+// hot path is a single load. A module that caches a value or programs hardware with it
+// registers a change handler; modules that read the value at use pick up changes without one.
+// This is a pure module with no hardware dependencies.
+
+enum ParamId : uint8_t {
+    PARAM_PHOTO_RATE = 0,         // Photo pacing on a default link, bytes per second
+    PARAM_PHOTO_FAST_RATE,        // Photo pacing on 2M PHY with DLE, bytes per second
+    PARAM_JPEG_QUALITY,           // Camera JPEG quality (lower is better and larger)
+    PARAM_FRAME_SIZE,             // Camera framesize_t; growth past the init size waits for the next init
+    PARAM_CAMERA_WARMUP_FRAMES,   // Frames discarded before each photo
+    PARAM_AUDIO_PACKET_SIZE,      // Largest u-law notification payload (bounded by the MTU)
+    PARAM_DEEP_SLEEP_DELAY_MS,    // Time without a client before deep sleep
+    PARAM_DEEP_SLEEP_WAKE_MS,     // Deep sleep duration
+    PARAM_LINK_CHECK_MS,          // Connection mode re-evaluation interval while connected
+    PARAM_WAKE_WINDOW_MS,         // Advertising time after an idle deep-sleep wake
+    PARAM_COUNT
+};
+
+// Written as the id on the config characteristic: restores every default
+constexpr uint8_t PARAM_RESET_ALL = 0xFF;
+
+enum ParamType : uint8_t {
+    PARAM_TYPE_U8 = 0,
+    PARAM_TYPE_U16,
+    PARAM_TYPE_U32
+};
+
+// When a new value takes effect
+enum ParamApply : uint8_t {
+    PARAM_APPLY_NOW = 0,      // At once, by its owning module
+    PARAM_APPLY_NEXT_USE      // By the next time the module starts (e.g. camera init) at the latest
+};
+
+struct ParamSpec {
+    const char *key;          // NVS key (at most 15 characters) and log name
+    ParamType type;
+    uint32_t default_value;
+    uint32_t min;
+    uint32_t max;
+    ParamApply apply;
+};
+
+extern const ParamSpec PARAM_SPECS[PARAM_COUNT];
+
+// Current values, indexed by ParamId. Written only through param_set().
+extern volatile uint32_t g_param_values[PARAM_COUNT];
+
+inline uint32_t param_get(ParamId id) {
+    return g_param_values[id];
+}
+
+enum ParamSetResult : uint8_t {
+    PARAM_SET_OK = 0,
+    PARAM_SET_UNCHANGED,      // Valid, and already the current value
+    PARAM_SET_UNKNOWN_ID,
+    PARAM_SET_OUT_OF_RANGE
+};
+
+// Called after a parameter changed, on the task that changed it
+typedef void (*ParamChangeHandler)(ParamId id, uint32_t value);
+
+// One handler per parameter; a second registration replaces the first
+void param_on_change(ParamId id, ParamChangeHandler handler);
+
+// Validates and stores a value, then runs the change handler. The caller persists it.
+ParamSetResult param_set(uint8_t id, uint32_t value);
+
+// Restores every default and runs the handlers of those that changed
+void param_reset_defaults();
+
+const char *param_set_result_name(ParamSetResult result);
+
+// Record returned by a read of the config characteristic: id, type, apply, then value,
+// default, min and max (uint32 LE)
+constexpr size_t PARAM_RECORD_LEN = 3 + 4 * 4;
+
+// Fills out with the record of a parameter. Returns false for an unknown id.
+bool param_encode(uint8_t id, uint8_t *out);
+
+#endif // PARAM_REGISTRY_H
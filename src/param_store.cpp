@@ -0,0 +1,48 @@
+#include "param_store.h"
+#include "config.h"
+#include "logger.h"
+#include <Preferences.h>
+
+static Preferences s_prefs;
+
+void param_store_load() {
+    if (!s_prefs.begin(PARAM_STORE_NAMESPACE, true)) {
+        logger_printf("[PARAM] No stored parameters. Using defaults.\n");
+        return;
+    }
+    for (uint8_t id = 0; id < PARAM_COUNT; id++) {
+        const ParamSpec &spec = PARAM_SPECS[id];
+        if (!s_prefs.isKey(spec.key)) {
+            continue;
+        }
+        uint32_t value = s_prefs.getUInt(spec.key, spec.default_value);
+        ParamSetResult result = param_set(id, value);
+        if (result == PARAM_SET_OK) {
+            logger_printf("[PARAM] %s = %u (stored, default %u).\n", spec.key, value, spec.default_value);
+        } else if (result != PARAM_SET_UNCHANGED) {
+            logger_printf("[PARAM] Stored %s = %u ignored: %s.\n", spec.key, value, param_set_result_name(result));
+        }
+    }
+    s_prefs.end();
+}
+
+bool param_store_save(ParamId id) {
+    if (id >= PARAM_COUNT || !s_prefs.begin(PARAM_STORE_NAMESPACE, false)) {
+        return false;
+    }
+    bool ok = s_prefs.putUInt(PARAM_SPECS[id].key, param_get(id)) == sizeof(uint32_t);
+    s_prefs.end();
+    if (!ok) {
+        logger_printf("[PARAM] ERROR: Failed to store %s!\n", PARAM_SPECS[id].key);
+    }
+    return ok;
+}
+
+bool param_store_clear() {
+    if (!s_prefs.begin(PARAM_STORE_NAMESPACE, false)) {
+        return false;
+    }
+    bool ok = s_prefs.clear();
+    s_prefs.end();
+    return ok;
+}
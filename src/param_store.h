@@ -0,0 +1,19 @@
+#ifndef PARAM_STORE_H
+#define PARAM_STORE_H
+
+#include "param_registry.h"
+
+// NVS persistence of the runtime parameters (param_registry.h), in the PARAM_STORE_NAMESPACE
+// namespace with one key per parameter. Only values a client changed are stored; a missing
+// or out-of-range key leaves the default.
+
+// Loads the stored values. Call early in setup(), before the modules read their parameters.
+void param_store_load();
+
+// Writes the current value of one parameter
+bool param_store_save(ParamId id);
+
+// Erases every stored value, so the defaults apply after a reboot too
+bool param_store_clear();
+
+#endif // PARAM_STORE_H
@@ -1,10 +1,17 @@
 #include "photo_manager.h"
 #include "config.h"       // For photo constants
 #include "camera_handler.h" // For take_photo(), release_photo_buffer(), and fb
-#include "ble_handler.h"    // For g_photo_data_characteristic and g_is_ble_connected
+#include "ble_handler.h"    // For g_is_ble_connected and the chunk payload size
 #include "led_handler.h"    // For LED status indicators
+#include "ble_tx_scheduler.h" // For paced photo notifications
+#include "ble_link.h"         // For photo throughput statistics and the bulk connection mode
+#include "ble_transport.h"    // For the L2CAP photo channel
+#include "ble_session.h"      // For the clients a photo goes to
+#include "pm_lock.h"          // For full speed during uploads
+#include "wifi_offload.h"     // For leaving the photo to a running offload
 #include "logger.h"         // For thread-safe logging
 #include <Arduino.h> // For Serial, millis(), memcpy()
+#include <esp_timer.h>
 
 // Define global photo state variables here
 // bool g_is_capturing_photos = false; // Replaced by g_capture_mode
@@ -12,30 +19,198 @@
 PhotoCaptureMode g_capture_mode = MODE_STOP;
 int g_capture_interval_ms = 0;
 unsigned long g_last_capture_time_ms = 0;
-size_t g_sent_photo_bytes = 0;
-uint16_t g_sent_photo_frames = 0;
-bool g_is_photo_uploading = false;
-// The g_photo_notifications_enabled flag is no longer needed as the task is managed by subscription.
-volatile bool g_single_shot_pending = false;
+
+// Photo task state. The task blocks on its notification value: CAMERA_NOTIFY_FRAME from the
+// camera task, PHOTO_NOTIFY_CONTROL from handle_photo_control(), or a timeout for the next
+// interval capture. It only runs without blocking while an upload is in progress.
+static const uint32_t PHOTO_NOTIFY_CONTROL = 1u << 1; // Bit 0 is CAMERA_NOTIFY_FRAME
+static bool s_uploading = false;        // An upload to at least one client is in progress
+static bool s_capture_requested = false; // Waiting for the camera task's frame
+static bool s_frame_handed_off = false;  // CAMERA_NOTIFY_FRAME seen, frame not taken yet
+static volatile bool s_single_shot_pending = false; // Set by the control, taken by the task
+static volatile unsigned long s_single_shot_due_ms = 0; // millis() before which the single shot is held back
+
+// Request-to-first-chunk timing of the current photo, in esp_timer time
+struct PhotoTiming {
+    int64_t requested_us; // Control write (single shot) or interval due
+    int64_t started_us;   // Camera task woke
+    int64_t ready_us;     // Frame handed off
+    bool first_chunk_logged;
+};
+static PhotoTiming s_timing = {};
+static volatile int64_t s_control_us = 0; // Last single-shot request, from handle_photo_control
 
 // Task handle for the photo streaming task, moved here from ble_handler.cpp
 static TaskHandle_t photo_streaming_task_handle = nullptr;
 
 void start_photo_upload(); // Forward declaration
 
-uint8_t *s_photo_chunk_buffer = nullptr;
+// Upload cursor of one session over the shared photo. Every subscribed client gets the same
+// frame buffer in chunks sized for its own MTU, and holds a reference to it until done.
+// Only the photo task touches these.
+struct PhotoUpload {
+    bool active;
+    uint32_t session_id;    // Session the cursor belongs to (see ble_session.h)
+    BlePhotoPath path;      // Chosen when the upload starts
+    size_t sent_bytes;
+    uint16_t sent_frames;
+    unsigned long start_ms;
+    uint16_t l2cap_sdu_len;
+};
 
-void initialize_photo_manager() {
-    logger_printf(" ");
-    logger_printf("[MEM] Free PSRAM before photo chunk buffer alloc: %u bytes", ESP.getFreePsram());
-    s_photo_chunk_buffer = (uint8_t *)ps_calloc(PHOTO_CHUNK_BUFFER_SIZE, sizeof(uint8_t));
-    if (!s_photo_chunk_buffer) {
-        logger_printf("[MEM] ERROR: Failed to allocate photo chunk buffer! Halting.");
-        while (1);
+static PhotoUpload s_uploads[BLE_MAX_CONNECTIONS] = {};
+
+static const char *path_name(BlePhotoPath path) {
+    return path == BLE_PHOTO_PATH_L2CAP ? "L2CAP" : "GATT";
+}
+
+// Logged once per photo, when the first piece of it leaves for a client
+static void log_first_chunk(BlePhotoPath path) {
+    if (s_timing.first_chunk_logged || s_timing.requested_us == 0) {
+        return;
+    }
+    s_timing.first_chunk_logged = true;
+    int64_t now_us = esp_timer_get_time();
+    logger_printf("[PHOTO] Request to first chunk (%s): %u ms (to camera task %u ms, capture %u ms, handoff to chunk %u ms).",
+                  path_name(path), (uint32_t)((now_us - s_timing.requested_us) / 1000),
+                  (uint32_t)((s_timing.started_us - s_timing.requested_us) / 1000),
+                  (uint32_t)((s_timing.ready_us - s_timing.started_us) / 1000),
+                  (uint32_t)((now_us - s_timing.ready_us) / 1000));
+}
+
+static void notify_photo_task() {
+    if (photo_streaming_task_handle) {
+        xTaskNotify(photo_streaming_task_handle, PHOTO_NOTIFY_CONTROL, eSetBits);
+    }
+}
+
+static void end_upload(int index) {
+    s_uploads[index].active = false;
+    drop_photo_buffer(); // The last upload to finish releases the frame
+    for (size_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        if (s_uploads[i].active) {
+            return;
+        }
+    }
+    s_uploading = false;
+    ble_link_set_photo_active(false);
+    pm_lock_release(PM_LOCK_PHOTO_UPLOAD);
+}
+
+static void finish_photo_upload(int index, const BleSession &session) {
+    PhotoUpload &upload = s_uploads[index];
+    uint32_t elapsed_ms = millis() - upload.start_ms;
+    // The link statistics cover the managed link only
+    if (session.conn == ble_link_get_stats().conn) {
+        ble_link_record_photo_transfer(upload.sent_bytes, elapsed_ms, upload.path);
+    }
+    logger_printf("[PHOTO][UPLOAD] Upload to session #%d complete over %s: %zu bytes in %u ms.",
+                  index, path_name(upload.path), upload.sent_bytes, elapsed_ms);
+    end_upload(index);
+}
+
+// Sends the next SDU of an L2CAP upload: the length and capture time first, then the JPEG
+// in SDU-sized pieces. If the channel fails, the photo starts over on GATT.
+static void continue_l2cap_upload(int index, const BleSession &session) {
+    PhotoUpload &upload = s_uploads[index];
+    bool sent;
+    if (upload.sent_frames == 0) {
+        uint8_t header[PHOTO_L2CAP_HEADER_LEN];
+        uint32_t jpeg_len = (uint32_t)fb->len;
+        uint64_t capture_us = (uint64_t)photo_capture_time_us();
+        for (size_t i = 0; i < 4; i++) {
+            header[i] = (uint8_t)((jpeg_len >> (8 * i)) & 0xFF);
+        }
+        for (size_t i = 0; i < 8; i++) {
+            header[4 + i] = (uint8_t)((capture_us >> (8 * i)) & 0xFF);
+        }
+        sent = ble_transport()->l2cap_send(session.conn, header, sizeof(header));
+        if (sent) {
+            log_first_chunk(BLE_PHOTO_PATH_L2CAP);
+        }
+    } else {
+        size_t sdu_len = fb->len - upload.sent_bytes;
+        if (sdu_len > upload.l2cap_sdu_len) {
+            sdu_len = upload.l2cap_sdu_len;
+        }
+        // Waits here while the client has no credits; audio keeps flowing on GATT
+        sent = ble_transport()->l2cap_send(session.conn, &fb->buf[upload.sent_bytes], sdu_len);
+        if (sent) {
+            upload.sent_bytes += sdu_len;
+        }
+    }
+    if (!sent) {
+        logger_printf("[PHOTO] L2CAP send failed after %zu bytes. Sending the photo over GATT.", upload.sent_bytes);
+        upload.path = BLE_PHOTO_PATH_GATT;
+        upload.sent_bytes = 0;
+        upload.sent_frames = 0;
+        upload.start_ms = millis();
+        return;
+    }
+    upload.sent_frames++;
+    if (upload.sent_bytes == fb->len) {
+        logger_printf("[PHOTO][END] Sent %u SDUs.", upload.sent_frames);
+        finish_photo_upload(index, session);
+    }
+}
+
+// Queues the next GATT chunk of an upload, or the end marker once the JPEG is out
+static void continue_gatt_upload(int index, const BleSession &session) {
+    PhotoUpload &upload = s_uploads[index];
+    BleSessionMask to_session = (BleSessionMask)(1u << index);
+    size_t remaining = fb->len - upload.sent_bytes;
+    if (remaining > 0) {
+        uint8_t header[PHOTO_CHUNK_HEADER_LEN] = {
+            (uint8_t)(upload.sent_frames & 0xFF),
+            (uint8_t)((upload.sent_frames >> 8) & 0xFF)
+        };
+        // The MTU minus 3 bytes for the ATT header and 2 bytes for our chunk header
+        size_t chunk_payload = session.mtu - 3 - PHOTO_CHUNK_HEADER_LEN;
+        if (chunk_payload > MAX_PHOTO_CHUNK_PAYLOAD_SIZE) {
+            chunk_payload = MAX_PHOTO_CHUNK_PAYLOAD_SIZE;
+        }
+        size_t bytes_to_copy = (remaining > chunk_payload) ? chunk_payload : remaining;
+
+        // The scheduler copies the chunk from the frame buffer and paces it behind audio.
+        // If its queue stays full, the same chunk is retried on the next pass.
+        if (!ble_tx_enqueue_parts(BLE_TX_STREAM_PHOTO, BLE_CHANNEL_PHOTO_DATA, to_session, header, sizeof(header),
+                                  &fb->buf[upload.sent_bytes], bytes_to_copy, BLE_TX_PHOTO_ENQUEUE_TIMEOUT_MS)) {
+            return;
+        }
+        if (upload.sent_frames == 0) {
+            log_first_chunk(BLE_PHOTO_PATH_GATT);
+        }
+        logger_printf("[PHOTO][CHUNK] Session: #%d, Frame: %u, Bytes: %zu, Offset: %zu, Remaining: %zu", index,
+                      upload.sent_frames, bytes_to_copy, upload.sent_bytes, remaining - bytes_to_copy);
+
+        upload.sent_bytes += bytes_to_copy;
+        upload.sent_frames++;
     } else {
-        logger_printf("[MEM] Photo chunk buffer allocated.");
+        // End-of-photo marker, followed by the capture time in the device timebase
+        uint8_t marker[PHOTO_END_MARKER_LEN];
+        marker[0] = 0xFF;
+        marker[1] = 0xFF;
+        uint64_t capture_us = (uint64_t)photo_capture_time_us();
+        for (size_t i = 0; i < PHOTO_END_MARKER_LEN - PHOTO_CHUNK_HEADER_LEN; i++) {
+            marker[PHOTO_CHUNK_HEADER_LEN + i] = (uint8_t)((capture_us >> (8 * i)) & 0xFF);
+        }
+        if (!ble_tx_enqueue(BLE_TX_STREAM_PHOTO, BLE_CHANNEL_PHOTO_DATA, to_session, marker,
+                            sizeof(marker), BLE_TX_PHOTO_ENQUEUE_TIMEOUT_MS)) {
+            return;
+        }
+        logger_printf("[PHOTO][END] Sent end-of-photo marker to session #%d. Total chunks: %u, Total bytes: %zu",
+                      index, upload.sent_frames, upload.sent_bytes);
+
+        // The CRC check has been removed for reliability.
+        // The BLE link-layer has its own integrity checks.
+
+        finish_photo_upload(index, session);
     }
+}
 
+void initialize_photo_manager() {
+    // Chunks are copied straight from the frame buffer into the transmit scheduler's slots,
+    // so no chunk buffer is needed
     g_capture_mode = MODE_STOP;
     g_capture_interval_ms = 0;
     g_last_capture_time_ms = 0;
@@ -46,87 +221,101 @@ void handle_photo_control(int8_t control_value) {
     logger_printf("[PHOTO] handle_photo_control received: %d", control_value);
     if (control_value == -1) {
         logger_printf("[PHOTO] Control: Single photo requested.");
-        // Add a delay to give the client time to prepare for the data stream.
-        // This helps prevent a race condition where the client isn't ready for the first chunk.
-        delay(200);
-        g_single_shot_pending = true;
+        s_control_us = esp_timer_get_time(); // The latency the client sees starts here
+        // Give the client time to prepare for the data stream, so it is ready for the first
+        // chunk. The photo task waits this out; the BLE dispatcher is not held up.
+        s_single_shot_due_ms = millis() + PHOTO_SINGLE_SHOT_DELAY_MS;
+        s_single_shot_pending = true;
     } else if (control_value == 0) {
         logger_printf("[PHOTO] Control: Stop capture requested.");
         g_capture_mode = MODE_STOP;
         g_capture_interval_ms = 0;
-        g_single_shot_pending = false;
+        s_single_shot_pending = false;
     } else if (control_value >= 5 && control_value <= 127) {
         logger_printf("[PHOTO] Control: Interval capture requested. Interval: %d s.", control_value);
         g_capture_interval_ms = (unsigned long)control_value * 1000;
         g_capture_mode = MODE_INTERVAL;
-        g_single_shot_pending = true; // Trigger an immediate photo
+        s_control_us = esp_timer_get_time();
+        s_single_shot_due_ms = millis();
+        s_single_shot_pending = true; // Trigger an immediate photo
         g_last_capture_time_ms = millis();
         logger_printf("[PHOTO] Interval mode set. First photo will be taken immediately.");
     } else {
         logger_printf("[PHOTO] Ignoring invalid or too-short interval: %d", control_value);
+        return;
     }
+    notify_photo_task();
+}
+
+bool is_photo_uploading() {
+    return s_uploading;
 }
 
 void process_photo_capture_and_upload(unsigned long current_time_ms) {
     // --- Step 1: Request a photo from the camera task if needed ---
     // The check for g_photo_notifications_enabled is removed, as this task only runs when subscribed.
-    if (!g_is_photo_uploading && g_is_ble_connected) {
-        bool trigger_capture = false;
-        if (g_single_shot_pending) {
-            trigger_capture = true;
-            g_single_shot_pending = false; // Consume flag immediately
-            logger_printf("[PHOTO_MGR] Single shot triggered. Signaling camera task.");
+    // A capture would replace the photo a running Wi-Fi offload is posting
+    bool offloading = wifi_offload_active();
+    if (!s_uploading && !s_capture_requested && g_is_ble_connected && !offloading) {
+        int64_t requested_us = 0;
+        if (s_single_shot_pending) {
+            if ((long)(current_time_ms - s_single_shot_due_ms) >= 0) {
+                s_single_shot_pending = false; // Consume flag immediately
+                requested_us = s_control_us;
+                logger_printf("[PHOTO_MGR] Single shot triggered. Signaling camera task.");
+            }
         } else if (g_capture_mode == MODE_INTERVAL) {
             if (current_time_ms - g_last_capture_time_ms >= (unsigned long)g_capture_interval_ms) {
-                trigger_capture = true;
+                requested_us = esp_timer_get_time();
                 g_last_capture_time_ms = current_time_ms;
                 logger_printf("[PHOTO_MGR] Interval triggered. Signaling camera task.");
             }
         }
 
-        if (trigger_capture) {
-            xSemaphoreGive(g_camera_request_semaphore); // Signal the dedicated camera task
+        if (requested_us != 0 && camera_request_photo()) {
+            s_capture_requested = true;
+            s_timing = {};
+            s_timing.requested_us = requested_us;
         }
     }
 
-    // --- Step 2: Check if a photo is ready and start the upload ---
-    if (g_is_photo_ready && !g_is_photo_uploading) {
-        logger_printf("[PHOTO_MGR] Photo is ready. Starting upload.");
-        set_led_status(LED_STATUS_PHOTO_CAPTURING);
-        start_photo_upload();
-        g_is_photo_ready = false; // Consume the flag
+    // --- Step 2: Start the upload once the camera task hands the frame over ---
+    CameraFrame frame;
+    if (!s_uploading && s_frame_handed_off) {
+        s_frame_handed_off = false;
+        s_capture_requested = false;
     }
-
-    // --- Step 3: Continue an ongoing photo upload ---
-    if (g_is_photo_uploading && fb && fb->len > 0 && s_photo_chunk_buffer && g_photo_data_characteristic) {
-        size_t remaining = fb->len - g_sent_photo_bytes;
-        if (remaining > 0) {
-            s_photo_chunk_buffer[0] = (uint8_t)(g_sent_photo_frames & 0xFF);
-            s_photo_chunk_buffer[1] = (uint8_t)((g_sent_photo_frames >> 8) & 0xFF);
-            size_t bytes_to_copy = (remaining > g_photo_chunk_payload_size) ? g_photo_chunk_payload_size : remaining;
-            memcpy(&s_photo_chunk_buffer[PHOTO_CHUNK_HEADER_LEN], &fb->buf[g_sent_photo_bytes], bytes_to_copy);
-
-            g_photo_data_characteristic->setValue(s_photo_chunk_buffer, bytes_to_copy + PHOTO_CHUNK_HEADER_LEN);
-            g_photo_data_characteristic->notify();
-            logger_printf("[PHOTO][CHUNK] Frame: %u, Bytes: %zu, Offset: %zu, Remaining: %zu", g_sent_photo_frames, bytes_to_copy, g_sent_photo_bytes, remaining - bytes_to_copy);
-            delay(10); // Reduced delay to 10ms to improve transfer speed
-
-            g_sent_photo_bytes += bytes_to_copy;
-            g_sent_photo_frames++;
+    if (!s_uploading && !offloading && camera_take_frame(&frame)) {
+        s_timing.started_us = frame.started_us;
+        s_timing.ready_us = frame.ready_us;
+        if (!frame.frame || frame.frame != fb) {
+            // Failed, or released since (reset, Wi-Fi offload)
+            logger_printf("[PHOTO_MGR] No photo from the camera task.");
         } else {
-            // End-of-photo marker
-            s_photo_chunk_buffer[0] = 0xFF;
-            s_photo_chunk_buffer[1] = 0xFF;
-            g_photo_data_characteristic->setValue(s_photo_chunk_buffer, PHOTO_CHUNK_HEADER_LEN);
-            g_photo_data_characteristic->notify();
-            logger_printf("[PHOTO][END] Sent end-of-photo marker. Total chunks: %u, Total bytes: %zu", g_sent_photo_frames, g_sent_photo_bytes);
-
-            // The CRC check has been removed for reliability.
-            // The BLE link-layer has its own integrity checks.
+            logger_printf("[PHOTO_MGR] Photo is ready. Starting upload.");
+            set_led_status(LED_STATUS_PHOTO_CAPTURING);
+            start_photo_upload();
+        }
+    }
 
-            g_is_photo_uploading = false;
-            logger_printf("[PHOTO][UPLOAD] Upload complete.");
-            release_photo_buffer();
+    // --- Step 3: Continue the ongoing uploads, one piece per client per pass ---
+    if (s_uploading && fb && fb->len > 0) {
+        for (size_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+            if (!s_uploads[i].active) {
+                continue;
+            }
+            BleSession session;
+            if (!ble_session_get((int)i, &session) || session.id != s_uploads[i].session_id ||
+                !(session.subscriptions & (1u << BLE_CHANNEL_PHOTO_DATA))) {
+                logger_printf("[PHOTO] Session #%u left or unsubscribed. Upload cancelled.", (unsigned)i);
+                end_upload((int)i);
+                continue;
+            }
+            if (s_uploads[i].path == BLE_PHOTO_PATH_L2CAP) {
+                continue_l2cap_upload((int)i, session);
+            } else {
+                continue_gatt_upload((int)i, session);
+            }
         }
     }
 }
@@ -136,39 +325,92 @@ void reset_photo_manager_state() {
     g_capture_mode = MODE_STOP;
     g_capture_interval_ms = 0;
     g_last_capture_time_ms = 0;
-    g_sent_photo_bytes = 0;
-    g_sent_photo_frames = 0;
-    g_is_photo_uploading = false;
-    g_single_shot_pending = false;
-    g_is_photo_ready = false;
+    memset(s_uploads, 0, sizeof(s_uploads));
+    s_uploading = false;
+    ble_link_set_photo_active(false);
+    pm_lock_release(PM_LOCK_PHOTO_UPLOAD);
+    s_single_shot_pending = false;
+    // A capture still running hands its frame to the next pass, which finds it released
+    s_capture_requested = false;
+    s_frame_handed_off = false;
+    CameraFrame held;
+    camera_take_frame(&held);
     release_photo_buffer();
 }
 
 void start_photo_upload() {
-    if (fb && fb->len > 0) {
-        g_is_photo_uploading = true;
-        g_sent_photo_bytes = 0;
-        g_sent_photo_frames = 0;
-        logger_printf("[PHOTO] Starting photo upload. Total size: %zu bytes\n", fb->len);
-    } else {
+    if (!fb || fb->len == 0) {
         logger_printf("[PHOTO] ERROR: Cannot start upload, no valid photo buffer.\n");
-        g_is_photo_uploading = false;
+        return;
+    }
+    // Every subscribed client gets the photo; each holds a reference to the one frame buffer
+    BleSessionMask sessions = ble_session_subscribers(BLE_CHANNEL_PHOTO_DATA);
+    size_t uploads = 0;
+    for (size_t i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        BleSession session;
+        if (!(sessions & (1u << i)) || !ble_session_get((int)i, &session)) {
+            continue;
+        }
+        PhotoUpload &upload = s_uploads[i];
+        upload.active = true;
+        upload.session_id = session.id;
+        upload.sent_bytes = 0;
+        upload.sent_frames = 0;
+        upload.start_ms = millis();
+        // A client that opened the L2CAP channel gets the photo there
+        upload.l2cap_sdu_len = session.l2cap_sdu_mtu;
+        upload.path = (upload.l2cap_sdu_len > PHOTO_L2CAP_HEADER_LEN) ? BLE_PHOTO_PATH_L2CAP : BLE_PHOTO_PATH_GATT;
+        retain_photo_buffer();
+        uploads++;
+        logger_printf("[PHOTO] Starting photo upload to session #%u over %s. Total size: %zu bytes\n",
+                      (unsigned)i, path_name(upload.path), fb->len);
+    }
+    if (uploads == 0) {
+        logger_printf("[PHOTO] No client subscribed. Photo dropped.\n");
+        release_photo_buffer();
+        return;
+    }
+    s_uploading = true;
+    ble_link_set_photo_active(true);
+    pm_lock_hold(PM_LOCK_PHOTO_UPLOAD);
+}
+
+// How long the photo task may block before it has something to do
+static TickType_t photo_task_wait_ticks(unsigned long now_ms) {
+    if (s_uploading || s_frame_handed_off) {
+        return 0; // The transmit queue provides the pacing; a handed-off frame is taken at once
+    }
+    if (s_capture_requested) {
+        return portMAX_DELAY; // Woken by the frame
+    }
+    if (!g_is_ble_connected || wifi_offload_active()) {
+        return pdMS_TO_TICKS(100); // Nothing is requested without a client; the task is suspended on disconnect anyway
     }
+    if (s_single_shot_pending) {
+        long remaining_ms = (long)(s_single_shot_due_ms - now_ms);
+        return remaining_ms > 0 ? pdMS_TO_TICKS(remaining_ms) : 0; // Otherwise came in during the last capture or upload
+    }
+    if (g_capture_mode != MODE_INTERVAL) {
+        return portMAX_DELAY; // Woken by the next control write
+    }
+    unsigned long elapsed_ms = now_ms - g_last_capture_time_ms;
+    if (elapsed_ms >= (unsigned long)g_capture_interval_ms) {
+        return 0;
+    }
+    return pdMS_TO_TICKS(g_capture_interval_ms - elapsed_ms);
 }
 
 // The photo streaming task, moved from ble_handler.cpp and simplified for on-demand operation.
 void photo_streaming_task(void *pvParameters) {
     logger_printf("[TASK] Photo streaming task is running.\n");
     while (true) {
-        // The task is suspended when not subscribed, so we just process photos when running.
-        if (g_is_ble_connected) {
-            process_photo_capture_and_upload(millis());
-        } else {
-            // If not connected, delay. The task will be suspended on disconnect anyway.
-            vTaskDelay(pdMS_TO_TICKS(100));
+        uint32_t notified = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &notified, photo_task_wait_ticks(millis()));
+        if (notified & CAMERA_NOTIFY_FRAME) {
+            // Taken after any running upload; the Wi-Fi offload may have claimed it meanwhile
+            s_frame_handed_off = true;
         }
-        // Yield to other tasks
-        vTaskDelay(pdMS_TO_TICKS(10));
+        process_photo_capture_and_upload(millis());
     }
 }
 
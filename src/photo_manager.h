@@ -4,7 +4,7 @@
 #include <stdint.h> // For uint8_t, int8_t, uint16_t
 #include <stddef.h> // For size_t
 
-#include "ble_handler.h"    // For g_photo_data_characteristic and g_is_ble_connected
+#include "ble_handler.h"    // For g_is_ble_connected
 #include <Arduino.h> // For Serial, millis(), memcpy()
 
 enum PhotoCaptureMode {
@@ -17,16 +17,11 @@ enum PhotoCaptureMode {
 extern PhotoCaptureMode g_capture_mode;
 extern int g_capture_interval_ms;
 extern unsigned long g_last_capture_time_ms;
-extern size_t g_sent_photo_bytes;
-extern uint16_t g_sent_photo_frames;
-extern bool g_is_photo_uploading;
-extern volatile bool g_single_shot_pending; // Flag for single photo request pending
-
-extern uint8_t *s_photo_chunk_buffer;
 
 
 void initialize_photo_manager();
 void handle_photo_control(int8_t control_value);
+bool is_photo_uploading(); // An upload to at least one client is in progress
 void process_photo_capture_and_upload(unsigned long current_time_ms);
 void reset_photo_manager_state();
 void start_photo_upload();
@@ -0,0 +1,123 @@
+#include "pm_lock.h"
+#include "config.h"
+#include "logger.h"
+#include <Arduino.h>
+#include <esp_pm.h>
+#include <esp_timer.h>
+
+const PmLockSpec PM_LOCK_SPECS[PM_LOCK_COUNT] = {
+    {"camera", true, true},        // A light sleep during sensor init or the JPEG DMA stalls the capture
+    {"photo_upload", true, true},  // Chunks are copied and queued between connection events
+    {"audio", true, false},        // The I2S driver already blocks light sleep while the channel runs
+    {"ota", true, true},           // Flash writes and hashing keep up with reception
+};
+
+struct PmLock {
+    esp_pm_lock_handle_t cpu_freq;
+    esp_pm_lock_handle_t no_sleep;
+    int64_t since_us;              // Start of the current hold
+    PmLockStats stats;
+};
+
+static PmLock s_locks[PM_LOCK_COUNT] = {};
+static portMUX_TYPE s_pm_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static esp_pm_lock_handle_t create_lock(esp_pm_lock_type_t type, const char *name) {
+    esp_pm_lock_handle_t handle = nullptr;
+    if (esp_pm_lock_create(type, 0, name, &handle) != ESP_OK) {
+        return nullptr;
+    }
+    return handle;
+}
+
+void pm_lock_init() {
+    if (!PM_LOCKS_ENABLED) {
+        logger_printf("[PM] Locks disabled. Bursts run under DFS and light sleep.\n");
+        return;
+    }
+    size_t created = 0;
+    for (int i = 0; i < PM_LOCK_COUNT; i++) {
+        const PmLockSpec &spec = PM_LOCK_SPECS[i];
+        if (spec.cpu_freq_max) {
+            s_locks[i].cpu_freq = create_lock(ESP_PM_CPU_FREQ_MAX, spec.name);
+            created += s_locks[i].cpu_freq != nullptr;
+        }
+        if (spec.no_light_sleep) {
+            s_locks[i].no_sleep = create_lock(ESP_PM_NO_LIGHT_SLEEP, spec.name);
+            created += s_locks[i].no_sleep != nullptr;
+        }
+    }
+    logger_printf("[PM] %u locks created.\n", (unsigned)created);
+}
+
+void pm_lock_hold(PmLockId id) {
+    if (id >= PM_LOCK_COUNT) {
+        return;
+    }
+    PmLock &lock = s_locks[id];
+    portENTER_CRITICAL(&s_pm_mux);
+    if (!lock.stats.held) {
+        // Taken inside the critical section, so a concurrent release cannot overtake it
+        if (lock.cpu_freq) {
+            esp_pm_lock_acquire(lock.cpu_freq);
+        }
+        if (lock.no_sleep) {
+            esp_pm_lock_acquire(lock.no_sleep);
+        }
+        lock.stats.held = true;
+        lock.stats.holds++;
+        lock.since_us = esp_timer_get_time();
+    }
+    portEXIT_CRITICAL(&s_pm_mux);
+}
+
+void pm_lock_release(PmLockId id) {
+    if (id >= PM_LOCK_COUNT) {
+        return;
+    }
+    PmLock &lock = s_locks[id];
+    portENTER_CRITICAL(&s_pm_mux);
+    if (lock.stats.held) {
+        if (lock.no_sleep) {
+            esp_pm_lock_release(lock.no_sleep);
+        }
+        if (lock.cpu_freq) {
+            esp_pm_lock_release(lock.cpu_freq);
+        }
+        uint32_t held_us = (uint32_t)(esp_timer_get_time() - lock.since_us);
+        lock.stats.held = false;
+        lock.stats.held_us += held_us;
+        if (held_us > lock.stats.longest_us) {
+            lock.stats.longest_us = held_us;
+        }
+    }
+    portEXIT_CRITICAL(&s_pm_mux);
+}
+
+PmLockStats pm_lock_get_stats(PmLockId id) {
+    PmLockStats stats = {};
+    if (id >= PM_LOCK_COUNT) {
+        return stats;
+    }
+    portENTER_CRITICAL(&s_pm_mux);
+    stats = s_locks[id].stats;
+    if (stats.held) {
+        stats.held_us += esp_timer_get_time() - s_locks[id].since_us;
+    }
+    portEXIT_CRITICAL(&s_pm_mux);
+    return stats;
+}
+
+void pm_lock_log_stats() {
+    uint64_t uptime_us = esp_timer_get_time();
+    for (int i = 0; i < PM_LOCK_COUNT; i++) {
+        PmLockStats stats = pm_lock_get_stats((PmLockId)i);
+        if (stats.holds == 0) {
+            continue;
+        }
+        uint32_t per_mille = uptime_us ? (uint32_t)(stats.held_us * 1000 / uptime_us) : 0;
+        logger_printf("[PM] %s: %u holds, %u ms held (%u.%u%% of uptime), longest %u ms%s\n", PM_LOCK_SPECS[i].name,
+                      stats.holds, (uint32_t)(stats.held_us / 1000), per_mille / 10, per_mille % 10,
+                      stats.longest_us / 1000, stats.held ? ", held now" : "");
+    }
+}
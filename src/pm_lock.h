@@ -0,0 +1,48 @@
+#ifndef PM_LOCK_H
+#define PM_LOCK_H
+
+#include <stdint.h>
+
+// Power-management locks for latency-critical bursts. DFS and automatic light sleep stay on
+// globally; a module holds its lock only while its burst is active, which keeps the CPU at
+// PM_MAX_FREQ_MHZ and/or prevents light sleep (and its wake-up penalty) until it is released.
+// A lock is either held or not: holding it again, or releasing it when it is not held, does
+// nothing, so callers can report their state without counting. Hold counts and times are
+// kept per lock and logged with the [PM] tag, to weigh the energy cost against the latency.
+
+enum PmLockId : uint8_t {
+    PM_LOCK_CAMERA = 0,     // Sensor init and capture
+    PM_LOCK_PHOTO_UPLOAD,   // A photo upload to at least one client
+    PM_LOCK_AUDIO,          // Audio stream running (encoder per block)
+    PM_LOCK_OTA,            // Firmware update in progress
+    PM_LOCK_COUNT
+};
+
+struct PmLockSpec {
+    const char *name;
+    bool cpu_freq_max;      // ESP_PM_CPU_FREQ_MAX
+    bool no_light_sleep;    // ESP_PM_NO_LIGHT_SLEEP
+};
+
+extern const PmLockSpec PM_LOCK_SPECS[PM_LOCK_COUNT];
+
+struct PmLockStats {
+    bool held;
+    uint32_t holds;         // Times the lock was taken
+    uint64_t held_us;       // Total hold time, including the current hold
+    uint32_t longest_us;
+};
+
+// Creates the locks. Call after esp_pm_configure(). Without PM support (or with
+// PM_LOCKS_ENABLED false) only the statistics are kept.
+void pm_lock_init();
+
+void pm_lock_hold(PmLockId id);
+void pm_lock_release(PmLockId id);
+
+PmLockStats pm_lock_get_stats(PmLockId id);
+
+// Logs each lock's holds and share of the uptime
+void pm_lock_log_stats();
+
+#endif // PM_LOCK_H
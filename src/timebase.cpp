@@ -0,0 +1,103 @@
+#include "timebase.h"
+#include "clock_sync.h"
+#include "config.h"
+#include "logger.h"
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <string.h>
+
+// Clock sync of one session. Requests and reads arrive on the stack's task.
+struct TimebaseSync {
+    ClockSyncEstimator estimator; // Zero-initialised, i.e. reset
+    // The exchange in progress: t1 and t2 from the request, t3 once the reply has been read
+    bool round_pending;
+    bool round_replied;
+    int64_t round_t1;
+    int64_t round_t2;
+    int64_t round_t3;
+};
+static TimebaseSync s_sync[BLE_MAX_CONNECTIONS] = {};
+
+static int64_t read_le64(const uint8_t *data) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) {
+        value = (value << 8) | data[i];
+    }
+    return (int64_t)value;
+}
+
+static void write_le32(uint8_t *out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out[i] = (uint8_t)((value >> (8 * i)) & 0xFF);
+    }
+}
+
+int64_t timebase_now_us() {
+    return esp_timer_get_time();
+}
+
+static bool valid_session(int session) {
+    return session >= 0 && session < (int)BLE_MAX_CONNECTIONS;
+}
+
+void timebase_reset_session(int session) {
+    if (valid_session(session)) {
+        memset(&s_sync[session], 0, sizeof(s_sync[session]));
+    }
+}
+
+void timebase_handle_sync_request(int session, const uint8_t *payload, size_t len, int64_t received_us) {
+    if (!valid_session(session)) {
+        return; // A client beyond BLE_MAX_CONNECTIONS
+    }
+    if (len != 8 && len != 16) {
+        logger_printf("[SYNC] Expected an 8-byte send time (+ optional 8-byte receive time). Ignored.\n");
+        return;
+    }
+    TimebaseSync &sync = s_sync[session];
+
+    // Close the previous exchange with the client's receive time of our reply
+    if (len == 16 && sync.round_pending && sync.round_replied) {
+        int64_t t4 = read_le64(payload + 8);
+        if (clock_sync_add_exchange(sync.estimator, sync.round_t1, sync.round_t2, sync.round_t3, t4)) {
+            logger_printf("[SYNC] #%d RTT: %u us | Offset: %lld us | Drift: %d ppb | Samples: %u\n",
+                          session,
+                          sync.estimator.last_rtt_us,
+                          (long long)sync.estimator.offset_us,
+                          clock_sync_drift_ppb(sync.estimator),
+                          sync.estimator.samples_used);
+        } else {
+            logger_printf("[SYNC] #%d Inconsistent exchange timestamps. Sample dropped.\n", session);
+        }
+    }
+
+    sync.round_t1 = read_le64(payload);
+    sync.round_t2 = received_us;
+    sync.round_pending = true;
+    sync.round_replied = false;
+}
+
+void timebase_fill_sync_reply(int session, uint8_t *out) {
+    int64_t now = timebase_now_us();
+    TimebaseSync unsynced = {};
+    TimebaseSync &sync = valid_session(session) ? s_sync[session] : unsynced;
+    if (sync.round_pending && !sync.round_replied) {
+        sync.round_t3 = now;
+        sync.round_replied = true;
+    }
+    int64_t t2 = sync.round_pending ? sync.round_t2 : now;
+    int64_t t3 = sync.round_pending ? sync.round_t3 : now;
+    for (int i = 0; i < 8; i++) {
+        out[i] = (uint8_t)(((uint64_t)t2 >> (8 * i)) & 0xFF);
+    }
+    write_le32(out + 8, (uint32_t)(t3 - t2));
+    write_le32(out + 12, (uint32_t)clock_sync_drift_ppb(sync.estimator));
+    write_le32(out + 16, sync.estimator.last_rtt_us);
+}
+
+int64_t timebase_device_to_client_us(int session, int64_t device_us) {
+    if (!valid_session(session)) {
+        return device_us;
+    }
+    return clock_sync_device_to_client_us(s_sync[session].estimator, device_us);
+}
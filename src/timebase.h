@@ -0,0 +1,34 @@
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Device timebase shared by all capture timestamps: microseconds since boot (esp_timer).
+// Photos carry their capture time and framed audio packets their first-sample time in it.
+// Clients map it to wall time with the clock-sync exchange on the photo control
+// characteristic:
+//   write  [CONTROL_OPCODE_CLOCK_SYNC][t1 int64 LE]              client send time
+//          [CONTROL_OPCODE_CLOCK_SYNC][t1 int64 LE][t4 int64 LE]  plus the receive time of
+//                                                                 the previous reply
+//   read   [t2 int64 LE][t3 - t2 uint32 LE][drift ppb int32 LE][last RTT us uint32 LE]
+// t2 is when the device received the request and t3 when it answered the read. Passing t4
+// back lets the device run the offset/drift estimator (clock_sync.h) as well. Each session
+// (see ble_session.h), addressed by its slot, has its own exchange and estimator, since
+// every client has its own clock and link delay.
+
+int64_t timebase_now_us();
+
+// Forgets the exchange and estimate of a session slot, for a new client in it
+void timebase_reset_session(int session);
+
+// Handles a clock-sync request (payload after the opcode) from a session, received at received_us
+void timebase_handle_sync_request(int session, const uint8_t *payload, size_t len, int64_t received_us);
+
+// Writes the CLOCK_SYNC_REPLY_LEN-byte reply for a session's read of the control characteristic
+void timebase_fill_sync_reply(int session, uint8_t *out);
+
+// Maps a device timestamp to a session's client wall time using its current estimate
+int64_t timebase_device_to_client_us(int session, int64_t device_us);
+
+#endif // TIMEBASE_H
@@ -0,0 +1,79 @@
+#include "wake_state.h"
+#include "param_registry.h"
+#include "logger.h"
+#include <Arduino.h>
+#include <esp_attr.h>
+#include <esp_sleep.h>
+#include <string.h>
+
+static const uint32_t WAKE_STATE_MAGIC = 0x57414B45; // "WAKE"
+
+// Kept through deep sleep; the magic tells retained state from whatever a reset left
+RTC_DATA_ATTR static WakeState s_state;
+
+static WakeReason s_reason = WAKE_REASON_COLD_BOOT;
+static volatile bool s_client_seen = false; // A client connected during this boot
+
+WakeReason wake_state_begin() {
+    esp_sleep_wakeup_cause_t cause = esp_sleep_get_wakeup_cause();
+    if (cause == ESP_SLEEP_WAKEUP_UNDEFINED || s_state.magic != WAKE_STATE_MAGIC) {
+        memset(&s_state, 0, sizeof(s_state));
+        s_state.magic = WAKE_STATE_MAGIC;
+        s_reason = WAKE_REASON_COLD_BOOT;
+        logger_printf("[WAKE] Cold boot.\n");
+        return s_reason;
+    }
+    s_state.wakes++;
+    s_reason = cause == ESP_SLEEP_WAKEUP_TIMER ? WAKE_REASON_IDLE_TIMER : WAKE_REASON_OTHER;
+    if (s_reason == WAKE_REASON_IDLE_TIMER) {
+        s_state.idle_wakes++;
+    }
+    logger_printf("[WAKE] Wake #%u (%s), idle wake %u. Last session: subscriptions 0x%03X, %u s, %s.\n",
+                  s_state.wakes, s_reason == WAKE_REASON_IDLE_TIMER ? "timer" : "other source", s_state.idle_wakes,
+                  s_state.last_subscriptions, s_state.last_session_s,
+                  s_state.sessions ? (s_state.last_bonded ? "bonded" : "not bonded") : "none");
+    return s_reason;
+}
+
+WakeReason wake_state_reason() {
+    return s_reason;
+}
+
+uint32_t wake_state_sleep_delay_ms() {
+    if (s_reason == WAKE_REASON_IDLE_TIMER && !s_client_seen) {
+        return param_get(PARAM_WAKE_WINDOW_MS);
+    }
+    return param_get(PARAM_DEEP_SLEEP_DELAY_MS);
+}
+
+void wake_state_set_boot_to_adv(uint32_t ms) {
+    if (s_reason == WAKE_REASON_COLD_BOOT || s_state.boot_to_adv_ms == 0) {
+        logger_printf("[WAKE] Advertising %u ms after reset.\n", ms);
+    } else {
+        logger_printf("[WAKE] Advertising %u ms after reset (previous boot: %u ms).\n", ms, s_state.boot_to_adv_ms);
+    }
+    s_state.boot_to_adv_ms = ms;
+}
+
+void wake_state_on_connect() {
+    s_client_seen = true;
+    s_state.sessions++;
+    s_state.idle_wakes = 0;
+    s_state.idle_awake_ms = 0;
+}
+
+void wake_state_on_disconnect(uint32_t subscriptions, uint32_t connected_ms, bool bonded) {
+    s_state.last_subscriptions = subscriptions;
+    s_state.last_session_s = connected_ms / 1000;
+    s_state.last_bonded = bonded;
+}
+
+void wake_state_before_sleep() {
+    if (s_client_seen || s_reason != WAKE_REASON_IDLE_TIMER) {
+        return;
+    }
+    // Awake time is what an idle wake costs: the radio advertises throughout
+    s_state.idle_awake_ms += millis();
+    logger_printf("[WAKE] Idle wake %u took %u ms (%u ms on average).\n", s_state.idle_wakes, (uint32_t)millis(),
+                  s_state.idle_awake_ms / s_state.idle_wakes);
+}
@@ -0,0 +1,52 @@
+#ifndef WAKE_STATE_H
+#define WAKE_STATE_H
+
+#include <stdint.h>
+
+// Deep-sleep wake cycle. After PARAM_DEEP_SLEEP_DELAY_MS without a client the device sleeps
+// for PARAM_DEEP_SLEEP_WAKE_MS, then wakes and advertises. On such an idle wake it only stays
+// up for PARAM_WAKE_WINDOW_MS (covered by the fast advertising burst, see ble_reconnect.h)
+// before sleeping again, unless a client connects. What the cycle needs across sleeps lives in
+// RTC slow memory, which deep sleep keeps powered: the wake counts, the time spent awake in
+// idle wakes, the previous boot-to-advertising time and the last session. Power-on and every
+// other reset start from a clean state.
+
+enum WakeReason : uint8_t {
+    WAKE_REASON_COLD_BOOT = 0, // Power-on or a reset: nothing retained
+    WAKE_REASON_IDLE_TIMER,    // Timer wake of the idle cycle
+    WAKE_REASON_OTHER          // Another deep-sleep wake source
+};
+
+struct WakeState {
+    uint32_t magic;
+    uint32_t wakes;              // Deep-sleep wakes since the cold boot
+    uint32_t idle_wakes;         // Timer wakes since a client was last connected
+    uint32_t idle_awake_ms;      // Time awake in those wakes
+    uint32_t boot_to_adv_ms;     // Reset to advertising, in the previous boot
+    // Last session before the device went idle
+    uint32_t sessions;           // Clients connected since the cold boot
+    uint32_t last_subscriptions; // Bit per BleChannel
+    uint32_t last_session_s;
+    bool last_bonded;
+};
+
+// Reads the wake cause and validates the retained state. Call in setup() once the logger is
+// up, before anything depends on the wake reason.
+WakeReason wake_state_begin();
+WakeReason wake_state_reason();
+
+// Time without a client before sleeping: PARAM_WAKE_WINDOW_MS on an idle wake where nobody
+// has connected yet, otherwise PARAM_DEEP_SLEEP_DELAY_MS
+uint32_t wake_state_sleep_delay_ms();
+
+// Records this boot's reset-to-advertising time and logs it against the previous boot's
+void wake_state_set_boot_to_adv(uint32_t ms);
+
+// Called by the BLE handler on the stack's task
+void wake_state_on_connect();
+void wake_state_on_disconnect(uint32_t subscriptions, uint32_t connected_ms, bool bonded);
+
+// Accounts for this wake. Call right before esp_deep_sleep_start().
+void wake_state_before_sleep();
+
+#endif // WAKE_STATE_H
@@ -0,0 +1,263 @@
+#include "wifi_offload.h"
+#include "config.h"
+#include "offload_http.h"   // For the chunked HTTP upload
+#include "camera_handler.h" // For fb, take_photo() and photo references
+#include "photo_manager.h"  // For is_photo_uploading()
+#include "audio_replay.h"   // For the pinned replay ring
+#include "audio_ulaw.h"     // For the codec and sample rate of the held audio
+#include "logger.h"
+#include <Arduino.h>
+#include <WiFi.h>
+#include <stdio.h>
+#include <string.h>
+
+static TaskHandle_t s_task = nullptr;
+static volatile bool s_cancel = false;
+
+// Command handed over from the BLE task
+static WifiOffloadMode s_mode = WIFI_OFFLOAD_MODE_SOFTAP;
+static uint32_t s_receiver_ipv4 = 0;
+static uint16_t s_receiver_port = WIFI_OFFLOAD_DEFAULT_PORT;
+static uint8_t s_items = WIFI_OFFLOAD_ITEM_PHOTO | WIFI_OFFLOAD_ITEM_AUDIO;
+
+static WifiOffloadStatus s_status = {};
+static portMUX_TYPE s_status_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void set_state(WifiOffloadState state) {
+    portENTER_CRITICAL(&s_status_mux);
+    s_status.state = state;
+    portEXIT_CRITICAL(&s_status_mux);
+}
+
+static void set_device_ipv4(uint32_t ipv4) {
+    portENTER_CRITICAL(&s_status_mux);
+    s_status.device_ipv4 = ipv4;
+    portEXIT_CRITICAL(&s_status_mux);
+}
+
+static bool start_soft_ap() {
+    WiFi.mode(WIFI_AP);
+    // One client at a time, so the receiver always gets the first DHCP lease
+    if (!WiFi.softAP(WIFI_OFFLOAD_AP_SSID, WIFI_OFFLOAD_AP_PASSWORD, WIFI_OFFLOAD_AP_CHANNEL, 0, 1)) {
+        logger_printf("[WIFI] ERROR: Failed to start SoftAP.\n");
+        return false;
+    }
+    set_device_ipv4((uint32_t)WiFi.softAPIP());
+    logger_printf("[WIFI] SoftAP \"%s\" up at %s.\n", WIFI_OFFLOAD_AP_SSID, WiFi.softAPIP().toString().c_str());
+    return true;
+}
+
+static bool join_network() {
+    WiFi.mode(WIFI_STA);
+    WiFi.begin(WIFI_OFFLOAD_STA_SSID, WIFI_OFFLOAD_STA_PASSWORD);
+    unsigned long start_ms = millis();
+    while (WiFi.status() != WL_CONNECTED) {
+        if (s_cancel || millis() - start_ms > WIFI_OFFLOAD_JOIN_TIMEOUT_MS) {
+            logger_printf("[WIFI] ERROR: Could not join \"%s\".\n", WIFI_OFFLOAD_STA_SSID);
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
+    set_device_ipv4((uint32_t)WiFi.localIP());
+    logger_printf("[WIFI] Joined \"%s\" as %s in %lu ms.\n", WIFI_OFFLOAD_STA_SSID, WiFi.localIP().toString().c_str(),
+                  millis() - start_ms);
+    return true;
+}
+
+static void stop_wifi() {
+    WiFi.softAPdisconnect(true);
+    WiFi.disconnect(true);
+    WiFi.mode(WIFI_OFF);
+    set_device_ipv4(0);
+}
+
+// POSTs one item, retrying while the receiver is not reachable yet (e.g. the phone is still
+// joining the SoftAP) for up to WIFI_OFFLOAD_SERVER_WAIT_MS after Wi-Fi came up.
+static bool post_with_retry(unsigned long wifi_up_ms, const char *path, const char *content_type,
+                            const char *headers, const OffloadSpan *spans, size_t span_count) {
+    while (true) {
+        set_state(WIFI_OFFLOAD_UPLOADING);
+        unsigned long start_ms = millis();
+        OffloadUploadResult result;
+        bool ok = offload_http_post(s_receiver_ipv4, s_receiver_port, path, content_type, headers, spans, span_count,
+                                    WIFI_OFFLOAD_CHUNK_BYTES, WIFI_OFFLOAD_SOCKET_TIMEOUT_MS, &result);
+        portENTER_CRITICAL(&s_status_mux);
+        s_status.bytes += result.body_bytes;
+        s_status.elapsed_ms += millis() - start_ms;
+        s_status.http_status = result.http_status;
+        portEXIT_CRITICAL(&s_status_mux);
+        if (ok) {
+            logger_printf("[WIFI] POST %s: %u bytes, HTTP %d.\n", path, (uint32_t)result.body_bytes, result.http_status);
+            return true;
+        }
+        // Only a receiver that never answered is retried; a rejected or broken upload is final
+        bool unreachable = result.http_status == 0 && result.body_bytes == 0;
+        if (!unreachable || s_cancel || millis() - wifi_up_ms > WIFI_OFFLOAD_SERVER_WAIT_MS) {
+            logger_printf("[WIFI] ERROR: POST %s failed (HTTP %d, errno %d, %u bytes sent).\n", path, result.http_status,
+                          result.error, (uint32_t)result.body_bytes);
+            return false;
+        }
+        set_state(WIFI_OFFLOAD_WAITING);
+        vTaskDelay(pdMS_TO_TICKS(WIFI_OFFLOAD_RETRY_MS));
+    }
+}
+
+static bool upload_photo(unsigned long wifi_up_ms) {
+    if (is_photo_uploading()) {
+        logger_printf("[WIFI] Photo upload over BLE in progress. Skipping the photo.\n");
+        return true;
+    }
+    CameraFrame held;
+    camera_take_frame(&held); // A held photo goes over Wi-Fi instead of BLE
+    if (!fb) {
+        if (!is_camera_initialized()) {
+            configure_camera();
+        }
+        if (!take_photo()) {
+            logger_printf("[WIFI] ERROR: No photo to offload.\n");
+            return false;
+        }
+    }
+
+    // A reference keeps the frame alive without holding the camera mutex through the retries
+    camera_fb_t *photo = retain_photo_buffer();
+    if (!photo) {
+        logger_printf("[WIFI] ERROR: No photo to offload.\n");
+        return false;
+    }
+    bool ok = false;
+    if (photo->len > 0) {
+        // The JPEG is sent straight from the PSRAM frame buffer
+        OffloadSpan span = {photo->buf, photo->len};
+        char headers[48];
+        snprintf(headers, sizeof(headers), "X-Capture-Time-Us: %lld\r\n", (long long)photo_capture_time_us());
+        ok = post_with_retry(wifi_up_ms, "/photo", "image/jpeg", headers, &span, 1);
+    }
+    drop_photo_buffer(ok); // An offloaded photo is released; a failed one stays held
+    return ok;
+}
+
+static bool upload_audio(unsigned long wifi_up_ms) {
+    const uint8_t *data[2];
+    size_t lens[2];
+    size_t count = audio_replay_pin(data, lens);
+    if (count == 0) {
+        audio_replay_unpin();
+        logger_printf("[WIFI] No audio held. Skipping the audio.\n");
+        return true;
+    }
+    // The ring's entries are sent as they are stored, from PSRAM
+    OffloadSpan spans[2];
+    for (size_t i = 0; i < count; i++) {
+        spans[i].data = data[i];
+        spans[i].len = lens[i];
+    }
+    char headers[64];
+    snprintf(headers, sizeof(headers), "X-Audio-Codec: %u\r\nX-Sample-Rate: %u\r\n", (unsigned)g_audio_codec_mode,
+             (unsigned)g_audio_output_sample_rate);
+    bool ok = post_with_retry(wifi_up_ms, "/audio", "application/octet-stream", headers, spans, count);
+    audio_replay_unpin();
+    return ok;
+}
+
+static void wifi_offload_task(void *pvParameters) {
+    portENTER_CRITICAL(&s_status_mux);
+    s_status.bytes = 0;
+    s_status.elapsed_ms = 0;
+    s_status.http_status = 0;
+    portEXIT_CRITICAL(&s_status_mux);
+    set_state(WIFI_OFFLOAD_STARTING);
+
+    bool ok = (s_mode == WIFI_OFFLOAD_MODE_SOFTAP) ? start_soft_ap() : join_network();
+    if (ok && s_receiver_ipv4 == 0) {
+        if (s_mode == WIFI_OFFLOAD_MODE_SOFTAP) {
+            s_receiver_ipv4 = WIFI_OFFLOAD_AP_CLIENT_IP;
+        } else {
+            logger_printf("[WIFI] ERROR: Station mode needs the receiver's address.\n");
+            ok = false;
+        }
+    }
+
+    unsigned long wifi_up_ms = millis();
+    if (ok && !s_cancel && (s_items & WIFI_OFFLOAD_ITEM_PHOTO)) {
+        ok = upload_photo(wifi_up_ms);
+    }
+    if (ok && !s_cancel && (s_items & WIFI_OFFLOAD_ITEM_AUDIO)) {
+        ok = upload_audio(wifi_up_ms);
+    }
+    stop_wifi();
+
+    portENTER_CRITICAL(&s_status_mux);
+    uint32_t elapsed_ms = s_status.elapsed_ms;
+    s_status.state = (ok && !s_cancel) ? WIFI_OFFLOAD_DONE : WIFI_OFFLOAD_FAILED;
+    uint32_t bytes = s_status.bytes;
+    portEXIT_CRITICAL(&s_status_mux);
+    logger_printf("[WIFI] Offload %s: %u bytes in %u ms (%u KB/s). Wi-Fi off.\n", ok && !s_cancel ? "done" : "failed",
+                  bytes, elapsed_ms, elapsed_ms > 0 ? (uint32_t)((uint64_t)bytes * 1000 / 1024 / elapsed_ms) : 0);
+
+    s_task = nullptr;
+    vTaskDelete(NULL);
+}
+
+void wifi_offload_handle_command(const uint8_t *data, size_t len) {
+    if (len == 0) {
+        logger_printf("[WIFI] Offload expected a mode byte. Command ignored.\n");
+        return;
+    }
+    WifiOffloadMode mode = (WifiOffloadMode)data[0];
+    if (mode == WIFI_OFFLOAD_MODE_STOP) {
+        if (s_task) {
+            logger_printf("[WIFI] Offload cancel requested.\n");
+            s_cancel = true;
+        }
+        return;
+    }
+    if (mode != WIFI_OFFLOAD_MODE_SOFTAP && mode != WIFI_OFFLOAD_MODE_STATION) {
+        logger_printf("[WIFI] Unknown offload mode %u. Command ignored.\n", mode);
+        return;
+    }
+    if (mode == WIFI_OFFLOAD_MODE_STATION && WIFI_OFFLOAD_STA_SSID[0] == '\0') {
+        logger_printf("[WIFI] Station mode needs WIFI_OFFLOAD_STA_SSID. Command ignored.\n");
+        return;
+    }
+    if (s_task) {
+        logger_printf("[WIFI] Offload already running. Command ignored.\n");
+        return;
+    }
+
+    s_mode = mode;
+    s_receiver_ipv4 = 0;
+    s_receiver_port = WIFI_OFFLOAD_DEFAULT_PORT;
+    s_items = WIFI_OFFLOAD_ITEM_PHOTO | WIFI_OFFLOAD_ITEM_AUDIO;
+    if (len >= 5) {
+        memcpy(&s_receiver_ipv4, &data[1], 4); // Already in network byte order
+    }
+    if (len >= 7 && (data[5] | (data[6] << 8)) != 0) {
+        s_receiver_port = data[5] | (data[6] << 8);
+    }
+    if (len >= 8 && data[7] != 0) {
+        s_items = data[7];
+    }
+    s_cancel = false;
+    logger_printf("[WIFI] Offload requested (%s, port %u, items 0x%02X).\n",
+                  mode == WIFI_OFFLOAD_MODE_SOFTAP ? "SoftAP" : "station", s_receiver_port, s_items);
+    set_state(WIFI_OFFLOAD_STARTING);
+    if (xTaskCreatePinnedToCore(wifi_offload_task, "WifiOffloadTask", WIFI_OFFLOAD_TASK_STACK_SIZE, NULL,
+                                WIFI_OFFLOAD_TASK_PRIORITY, &s_task, 1) != pdPASS) {
+        logger_printf("[WIFI] ERROR: Failed to create offload task!\n");
+        s_task = nullptr;
+        set_state(WIFI_OFFLOAD_FAILED);
+    }
+}
+
+bool wifi_offload_active() {
+    return s_task != nullptr;
+}
+
+WifiOffloadStatus wifi_offload_get_status() {
+    WifiOffloadStatus status;
+    portENTER_CRITICAL(&s_status_mux);
+    status = s_status;
+    portEXIT_CRITICAL(&s_status_mux);
+    return status;
+}
@@ -0,0 +1,48 @@
+#ifndef WIFI_OFFLOAD_H
+#define WIFI_OFFLOAD_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Opt-in bulk transfer over Wi-Fi. A write to the offload characteristic brings the radio
+// up (SoftAP or station), POSTs the held photo and the audio replay ring to an HTTP receiver
+// run by the client (offload_http.h), then turns Wi-Fi off again.
+
+enum WifiOffloadMode : uint8_t {
+    WIFI_OFFLOAD_MODE_STOP = 0,    // Cancels a running offload after the current upload
+    WIFI_OFFLOAD_MODE_SOFTAP = 1,  // The phone joins WIFI_OFFLOAD_AP_SSID
+    WIFI_OFFLOAD_MODE_STATION = 2  // The device joins WIFI_OFFLOAD_STA_SSID
+};
+
+enum WifiOffloadState : uint8_t {
+    WIFI_OFFLOAD_IDLE = 0,
+    WIFI_OFFLOAD_STARTING,   // Bringing Wi-Fi up
+    WIFI_OFFLOAD_WAITING,    // Retrying until the receiver accepts connections
+    WIFI_OFFLOAD_UPLOADING,
+    WIFI_OFFLOAD_DONE,
+    WIFI_OFFLOAD_FAILED
+};
+
+// Items of the command's item mask
+constexpr uint8_t WIFI_OFFLOAD_ITEM_PHOTO = 0x01; // POST /photo: the held photo, or a new one
+constexpr uint8_t WIFI_OFFLOAD_ITEM_AUDIO = 0x02; // POST /audio: the replay ring's entries
+
+struct WifiOffloadStatus {
+    WifiOffloadState state;
+    uint32_t device_ipv4;  // Network byte order, 0 while Wi-Fi is down
+    uint32_t bytes;        // Body bytes sent in the last offload
+    uint32_t elapsed_ms;   // Time spent in those uploads
+    uint16_t http_status;  // Last reply from the receiver
+};
+
+// Handles a write to the offload characteristic: [mode] [receiver IPv4, 0 = default]
+// [port LE16, 0 = WIFI_OFFLOAD_DEFAULT_PORT] [item mask, 0 = all]. Everything after the mode
+// byte is optional. In SoftAP mode the default receiver is the only client's address.
+// Starts the offload task; called by the command dispatcher.
+void wifi_offload_handle_command(const uint8_t *data, size_t len);
+
+bool wifi_offload_active();
+
+WifiOffloadStatus wifi_offload_get_status();
+
+#endif // WIFI_OFFLOAD_H
@@ -0,0 +1,21 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// The few Arduino-core names the pure-ish firmware modules use, for host builds only
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h" // As on the ESP32 core, for portMUX_TYPE
+
+#define IRAM_ATTR
+
+unsigned long millis();
+unsigned long micros();
+
+struct EspClass {
+    uint32_t getCycleCount(); // Host nanoseconds, truncated like the CPU cycle counter
+};
+extern EspClass ESP;
+
+#endif // HOST_ARDUINO_H
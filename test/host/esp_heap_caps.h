@@ -0,0 +1,12 @@
+#ifndef HOST_ESP_HEAP_CAPS_H
+#define HOST_ESP_HEAP_CAPS_H
+
+#include <stdlib.h>
+
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_8BIT (1 << 2)
+
+static inline void *heap_caps_malloc(size_t size, unsigned int) { return malloc(size); }
+static inline void heap_caps_free(void *ptr) { free(ptr); }
+
+#endif // HOST_ESP_HEAP_CAPS_H
@@ -0,0 +1,11 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+// Critical sections for host builds, where the tests run on one thread
+
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+
+#endif // HOST_FREERTOS_H
@@ -0,0 +1,56 @@
+// Host stand-ins for the hardware-facing functions the audio modules call. Linked into the
+// host tests that build firmware sources which include logger.h or ble_handler.h.
+
+#include "host_stubs.h"
+#include "audio_replay.h"
+#include "ble_handler.h"
+#include "logger.h"
+#include <esp_timer.h>
+#include <chrono>
+#include <stdarg.h>
+#include <stdio.h>
+
+std::vector<HostAudioPacket> g_host_audio_packets;
+bool g_host_verbose_log = false;
+volatile bool g_is_ble_connected = true;
+EspClass ESP;
+
+static int64_t host_now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+int64_t esp_timer_get_time() { return host_now_us(); }
+unsigned long millis() { return (unsigned long)(host_now_us() / 1000); }
+unsigned long micros() { return (unsigned long)host_now_us(); }
+
+uint32_t EspClass::getCycleCount() {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void logger_printf(const char *format, ...) {
+    if (!g_host_verbose_log) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+void notify_framed_audio_packet(BleChannel channel, BleSessionMask, uint16_t sequence, uint32_t timestamp_us,
+                                const uint8_t *packet, size_t packet_len) {
+    g_host_audio_packets.push_back({channel, sequence, timestamp_us, std::vector<uint8_t>(packet, packet + packet_len)});
+}
+
+// No stack on the host: tests install a mock with ble_transport_install()
+BleTransport *ble_transport_default() {
+    return nullptr;
+}
+
+BleSessionMask audio_replay_capture(BleChannel, uint16_t, uint32_t, const uint8_t *, size_t) {
+    return 1; // Live: send it now to session #0
+}
@@ -0,0 +1,22 @@
+#ifndef HOST_STUBS_H
+#define HOST_STUBS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#include "ble_transport.h" // For BleChannel
+
+// What the firmware modules under test sent through notify_framed_audio_packet()
+struct HostAudioPacket {
+    BleChannel channel;
+    uint16_t sequence;
+    uint32_t timestamp_us;
+    std::vector<uint8_t> data;
+};
+extern std::vector<HostAudioPacket> g_host_audio_packets;
+
+// Log lines are dropped unless this is set
+extern bool g_host_verbose_log;
+
+#endif // HOST_STUBS_H
@@ -0,0 +1,56 @@
+#ifndef MOCK_BLE_TRANSPORT_H
+#define MOCK_BLE_TRANSPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <set>
+#include <vector>
+
+#include "ble_transport.h"
+
+// BleTransport for host tests: records what the firmware sends, and refuses notifications to
+// the connections in 'refuse' the way a stack without free buffers does.
+// Install with ble_transport_install().
+class MockBleTransport : public BleTransport {
+public:
+    struct Notification {
+        uint16_t conn;
+        BleChannel channel;
+        std::vector<uint8_t> data;
+        bool accepted;
+    };
+
+    std::vector<Notification> notifications;
+    std::set<uint16_t> refuse;
+    std::vector<uint8_t> values[BLE_CHANNEL_COUNT];
+    BleTransportListener *listener = nullptr;
+
+    const char *name() const override { return "mock"; }
+    bool begin(BleTransportListener *l) override {
+        listener = l;
+        return true;
+    }
+    void start_advertising(uint16_t, uint16_t) override {}
+    bool notify(uint16_t conn, BleChannel channel, const uint8_t *data, size_t len) override {
+        bool accepted = refuse.count(conn) == 0;
+        notifications.push_back({conn, channel, std::vector<uint8_t>(data, data + len), accepted});
+        return accepted;
+    }
+    void set_value(BleChannel channel, const uint8_t *data, size_t len) override {
+        values[channel].assign(data, data + len);
+    }
+    bool request_data_length(uint16_t, uint16_t) override { return true; }
+    bool request_2m_phy(uint16_t) override { return true; }
+    bool update_conn_params(uint16_t, uint16_t, uint16_t, uint16_t, uint16_t) override { return true; }
+
+    // Notifications sent to one connection
+    size_t count_for(uint16_t conn) const {
+        size_t count = 0;
+        for (const Notification &n : notifications) {
+            count += n.conn == conn;
+        }
+        return count;
+    }
+};
+
+#endif // MOCK_BLE_TRANSPORT_H
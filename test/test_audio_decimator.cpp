@@ -0,0 +1,175 @@
+// Half-band decimator: the tap table against the design in audio_decimator.h, the response
+// of the fixed-point kernel to sines, block-size independence, and a benchmark.
+
+// The taps are private to the kernel, so the test builds it directly
+#include "audio_decimator.cpp"
+#include "test_util.h"
+#include <math.h>
+#include <vector>
+
+static const int ODD_TAP_COUNT = (DECIMATOR_TAPS + 1) / 4;
+
+// Gain of the quantised taps at frequency f (Hz, input rate SAMPLE_RATE), from the taps alone
+static double design_gain_db(double f) {
+    double w = 2 * M_PI * f / SAMPLE_RATE;
+    double h = HALFBAND_CENTRE_TAP;
+    for (int k = 0; k < ODD_TAP_COUNT; k++) {
+        h += 2.0 * HALFBAND_ODD_TAPS[k] * cos(w * (2 * k + 1));
+    }
+    return 20 * log10(fabs(h) / 32768.0);
+}
+
+// Gain of the kernel itself: RMS out over RMS in for a sine, after the filter has settled
+static double measured_gain_db(double f, double amplitude) {
+    DecimatorState state;
+    decimator_reset(state);
+    const size_t block = 320;
+    std::vector<int16_t> in(block), out(block / 2);
+    double in_energy = 0, out_energy = 0;
+    size_t n = 0;
+    for (int b = 0; b < 200; b++) {
+        for (size_t i = 0; i < block; i++, n++) {
+            in[i] = (int16_t)lrint(amplitude * sin(2 * M_PI * f * n / SAMPLE_RATE));
+        }
+        CHECK(decimate_by_2(state, in.data(), block, out.data()) == block / 2);
+        if (b < 10) {
+            continue; // Filter start-up
+        }
+        for (size_t i = 0; i < block; i++) {
+            in_energy += (double)in[i] * in[i] / 2; // Per output sample
+        }
+        for (size_t i = 0; i < block / 2; i++) {
+            out_energy += (double)out[i] * out[i];
+        }
+    }
+    return 10 * log10((out_energy + 1e-9) / in_energy);
+}
+
+static void test_taps() {
+    int32_t sum = HALFBAND_CENTRE_TAP;
+    for (int k = 0; k < ODD_TAP_COUNT; k++) {
+        sum += 2 * HALFBAND_ODD_TAPS[k];
+    }
+    CHECK(sum == 32768); // Unity DC gain in Q15
+    CHECK(HALFBAND_CENTRE_TAP == 16384); // Half-band: the centre tap is exactly one half
+
+    // Passband ripple and stopband attenuation as documented
+    double max_ripple = 0, min_attenuation = 1e9;
+    for (double f = 0; f <= 3400; f += 10) {
+        max_ripple = fmax(max_ripple, fabs(design_gain_db(f)));
+    }
+    for (double f = 4600; f <= SAMPLE_RATE / 2; f += 10) {
+        min_attenuation = fmin(min_attenuation, -design_gain_db(f));
+    }
+    printf("design: passband ripple %.4f dB, stopband attenuation %.1f dB\n", max_ripple, min_attenuation);
+    CHECK(max_ripple < 0.03);
+    CHECK(min_attenuation > 69);
+    CHECK_NEAR(design_gain_db(SAMPLE_RATE / 4), -6.02, 0.01); // Half-band: -6 dB at the new Nyquist
+}
+
+static void test_kernel_response() {
+    // DC passes exactly
+    DecimatorState state;
+    decimator_reset(state);
+    std::vector<int16_t> in(256, 12345), out(128);
+    decimate_by_2(state, in.data(), in.size(), out.data());
+    CHECK(out[out.size() - 1] == 12345);
+
+    const double passband[] = {100, 300, 1000, 2000, 3000, 3400};
+    for (double f : passband) {
+        CHECK_NEAR(measured_gain_db(f, 16000), 0, 0.05);
+    }
+    // Quantisation noise of the output (about -101 dBFS) bounds what can be measured
+    const double stopband[] = {4600, 5000, 6000, 7000, 7900};
+    for (double f : stopband) {
+        CHECK(measured_gain_db(f, 30000) < -65);
+    }
+}
+
+static void test_full_scale_saturates() {
+    // A full-scale square wave overshoots at its edges: the output clamps instead of wrapping
+    DecimatorState state;
+    decimator_reset(state);
+    std::vector<int16_t> in(AUDIO_MAX_INPUT_FRAME_SAMPLES), out(in.size() / 2);
+    for (size_t i = 0; i < in.size(); i++) {
+        in[i] = (i / 128) % 2 ? INT16_MAX : INT16_MIN;
+    }
+    decimate_by_2(state, in.data(), in.size(), out.data());
+    int16_t highest = 0, lowest = 0;
+    for (size_t m = 0; m < out.size(); m++) {
+        highest = out[m] > highest ? out[m] : highest;
+        lowest = out[m] < lowest ? out[m] : lowest;
+        // Output m is centred on input 2m + 1 + HALFBAND_CENTRE - DECIMATOR_HISTORY
+        long centre = 2 * (long)m + 1 + HALFBAND_CENTRE - (long)DECIMATOR_HISTORY;
+        long phase = centre % 128;
+        if (centre >= 0 && phase >= 4 && phase < 124) {
+            // Past the edge itself, where the overshoot is, the output keeps the input's sign
+            CHECK(in[centre] > 0 ? out[m] > 0 : out[m] < 0);
+        }
+        if (centre >= 0 && phase >= 40 && phase < 88) {
+            CHECK(in[centre] > 0 ? out[m] > 32000 : out[m] < -32000);
+        }
+    }
+    CHECK(highest == INT16_MAX);
+    CHECK(lowest == INT16_MIN);
+}
+
+static void test_block_size_independent() {
+    // The history carries across calls: one long block and many short ones agree
+    std::vector<int16_t> in(AUDIO_MAX_INPUT_FRAME_SAMPLES);
+    TestRng rng = {5};
+    for (int16_t &s : in) {
+        s = (int16_t)rng.range(-20000, 20000);
+    }
+    DecimatorState whole, pieces;
+    decimator_reset(whole);
+    decimator_reset(pieces);
+    std::vector<int16_t> out_whole(in.size() / 2), out_pieces(in.size() / 2);
+    decimate_by_2(whole, in.data(), in.size(), out_whole.data());
+    size_t pos = 0;
+    const size_t sizes[] = {2, 30, 64, 320, 6};
+    for (int i = 0; pos < in.size(); i++) {
+        size_t n = sizes[i % 5] < in.size() - pos ? sizes[i % 5] : in.size() - pos;
+        decimate_by_2(pieces, &in[pos], n, &out_pieces[pos / 2]);
+        pos += n;
+    }
+    CHECK(out_whole == out_pieces);
+}
+
+static void test_rejects_bad_arguments() {
+    DecimatorState state;
+    decimator_reset(state);
+    int16_t in[AUDIO_MAX_INPUT_FRAME_SAMPLES + 2] = {}, out[AUDIO_MAX_INPUT_FRAME_SAMPLES] = {};
+    CHECK(decimate_by_2(state, in, 0, out) == 0);
+    CHECK(decimate_by_2(state, in, 31, out) == 0);
+    CHECK(decimate_by_2(state, in, AUDIO_MAX_INPUT_FRAME_SAMPLES + 2, out) == 0);
+    CHECK(decimate_by_2(state, nullptr, 32, out) == 0);
+}
+
+static void benchmark() {
+    DecimatorState state;
+    decimator_reset(state);
+    const size_t block = 320; // 20ms at 16kHz
+    std::vector<int16_t> in(block), out(block / 2);
+    for (size_t i = 0; i < block; i++) {
+        in[i] = (int16_t)(8000 * sin(i * 0.3));
+    }
+    const int blocks = 20000;
+    int64_t start = test_now_ns();
+    for (int b = 0; b < blocks; b++) {
+        decimate_by_2(state, in.data(), block, out.data());
+    }
+    int64_t elapsed = test_now_ns() - start;
+    printf("benchmark: decimate_by_2 %.3f us per 20ms block, %.2f ns per output sample (host)\n",
+           elapsed / 1000.0 / blocks, (double)elapsed / blocks / (block / 2));
+}
+
+int main() {
+    test_taps();
+    test_kernel_response();
+    test_full_scale_saturates();
+    test_block_size_independent();
+    test_rejects_bad_arguments();
+    benchmark();
+    return test_result("test_audio_decimator");
+}
@@ -0,0 +1,158 @@
+// Fixed-point DSP front-end against a float reference of the same filters: DC removal, the
+// saturating gain and the AGC law, plus a benchmark of audio_dsp_process().
+
+// The stages are private to audio_dsp.cpp, so the test builds it directly
+#include "audio_dsp.cpp"
+#include "test_util.h"
+#include <math.h>
+#include <vector>
+
+static const double DC_POLE = DSP_DC_BLOCK_COEFF_Q15 / 32768.0;
+
+static double saturate(double v) {
+    return v > INT16_MAX ? INT16_MAX : v < INT16_MIN ? INT16_MIN : v;
+}
+
+// Microphone-like input: a DC offset, a 200 Hz tone, a slow drift and noise
+static std::vector<int16_t> make_input(size_t n, int offset, double amplitude, uint32_t seed) {
+    std::vector<int16_t> pcm(n);
+    TestRng rng = {seed};
+    for (size_t i = 0; i < n; i++) {
+        double t = (double)i / SAMPLE_RATE;
+        double v = offset + amplitude * sin(2 * M_PI * 200 * t) + 300 * sin(2 * M_PI * 0.5 * t) + rng.range(-50, 51);
+        pcm[i] = (int16_t)saturate(lrint(v));
+    }
+    return pcm;
+}
+
+static void test_dc_block_matches_float() {
+    std::vector<int16_t> pcm = make_input(SAMPLE_RATE * 2, -1800, 4000, 1);
+    AudioDspState state;
+    audio_dsp_reset(state);
+
+    double x1 = 0, y1 = 0, max_error = 0, tail_sum = 0;
+    const size_t frame = 320;
+    for (size_t start = 0; start < pcm.size(); start += frame) {
+        std::vector<int16_t> out(pcm.begin() + start, pcm.begin() + start + frame);
+        dc_block(state, out.data(), out.size());
+        for (size_t i = 0; i < frame; i++) {
+            double x = pcm[start + i];
+            double y = x - x1 + DC_POLE * y1;
+            x1 = x;
+            y1 = y;
+            max_error = fmax(max_error, fabs(out[i] - saturate(y)));
+            if (start + i >= pcm.size() - SAMPLE_RATE) {
+                tail_sum += out[i];
+            }
+        }
+    }
+    printf("dc_block: max error against float %.2f LSB\n", max_error);
+    CHECK(max_error <= 2);
+    CHECK_NEAR(tail_sum / SAMPLE_RATE, 0, 2); // The -1800 offset is gone after settling
+}
+
+static void test_dc_block_settles_to_zero() {
+    // Constant input: the extra fractional bits must not leave a residual offset
+    AudioDspState state;
+    audio_dsp_reset(state);
+    std::vector<int16_t> pcm(SAMPLE_RATE * 3, 2500);
+    dc_block(state, pcm.data(), pcm.size());
+    for (size_t i = pcm.size() - 1000; i < pcm.size(); i++) {
+        CHECK(pcm[i] == 0);
+    }
+}
+
+static void test_gain_matches_float() {
+    const uint32_t gains_q8[] = {32, 256, 300, 1024, 2048 + 77};
+    for (uint32_t gain_q8 : gains_q8) {
+        std::vector<int16_t> pcm = make_input(4000, 0, 12000, 2);
+        std::vector<int16_t> original = pcm;
+        apply_gain(pcm.data(), pcm.size(), gain_q8);
+        for (size_t i = 0; i < pcm.size(); i++) {
+            double expected = saturate(floor(original[i] * (double)gain_q8 / 256.0));
+            CHECK(pcm[i] == expected);
+        }
+    }
+}
+
+// Float version of the AGC law in audio_dsp.h: fast attack, release 1/AGC_RELEASE_DIVISOR
+// of the way to the target per frame
+static double agc_reference(double gain, double rms) {
+    if (rms < AGC_NOISE_GATE_RMS) {
+        return gain;
+    }
+    double desired = AGC_TARGET_RMS / (rms * (1 << VOLUME_GAIN));
+    desired = fmin(fmax(desired, AGC_MIN_GAIN_Q8 / 256.0), AGC_MAX_GAIN_Q8 / 256.0);
+    return desired < gain ? desired : gain + (desired - gain) / AGC_RELEASE_DIVISOR;
+}
+
+static void test_agc_tracks_float() {
+    // Loud, then quiet, then near-silence, then a level needing a gain just above unity
+    const uint32_t levels[] = {1500, 200, 50, 700};
+    AudioDspState state;
+    audio_dsp_reset(state);
+    double gain = 1.0;
+    for (uint32_t rms : levels) {
+        for (int frame = 0; frame < 400; frame++) {
+            update_agc(state, rms);
+            gain = agc_reference(gain, rms);
+            CHECK_NEAR(state.agc_gain_q8 / 256.0, gain, 0.02 + gain * 0.02);
+        }
+        // Settled: the output level is on target unless the gain hit a limit or the gate
+        double expected = agc_reference(gain, rms);
+        double level = rms * (1 << VOLUME_GAIN) * state.agc_gain_q8 / 256.0;
+        if (rms >= AGC_NOISE_GATE_RMS && expected > AGC_MIN_GAIN_Q8 / 256.0 && expected < AGC_MAX_GAIN_Q8 / 256.0) {
+            CHECK_NEAR(level, AGC_TARGET_RMS, AGC_TARGET_RMS * 0.01);
+        }
+    }
+}
+
+static void test_process_frame() {
+    // The whole chain (AGC as configured) against the float reference
+    std::vector<int16_t> pcm = make_input(SAMPLE_RATE, 900, 2000, 3);
+    AudioDspState state;
+    audio_dsp_reset(state);
+    std::vector<int16_t> out = pcm;
+    const size_t frame = 320;
+    for (size_t start = 0; start < out.size(); start += frame) {
+        audio_dsp_process(state, &out[start], frame);
+    }
+    if (!AUDIO_AGC_ENABLED) {
+        double x1 = 0, y1 = 0, max_error = 0;
+        for (size_t i = 0; i < pcm.size(); i++) {
+            double y = pcm[i] - x1 + DC_POLE * y1;
+            x1 = pcm[i];
+            y1 = y;
+            max_error = fmax(max_error, fabs(out[i] - saturate(y * (1 << VOLUME_GAIN))));
+        }
+        CHECK(max_error <= 2 << VOLUME_GAIN);
+    }
+    CHECK(state.last_rms > 1000 && state.last_rms < 1600); // 2000 / sqrt(2) plus the drift and noise
+}
+
+static void benchmark() {
+    std::vector<int16_t> input = make_input(320, 500, 3000, 4);
+    std::vector<int16_t> pcm(320);
+    AudioDspState state;
+    audio_dsp_reset(state);
+    const int frames = 50000;
+    int64_t start = test_now_ns();
+    for (int f = 0; f < frames; f++) {
+        pcm = input;
+        audio_dsp_process(state, pcm.data(), pcm.size());
+        update_agc(state, state.last_rms); // AGC cost, also when it is configured off
+    }
+    int64_t elapsed = test_now_ns() - start;
+    printf("benchmark: audio_dsp_process %.3f us per 20ms frame, %.2f ns per sample (host)\n",
+           elapsed / 1000.0 / frames, (double)elapsed / frames / pcm.size());
+}
+
+int main() {
+    test_dc_block_matches_float();
+    test_dc_block_settles_to_zero();
+    test_gain_matches_float();
+    test_agc_tracks_float();
+    test_process_frame();
+    benchmark();
+    return test_result("test_audio_dsp");
+}
@@ -0,0 +1,233 @@
+// Log-mel features against a double-precision reference built from the definition in
+// audio_logmel.h (Hann window, unnormalised DFT power, HTK mel triangles, 4 * log2), plus a
+// benchmark of one feature frame.
+
+#include "audio_logmel.h"
+#include "config.h"
+#include "host_stubs.h"
+#include "test_util.h"
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+static double hz_to_mel(double hz) { return 2595.0 * log10(1.0 + hz / 700.0); }
+static double mel_to_hz(double mel) { return 700.0 * (pow(10.0, mel / 2595.0) - 1.0); }
+
+static std::vector<double> reference_frame(const std::vector<int16_t> &window, uint32_t rate) {
+    size_t n = window.size();
+    size_t fft_size = 1;
+    while (fft_size < n) {
+        fft_size <<= 1;
+    }
+    std::vector<double> power(fft_size / 2 + 1);
+    for (size_t k = 0; k <= fft_size / 2; k++) {
+        double re = 0, im = 0;
+        for (size_t i = 0; i < n; i++) {
+            double w = 0.5 - 0.5 * cos(2 * M_PI * i / (n - 1));
+            double angle = 2 * M_PI * k * i / fft_size;
+            re += window[i] * w * cos(angle);
+            im -= window[i] * w * sin(angle);
+        }
+        power[k] = re * re + im * im;
+    }
+
+    double edges[LOGMEL_NUM_BINS + 2];
+    double mel_low = hz_to_mel(LOGMEL_MIN_HZ), mel_high = hz_to_mel(rate / 2.0);
+    for (int m = 0; m < LOGMEL_NUM_BINS + 2; m++) {
+        edges[m] = mel_to_hz(mel_low + (mel_high - mel_low) * m / (LOGMEL_NUM_BINS + 1));
+    }
+    std::vector<double> values(LOGMEL_NUM_BINS);
+    for (int m = 0; m < LOGMEL_NUM_BINS; m++) {
+        double energy = 0;
+        for (size_t k = 0; k <= fft_size / 2; k++) {
+            double hz = (double)k * rate / fft_size;
+            double weight = 0;
+            if (hz >= edges[m] && hz < edges[m + 1]) {
+                weight = (hz - edges[m]) / (edges[m + 1] - edges[m]);
+            } else if (hz >= edges[m + 1] && hz < edges[m + 2]) {
+                weight = (edges[m + 2] - hz) / (edges[m + 2] - edges[m + 1]);
+            }
+            energy += weight * power[k];
+        }
+        values[m] = energy > 0 ? 4 * log2(energy) : 0;
+    }
+    return values;
+}
+
+static std::vector<int16_t> make_window(const char *kind, size_t n, uint32_t rate, double amplitude, uint32_t seed) {
+    std::vector<int16_t> pcm(n);
+    TestRng rng = {seed};
+    for (size_t i = 0; i < n; i++) {
+        double t = (double)i / rate;
+        double v = 0;
+        if (!strcmp(kind, "tone")) {
+            v = amplitude * sin(2 * M_PI * 1000 * t);
+        } else if (!strcmp(kind, "voice")) {
+            for (int h = 1; h <= 20; h++) {
+                v += amplitude / h * sin(2 * M_PI * 120 * h * t + h);
+            }
+        } else if (!strcmp(kind, "noise")) {
+            v = amplitude * (rng.range(-10000, 10001) / 10000.0);
+        }
+        pcm[i] = (int16_t)fmax(-32768, fmin(32767, lrint(v)));
+    }
+    return pcm;
+}
+
+struct Comparison {
+    double max_error;  // Steps of 0.75 dB, over bins within 50 dB of the frame's loudest
+    double mean_error;
+};
+
+static Comparison compare(const char *kind, uint32_t rate, double amplitude, uint32_t seed) {
+    CHECK(initialize_logmel(rate));
+    size_t n = rate * LOGMEL_WINDOW_MS / 1000;
+    std::vector<int16_t> window = make_window(kind, n, rate, amplitude, seed);
+    uint8_t out[LOGMEL_NUM_BINS];
+    CHECK(logmel_compute_frame(window.data(), n, out));
+    std::vector<double> expected = reference_frame(window, rate);
+
+    double loudest = 0;
+    for (double v : expected) {
+        loudest = fmax(loudest, v);
+    }
+    Comparison c = {0, 0};
+    int counted = 0;
+    for (int m = 0; m < LOGMEL_NUM_BINS; m++) {
+        double clamped = fmin(255, fmax(0, expected[m]));
+        if (expected[m] < loudest - 67) { // The 16-bit FFT's noise floor is about 60 dB down
+            continue;
+        }
+        double error = fabs(out[m] - clamped);
+        c.max_error = fmax(c.max_error, error);
+        c.mean_error += error;
+        counted++;
+    }
+    c.mean_error /= counted ? counted : 1;
+    return c;
+}
+
+static void test_matches_reference() {
+    const char *kinds[] = {"tone", "voice", "noise"};
+    const uint32_t rates[] = {(uint32_t)SAMPLE_RATE, (uint32_t)SAMPLE_RATE / 2};
+    const double amplitudes[] = {300, 3000, 30000};
+    for (const char *kind : kinds) {
+        for (uint32_t rate : rates) {
+            for (double amplitude : amplitudes) {
+                Comparison c = compare(kind, rate, amplitude, 11);
+                printf("%-5s %5u Hz amplitude %5.0f: max error %.2f, mean %.2f steps\n", kind, rate, amplitude,
+                       c.max_error, c.mean_error);
+                CHECK(c.max_error <= 3);
+                CHECK(c.mean_error <= 1);
+            }
+        }
+    }
+}
+
+static void test_tone_lands_in_its_filter() {
+    CHECK(initialize_logmel(SAMPLE_RATE));
+    size_t n = SAMPLE_RATE * LOGMEL_WINDOW_MS / 1000;
+    std::vector<int16_t> window = make_window("tone", n, SAMPLE_RATE, 10000, 1);
+    uint8_t out[LOGMEL_NUM_BINS];
+    CHECK(logmel_compute_frame(window.data(), n, out));
+    std::vector<double> expected = reference_frame(window, SAMPLE_RATE);
+    int peak = 0, expected_peak = 0;
+    for (int m = 1; m < LOGMEL_NUM_BINS; m++) {
+        peak = out[m] > out[peak] ? m : peak;
+        expected_peak = expected[m] > expected[expected_peak] ? m : expected_peak;
+    }
+    CHECK(peak == expected_peak);
+}
+
+static void test_edge_cases() {
+    CHECK(!initialize_logmel(44100));
+    CHECK(initialize_logmel(SAMPLE_RATE));
+    size_t n = SAMPLE_RATE * LOGMEL_WINDOW_MS / 1000;
+    std::vector<int16_t> silence(n, 0);
+    uint8_t out[LOGMEL_NUM_BINS];
+    memset(out, 0xAA, sizeof(out));
+    CHECK(logmel_compute_frame(silence.data(), n, out));
+    for (uint8_t v : out) {
+        CHECK(v == 0);
+    }
+    CHECK(!logmel_compute_frame(silence.data(), n - 1, out)); // Wrong window length
+
+    // Full-scale square wave: no overflow in the FFT, the loudest bins clamp at 255 at most
+    std::vector<int16_t> square(n);
+    for (size_t i = 0; i < n; i++) {
+        square[i] = (i / 8) % 2 ? INT16_MAX : INT16_MIN;
+    }
+    CHECK(logmel_compute_frame(square.data(), n, out));
+    std::vector<double> expected = reference_frame(square, SAMPLE_RATE);
+    for (int m = 0; m < LOGMEL_NUM_BINS; m++) {
+        if (expected[m] > 100) {
+            CHECK_NEAR(out[m], fmin(255, expected[m]), 2.5);
+        }
+    }
+}
+
+static void test_send_path_stamps_window_start() {
+    CHECK(initialize_logmel(SAMPLE_RATE));
+    reset_logmel_stream();
+    g_host_audio_packets.clear();
+    size_t hop = SAMPLE_RATE * LOGMEL_HOP_MS / 1000;
+    std::vector<int16_t> pcm = make_window("voice", hop, SAMPLE_RATE, 3000, 1);
+    CHECK(process_and_send_logmel_features(BLE_CHANNEL_AUDIO_LOGMEL, pcm.data(), hop, 1000000) == LOGMEL_NUM_BINS);
+    CHECK(g_host_audio_packets.size() == 1);
+    if (!g_host_audio_packets.empty()) {
+        CHECK(g_host_audio_packets[0].data.size() == LOGMEL_NUM_BINS);
+        // The window is 25ms and ends with this 10ms hop
+        CHECK(g_host_audio_packets[0].timestamp_us == 1000000 - (LOGMEL_WINDOW_MS - LOGMEL_HOP_MS) * 1000);
+    }
+}
+
+static void test_window_cleared_across_gap() {
+    CHECK(initialize_logmel(SAMPLE_RATE));
+    reset_logmel_stream();
+    g_host_audio_packets.clear();
+    size_t hop = SAMPLE_RATE * LOGMEL_HOP_MS / 1000;
+    size_t n = SAMPLE_RATE * LOGMEL_WINDOW_MS / 1000;
+    std::vector<int16_t> loud = make_window("voice", hop, SAMPLE_RATE, 3000, 1);
+    std::vector<int16_t> quiet = make_window("voice", hop, SAMPLE_RATE, 100, 2);
+    for (int i = 0; i < 3; i++) {
+        process_and_send_logmel_features(BLE_CHANNEL_AUDIO_LOGMEL, loud.data(), hop, 1000000);
+    }
+
+    // After the gap the window holds only the new hop, and the sequence carries on
+    clear_logmel_window();
+    CHECK(process_and_send_logmel_features(BLE_CHANNEL_AUDIO_LOGMEL, quiet.data(), hop, 2000000) == LOGMEL_NUM_BINS);
+    std::vector<int16_t> window(n, 0);
+    memcpy(&window[n - hop], quiet.data(), hop * sizeof(int16_t));
+    uint8_t expected[LOGMEL_NUM_BINS];
+    CHECK(logmel_compute_frame(window.data(), n, expected));
+    CHECK(g_host_audio_packets.size() == 4);
+    if (g_host_audio_packets.size() == 4) {
+        CHECK(g_host_audio_packets[3].sequence == 3);
+        CHECK(memcmp(g_host_audio_packets[3].data.data(), expected, LOGMEL_NUM_BINS) == 0);
+    }
+}
+
+static void benchmark() {
+    CHECK(initialize_logmel(SAMPLE_RATE));
+    size_t n = SAMPLE_RATE * LOGMEL_WINDOW_MS / 1000;
+    std::vector<int16_t> window = make_window("voice", n, SAMPLE_RATE, 3000, 1);
+    uint8_t out[LOGMEL_NUM_BINS];
+    const int frames = 5000;
+    int64_t start = test_now_ns();
+    for (int f = 0; f < frames; f++) {
+        window[f % n] ^= 1; // Keep the compiler from hoisting the work
+        logmel_compute_frame(window.data(), n, out);
+    }
+    int64_t elapsed = test_now_ns() - start;
+    printf("benchmark: logmel_compute_frame %.2f us per frame (host, scalar FFT)\n", elapsed / 1000.0 / frames);
+}
+
+int main() {
+    test_matches_reference();
+    test_tone_lands_in_its_filter();
+    test_edge_cases();
+    test_send_path_stamps_window_start();
+    test_window_cleared_across_gap();
+    benchmark();
+    return test_result("test_audio_logmel");
+}
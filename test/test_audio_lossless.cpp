@@ -0,0 +1,200 @@
+// Lossless block codec: every block must decode bit-exactly with a decoder written from the
+// layout in audio_lossless.h, and the benchmark reports encode time and ratio.
+
+#include "audio_lossless.h"
+#include "config.h"
+#include "host_stubs.h"
+#include "test_util.h"
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+// --- Reference decoder, from the documented block layout ---
+struct BitReader {
+    const uint8_t *buf;
+    size_t len;
+    size_t bit_pos;
+    bool overrun;
+    uint32_t bit() {
+        if (bit_pos >= len * 8) {
+            overrun = true;
+            return 0;
+        }
+        uint32_t b = (buf[bit_pos / 8] >> (7 - bit_pos % 8)) & 1;
+        bit_pos++;
+        return b;
+    }
+};
+
+static bool decode_block(const uint8_t *block, size_t len, std::vector<int16_t> &pcm) {
+    if (len < LOSSLESS_BLOCK_HEADER_LEN) {
+        return false;
+    }
+    uint8_t order = block[0];
+    uint8_t k = block[1];
+    size_t count = block[2] | (block[3] << 8);
+    pcm.assign(count, 0);
+    size_t pos = LOSSLESS_BLOCK_HEADER_LEN;
+    if (order == LOSSLESS_ORDER_VERBATIM) {
+        if (len != pos + 2 * count) {
+            return false;
+        }
+        for (size_t i = 0; i < count; i++, pos += 2) {
+            pcm[i] = (int16_t)(block[pos] | (block[pos + 1] << 8));
+        }
+        return true;
+    }
+    if (order > LOSSLESS_MAX_ORDER || count < order || len < pos + 2 * order) {
+        return false;
+    }
+    std::vector<int32_t> x(count);
+    for (size_t i = 0; i < order; i++, pos += 2) {
+        x[i] = (int16_t)(block[pos] | (block[pos + 1] << 8));
+    }
+    BitReader r = {block + pos, len - pos, 0, false};
+    for (size_t n = order; n < count; n++) {
+        uint32_t q = 0;
+        while (r.bit() && !r.overrun) {
+            q++;
+        }
+        uint32_t low = 0;
+        for (int b = 0; b < k; b++) {
+            low = (low << 1) | r.bit();
+        }
+        uint32_t u = (q << k) | low;
+        int32_t residual = (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+        int32_t prediction = 0;
+        switch (order) {
+            case 0: prediction = 0; break;
+            case 1: prediction = x[n - 1]; break;
+            case 2: prediction = 2 * x[n - 1] - x[n - 2]; break;
+            case 3: prediction = 3 * x[n - 1] - 3 * x[n - 2] + x[n - 3]; break;
+            default: prediction = 4 * x[n - 1] - 6 * x[n - 2] + 4 * x[n - 3] - x[n - 4]; break;
+        }
+        x[n] = prediction + residual;
+    }
+    if (r.overrun || (r.bit_pos + 7) / 8 != r.len) {
+        return false; // Truncated, or trailing bytes the encoder should not have written
+    }
+    for (size_t n = 0; n < count; n++) {
+        pcm[n] = (int16_t)x[n];
+    }
+    return true;
+}
+
+// --- Test signals ---
+static std::vector<int16_t> make_signal(const char *kind, size_t n, uint32_t seed) {
+    std::vector<int16_t> pcm(n);
+    TestRng rng = {seed};
+    for (size_t i = 0; i < n; i++) {
+        double t = (double)i / SAMPLE_RATE;
+        double v = 0;
+        if (!strcmp(kind, "silence")) {
+            v = 0;
+        } else if (!strcmp(kind, "hiss")) {
+            v = rng.range(-8, 9);
+        } else if (!strcmp(kind, "sine")) {
+            v = 8000 * sin(2 * M_PI * 440 * t);
+        } else if (!strcmp(kind, "speech")) {
+            // Harmonics of a 140 Hz voice with a syllable envelope and a little noise
+            double envelope = 0.5 + 0.5 * sin(2 * M_PI * 4 * t);
+            for (int h = 1; h <= 8; h++) {
+                v += 3000.0 / h * sin(2 * M_PI * 140 * h * t + h);
+            }
+            v = v * envelope + rng.range(-40, 41);
+        } else if (!strcmp(kind, "noise")) {
+            v = rng.range(-32768, 32768);
+        } else if (!strcmp(kind, "square")) {
+            v = (i / 7) % 2 ? 32767 : -32768; // Full-scale edges: largest order-4 residuals
+        }
+        pcm[i] = (int16_t)(v > 32767 ? 32767 : v < -32768 ? -32768 : v);
+    }
+    return pcm;
+}
+
+static size_t check_round_trip(const std::vector<int16_t> &pcm, const char *what) {
+    uint8_t block[LOSSLESS_MAX_PACKET_BYTES + 8];
+    size_t len = lossless_encode_block(pcm.data(), pcm.size(), block, LOSSLESS_BLOCK_HEADER_LEN + 2 * pcm.size());
+    std::vector<int16_t> decoded;
+    bool ok = len > 0 && len <= LOSSLESS_BLOCK_HEADER_LEN + 2 * pcm.size() && decode_block(block, len, decoded) &&
+              decoded == pcm;
+    if (!ok) {
+        fprintf(stderr, "round trip failed: %s, %zu samples, %zu bytes\n", what, pcm.size(), len);
+    }
+    CHECK(ok);
+    return len;
+}
+
+static void test_round_trips() {
+    const char *kinds[] = {"silence", "hiss", "sine", "speech", "noise", "square"};
+    const size_t sizes[] = {1, 4, 5, 17, 160, 511, (size_t)LOSSLESS_BLOCK_SAMPLES};
+    for (const char *kind : kinds) {
+        for (size_t n : sizes) {
+            for (uint32_t seed = 1; seed <= 3; seed++) {
+                check_round_trip(make_signal(kind, n, seed), kind);
+            }
+        }
+    }
+}
+
+static void test_compresses_where_it_should() {
+    size_t full = LOSSLESS_BLOCK_HEADER_LEN + 2 * LOSSLESS_BLOCK_SAMPLES;
+    CHECK(check_round_trip(make_signal("silence", LOSSLESS_BLOCK_SAMPLES, 1), "silence") < full / 10);
+    CHECK(check_round_trip(make_signal("speech", LOSSLESS_BLOCK_SAMPLES, 1), "speech") < full * 3 / 4);
+
+    // White full-scale noise cannot compress: it must fall back to verbatim, not grow
+    std::vector<int16_t> noise = make_signal("noise", LOSSLESS_BLOCK_SAMPLES, 1);
+    uint8_t block[LOSSLESS_MAX_PACKET_BYTES];
+    CHECK(lossless_encode_block(noise.data(), noise.size(), block, sizeof(block)) == full);
+    CHECK(block[0] == LOSSLESS_ORDER_VERBATIM);
+}
+
+static void test_rejects_bad_arguments() {
+    int16_t pcm[8] = {};
+    uint8_t block[64];
+    CHECK(lossless_encode_block(nullptr, 8, block, sizeof(block)) == 0);
+    CHECK(lossless_encode_block(pcm, 8, nullptr, sizeof(block)) == 0);
+    CHECK(lossless_encode_block(pcm, 0, block, sizeof(block)) == 0);
+    CHECK(lossless_encode_block(pcm, 8, block, LOSSLESS_BLOCK_HEADER_LEN + 15) == 0); // Below the verbatim size
+}
+
+static void test_send_path_frames_each_block() {
+    g_host_audio_packets.clear();
+    reset_lossless_stream();
+    std::vector<int16_t> pcm = make_signal("speech", LOSSLESS_BLOCK_SAMPLES, 2);
+    process_and_send_lossless_audio(BLE_CHANNEL_AUDIO_LOSSLESS, pcm.data(), pcm.size(), 1000);
+    process_and_send_lossless_audio(BLE_CHANNEL_AUDIO_LOSSLESS, pcm.data(), pcm.size(), 33000);
+    CHECK(g_host_audio_packets.size() == 2);
+    if (g_host_audio_packets.size() == 2) {
+        CHECK(g_host_audio_packets[0].sequence + 1 == g_host_audio_packets[1].sequence);
+        CHECK(g_host_audio_packets[1].timestamp_us == 33000);
+        std::vector<int16_t> decoded;
+        const std::vector<uint8_t> &data = g_host_audio_packets[1].data;
+        CHECK(decode_block(data.data(), data.size(), decoded) && decoded == pcm);
+    }
+}
+
+static void benchmark() {
+    const int blocks = 2000;
+    std::vector<int16_t> pcm = make_signal("speech", LOSSLESS_BLOCK_SAMPLES * 16, 7);
+    uint8_t block[LOSSLESS_MAX_PACKET_BYTES];
+    size_t total = 0;
+    int64_t start = test_now_ns();
+    for (int b = 0; b < blocks; b++) {
+        const int16_t *src = pcm.data() + (b % 16) * LOSSLESS_BLOCK_SAMPLES;
+        total += lossless_encode_block(src, LOSSLESS_BLOCK_SAMPLES, block, sizeof(block));
+    }
+    int64_t elapsed = test_now_ns() - start;
+    double ratio = (double)blocks * LOSSLESS_BLOCK_SAMPLES * 2 / (double)total;
+    printf("benchmark: lossless encode %.2f us per %d-sample block (host), ratio %.2f on synthetic speech\n",
+           elapsed / 1000.0 / blocks, LOSSLESS_BLOCK_SAMPLES, ratio);
+}
+
+int main() {
+    test_round_trips();
+    test_compresses_where_it_should();
+    test_rejects_bad_arguments();
+    test_send_path_frames_each_block();
+    benchmark();
+    return test_result("test_audio_lossless");
+}
@@ -0,0 +1,110 @@
+// Opus speech encoder: with libopus on the host, an encode smoke test (packet sizes, bitrate,
+// decodable output with the right level) and a per-frame benchmark; without it, that the
+// module reports the codec as unavailable.
+
+#include "audio_opus.h"
+#include "config.h"
+#include "host_stubs.h"
+#include "test_util.h"
+#include <math.h>
+#include <vector>
+
+#if __has_include(<opus.h>)
+#include <opus.h>
+
+static std::vector<int16_t> make_voice(size_t n, uint32_t rate) {
+    std::vector<int16_t> pcm(n);
+    for (size_t i = 0; i < n; i++) {
+        double t = (double)i / rate;
+        double v = 0;
+        for (int h = 1; h <= 12; h++) {
+            v += 2500.0 / h * sin(2 * M_PI * 130 * h * t + h);
+        }
+        pcm[i] = (int16_t)(v * (0.6 + 0.4 * sin(2 * M_PI * 3 * t)));
+    }
+    return pcm;
+}
+
+static double rms(const int16_t *pcm, size_t n) {
+    double sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += (double)pcm[i] * pcm[i];
+    }
+    return sqrt(sum / n);
+}
+
+static void test_encode_smoke(uint32_t rate) {
+    CHECK(initialize_opus_encoder(rate));
+    reset_opus_stream();
+    g_host_audio_packets.clear();
+
+    size_t frame = rate * OPUS_FRAME_MS / 1000;
+    const int frames = 100; // 2 s
+    std::vector<int16_t> pcm = make_voice(frame * frames, rate);
+    CHECK(process_and_send_opus_audio(BLE_CHANNEL_AUDIO_OPUS, pcm.data(), frame - 1, 0) == 0); // Wrong frame size
+    size_t total = 0;
+    for (int f = 0; f < frames; f++) {
+        size_t encoded = process_and_send_opus_audio(BLE_CHANNEL_AUDIO_OPUS, &pcm[f * frame], frame, f * OPUS_FRAME_MS * 1000);
+        CHECK(encoded > 0 && encoded <= OPUS_MAX_PACKET_BYTES);
+        total += encoded;
+    }
+    CHECK(g_host_audio_packets.size() == (size_t)frames);
+    double kbps = total * 8.0 / (frames * OPUS_FRAME_MS);
+    printf("opus %u Hz: %.1f kbit/s average\n", rate, kbps);
+    CHECK(kbps > OPUS_BITRATE_BPS / 1000.0 * 0.5 && kbps < OPUS_BITRATE_BPS / 1000.0 * 1.5);
+
+    // The packets decode, and the speech comes back at about the level it went in
+    int err = 0;
+    OpusDecoder *decoder = opus_decoder_create(rate, 1, &err);
+    CHECK(err == OPUS_OK);
+    std::vector<int16_t> decoded(frame);
+    double in_rms = 0, out_rms = 0;
+    for (size_t f = 0; f < g_host_audio_packets.size(); f++) {
+        const HostAudioPacket &packet = g_host_audio_packets[f];
+        CHECK(packet.sequence == f);
+        int n = opus_decode(decoder, packet.data.data(), (opus_int32)packet.data.size(), decoded.data(), (int)frame, 0);
+        CHECK(n == (int)frame);
+        if (f >= 10) { // Past the encoder's start-up
+            in_rms += rms(&pcm[f * frame], frame);
+            out_rms += rms(decoded.data(), frame);
+        }
+    }
+    opus_decoder_destroy(decoder);
+    CHECK_NEAR(out_rms / in_rms, 1.0, 0.25);
+}
+
+static void benchmark() {
+    CHECK(initialize_opus_encoder(SAMPLE_RATE));
+    std::vector<int16_t> pcm = make_voice(OPUS_FRAME_SAMPLES * 50, SAMPLE_RATE);
+    g_host_audio_packets.clear();
+    const int frames = 500;
+    int64_t start = test_now_ns();
+    for (int f = 0; f < frames; f++) {
+        process_and_send_opus_audio(BLE_CHANNEL_AUDIO_OPUS, &pcm[(f % 50) * OPUS_FRAME_SAMPLES], OPUS_FRAME_SAMPLES, 0);
+    }
+    int64_t elapsed = test_now_ns() - start;
+    g_host_audio_packets.clear();
+    printf("benchmark: opus encode %.1f us per %d ms frame at complexity %d (host)\n", elapsed / 1000.0 / frames,
+           OPUS_FRAME_MS, OPUS_COMPLEXITY);
+}
+
+int main() {
+    test_encode_smoke(SAMPLE_RATE);
+    test_encode_smoke(SAMPLE_RATE / 2);
+    benchmark();
+    return test_result("test_audio_opus");
+}
+
+#else
+
+int main() {
+    // Built without libopus: the codec must say so instead of sending empty frames
+    CHECK(!initialize_opus_encoder(SAMPLE_RATE));
+    int16_t pcm[OPUS_FRAME_SAMPLES] = {};
+    CHECK(process_and_send_opus_audio(BLE_CHANNEL_AUDIO_OPUS, pcm, OPUS_FRAME_SAMPLES, 0) == 0);
+    CHECK(g_host_audio_packets.empty());
+    printf("test_audio_opus: libopus not found, encoder smoke test and benchmark skipped\n");
+    return test_result("test_audio_opus");
+}
+
+#endif
@@ -0,0 +1,165 @@
+// Voice activity detector on synthetic audio (room noise, voiced speech, hiss, pauses), and
+// the u-law chunk lengths that keep silence markers unambiguous.
+
+#include "audio_vad.h"
+#include "config.h"
+#include "test_util.h"
+#include <math.h>
+#include <vector>
+
+static const size_t FRAME_MS = 20;
+static const size_t FRAME = SAMPLE_RATE * FRAME_MS / 1000;
+
+// Low-passed noise of the given RMS, like a quiet room through the microphone
+static void room_noise(TestRng &rng, double rms, int16_t *pcm, size_t n, double *state) {
+    for (size_t i = 0; i < n; i++) {
+        *state = 0.9 * *state + 0.1 * rng.range(-1000, 1001) / 1000.0;
+        pcm[i] = (int16_t)lrint(*state * rms * 7.6); // Filter gain ~1/7.6 for this input
+    }
+}
+
+// Voiced speech: harmonics of a 150 Hz pitch
+static void voiced(size_t start, double amplitude, int16_t *pcm, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        double t = (double)(start + i) / SAMPLE_RATE;
+        double v = 0;
+        for (int h = 1; h <= 6; h++) {
+            v += amplitude / h * sin(2 * M_PI * 150 * h * t);
+        }
+        pcm[i] = (int16_t)lrint(v);
+    }
+}
+
+// White noise: about half the samples change sign
+static void hiss(TestRng &rng, int amplitude, int16_t *pcm, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        pcm[i] = (int16_t)rng.range(-amplitude, amplitude + 1);
+    }
+}
+
+static void test_speech_and_silence() {
+    VadState vad;
+    vad_reset(vad);
+    TestRng rng = {3};
+    double filter = 0;
+    int16_t pcm[FRAME];
+
+    // A second of room noise: silence throughout, and the floor settles near its energy
+    for (int f = 0; f < 50; f++) {
+        room_noise(rng, 30, pcm, FRAME, &filter);
+        CHECK(!vad_process_frame(vad, pcm, FRAME, SAMPLE_RATE));
+    }
+    CHECK(vad.noise_floor > 300 && vad.noise_floor < 2000);
+
+    // Speech onset is detected in its first frame
+    voiced(0, 3000, pcm, FRAME);
+    CHECK(vad_process_frame(vad, pcm, FRAME, SAMPLE_RATE));
+    for (int f = 1; f < 25; f++) {
+        voiced(f * FRAME, 3000, pcm, FRAME);
+        CHECK(vad_process_frame(vad, pcm, FRAME, SAMPLE_RATE));
+    }
+
+    // The hangover keeps sending through VAD_HANGOVER_MS of pause, then it stops
+    int hangover_frames = 0;
+    for (int f = 0; f < 50; f++) {
+        room_noise(rng, 30, pcm, FRAME, &filter);
+        if (vad_process_frame(vad, pcm, FRAME, SAMPLE_RATE)) {
+            CHECK(hangover_frames == f); // One contiguous run from the end of speech
+            hangover_frames++;
+        }
+    }
+    CHECK(hangover_frames * FRAME_MS >= VAD_HANGOVER_MS - FRAME_MS);
+    CHECK(hangover_frames * FRAME_MS <= VAD_HANGOVER_MS);
+}
+
+static void test_quiet_speech_needs_margin() {
+    // Speech barely above the room noise is not enough; 6 dB above it is
+    VadState vad;
+    vad_reset(vad);
+    TestRng rng = {4};
+    double filter = 0;
+    int16_t pcm[FRAME];
+    for (int f = 0; f < 50; f++) {
+        room_noise(rng, 200, pcm, FRAME, &filter);
+        vad_process_frame(vad, pcm, FRAME, SAMPLE_RATE);
+    }
+    uint32_t floor = vad.noise_floor;
+    // Harmonic sum RMS ~ amplitude * 0.9; choose energies at 1.5x and 8x the floor
+    double quiet = sqrt(floor * 1.5) / 0.9, loud = sqrt(floor * 8.0) / 0.9;
+    voiced(0, quiet, pcm, FRAME);
+    CHECK(!vad_process_frame(vad, pcm, FRAME, SAMPLE_RATE));
+    voiced(FRAME, loud, pcm, FRAME);
+    CHECK(vad_process_frame(vad, pcm, FRAME, SAMPLE_RATE));
+}
+
+static void test_steady_hiss_is_not_speech() {
+    // Broadband noise louder than the floor (a fan switching on) is rejected by its
+    // zero-crossing rate, and the floor adapts to it
+    VadState vad;
+    vad_reset(vad);
+    TestRng rng = {5};
+    int16_t pcm[FRAME] = {};
+    for (int f = 0; f < 10; f++) {
+        vad_process_frame(vad, pcm, FRAME, SAMPLE_RATE); // Digital silence
+    }
+    CHECK(vad.noise_floor == VAD_MIN_NOISE_FLOOR);
+    int early_speech = 0, late_speech = 0;
+    uint32_t zcr_sum = 0;
+    for (int f = 0; f < 100; f++) {
+        hiss(rng, 300, pcm, FRAME);
+        bool speech = vad_process_frame(vad, pcm, FRAME, SAMPLE_RATE);
+        (f < 50 ? early_speech : late_speech) += speech;
+        zcr_sum += vad.last_zcr_per_mille;
+    }
+    CHECK(zcr_sum / 100 > VAD_MAX_ZCR_PER_MILLE);
+    // A frame whose crossings dip below the limit may pass (with its hangover) until the
+    // floor has caught up, after which the hiss is silence
+    printf("hiss: %d of the first 50 frames sent\n", early_speech);
+    CHECK(early_speech <= 25);
+    CHECK(late_speech == 0);
+    CHECK(vad.noise_floor > 10000); // 300 / sqrt(3) squared is 30000
+
+    // Very loud broadband sound (a fricative) still counts
+    hiss(rng, 20000, pcm, FRAME);
+    CHECK(vad_process_frame(vad, pcm, FRAME, SAMPLE_RATE));
+}
+
+static void test_ignores_bad_arguments() {
+    VadState vad;
+    vad_reset(vad);
+    int16_t pcm[FRAME] = {};
+    CHECK(!vad_process_frame(vad, nullptr, FRAME, SAMPLE_RATE));
+    CHECK(!vad_process_frame(vad, pcm, 0, SAMPLE_RATE));
+    CHECK(!vad_process_frame(vad, pcm, FRAME, 0));
+    CHECK(!vad.initialized); // None of them touched the state
+}
+
+static void test_ulaw_chunks_never_look_like_markers() {
+    // Every frame size against every packet size the parameter allows, and small MTUs
+    for (size_t max_len = 1; max_len <= 300; max_len++) {
+        for (size_t frame = 1; frame <= 2 * FRAME; frame++) {
+            size_t left = frame;
+            while (left > 0) {
+                size_t len = vad_ulaw_chunk_len(left, max_len);
+                if (len == 0 || len > max_len || len > left || len == AUDIO_SILENCE_MARKER_LEN) {
+                    fprintf(stderr, "frame %zu, max %zu: chunk of %zu with %zu left\n", frame, max_len, len, left);
+                    CHECK(false);
+                    break;
+                }
+                left -= len;
+            }
+        }
+    }
+    CHECK(vad_ulaw_chunk_len(160, 100) == 100);
+    CHECK(vad_ulaw_chunk_len(60, 100) == 60);
+    CHECK(vad_ulaw_chunk_len(5, 100) == 4);
+}
+
+int main() {
+    test_speech_and_silence();
+    test_quiet_speech_needs_margin();
+    test_steady_hiss_is_not_speech();
+    test_ignores_bad_arguments();
+    test_ulaw_chunks_never_look_like_markers();
+    return test_result("test_audio_vad");
+}
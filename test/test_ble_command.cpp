@@ -0,0 +1,172 @@
+// Command decoding from raw characteristic writes: every channel against every write length
+// up to past the longest command, malformed contents, and dispatch to the handlers.
+
+#include "ble_command.h"
+#include "config.h"
+#include "param_registry.h"
+#include "test_util.h"
+#include <string.h>
+
+// Write lengths a channel accepts, for the exhaustive length sweep
+static bool length_valid(BleChannel channel, size_t len) {
+    switch (channel) {
+        case BLE_CHANNEL_PHOTO_CONTROL: return len == 1;
+        case BLE_CHANNEL_AUDIO_FORMAT: return len == 2;
+        case BLE_CHANNEL_AUDIO_REPLAY: return len == 2 || len == 6;
+        case BLE_CHANNEL_WIFI_OFFLOAD:
+        case BLE_CHANNEL_OTA_CONTROL: return len >= 1 && len <= BLE_COMMAND_MAX_PAYLOAD;
+        case BLE_CHANNEL_PARAM_CONFIG: return len == 1 || len == 5;
+        default: return false;
+    }
+}
+
+static void test_every_length_on_every_channel() {
+    uint8_t data[BLE_COMMAND_MAX_PAYLOAD + 8];
+    memset(data, 0, sizeof(data)); // Parameter id 0 exists
+    for (int c = 0; c < BLE_CHANNEL_COUNT; c++) {
+        BleChannel channel = (BleChannel)c;
+        for (size_t len = 0; len <= sizeof(data); len++) {
+            BleCommand command;
+            memset(&command, 0xA5, sizeof(command));
+            const char *error = nullptr;
+            bool ok = ble_command_decode_write(7, channel, data, len, 1234, &command, &error);
+            if (ok != length_valid(channel, len)) {
+                fprintf(stderr, "channel %d, %zu bytes: decoded %d\n", c, len, ok);
+            }
+            CHECK(ok == length_valid(channel, len));
+            if (ok) {
+                CHECK(command.channel == channel && command.conn == 7 && command.received_us == 1234);
+                CHECK(command.type != BLE_CMD_NONE);
+            } else {
+                CHECK(error != nullptr && error[0] != '\0');
+            }
+        }
+    }
+}
+
+static void test_empty_write_has_no_data() {
+    // A zero-length write may arrive with no buffer at all
+    BleCommand command;
+    const char *error = nullptr;
+    CHECK(!ble_command_decode_write(0, BLE_CHANNEL_PHOTO_CONTROL, nullptr, 0, 0, &command, &error));
+    CHECK(strcmp(error, "received empty data") == 0);
+    CHECK(!ble_command_decode_write(0, BLE_CHANNEL_OTA_CONTROL, nullptr, 0, 0, &command, &error));
+    CHECK(!ble_command_decode_write(0, BLE_CHANNEL_PARAM_CONFIG, nullptr, 0, 0, &command, nullptr)); // No error pointer
+}
+
+static void test_decoded_values() {
+    BleCommand command;
+    const char *error = nullptr;
+
+    const uint8_t photo[] = {0xFB}; // -5: one photo every 5 s
+    CHECK(ble_command_decode_write(0, BLE_CHANNEL_PHOTO_CONTROL, photo, 1, 0, &command, &error));
+    CHECK(command.type == BLE_CMD_PHOTO_CONTROL && command.photo_control == -5);
+
+    const uint8_t rate[] = {0x40, 0x1F}; // 8000
+    CHECK(ble_command_decode_write(0, BLE_CHANNEL_AUDIO_FORMAT, rate, 2, 0, &command, &error));
+    CHECK(command.type == BLE_CMD_AUDIO_SAMPLE_RATE && command.sample_rate == 8000);
+
+    const uint8_t replay_short[] = {0x34, 0x12};
+    CHECK(ble_command_decode_write(0, BLE_CHANNEL_AUDIO_REPLAY, replay_short, 2, 0, &command, &error));
+    CHECK(command.replay_from == 0x1234 && command.replay_rate == AUDIO_REPLAY_CATCHUP_BYTES_PER_SEC);
+    const uint8_t replay_long[] = {0xFF, 0xFF, 0x78, 0x56, 0x34, 0x92};
+    CHECK(ble_command_decode_write(0, BLE_CHANNEL_AUDIO_REPLAY, replay_long, 6, 0, &command, &error));
+    CHECK(command.replay_from == 0xFFFF && command.replay_rate == 0x92345678u); // Top bit survives
+
+    uint8_t ota[BLE_COMMAND_MAX_PAYLOAD];
+    for (size_t i = 0; i < sizeof(ota); i++) {
+        ota[i] = (uint8_t)(i * 7);
+    }
+    CHECK(ble_command_decode_write(0, BLE_CHANNEL_OTA_CONTROL, ota, sizeof(ota), 0, &command, &error));
+    CHECK(command.type == BLE_CMD_OTA_CONTROL && command.payload_len == sizeof(ota));
+    CHECK(memcmp(command.payload, ota, sizeof(ota)) == 0);
+    CHECK(!ble_command_decode_write(0, BLE_CHANNEL_OTA_CONTROL, ota, sizeof(ota) + 1, 0, &command, &error));
+    CHECK(strcmp(error, "too long") == 0);
+}
+
+static void test_param_config_ids() {
+    BleCommand command;
+    const char *error = nullptr;
+    uint8_t write[5] = {0, 0x10, 0x27, 0, 0x80}; // Value 0x80002710
+    for (int id = 0; id < 256; id++) {
+        write[0] = (uint8_t)id;
+        bool select = ble_command_decode_write(0, BLE_CHANNEL_PARAM_CONFIG, write, 1, 0, &command, &error);
+        CHECK(select == (id < PARAM_COUNT || id == PARAM_RESET_ALL));
+        if (select) {
+            CHECK(command.param_id == id && !command.param_set);
+        } else {
+            CHECK(strcmp(error, "unknown parameter id") == 0);
+        }
+        // Reset-all takes no value: it cannot be "set"
+        bool set = ble_command_decode_write(0, BLE_CHANNEL_PARAM_CONFIG, write, 5, 0, &command, &error);
+        CHECK(set == (id < PARAM_COUNT));
+        if (set) {
+            CHECK(command.param_set && command.param_value == 0x80002710u);
+        }
+    }
+    CHECK(!ble_command_decode_write(0, BLE_CHANNEL_PARAM_CONFIG, write, 3, 0, &command, &error));
+    CHECK(strcmp(error, "expected an id (+ 4-byte value)") == 0);
+}
+
+// --- Dispatch ---
+static int s_calls = 0;
+static int8_t s_photo = 0;
+static BleChannel s_channel = BLE_CHANNEL_COUNT;
+static bool s_enabled = false;
+static size_t s_payload_len = 0;
+static uint16_t s_conn = 0;
+
+static void on_photo(int8_t value) { s_calls++; s_photo = value; }
+static void on_subscribe(uint16_t conn, BleChannel channel, bool enabled) { s_calls++; s_conn = conn; s_channel = channel; s_enabled = enabled; }
+static void on_payload(const uint8_t *, size_t len) { s_calls++; s_payload_len = len; }
+static void on_replay(uint16_t conn, uint16_t, uint32_t) { s_calls++; s_conn = conn; }
+
+static void test_dispatch() {
+    BleCommandHandlers handlers = {};
+    handlers.photo_control = on_photo;
+    handlers.subscribe = on_subscribe;
+    handlers.ota_control = on_payload;
+    handlers.audio_replay = on_replay;
+
+    BleCommand command;
+    const uint8_t photo[] = {3};
+    CHECK(ble_command_decode_write(0, BLE_CHANNEL_PHOTO_CONTROL, photo, 1, 0, &command, nullptr));
+    CHECK(ble_command_dispatch(command, handlers));
+    CHECK(s_calls == 1 && s_photo == 3);
+
+    CHECK(ble_command_dispatch(ble_command_subscribe(5, BLE_CHANNEL_AUDIO_OPUS, true, 0), handlers));
+    CHECK(s_calls == 2 && s_conn == 5 && s_channel == BLE_CHANNEL_AUDIO_OPUS && s_enabled);
+
+    const uint8_t ota[] = {1, 2, 3};
+    CHECK(ble_command_decode_write(0, BLE_CHANNEL_OTA_CONTROL, ota, 3, 0, &command, nullptr));
+    CHECK(ble_command_dispatch(command, handlers));
+    CHECK(s_calls == 3 && s_payload_len == 3);
+
+    // The backlog goes to the client that asked for it
+    const uint8_t replay[] = {0, 0};
+    CHECK(ble_command_decode_write(42, BLE_CHANNEL_AUDIO_REPLAY, replay, 2, 0, &command, nullptr));
+    CHECK(ble_command_dispatch(command, handlers));
+    CHECK(s_calls == 4 && s_conn == 42);
+
+    // No handler, or no command: nothing runs
+    const uint8_t rate[] = {0x80, 0x3E};
+    CHECK(ble_command_decode_write(0, BLE_CHANNEL_AUDIO_FORMAT, rate, 2, 0, &command, nullptr));
+    CHECK(!ble_command_dispatch(command, handlers));
+    BleCommand none;
+    memset(&none, 0, sizeof(none));
+    CHECK(!ble_command_dispatch(none, handlers));
+    CHECK(s_calls == 4);
+
+    for (int type = BLE_CMD_NONE; type <= BLE_CMD_OTA_CONTROL; type++) {
+        CHECK(ble_command_name((BleCommandType)type) != nullptr);
+    }
+}
+
+int main() {
+    test_every_length_on_every_channel();
+    test_empty_write_has_no_data();
+    test_decoded_values();
+    test_param_config_ids();
+    test_dispatch();
+    return test_result("test_ble_command");
+}
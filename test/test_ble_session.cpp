@@ -0,0 +1,103 @@
+// Per-client sessions and ble_session_notify() through a mock BLE transport: fan-out to the
+// subscribed clients, refusals reported per client for the TX scheduler's photo retry, and
+// the per-client statistics.
+
+#include "ble_session.h"
+#include "config.h"
+#include "host_stubs.h"
+#include "mock_ble_transport.h"
+#include "test_util.h"
+
+static MockBleTransport s_mock;
+
+static void close_all() {
+    for (uint16_t conn = 0; conn < 16; conn++) {
+        ble_session_close(conn);
+    }
+    s_mock.notifications.clear();
+    s_mock.refuse.clear();
+}
+
+static void test_fan_out_to_subscribers() {
+    int a = ble_session_open(1), b = ble_session_open(2), c = ble_session_open(3);
+    CHECK(a >= 0 && b >= 0 && c >= 0 && a != b && b != c);
+    CHECK(ble_session_open(4) == -1); // BLE_MAX_CONNECTIONS taken
+    ble_session_set_subscribed(1, BLE_CHANNEL_AUDIO_OPUS, true);
+    ble_session_set_subscribed(3, BLE_CHANNEL_AUDIO_OPUS, true);
+    ble_session_set_subscribed(2, BLE_CHANNEL_PHOTO_DATA, true);
+
+    BleSessionMask audio = ble_session_subscribers(BLE_CHANNEL_AUDIO_OPUS);
+    CHECK(audio == (BleSessionMask)((1u << a) | (1u << c)));
+
+    const uint8_t packet[] = {1, 2, 3, 4, 5};
+    CHECK(ble_session_notify(audio, BLE_CHANNEL_AUDIO_OPUS, packet, sizeof(packet)) == 0);
+    CHECK(s_mock.notifications.size() == 2);
+    CHECK(s_mock.count_for(1) == 1 && s_mock.count_for(3) == 1 && s_mock.count_for(2) == 0);
+    for (const MockBleTransport::Notification &n : s_mock.notifications) {
+        CHECK(n.channel == BLE_CHANNEL_AUDIO_OPUS);
+        CHECK(n.data == std::vector<uint8_t>(packet, packet + sizeof(packet)));
+    }
+
+    // A client that unsubscribed or left after the notification was queued is skipped
+    s_mock.notifications.clear();
+    ble_session_set_subscribed(3, BLE_CHANNEL_AUDIO_OPUS, false);
+    CHECK(ble_session_notify(audio, BLE_CHANNEL_AUDIO_OPUS, packet, sizeof(packet)) == 0);
+    ble_session_close(1);
+    CHECK(ble_session_notify(audio, BLE_CHANNEL_AUDIO_OPUS, packet, sizeof(packet)) == 0);
+    CHECK(s_mock.notifications.size() == 1 && s_mock.notifications[0].conn == 1);
+    close_all();
+}
+
+static void test_refusals_reported_per_client() {
+    int a = ble_session_open(7), b = ble_session_open(8);
+    ble_session_set_subscribed(7, BLE_CHANNEL_PHOTO_DATA, true);
+    ble_session_set_subscribed(8, BLE_CHANNEL_PHOTO_DATA, true);
+    BleSessionMask photo = ble_session_subscribers(BLE_CHANNEL_PHOTO_DATA);
+
+    uint8_t chunk[PHOTO_CHUNK_BUFFER_SIZE] = {};
+    s_mock.refuse.insert(8);
+    BleSessionMask refused = ble_session_notify(photo, BLE_CHANNEL_PHOTO_DATA, chunk, sizeof(chunk));
+    CHECK(refused == (BleSessionMask)(1u << b));
+
+    // The scheduler resends to the refused clients only; once the stack has room it goes through
+    s_mock.refuse.clear();
+    s_mock.notifications.clear();
+    CHECK(ble_session_notify(refused, BLE_CHANNEL_PHOTO_DATA, chunk, sizeof(chunk)) == 0);
+    CHECK(s_mock.notifications.size() == 1 && s_mock.notifications[0].conn == 8);
+
+    BleSession session;
+    CHECK(ble_session_get(a, &session));
+    CHECK(session.notifications == 1 && session.failed == 0 && session.bytes == sizeof(chunk));
+    CHECK(session.first_notify_ms >= 1);
+    CHECK(ble_session_get(b, &session));
+    CHECK(session.notifications == 1 && session.failed == 1 && session.bytes == sizeof(chunk));
+    close_all();
+}
+
+static void test_mtu_and_slot_reuse() {
+    int a = ble_session_open(10), b = ble_session_open(11);
+    CHECK(ble_session_min_mtu((BleSessionMask)((1u << a) | (1u << b))) == 23);
+    ble_session_set_mtu(10, 247);
+    ble_session_set_mtu(11, 185);
+    CHECK(ble_session_min_mtu((BleSessionMask)(1u << a)) == 247);
+    CHECK(ble_session_min_mtu((BleSessionMask)((1u << a) | (1u << b))) == 185);
+    CHECK(ble_session_min_mtu(0) == 23);
+
+    BleSession first, second;
+    CHECK(ble_session_get(a, &first));
+    ble_session_close(10);
+    CHECK(!ble_session_get(a, &second));
+    CHECK(ble_session_open(12) == a); // The freed slot, with a new id and fresh state
+    CHECK(ble_session_get(a, &second));
+    CHECK(second.id != first.id && second.mtu == 23 && second.subscriptions == 0 && second.conn == 12);
+    CHECK(ble_session_count() == 2);
+    close_all();
+}
+
+int main() {
+    ble_transport_install(&s_mock);
+    test_fan_out_to_subscribers();
+    test_refusals_reported_per_client();
+    test_mtu_and_slot_reuse();
+    return test_result("test_ble_session");
+}
@@ -0,0 +1,153 @@
+// Token-bucket TX policy on a simulated link: a 20ms audio stream and a photo upload that
+// always has a chunk ready share one link, as in the TX task of ble_tx_scheduler.cpp.
+
+#include "ble_tx_policy.h"
+#include "config.h"
+#include "test_util.h"
+
+static const size_t AUDIO_PACKET_LEN = AUDIO_FRAME_HEADER_LEN + 160;
+static const int64_t AUDIO_PERIOD_US = 20000;
+static const uint32_t LINK_BYTES_PER_SEC = 100000; // Air time of a notification
+
+struct LinkResult {
+    uint64_t audio_bytes;
+    uint64_t photo_bytes;
+    uint32_t audio_max_queue;
+    uint32_t idle_waits; // Times the policy asked the link to wait with data queued
+};
+
+// Runs duration_us of simulated time. photo_rate changes to photo_rate_after at switch_us.
+static LinkResult run_link(BleTxPolicy &policy, int64_t duration_us, int64_t switch_us, uint32_t photo_rate_after) {
+    LinkResult result = {};
+    uint32_t audio_queued = 0;
+    int64_t next_audio_us = 0;
+    int64_t now_us = 0;
+    bool switched = false;
+    while (now_us < duration_us) {
+        while (next_audio_us <= now_us) {
+            audio_queued++;
+            next_audio_us += AUDIO_PERIOD_US;
+        }
+        if (audio_queued > result.audio_max_queue) {
+            result.audio_max_queue = audio_queued;
+        }
+        if (!switched && now_us >= switch_us) {
+            ble_tx_policy_set_rate(policy, BLE_TX_STREAM_PHOTO, photo_rate_after, now_us);
+            switched = true;
+        }
+
+        size_t head_len[BLE_TX_STREAM_COUNT] = {audio_queued ? AUDIO_PACKET_LEN : 0, PHOTO_CHUNK_BUFFER_SIZE};
+        uint32_t wait_us = 0;
+        int stream = ble_tx_policy_select(policy, head_len, now_us, &wait_us);
+        if (stream == BLE_TX_STREAM_NONE) {
+            CHECK(wait_us > 0 && wait_us != UINT32_MAX); // Photo is always queued
+            result.idle_waits++;
+            int64_t wake_us = now_us + wait_us;
+            now_us = wake_us < next_audio_us ? wake_us : next_audio_us;
+            continue;
+        }
+        size_t len = head_len[stream];
+        if (stream == BLE_TX_STREAM_AUDIO) {
+            audio_queued--;
+            result.audio_bytes += len;
+        } else {
+            result.photo_bytes += len;
+        }
+        now_us += (int64_t)len * 1000000 / LINK_BYTES_PER_SEC;
+    }
+    return result;
+}
+
+static void test_photo_held_to_its_rate() {
+    const uint32_t rates[BLE_TX_STREAM_COUNT] = {0, BLE_TX_PHOTO_RATE_BYTES_PER_SEC};
+    const uint32_t bursts[BLE_TX_STREAM_COUNT] = {0, BLE_TX_PHOTO_BURST_BYTES};
+    BleTxPolicy policy;
+    ble_tx_policy_init(policy, rates, bursts, 0);
+
+    const int64_t duration_us = 10000000;
+    LinkResult r = run_link(policy, duration_us, duration_us, BLE_TX_PHOTO_RATE_BYTES_PER_SEC);
+
+    // Rate over the run plus the initial burst, within one chunk
+    double expected_photo = BLE_TX_PHOTO_RATE_BYTES_PER_SEC * 10.0 + BLE_TX_PHOTO_BURST_BYTES;
+    CHECK_NEAR((double)r.photo_bytes, expected_photo, PHOTO_CHUNK_BUFFER_SIZE);
+    // Every audio packet went out and none waited behind more than the chunk on the air
+    CHECK(r.audio_bytes >= (uint64_t)(duration_us / AUDIO_PERIOD_US - 1) * AUDIO_PACKET_LEN);
+    CHECK(r.audio_max_queue <= 1);
+    CHECK(r.idle_waits > 0);
+    CHECK(policy.stats[BLE_TX_STREAM_PHOTO].throttled >= r.idle_waits);
+    CHECK(policy.stats[BLE_TX_STREAM_AUDIO].throttled == 0);
+}
+
+static void test_rate_change_takes_effect() {
+    const uint32_t rates[BLE_TX_STREAM_COUNT] = {0, BLE_TX_PHOTO_RATE_BYTES_PER_SEC};
+    const uint32_t bursts[BLE_TX_STREAM_COUNT] = {0, BLE_TX_PHOTO_BURST_BYTES};
+    BleTxPolicy policy;
+    ble_tx_policy_init(policy, rates, bursts, 0);
+
+    // 2 s at the slow rate, then 4 s at the fast one: the link (100 kB/s) still has room
+    LinkResult r = run_link(policy, 6000000, 2000000, BLE_TX_PHOTO_FAST_RATE_BYTES_PER_SEC);
+    double expected_photo = BLE_TX_PHOTO_RATE_BYTES_PER_SEC * 2.0 + BLE_TX_PHOTO_FAST_RATE_BYTES_PER_SEC * 4.0 +
+                            BLE_TX_PHOTO_BURST_BYTES;
+    CHECK_NEAR((double)r.photo_bytes, expected_photo, 2 * PHOTO_CHUNK_BUFFER_SIZE);
+    CHECK(r.audio_max_queue <= 1);
+}
+
+static void test_unlimited_photo_fills_link_after_audio() {
+    const uint32_t rates[BLE_TX_STREAM_COUNT] = {0, 0};
+    const uint32_t bursts[BLE_TX_STREAM_COUNT] = {0, 0};
+    BleTxPolicy policy;
+    ble_tx_policy_init(policy, rates, bursts, 0);
+
+    LinkResult r = run_link(policy, 5000000, 5000000, 0);
+    CHECK(r.idle_waits == 0);
+    CHECK_NEAR((double)(r.audio_bytes + r.photo_bytes), LINK_BYTES_PER_SEC * 5.0, 2 * PHOTO_CHUNK_BUFFER_SIZE);
+    CHECK(r.audio_max_queue <= 1);
+}
+
+static void test_throttled_stream_does_not_block_lower() {
+    // Audio limited and out of tokens: the photo head below it still goes
+    const uint32_t rates[BLE_TX_STREAM_COUNT] = {1000, 0};
+    const uint32_t bursts[BLE_TX_STREAM_COUNT] = {100, 0};
+    BleTxPolicy policy;
+    ble_tx_policy_init(policy, rates, bursts, 0);
+
+    size_t heads[BLE_TX_STREAM_COUNT] = {100, 50};
+    uint32_t wait_us = 0;
+    CHECK(ble_tx_policy_select(policy, heads, 0, &wait_us) == BLE_TX_STREAM_AUDIO); // Full bucket
+    CHECK(ble_tx_policy_select(policy, heads, 0, &wait_us) == BLE_TX_STREAM_PHOTO);
+    CHECK(policy.stats[BLE_TX_STREAM_AUDIO].throttled == 1);
+
+    size_t audio_only[BLE_TX_STREAM_COUNT] = {100, 0};
+    CHECK(ble_tx_policy_select(policy, audio_only, 0, &wait_us) == BLE_TX_STREAM_NONE);
+    CHECK(wait_us == 100000); // 100 bytes at 1000 B/s
+    CHECK(ble_tx_policy_select(policy, audio_only, 99999, &wait_us) == BLE_TX_STREAM_NONE);
+    CHECK(wait_us == 1);
+    CHECK(ble_tx_policy_select(policy, audio_only, 100000, &wait_us) == BLE_TX_STREAM_AUDIO);
+
+    size_t empty[BLE_TX_STREAM_COUNT] = {0, 0};
+    CHECK(ble_tx_policy_select(policy, empty, 200000, &wait_us) == BLE_TX_STREAM_NONE);
+    CHECK(wait_us == UINT32_MAX);
+}
+
+static void test_oversized_head_admitted_by_full_bucket() {
+    const uint32_t rates[BLE_TX_STREAM_COUNT] = {0, 1000};
+    const uint32_t bursts[BLE_TX_STREAM_COUNT] = {0, 100};
+    BleTxPolicy policy;
+    ble_tx_policy_init(policy, rates, bursts, 0);
+
+    size_t heads[BLE_TX_STREAM_COUNT] = {0, 300};
+    uint32_t wait_us = 0;
+    CHECK(ble_tx_policy_select(policy, heads, 0, &wait_us) == BLE_TX_STREAM_PHOTO);
+    // The bucket went 200 bytes into debt; it waits for the debt plus a full bucket
+    CHECK(ble_tx_policy_select(policy, heads, 0, &wait_us) == BLE_TX_STREAM_NONE);
+    CHECK(wait_us == 300000);
+}
+
+int main() {
+    test_photo_held_to_its_rate();
+    test_rate_change_takes_effect();
+    test_unlimited_photo_fills_link_after_audio();
+    test_throttled_stream_does_not_block_lower();
+    test_oversized_head_admitted_by_full_bucket();
+    return test_result("test_ble_tx_policy");
+}
@@ -0,0 +1,96 @@
+// Clock-sync estimator under simulated BLE delays: connection-event latency in both
+// directions, plus occasional retransmission spikes on one side only.
+
+#include "clock_sync.h"
+#include "test_util.h"
+
+static const int64_t TRUE_OFFSET_US = 1700000000000000LL; // Client wall clock at device time 0
+static const double TRUE_DRIFT = 40e-6;                     // Client gains 40 ppm
+
+static int64_t client_time(int64_t device_us) {
+    return TRUE_OFFSET_US + device_us + (int64_t)(TRUE_DRIFT * (double)device_us);
+}
+
+// One-way delay of a notification or write: up to one 30ms connection interval, and a spike
+// of one to three retransmissions one time in five
+static int64_t link_delay_us(TestRng &rng) {
+    int64_t delay = rng.range(1000, 30000);
+    if (rng.range(0, 5) == 0) {
+        delay += 30000 * rng.range(1, 4);
+    }
+    return delay;
+}
+
+static void simulate(ClockSyncEstimator &est, TestRng &rng, int exchanges, int64_t *device_now_us) {
+    for (int i = 0; i < exchanges; i++) {
+        int64_t d1 = *device_now_us;
+        int64_t t1 = client_time(d1);
+        int64_t t2 = d1 + link_delay_us(rng);
+        int64_t t3 = t2 + rng.range(100, 2000); // Reply from the BLE callback
+        int64_t t4 = client_time(t3 + link_delay_us(rng));
+        CHECK(clock_sync_add_exchange(est, t1, t2, t3, t4));
+        *device_now_us += 5000000; // One exchange every 5 s
+    }
+}
+
+static void test_converges_under_ble_delay() {
+    // Several link histories: the bounds must not depend on one lucky seed
+    const uint32_t seeds[] = {1, 7, 99, 1234, 4242, 31337};
+    for (uint32_t seed : seeds) {
+        ClockSyncEstimator est;
+        clock_sync_reset(est);
+        TestRng rng = {seed};
+        int64_t device_us = 10000000;
+        simulate(est, rng, 2 * (int)CLOCK_SYNC_WINDOW, &device_us);
+
+        // Over the window, the mapping error stays within the delay asymmetry of the fastest
+        // exchanges; one-way delays reach 30 ms, spikes 120 ms
+        for (int64_t probe = device_us - 300000000; probe <= device_us; probe += 30000000) {
+            int64_t error_us = clock_sync_device_to_client_us(est, probe) - client_time(probe);
+            CHECK_NEAR(error_us, 0, 5000);
+        }
+        CHECK_NEAR(clock_sync_drift_ppb(est), TRUE_DRIFT * 1e9, 30000);
+        CHECK(est.samples_used <= CLOCK_SYNC_WINDOW / 2 + 1);
+    }
+}
+
+static void test_symmetric_delay_is_exact() {
+    // Equal delays both ways: the fit recovers offset and drift up to rounding
+    ClockSyncEstimator est;
+    clock_sync_reset(est);
+    int64_t device_us = 10000000;
+    for (int i = 0; i < (int)CLOCK_SYNC_WINDOW; i++) {
+        int64_t t2 = device_us + 15000;
+        CHECK(clock_sync_add_exchange(est, client_time(device_us), t2, t2 + 500, client_time(t2 + 500 + 15000)));
+        device_us += 5000000;
+    }
+    CHECK_NEAR(clock_sync_device_to_client_us(est, device_us) - client_time(device_us), 0, 20);
+    CHECK_NEAR(clock_sync_drift_ppb(est), TRUE_DRIFT * 1e9, 200);
+}
+
+static void test_single_exchange_gives_offset() {
+    ClockSyncEstimator est;
+    clock_sync_reset(est);
+    CHECK(clock_sync_device_to_client_us(est, 42) == 42); // Identity before any exchange
+    // Symmetric 10ms delays: the offset is exact
+    int64_t t1 = client_time(1000000);
+    CHECK(clock_sync_add_exchange(est, t1, 1010000, 1010500, client_time(1020500)));
+    CHECK_NEAR(clock_sync_device_to_client_us(est, 1010250) - client_time(1010250), 0, 2);
+    CHECK(est.last_rtt_us == 20000);
+}
+
+static void test_rejects_inconsistent_exchange() {
+    ClockSyncEstimator est;
+    clock_sync_reset(est);
+    CHECK(!clock_sync_add_exchange(est, 1000, 500, 400, 2000));  // t3 before t2
+    CHECK(!clock_sync_add_exchange(est, 1000, 500, 1600, 1500)); // Device held it longer than the round trip
+    CHECK(!est.valid);
+}
+
+int main() {
+    test_converges_under_ble_delay();
+    test_symmetric_delay_is_exact();
+    test_single_exchange_gives_offset();
+    test_rejects_inconsistent_exchange();
+    return test_result("test_clock_sync");
+}
@@ -0,0 +1,239 @@
+// Wi-Fi offload HTTP upload against a loopback server: chunked framing of several spans, the
+// continuation after partial sendmsg() calls, and the result for 2xx, non-2xx, missing and
+// refused replies.
+
+#include "offload_http.h"
+#include "test_util.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// --- sendmsg() that accepts at most s_send_cap bytes per call, to exercise partial sends.
+// The test executable's definition takes precedence over the C library's. ---
+static size_t s_send_cap = 0; // 0 = no limit
+static int s_send_calls = 0;
+
+extern "C" ssize_t sendmsg(int fd, const struct msghdr *message, int) {
+    s_send_calls++;
+    std::vector<struct iovec> iov(message->msg_iov, message->msg_iov + message->msg_iovlen);
+    if (s_send_cap) {
+        size_t budget = s_send_cap;
+        size_t used = 0;
+        for (; used < iov.size() && budget > 0; used++) {
+            if (iov[used].iov_len > budget) {
+                iov[used].iov_len = budget;
+            }
+            budget -= iov[used].iov_len;
+        }
+        iov.resize(used);
+    }
+    return writev(fd, iov.data(), (int)iov.size());
+}
+
+// --- One-request loopback server ---
+struct ServerRequest {
+    std::string head;                // Request line and headers
+    std::vector<size_t> chunk_sizes; // As framed on the wire, without the final 0
+    std::string body;
+    bool complete = false;           // The terminating chunk arrived and the framing was valid
+};
+
+// Parses a chunked request. Returns false while more data is needed.
+static bool parse_request(const std::string &raw, ServerRequest *request) {
+    size_t head_end = raw.find("\r\n\r\n");
+    if (head_end == std::string::npos) {
+        return false;
+    }
+    ServerRequest parsed;
+    parsed.head = raw.substr(0, head_end + 2);
+    size_t pos = head_end + 4;
+    while (true) {
+        size_t line_end = raw.find("\r\n", pos);
+        if (line_end == std::string::npos) {
+            return false;
+        }
+        size_t size = strtoul(raw.substr(pos, line_end - pos).c_str(), nullptr, 16);
+        pos = line_end + 2;
+        if (raw.size() < pos + size + 2) {
+            return false;
+        }
+        if (raw.compare(pos + size, 2, "\r\n") != 0) {
+            *request = parsed; // Framing error: complete stays false
+            return true;
+        }
+        if (size == 0) {
+            parsed.complete = pos + 2 == raw.size();
+            *request = parsed;
+            return true;
+        }
+        parsed.chunk_sizes.push_back(size);
+        parsed.body.append(raw, pos, size);
+        pos += size + 2;
+    }
+}
+
+class LoopbackServer {
+public:
+    ServerRequest request;
+    int port = 0;
+
+    // reply = nullptr closes the connection without answering
+    explicit LoopbackServer(const char *reply) : reply_(reply) {
+        listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(listen_fd_, (struct sockaddr *)&addr, sizeof(addr));
+        listen(listen_fd_, 1);
+        socklen_t len = sizeof(addr);
+        getsockname(listen_fd_, (struct sockaddr *)&addr, &len);
+        port = ntohs(addr.sin_port);
+        thread_ = std::thread([this] { serve(); });
+    }
+    ~LoopbackServer() {
+        wait();
+        close(listen_fd_);
+    }
+    void wait() {
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+private:
+    void serve() {
+        int fd = accept(listen_fd_, nullptr, nullptr);
+        if (fd < 0) {
+            return;
+        }
+        std::string raw;
+        char buf[1024];
+        while (!parse_request(raw, &request)) {
+            ssize_t got = recv(fd, buf, sizeof(buf), 0);
+            if (got <= 0) {
+                break;
+            }
+            raw.append(buf, (size_t)got);
+        }
+        if (reply_) {
+            send(fd, reply_, strlen(reply_), MSG_NOSIGNAL);
+        }
+        close(fd);
+    }
+
+    const char *reply_;
+    int listen_fd_;
+    std::thread thread_;
+};
+
+static const char *REPLY_200 = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+static const uint32_t LOOPBACK = htonl(INADDR_LOOPBACK); // Network byte order, as offload_http_post() takes it
+
+static std::vector<uint8_t> make_bytes(size_t n, uint8_t seed) {
+    std::vector<uint8_t> bytes(n);
+    for (size_t i = 0; i < n; i++) {
+        bytes[i] = (uint8_t)(i * 31 + seed);
+    }
+    return bytes;
+}
+
+static void test_chunked_spans(size_t send_cap) {
+    s_send_cap = send_cap;
+    s_send_calls = 0;
+    // A JPEG split across the end of a PSRAM ring, and a trailer: three spans, one empty
+    std::vector<uint8_t> first = make_bytes(1300, 1), second = make_bytes(777, 2), third;
+    OffloadSpan spans[] = {{first.data(), first.size()}, {third.data(), 0}, {second.data(), second.size()}};
+
+    LoopbackServer server(REPLY_200);
+    OffloadUploadResult result;
+    bool ok = offload_http_post(LOOPBACK, (uint16_t)server.port, "/photo", "image/jpeg", "X-Frame: 42\r\n", spans, 3,
+                                512, 2000, &result);
+    server.wait();
+    s_send_cap = 0;
+
+    CHECK(ok);
+    CHECK(result.http_status == 200 && result.error == 0);
+    CHECK(result.body_bytes == first.size() + second.size());
+    const ServerRequest &r = server.request;
+    CHECK(r.complete);
+    CHECK(r.head.rfind("POST /photo HTTP/1.1\r\n", 0) == 0);
+    CHECK(r.head.find("Transfer-Encoding: chunked\r\n") != std::string::npos);
+    CHECK(r.head.find("Content-Type: image/jpeg\r\n") != std::string::npos);
+    CHECK(r.head.find("X-Frame: 42\r\n") != std::string::npos);
+    // Chunks never span two spans, and none is larger than chunk_bytes
+    std::vector<size_t> expected_chunks = {512, 512, 276, 512, 265};
+    CHECK(r.chunk_sizes == expected_chunks);
+    std::string expected_body((const char *)first.data(), first.size());
+    expected_body.append((const char *)second.data(), second.size());
+    CHECK(r.body == expected_body);
+    if (send_cap) {
+        CHECK(s_send_calls > (int)(expected_body.size() / send_cap)); // Really did continue
+    }
+}
+
+static void test_status_codes() {
+    std::vector<uint8_t> data = make_bytes(100, 3);
+    OffloadSpan span = {data.data(), data.size()};
+    const struct {
+        const char *reply;
+        int status;
+        bool ok;
+    } cases[] = {
+        {"HTTP/1.1 204 No Content\r\n\r\n", 204, true},
+        {"HTTP/1.0 201 Created\r\n\r\n", 201, true},
+        {"HTTP/1.1 500 Internal Server Error\r\n\r\n", 500, false},
+        {"HTTP/1.1 404 Not Found\r\n\r\n", 404, false},
+        {"HTTP/1.1 302 Found\r\nLocation: /\r\n\r\n", 302, false},
+        {"garbage\r\n", 0, false},
+        {nullptr, 0, false}, // Closed without a reply
+    };
+    for (const auto &c : cases) {
+        LoopbackServer server(c.reply);
+        OffloadUploadResult result;
+        bool ok = offload_http_post(LOOPBACK, (uint16_t)server.port, "/p", "application/octet-stream", nullptr, &span,
+                                    1, 64, 2000, &result);
+        server.wait();
+        CHECK(ok == c.ok);
+        CHECK(result.http_status == c.status);
+        CHECK(result.body_bytes == data.size());
+        CHECK(server.request.complete);
+    }
+}
+
+static void test_connection_refused() {
+    // Take a free port, then close it so nothing listens there
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    socklen_t len = sizeof(addr);
+    getsockname(fd, (struct sockaddr *)&addr, &len);
+    close(fd);
+
+    uint8_t byte = 0;
+    OffloadSpan span = {&byte, 1};
+    OffloadUploadResult result;
+    CHECK(!offload_http_post(LOOPBACK, ntohs(addr.sin_port), "/p", "a/b", nullptr, &span, 1, 64, 500, &result));
+    CHECK(result.error == ECONNREFUSED);
+    CHECK(result.http_status == 0 && result.body_bytes == 0);
+
+    CHECK(!offload_http_post(LOOPBACK, ntohs(addr.sin_port), "/p", "a/b", nullptr, &span, 1, 0, 500, &result));
+    CHECK(result.error == EINVAL); // chunk_bytes 0
+}
+
+int main() {
+    test_chunked_spans(0);
+    test_chunked_spans(7); // Every sendmsg() stops after 7 bytes, mid size line, data or CRLF
+    test_chunked_spans(515);
+    test_status_codes();
+    test_connection_refused();
+    return test_result("test_offload_http");
+}
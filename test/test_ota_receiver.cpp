@@ -0,0 +1,223 @@
+// OTA image reassembly: duplicate, gap, busy and invalid chunks, resume offsets, and whole
+// uploads over a lossy link with a slow flash writer, checked byte for byte.
+
+#include "ota_receiver.h"
+#include "test_util.h"
+#include <string.h>
+#include <vector>
+
+static const size_t BLOCK = 1024;
+
+struct Harness {
+    uint8_t storage[OTA_RECEIVER_BUFFERS][BLOCK];
+    OtaReceiver rx;
+    std::vector<uint8_t> image;
+    std::vector<uint8_t> flash;
+
+    Harness(size_t image_size, uint32_t seed) : image(image_size), flash(image_size, 0) {
+        uint8_t *buffers[OTA_RECEIVER_BUFFERS];
+        for (size_t i = 0; i < OTA_RECEIVER_BUFFERS; i++) {
+            buffers[i] = storage[i];
+        }
+        ota_receiver_init(rx, buffers, BLOCK);
+        TestRng rng = {seed};
+        for (uint8_t &b : image) {
+            b = (uint8_t)rng.next();
+        }
+    }
+
+    OtaChunkResult push(uint32_t offset, size_t len, bool *block_ready = nullptr) {
+        std::vector<uint8_t> chunk(OTA_CHUNK_HEADER_LEN + len);
+        chunk[0] = (uint8_t)offset;
+        chunk[1] = (uint8_t)(offset >> 8);
+        chunk[2] = (uint8_t)(offset >> 16);
+        chunk[3] = (uint8_t)(offset >> 24);
+        if (len) {
+            memcpy(&chunk[OTA_CHUNK_HEADER_LEN], &image[offset], len);
+        }
+        bool ready = false;
+        OtaChunkResult result = ota_receiver_push(rx, chunk.data(), chunk.size(), &ready);
+        if (block_ready) {
+            *block_ready = ready;
+        }
+        return result;
+    }
+
+    // Writes the oldest waiting block to "flash". Returns false if none was waiting.
+    bool flush_one() {
+        const uint8_t *data;
+        uint32_t offset, len;
+        if (!ota_receiver_next_block(rx, &data, &offset, &len)) {
+            return false;
+        }
+        CHECK(offset % BLOCK == 0);
+        CHECK(len == BLOCK || offset + len == image.size());
+        memcpy(&flash[offset], data, len);
+        ota_receiver_block_written(rx);
+        return true;
+    }
+};
+
+static void test_in_order_upload() {
+    Harness h(5 * BLOCK + 300, 1);
+    ota_receiver_start(h.rx, (uint32_t)h.image.size(), 0);
+    size_t blocks = 0;
+    for (uint32_t offset = 0; offset < h.image.size(); offset += 180) {
+        size_t len = h.image.size() - offset < 180 ? h.image.size() - offset : 180;
+        bool ready = false;
+        CHECK(h.push(offset, len, &ready) == OTA_CHUNK_ACCEPTED);
+        if (ready) {
+            blocks++;
+            CHECK(h.flush_one());
+        }
+    }
+    CHECK(blocks == 6); // Five full blocks and the 300-byte tail
+    CHECK(ota_receiver_complete(h.rx));
+    CHECK(h.flash == h.image);
+    CHECK(h.rx.duplicates == 0 && h.rx.gaps == 0 && h.rx.busy == 0);
+}
+
+static void test_duplicates_and_gaps() {
+    Harness h(4 * BLOCK, 2);
+    ota_receiver_start(h.rx, (uint32_t)h.image.size(), 0);
+    CHECK(h.push(0, 200) == OTA_CHUNK_ACCEPTED);
+    CHECK(h.push(200, 200) == OTA_CHUNK_ACCEPTED);
+    CHECK(h.push(200, 200) == OTA_CHUNK_DUPLICATE); // Resent after a lost status
+    CHECK(h.push(0, 400) == OTA_CHUNK_DUPLICATE);   // Ends exactly at the next expected byte
+    CHECK(h.push(300, 200) == OTA_CHUNK_GAP);       // Overlaps the end: not a clean continuation
+    CHECK(h.push(600, 200) == OTA_CHUNK_GAP);       // 400-599 were lost
+    CHECK(h.rx.next_offset == 400);                 // What the status tells the client
+    CHECK(h.push(400, 200) == OTA_CHUNK_ACCEPTED);
+    CHECK(h.rx.duplicates == 2 && h.rx.gaps == 2 && h.rx.chunks == 3);
+}
+
+static void test_busy_while_flash_lags() {
+    Harness h(6 * BLOCK, 3);
+    ota_receiver_start(h.rx, (uint32_t)h.image.size(), 0);
+    // Fill both buffers without flushing: the next byte has nowhere to go
+    uint32_t offset = 0;
+    for (; offset < 2 * BLOCK; offset += 256) {
+        CHECK(h.push(offset, 256) == OTA_CHUNK_ACCEPTED);
+    }
+    CHECK(h.push(offset, 256) == OTA_CHUNK_BUSY);
+    CHECK(h.rx.busy == 1 && h.rx.next_offset == 2 * BLOCK);
+    CHECK(h.flush_one());
+    CHECK(h.push(offset, 256) == OTA_CHUNK_ACCEPTED);
+
+    // A chunk that straddles a block boundary spills into the next buffer only if it is free
+    Harness s(4 * BLOCK, 4);
+    ota_receiver_start(s.rx, (uint32_t)s.image.size(), 0);
+    CHECK(s.push(0, 1000) == OTA_CHUNK_ACCEPTED);
+    CHECK(s.push(1000, 1000) == OTA_CHUNK_ACCEPTED);  // 24 + 976 bytes: buffer 0 full, buffer 1 filling
+    CHECK(s.push(2000, 1000) == OTA_CHUNK_BUSY);      // Needs buffer 0, still waiting for flash
+    CHECK(s.flush_one());
+    CHECK(s.push(2000, 1000) == OTA_CHUNK_ACCEPTED);
+    while (s.flush_one()) {
+    }
+    CHECK(memcmp(s.flash.data(), s.image.data(), 2 * BLOCK) == 0);
+}
+
+static void test_invalid_chunks() {
+    Harness h(2 * BLOCK, 5);
+    bool ready = true;
+    uint8_t header_only[OTA_CHUNK_HEADER_LEN] = {};
+    CHECK(ota_receiver_push(h.rx, header_only, sizeof(header_only), &ready) == OTA_CHUNK_INVALID); // No image
+    CHECK(!ready);
+    ota_receiver_start(h.rx, (uint32_t)h.image.size(), 0);
+    CHECK(ota_receiver_push(h.rx, header_only, sizeof(header_only), &ready) == OTA_CHUNK_INVALID); // No data
+    CHECK(ota_receiver_push(h.rx, header_only, 2, &ready) == OTA_CHUNK_INVALID);                   // Short header
+
+    std::vector<uint8_t> big(OTA_CHUNK_HEADER_LEN + BLOCK + 1, 0);
+    CHECK(ota_receiver_push(h.rx, big.data(), big.size(), &ready) == OTA_CHUNK_INVALID); // Larger than a block
+    CHECK(h.push(2 * BLOCK - 10, 10) == OTA_CHUNK_GAP);                                    // Last bytes, but early
+    uint8_t past_end[OTA_CHUNK_HEADER_LEN + 20] = {};
+    uint32_t offset = 2 * BLOCK - 10;
+    memcpy(past_end, &offset, 4); // Little-endian host
+    CHECK(ota_receiver_push(h.rx, past_end, sizeof(past_end), &ready) == OTA_CHUNK_INVALID);
+    offset = 0xFFFFFFF0u; // Offset + length would wrap around
+    memcpy(past_end, &offset, 4);
+    CHECK(ota_receiver_push(h.rx, past_end, sizeof(past_end), &ready) == OTA_CHUNK_INVALID);
+    CHECK(h.rx.chunks == 0);
+}
+
+static void test_resume_offsets() {
+    Harness h(5 * BLOCK + 10, 6);
+    ota_receiver_start(h.rx, (uint32_t)h.image.size(), 2 * BLOCK + 500); // Rounded down to a block
+    CHECK(h.rx.next_offset == 2 * BLOCK && h.rx.written == 2 * BLOCK);
+    ota_receiver_start(h.rx, (uint32_t)h.image.size(), 3 * BLOCK);
+    CHECK(h.rx.next_offset == 3 * BLOCK);
+    ota_receiver_start(h.rx, (uint32_t)h.image.size(), 99 * BLOCK); // Past the image: from the start
+    CHECK(h.rx.next_offset == 0);
+    ota_receiver_start(h.rx, (uint32_t)h.image.size(), (uint32_t)h.image.size()); // All on flash already
+    CHECK(h.rx.next_offset == 5 * BLOCK);
+    CHECK(!ota_receiver_complete(h.rx)); // The 10-byte tail is not, since resuming rounds down
+
+    // Buffered data is dropped on restart: the second start does not write the first's bytes
+    ota_receiver_start(h.rx, (uint32_t)h.image.size(), 0);
+    CHECK(h.push(0, 600) == OTA_CHUNK_ACCEPTED);
+    ota_receiver_start(h.rx, (uint32_t)h.image.size(), 0);
+    CHECK(!h.flush_one());
+    CHECK(h.rx.chunks == 0 && h.rx.next_offset == 0);
+}
+
+// A client with no per-chunk acks: it streams from its cursor and, every few chunks, reads the
+// status and rewinds to the receiver's next expected offset
+static void run_lossy_upload(Harness &h, TestRng &rng, size_t chunk, int flush_every, uint32_t disconnect_at) {
+    uint32_t cursor = h.rx.next_offset;
+    int sent = 0;
+    bool disconnected = false;
+    while (!ota_receiver_complete(h.rx)) {
+        if (cursor < h.image.size()) {
+            size_t len = h.image.size() - cursor < chunk ? h.image.size() - cursor : chunk;
+            uint32_t roll = rng.range(0, 100);
+            if (roll >= 10) { // 10% lost on the air
+                h.push(cursor, len);
+                if (roll >= 95) {
+                    h.push(cursor, len); // 5% delivered twice
+                }
+            }
+            cursor += (uint32_t)len;
+            sent++;
+        }
+        if (sent % flush_every == 0 || cursor >= h.image.size()) {
+            h.flush_one();
+        }
+        if (sent % 8 == 0 || cursor >= h.image.size()) {
+            cursor = h.rx.next_offset; // Status read
+        }
+        if (!disconnected && h.rx.written >= disconnect_at) {
+            // Link lost: buffered blocks are gone, the client resumes from what is on flash
+            disconnected = true;
+            ota_receiver_start(h.rx, (uint32_t)h.image.size(), h.rx.written + 123);
+            cursor = h.rx.next_offset;
+        }
+        CHECK(sent < 100000);
+        if (sent >= 100000) {
+            return;
+        }
+    }
+}
+
+static void test_lossy_uploads() {
+    const size_t chunks[] = {100, 244, 509, BLOCK};
+    for (size_t chunk : chunks) {
+        for (uint32_t seed = 1; seed <= 3; seed++) {
+            Harness h(20 * BLOCK + 77, seed);
+            ota_receiver_start(h.rx, (uint32_t)h.image.size(), 0);
+            TestRng rng = {seed * 101};
+            run_lossy_upload(h, rng, chunk, 3, 9 * BLOCK);
+            CHECK(ota_receiver_complete(h.rx));
+            CHECK(h.flash == h.image);
+        }
+    }
+}
+
+int main() {
+    test_in_order_upload();
+    test_duplicates_and_gaps();
+    test_busy_while_flash_lags();
+    test_invalid_chunks();
+    test_resume_offsets();
+    test_lossy_uploads();
+    return test_result("test_ota_receiver");
+}
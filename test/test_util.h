@@ -0,0 +1,59 @@
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+// Minimal checks for the host tests: a failed check is reported and counted, and the test
+// keeps going so one run shows every failure. main() returns test_result().
+
+static int g_test_failures = 0;
+
+#define CHECK(cond)                                                                  \
+    do {                                                                             \
+        if (!(cond)) {                                                               \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            g_test_failures++;                                                       \
+        }                                                                            \
+    } while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance)                                                    \
+    do {                                                                                           \
+        double a_ = (double)(actual), e_ = (double)(expected), t_ = (double)(tolerance);           \
+        if (!(a_ >= e_ - t_ && a_ <= e_ + t_)) {                                                   \
+            fprintf(stderr, "%s:%d: CHECK_NEAR failed: %s = %g, expected %g +- %g\n", __FILE__,    \
+                    __LINE__, #actual, a_, e_, t_);                                                \
+            g_test_failures++;                                                                     \
+        }                                                                                          \
+    } while (0)
+
+static inline int test_result(const char *name) {
+    if (g_test_failures) {
+        fprintf(stderr, "%s: %d check(s) failed\n", name, g_test_failures);
+        return 1;
+    }
+    printf("%s: passed\n", name);
+    return 0;
+}
+
+// Deterministic generator, so a failing run can be reproduced
+struct TestRng {
+    uint32_t state;
+    uint32_t next() {
+        state = state * 1664525u + 1013904223u;
+        return state;
+    }
+    // Uniform in [lo, hi)
+    int32_t range(int32_t lo, int32_t hi) { return lo + (int32_t)(next() % (uint32_t)(hi - lo)); }
+};
+
+// Wall-clock time of a benchmark loop, in nanoseconds
+static inline int64_t test_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+#endif // TEST_UTIL_H